@@ -2,6 +2,7 @@
 
 #include "core.hpp"
 #include "core_win32.hpp"
+#include "core_lockfree_map.hpp"
 
 #include <Winusb.h>
 #include <tlhelp32.h>
@@ -120,8 +121,7 @@ static bool OpenSharedMemory()
     m_SharedMemory->ImplantInstalled = 0;
     m_SharedMemory->ImplantRemoveGood = 0;
     m_SharedMemory->ImplantRemoveFail = 0;
-    m_SharedMemory->BeforeWriteCounter = 0;
-    m_SharedMemory->AfterWriteCounter = 0;
+    m_SharedMemory->ResetCamera();
 
     return true;
 }
@@ -167,51 +167,13 @@ struct ReadRequest
 {
     uint8_t* Buffer;
     unsigned BufferLength;
-    LPOVERLAPPED Overlapped;
 };
 
 static WinUsb_ReadPipe_ptr_t m_WinUsb_ReadPipe;
 static WinUsb_GetOverlappedResult_ptr_t m_WinUsb_GetOverlappedResult;
 
-static CRITICAL_SECTION m_RequestLock;
-#define MAX_REQUEST_MEMORY 32
-static ReadRequest m_Requests[MAX_REQUEST_MEMORY];
-static int m_NextRequest;
-
-static void AddReadRequest(LPOVERLAPPED overlapped, uint8_t* buffer, unsigned length)
-{
-    ::EnterCriticalSection(&m_RequestLock);
-
-    const int request_index = m_NextRequest;
-    if (++m_NextRequest >= MAX_REQUEST_MEMORY) {
-        m_NextRequest = 0;
-    }
-
-    m_Requests[request_index].Buffer = buffer;
-    m_Requests[request_index].BufferLength = length;
-    m_Requests[request_index].Overlapped = overlapped;
-
-    ::LeaveCriticalSection(&m_RequestLock);
-}
-
-static bool FindReadRequest(LPOVERLAPPED overlapped, ReadRequest& request)
-{
-    ::EnterCriticalSection(&m_RequestLock);
-    int request_index = m_NextRequest;
-    for (int i = 0; i < MAX_REQUEST_MEMORY; ++i)
-    {
-        if (--request_index < 0) {
-            request_index = MAX_REQUEST_MEMORY - 1;
-        }
-        if (m_Requests[request_index].Overlapped == overlapped) {
-            request = m_Requests[request_index];
-            ::LeaveCriticalSection(&m_RequestLock);
-            return true;
-        }
-    }
-    ::LeaveCriticalSection(&m_RequestLock);
-    return false;
-}
+// Keyed by OVERLAPPED.  Lock-free because it runs on the runtime's USB thread
+static core::LockFreePointerMap<ReadRequest> m_Requests;
 
 static BOOL My_WinUsb_ReadPipe(
     WINUSB_INTERFACE_HANDLE InterfaceHandle,
@@ -222,7 +184,11 @@ static BOOL My_WinUsb_ReadPipe(
     LPOVERLAPPED            Overlapped
 )
 {
-    AddReadRequest(Overlapped, Buffer, BufferLength);
+    ReadRequest request;
+    request.Buffer = Buffer;
+    request.BufferLength = BufferLength;
+    m_Requests.Insert(Overlapped, request);
+
     return m_WinUsb_ReadPipe(InterfaceHandle, PipeID, Buffer, BufferLength, LengthTransferred, Overlapped);
 }
 
@@ -234,10 +200,16 @@ static BOOL My_WinUsb_GetOverlappedResult(
 )
 {
     ReadRequest request{};
-    bool found = FindReadRequest(lpOverlapped, request);
+    bool found = m_Requests.Find(lpOverlapped, request);
 
     DWORD read_bytes = 0;
     BOOL result = m_WinUsb_GetOverlappedResult(InterfaceHandle, lpOverlapped, &read_bytes, bWait);
+    const DWORD last_error = ::GetLastError();
+
+    // Forget the request once it is no longer pending
+    if (found && (result || last_error != ERROR_IO_INCOMPLETE)) {
+        m_Requests.Remove(lpOverlapped);
+    }
 
     if (found) {
         if (read_bytes >= 640 * 480 * 2) {
@@ -245,9 +217,11 @@ static BOOL My_WinUsb_GetOverlappedResult(
             if (write_bytes > ImplantSharedMemoryLayout::kCameraBytes) {
                 write_bytes = ImplantSharedMemoryLayout::kCameraBytes;
             }
-            uint64_t exposure_usec = core::GetTimeUsec() - 15000;
-            m_SharedMemory->WriteCamera(request.Buffer, write_bytes, exposure_usec);
-            ::SetEvent(m_FrameEvent);
+            // The client estimates the exposure time from this
+            const uint64_t receive_usec = core::GetTimeUsec();
+            if (m_SharedMemory->WriteCamera(request.Buffer, write_bytes, receive_usec)) {
+                ::SetEvent(m_FrameEvent);
+            }
         }
 #if defined(CORE_DEBUG)
         else {
@@ -269,6 +243,8 @@ static BOOL My_WinUsb_GetOverlappedResult(
         *lpNumberOfBytesTransferred = read_bytes;
     }
 
+    // The caller checks GetLastError() for ERROR_IO_INCOMPLETE
+    ::SetLastError(last_error);
     return result;
 }
 
@@ -341,14 +317,7 @@ static bool InstallHooks()
     m_WinUsb_ReadPipe = nullptr;
     m_WinUsb_GetOverlappedResult = nullptr;
 
-    ::InitializeCriticalSection(&m_RequestLock);
-
-    for (int i = 0; i < MAX_REQUEST_MEMORY; ++i)
-    {
-        m_Requests[i].Buffer = nullptr;
-        m_Requests[i].BufferLength = 0;
-    }
-    m_NextRequest = 0;
+    m_Requests.Clear();
 
     m_SharedMemory->ImplantStage = 1;
 
@@ -14,6 +14,21 @@ using namespace core;
 static logger::Channel Logger("AppSettings");
 
 
+//------------------------------------------------------------------------------
+// Tools
+
+// Optional values keep their default if they are missing
+static bool ReadOptionalBool(winreg::RegKey& key, const std::wstring& name, bool default_value)
+{
+    try {
+        return key.GetDwordValue(name) != 0;
+    }
+    catch (winreg::RegException& /*ex*/) {
+        return default_value;
+    }
+}
+
+
 //------------------------------------------------------------------------------
 // ApplicationSettings
 
@@ -25,6 +40,10 @@ bool ApplicationSettings::ReadSettings()
     try {
         winreg::RegKey key(WINREG_PARENT_KEY, WINREG_SUBKEY, KEY_READ);
 
+        EnableCameraDenoise = ReadOptionalBool(key, WINREG_VALUE_CAMERA_DENOISE, EnableCameraDenoise);
+        EnableCameraStereo = ReadOptionalBool(key, WINREG_VALUE_CAMERA_STEREO, EnableCameraStereo);
+        EnableCameraContrast = ReadOptionalBool(key, WINREG_VALUE_CAMERA_CONTRAST, EnableCameraContrast);
+
         // Read float key
         std::wstring dpi_wstr = key.GetStringValue(WINREG_VALUE_DPI);
         std::string dpi_str = WideStringToUtf8String(dpi_wstr);
@@ -52,6 +71,9 @@ bool ApplicationSettings::SaveSettings()
         winreg::RegKey key(WINREG_PARENT_KEY, WINREG_SUBKEY, KEY_WRITE);
 
         key.SetStringValue(WINREG_VALUE_DPI, std::to_wstring(MonitorDpi));
+        key.SetDwordValue(WINREG_VALUE_CAMERA_DENOISE, EnableCameraDenoise ? 1 : 0);
+        key.SetDwordValue(WINREG_VALUE_CAMERA_STEREO, EnableCameraStereo ? 1 : 0);
+        key.SetDwordValue(WINREG_VALUE_CAMERA_CONTRAST, EnableCameraContrast ? 1 : 0);
 
         return true;
     }
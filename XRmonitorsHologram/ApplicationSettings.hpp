@@ -17,6 +17,9 @@ namespace xrm {
 #define WINREG_PARENT_KEY   HKEY_CURRENT_USER
 #define WINREG_SUBKEY       L"SOFTWARE\\XRmonitors"
 #define WINREG_VALUE_DPI    L"MonitorDpi" /* float-as-string */
+#define WINREG_VALUE_CAMERA_DENOISE L"CameraDenoise" /* DWORD 0/1 */
+#define WINREG_VALUE_CAMERA_STEREO L"CameraStereo" /* DWORD 0/1 */
+#define WINREG_VALUE_CAMERA_CONTRAST L"CameraContrast" /* DWORD 0/1 */
 
 #define XRM_DEFAULT_DPI 50.f
 
@@ -28,6 +31,15 @@ struct ApplicationSettings
 {
     float MonitorDpi = XRM_DEFAULT_DPI;
 
+    // Temporal denoise of the passthrough image
+    bool EnableCameraDenoise = false;
+
+    // Stereo depth estimate of the passthrough scene
+    bool EnableCameraStereo = false;
+
+    // Local contrast enhancement (CLAHE) of the passthrough image
+    bool EnableCameraContrast = false;
+
 
     bool ReadSettings();
     bool SaveSettings();
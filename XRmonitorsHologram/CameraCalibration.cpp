@@ -30,6 +30,21 @@ void HeadsetCameraCalibration::Print()
     Logger.Info(" * EyeCantZ = ", EyeCantZ);
 }
 
+core::CameraUndistortParams HeadsetCameraCalibration::GetUndistortParams(unsigned eye_width, unsigned height) const
+{
+    // Scale and offsets place the camera quad in the scene, so only the
+    // radial terms affect the image itself
+    core::CameraUndistortParams params;
+    params.K1 = K1;
+    params.K2 = K2;
+    params.SourceWidth = eye_width;
+    params.SourceHeight = height;
+    params.SourcePitch = eye_width;
+    params.OutputWidth = eye_width;
+    params.OutputHeight = height;
+    return params;
+}
+
 bool HeadsetCameraCalibration::ReadForHeadset(std::string headset_name)
 {
     bool success = false;
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "CameraUndistort.hpp"
+
 #include <string>
 
 namespace xrm {
@@ -27,6 +29,9 @@ struct HeadsetCameraCalibration
 
     bool ReadForHeadset(std::string headset_name);
 
+    /// Parameters for undistorting one eye plane on the CPU
+    core::CameraUndistortParams GetUndistortParams(unsigned eye_width, unsigned height) const;
+
     void Print();
 };
 
@@ -10,36 +10,66 @@ using namespace core;
 
 static logger::Channel Logger("CameraImager");
 
+// Brightest pixels left out of the frame brightness
+static const unsigned kCameraBrightTrimPercent = 1;
+
+// Consecutive frames over budget before a stage is disabled
+static const unsigned kCameraStageOverBudgetFrames = 30;
+
 
 //------------------------------------------------------------------------------
 // CameraImager
 
 bool CameraImager::AcquireImage(
     D3D11DeviceContext& device_context,
-    core::CameraClient* cameras)
+    core::CameraClient* cameras,
+    uint64_t display_usec,
+    uint64_t display_period_usec)
 {
+    if (!LatencyStarted) {
+        // Counters are still logged if the shared memory is unavailable
+        Latency.Start();
+        LatencyStarted = true;
+    }
+
+    // Queue the frames that arrived since the last render frame
     CameraFrame frame;
-    if (cameras->AcquireNextFrame(frame)) {
+    while (cameras->AcquireNextFrame(frame)) {
         ScopedFunction frame_scope([&]() {
             cameras->ReleaseFrame();
         });
 
-        if (UpdateTexture(
-            device_context,
-            frame.CameraImage,
-            frame.Width,
-            frame.Height))
-        {
-            HasCameraImage = true;
-            ExposureTimeUsec = frame.ExposureTimeUsec;
+        if (QueueFrame(frame)) {
             LastImageTicks = ::GetTickCount64();
-            return true;
         }
     }
 
+    const CameraScheduledFrame* scheduled = Scheduler.Select(display_usec, display_period_usec);
+    if (scheduled) {
+        UploadedStamps = scheduled->Stamps;
+        UploadedStamps.Set(CameraLatencyStage::Select, GetTimeUsec());
+
+        UploadFrame(device_context, *scheduled);
+
+        // The copy is queued on the GPU, so this is when it was submitted
+        UploadedStamps.Set(CameraLatencyStage::Upload, GetTimeUsec());
+        RenderPending = true;
+
+        HasCameraImage = true;
+        ExposureTimeUsec = scheduled->ExposureTimeUsec;
+        LogScheduleStats();
+        Latency.LogPeriodically();
+        return true;
+    }
+
     const uint64_t timeout_ticks = 500;
     if (::GetTickCount64() - LastImageTicks > timeout_ticks) {
         HasCameraImage = false;
+
+        // Do not blend or schedule the next frame against a stale scene
+        Denoiser.Reset();
+        Scheduler.Reset();
+        SceneDistanceMeters = 0.f;
     }
 
     return false;
@@ -97,12 +127,182 @@ void CameraImager::CreateTextures(
     }
 }
 
-bool CameraImager::UpdateTexture(
+bool CameraImager::QueueFrame(const core::CameraFrame& frame)
+{
+    const unsigned width = frame.Width;
+    const unsigned height = frame.Height;
+
+    if (width != QueuedWidth || height != QueuedHeight) {
+        Scheduler.Reset();
+        Denoiser.Reset();
+        QueuedWidth = width;
+        QueuedHeight = height;
+    }
+
+    // Queued images hold both eyes side by side, as the texture does, so
+    // every stage works in place and the upload copies whole rows
+    const unsigned eye_width = width / 2;
+    uint8_t* image = Scheduler.BeginPush(width * height);
+
+    CameraEyePlanes planes;
+    planes.Left = image;
+    planes.LeftPitch = width;
+    planes.Right = image + eye_width;
+    planes.RightPitch = width;
+
+    if (!StripTagsAndSplitEyes(
+        frame.Buffer,
+        frame.BufferBytes,
+        eye_width,
+        height,
+        planes))
+    {
+        Logger.Error("Camera transfer is truncated");
+        return false;
+    }
+
+    // Exact histogram of both eyes.  The trimmed mean ignores the controller
+    // LEDs that stay lit in dark tracking frames
+    CameraHistogram right_histogram;
+    if (!ComputeCameraHistogram(planes.Left, planes.LeftPitch, eye_width, height, Histogram) ||
+        !ComputeCameraHistogram(planes.Right, planes.RightPitch, eye_width, height, right_histogram))
+    {
+        Logger.Error("Camera histogram failed");
+        return false;
+    }
+    Histogram.Add(right_histogram);
+
+    // Dark tracking frames must not reach the denoise history
+    const int bright_avg = Histogram.GetTrimmedMean16(kCameraBrightTrimPercent);
+    if (!Scheduler.AcceptBrightness(bright_avg)) {
+        return false;
+    }
+
+    if (EnableDenoise)
+    {
+        const uint64_t t0 = GetTimeUsec();
+
+        const bool denoise_ok =
+            Denoiser.Process(0, planes.Left, planes.LeftPitch, planes.Left, planes.LeftPitch, eye_width, height) &&
+            Denoiser.Process(1, planes.Right, planes.RightPitch, planes.Right, planes.RightPitch, eye_width, height);
+
+        const uint64_t denoise_usec = GetTimeUsec() - t0;
+
+        if (!denoise_ok) {
+            Logger.Error("Camera denoise failed: Disabling it");
+            EnableDenoise = false;
+        }
+        else if (!CheckStageBudget("denoise", denoise_usec, kCameraDenoiseBudgetUsec, DenoiseOverBudget)) {
+            EnableDenoise = false;
+            Denoiser.Reset();
+        }
+    }
+
+    // Match before contrast enhancement, which equalizes each eye differently
+    if (EnableStereo)
+    {
+        const uint64_t t0 = GetTimeUsec();
+
+        const bool stereo_ok = Stereo.Process(
+            planes.Left, planes.LeftPitch,
+            planes.Right, planes.RightPitch,
+            eye_width, height,
+            GetWorkers());
+
+        const uint64_t stereo_usec = GetTimeUsec() - t0;
+
+        if (!stereo_ok) {
+            Logger.Error("Camera stereo failed: Disabling it");
+            EnableStereo = false;
+            SceneDistanceMeters = 0.f;
+        }
+        else if (!CheckStageBudget("stereo", stereo_usec, kCameraStereoBudgetUsec, StereoOverBudget)) {
+            EnableStereo = false;
+            SceneDistanceMeters = 0.f;
+        }
+        else {
+            SceneDistanceMeters = Stereo.EstimateSceneDistance();
+        }
+    }
+
+    if (EnableContrast)
+    {
+        WorkerPool* workers = GetWorkers();
+
+        const uint64_t t0 = GetTimeUsec();
+
+        const bool contrast_ok =
+            Contrast.Process(planes.Left, planes.LeftPitch, eye_width, height, workers) &&
+            Contrast.Process(planes.Right, planes.RightPitch, eye_width, height, workers);
+
+        const uint64_t contrast_usec = GetTimeUsec() - t0;
+
+        if (!contrast_ok) {
+            Logger.Error("Camera contrast enhancement failed: Disabling it");
+            EnableContrast = false;
+        }
+        else if (!CheckStageBudget("contrast", contrast_usec, kCameraContrastBudgetUsec, ContrastOverBudget)) {
+            EnableContrast = false;
+        }
+    }
+
+    CameraFrameStamps stamps = frame.Stamps;
+    stamps.Set(CameraLatencyStage::Process, GetTimeUsec());
+
+    Scheduler.CommitPush(frame.ExposureTimeUsec, frame.FrameNumber, stamps);
+    return true;
+}
+
+void CameraImager::OnFrameRendered()
+{
+    if (!RenderPending) {
+        return;
+    }
+    RenderPending = false;
+
+    UploadedStamps.Set(CameraLatencyStage::Render, GetTimeUsec());
+    Latency.AddFrame(UploadedStamps);
+}
+
+WorkerPool* CameraImager::GetWorkers()
+{
+    if (!WorkersStarted) {
+        // Two helpers are enough for the rows and tiles without starving the renderer
+        Workers.Start(2);
+        WorkersStarted = true;
+    }
+    return &Workers;
+}
+
+bool CameraImager::CheckStageBudget(
+    const char* name,
+    uint64_t stage_usec,
+    uint64_t budget_usec,
+    unsigned& over_budget)
+{
+    if (stage_usec <= budget_usec) {
+        over_budget = 0;
+        return true;
+    }
+
+    // A single slow frame can be a context switch, but a run of them
+    // means this machine cannot afford the stage
+    if (++over_budget < kCameraStageOverBudgetFrames) {
+        return true;
+    }
+
+    Logger.Warning("Camera ", name, " took ", stage_usec,
+        " usec, over the budget of ", budget_usec, " usec: Disabling it");
+    return false;
+}
+
+void CameraImager::UploadFrame(
     D3D11DeviceContext& device_context,
-    const uint8_t* image,
-    unsigned width,
-    unsigned height)
+    const core::CameraScheduledFrame& frame)
 {
+    const unsigned width = QueuedWidth;
+    const unsigned height = QueuedHeight;
+
     CreateTextures(device_context, width, height);
 
     const UINT subresource_index = D3D11CalcSubresource(0, 0, 0);
@@ -118,60 +318,30 @@ bool CameraImager::UpdateTexture(
     uint8_t* dest = reinterpret_cast<uint8_t*>(subresource.pData);
     const unsigned pitch = subresource.RowPitch;
 
-    // HACK: Remove 32 byte tags from the image
-    const unsigned offset = 23264 + 1312 - 32;
-    unsigned next_tag_offset = offset - 1312 + 32;
-
-    unsigned bright_sum_count = 0;
-    int bright_sum = 0;
-
-    for (unsigned i = 0; i < height; ++i) {
-        if (next_tag_offset < width) {
-            memcpy(dest, image, next_tag_offset);
-            //memset(dest, 128, next_tag_offset);
-            image += 32;
-            memcpy(dest + next_tag_offset, image + next_tag_offset, width - next_tag_offset);
-            //memset(dest + next_tag_offset, 128, width - next_tag_offset);
-            next_tag_offset = offset - (width - next_tag_offset);
-        }
-        else {
-            memcpy(dest, image, width);
-            //memset(dest, 128, width);
-            next_tag_offset -= width;
-
-            for (unsigned j = 0; j < width; j += 32) {
-                bright_sum += image[j];
-            }
-            ++bright_sum_count;
-        }
-        image += width;
-        dest += pitch;
-    }
+    // The queued image is already laid out side by side
+    core::CopyPlane2D(dest, pitch, frame.Image.data(), width, width, height);
 
     device_context.Context->Unmap(
         StagingTexture.Get(),
         subresource_index);
 
-    int bright_avg = bright_sum / bright_sum_count * 20;
-    if (bright_avg < LastAcceptedBright / 4 && FrameSkipped < 7) {
-        return false;
-    }
-    LastAcceptedBright = bright_avg;
-    FrameSkipped = 0;
-
-#if 0
-    // Reduce framerate
-    static uint64_t last_t = 0;
-    uint64_t now = GetTimeUsec();
-    if (now - last_t < 1000000) {
-        return false;
-    }
-    last_t = now;
-#endif
-
     device_context.Context->CopyResource(RenderTexture.Get(), StagingTexture.Get());
+}
 
-    return true;
+void CameraImager::LogScheduleStats()
+{
+    const uint64_t now_msec = GetTimeMsec();
+    if (now_msec - LastStatsLogMsec < 10000) {
+        return;
+    }
+    LastStatsLogMsec = now_msec;
+
+    const CameraScheduleStats& stats = Scheduler.GetStats();
+    Logger.Info("Camera frames: Shown=", stats.Shown,
+        " Dropped=", stats.Dropped,
+        " Late=", stats.Late,
+        " Dark=", stats.Dark,
+        " TargetLatency=", Scheduler.GetTargetLatencyUsec() / 1000, " msec");
 }
 
 
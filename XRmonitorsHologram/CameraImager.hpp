@@ -3,8 +3,15 @@
 #pragma once
 
 #include "D3D11Tools.hpp"
+#include "core_copy.hpp"
 #include "CameraCalibration.hpp"
 #include "CameraClient.hpp"
+#include "CameraKernels.hpp"
+#include "CameraDenoise.hpp"
+#include "CameraStereo.hpp"
+#include "CameraContrast.hpp"
+#include "CameraScheduler.hpp"
+#include "CameraLatency.hpp"
 
 #include "SimpleMath.h"
 
@@ -21,10 +28,18 @@ using namespace DirectX::SimpleMath;
 class CameraImager
 {
 public:
-    // Attempt to acquire a new camera image
+    // Attempt to acquire a new camera image.
+    // display_usec: When the frame being rendered will be shown
+    // (core::GetTimeUsec), or 0 to always show the newest camera frame
     bool AcquireImage(
         D3D11DeviceContext& device_context,
-        core::CameraClient* cameras);
+        core::CameraClient* cameras,
+        uint64_t display_usec,
+        uint64_t display_period_usec);
+
+    // Called when a view has been rendered with the frame from the last
+    // successful AcquireImage().  Only the first call per frame is counted
+    void OnFrameRendered();
 
 
     // Do we have a camera image to render?
@@ -37,6 +52,28 @@ public:
     // Exposure time for the camera frame
     uint64_t ExposureTimeUsec = 0;
 
+    // Temporal denoise before upload, set from ApplicationSettings.  Turned
+    // off automatically if it keeps exceeding core::kCameraDenoiseBudgetUsec
+    bool EnableDenoise = false;
+
+    // Stereo depth after denoise, set from ApplicationSettings.  Turned
+    // off automatically if it keeps exceeding core::kCameraStereoBudgetUsec
+    bool EnableStereo = false;
+
+    // Median scene depth of the last matched frame in meters, or 0 if
+    // stereo is off or too few blocks matched
+    float SceneDistanceMeters = 0.f;
+
+    // Local contrast enhancement after denoise, set from ApplicationSettings.
+    // Turned off automatically if it keeps exceeding core::kCameraContrastBudgetUsec
+    bool EnableContrast = false;
+
+    // Histogram of both eyes of the last queued frame
+    core::CameraHistogram Histogram;
+
+    // Per-stage latency histograms, logged and published in shared memory
+    core::CameraLatencyTracker Latency;
+
 protected:
     // Texture that we can map to CPU memory (on dupe device)
     ComPtr<ID3D11Texture2D> StagingTexture;
@@ -45,16 +82,54 @@ protected:
     // Last time when a camera image was captured
     uint64_t LastImageTicks = 0;
 
-    int LastAcceptedBright = 0;
-    unsigned FrameSkipped = 0;
+    // Frames waiting for their display time
+    core::CameraFrameScheduler Scheduler;
+    unsigned QueuedWidth = 0;
+    unsigned QueuedHeight = 0;
+
+    core::CameraTemporalDenoiser Denoiser;
+    core::CameraStereoMatcher Stereo;
+    core::CameraContrastEnhancer Contrast;
+
+    // Consecutive frames over each stage's time budget
+    unsigned DenoiseOverBudget = 0;
+    unsigned StereoOverBudget = 0;
+    unsigned ContrastOverBudget = 0;
 
+    // Threads for the stereo block rows and contrast tiles, started by the
+    // first stage that needs them
+    core::WorkerPool Workers;
+    bool WorkersStarted = false;
 
-    // Called when camera image updates
-    bool UpdateTexture(
+    uint64_t LastStatsLogMsec = 0;
+
+    // Stamps of the uploaded frame, until its first render
+    core::CameraFrameStamps UploadedStamps;
+    bool RenderPending = false;
+    bool LatencyStarted = false;
+
+
+    // Strip, split, denoise and enhance a frame into the scheduler queue.
+    // Returns false if the frame was rejected
+    bool QueueFrame(const core::CameraFrame& frame);
+
+    // Start the worker threads on first use
+    core::WorkerPool* GetWorkers();
+
+    // Returns false if a stage took too long on too many frames in a row
+    // and should be disabled
+    bool CheckStageBudget(
+        const char* name,
+        uint64_t stage_usec,
+        uint64_t budget_usec,
+        unsigned& over_budget);
+
+    // Copy a scheduled frame to RenderTexture
+    void UploadFrame(
         D3D11DeviceContext& device_context,
-        const uint8_t* image,
-        unsigned width,
-        unsigned height);
+        const core::CameraScheduledFrame& frame);
+
+    void LogScheduleStats();
 
     void CreateTextures(
         D3D11DeviceContext& device_context,
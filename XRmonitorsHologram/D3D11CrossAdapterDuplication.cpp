@@ -118,9 +118,15 @@ bool D3D11CrossAdapterDuplication::AcquireVrRenderTexture()
 
 bool D3D11CrossAdapterDuplication::CopyToVrStaging()
 {
+    // A new texture holds none of the previous frame
+    const bool vr_staging_current = VrStaging.GetTexture() != nullptr &&
+        VrStaging.Width() == DesktopDesc.Width &&
+        VrStaging.Height() == DesktopDesc.Height &&
+        VrStaging.Format() == DesktopDesc.Format;
+
     bool vr_staging = VrStaging.Prepare(
         *VrDeviceResources,
-        StagingTexture::RW::WriteOnly,
+        StagingTexture::RW::ReadWrite,
         DesktopDesc.Width,
         DesktopDesc.Height,
         DesktopDesc.MipLevels,
@@ -132,12 +138,22 @@ bool D3D11CrossAdapterDuplication::CopyToVrStaging()
         return false;
     }
 
+    if (!vr_staging_current) {
+        VrStagingStale.Set(core::RegionRect(0, 0, (int)DesktopDesc.Width, (int)DesktopDesc.Height));
+    }
+
     if (!VrStaging.Map(*VrDeviceResources)) {
         return false;
     }
 
+    // Moved pixels are shifted inside VrStaging, so only the dirty rects
+    // are read from the duplicated surface
+    const bool move_in_place = CanMoveInVrStaging();
+    const std::vector<RECT>& copy_rects = move_in_place ? CopyDesc.DirtyCopyRects : CopyDesc.CopyRects;
+
 #ifdef DD_LOG_RECTS
-    Logger.Info("MoveCount: ", CopyDesc.MoveCount, " DirtyCount: ", CopyDesc.DirtyCount);
+    Logger.Info("MoveCount: ", CopyDesc.MoveCount, " DirtyCount: ", CopyDesc.DirtyCount,
+        " CopyCount: ", copy_rects.size(), " MoveInPlace: ", move_in_place);
 #endif
 
     if (!CopyDesc.CursorToErase->Empty())
@@ -169,20 +185,22 @@ bool D3D11CrossAdapterDuplication::CopyToVrStaging()
 #endif
     }
 
-    const unsigned move_count = CopyDesc.MoveCount;
-    for (unsigned i = 0; i < move_count; ++i)
-    {
-        const RECT& rect = CopyDesc.MoveRects[i].DestinationRect;
+    if (move_in_place) {
+        CopyDesc.ApplyMoveRects(VrStaging.GetMappedData(), VrStaging.GetMappedPitch());
+    }
 
+    for (const RECT& rect : copy_rects)
+    {
         CopyRectBGRA(
             rect,
             VrStaging.GetMappedData(),
             VrStaging.GetMappedPitch(),
             DupeStaging.GetMappedData(),
-            DupeStaging.GetMappedPitch());
+            DupeStaging.GetMappedPitch(),
+            Copies);
 
 #ifdef DD_LOG_RECTS
-        Logger.Info("Move rect size: ",
+        Logger.Info("Copy rect size: ",
             rect.right - rect.left,
             " x ",
             rect.bottom - rect.top,
@@ -194,29 +212,18 @@ bool D3D11CrossAdapterDuplication::CopyToVrStaging()
 #endif
     }
 
-    const unsigned dirty_count = CopyDesc.DirtyCount;
-    for (unsigned i = 0; i < dirty_count; ++i)
+    // These pixels of VrStaging now hold the current frame
+    if (!VrStagingStale.Empty())
     {
-        const RECT& rect = CopyDesc.DirtyRects[i];
-
-        CopyRectBGRA(
-            rect,
-            VrStaging.GetMappedData(),
-            VrStaging.GetMappedPitch(),
-            DupeStaging.GetMappedData(),
-            DupeStaging.GetMappedPitch());
-
-#ifdef DD_LOG_RECTS
-        Logger.Info("Dirty rect size: ",
-            rect.right - rect.left,
-            " x ",
-            rect.bottom - rect.top,
-            " @ (",
-            rect.left,
-            ", ",
-            rect.top,
-            ")");
-#endif
+        if (move_in_place) {
+            for (unsigned i = 0; i < CopyDesc.MoveCount; ++i) {
+                const RECT& rect = CopyDesc.MoveRects[i].DestinationRect;
+                VrStagingStale.Subtract(core::RegionRect(rect.left, rect.top, rect.right, rect.bottom));
+            }
+        }
+        for (const RECT& rect : copy_rects) {
+            VrStagingStale.Subtract(core::RegionRect(rect.left, rect.top, rect.right, rect.bottom));
+        }
     }
 
     if (!CopyDesc.CursorToWrite->Empty())
@@ -279,47 +286,48 @@ bool D3D11CrossAdapterDuplication::CopyToVrStaging()
             D3D11_COPY_DISCARD);
     }
 
-    for (unsigned i = 0; i < move_count; ++i)
+    if (move_in_place)
     {
-        const RECT& dest_rect = CopyDesc.MoveRects[i].DestinationRect;
-
-        D3D11_BOX Box;
-        Box.left = dest_rect.left;
-        Box.top = dest_rect.top;
-        Box.front = 0;
-        Box.right = dest_rect.right;
-        Box.bottom = dest_rect.bottom;
-        Box.back = 1;
-
-        context->CopySubresourceRegion1(
-            VrRenderTexture.Get(), // destination
-            0,
-            dest_rect.left, // destination x
-            dest_rect.top, // destination y
-            0,
-            VrStaging.GetTexture(), // source
-            0,
-            &Box, // source
-            D3D11_COPY_DISCARD);
+        for (unsigned i = 0; i < CopyDesc.MoveCount; ++i)
+        {
+            const RECT& move_rect = CopyDesc.MoveRects[i].DestinationRect;
+
+            D3D11_BOX Box;
+            Box.left = move_rect.left;
+            Box.top = move_rect.top;
+            Box.front = 0;
+            Box.right = move_rect.right;
+            Box.bottom = move_rect.bottom;
+            Box.back = 1;
+
+            context->CopySubresourceRegion1(
+                VrRenderTexture.Get(), // destination
+                0,
+                move_rect.left, // destination x
+                move_rect.top, // destination y
+                0,
+                VrStaging.GetTexture(), // source
+                0,
+                &Box, // source
+                D3D11_COPY_DISCARD);
+        }
     }
 
-    for (unsigned i = 0; i < dirty_count; ++i)
+    for (const RECT& copy_rect : copy_rects)
     {
-        const RECT& dirty_rect = CopyDesc.DirtyRects[i];
-
         D3D11_BOX Box;
-        Box.left = dirty_rect.left;
-        Box.top = dirty_rect.top;
+        Box.left = copy_rect.left;
+        Box.top = copy_rect.top;
         Box.front = 0;
-        Box.right = dirty_rect.right;
-        Box.bottom = dirty_rect.bottom;
+        Box.right = copy_rect.right;
+        Box.bottom = copy_rect.bottom;
         Box.back = 1;
 
         context->CopySubresourceRegion1(
             VrRenderTexture.Get(), // destination
             0,
-            dirty_rect.left, // destination x
-            dirty_rect.top, // destination y
+            copy_rect.left, // destination x
+            copy_rect.top, // destination y
             0,
             VrStaging.GetTexture(), // source
             0,
@@ -357,7 +365,7 @@ bool D3D11CrossAdapterDuplication::CopyToVrStaging()
 
 bool D3D11CrossAdapterDuplication::CanUseVrStagingPool()
 {
-    size_t total = CopyDesc.DirtyCount + CopyDesc.MoveCount + 2;
+    size_t total = CopyDesc.CopyRects.size() + 2;
     if (CopyDesc.CursorToWrite->Empty()) {
         --total;
     }
@@ -371,21 +379,8 @@ bool D3D11CrossAdapterDuplication::CanUseVrStagingPool()
     const unsigned max_width = 1024;
     const unsigned max_height = 512;
 
-    const unsigned move_count = CopyDesc.MoveCount;
-    for (unsigned i = 0; i < move_count; ++i)
-    {
-        const RECT& rect = CopyDesc.MoveRects[i].DestinationRect;
-        const int width = rect.right - rect.left;
-        const int height = rect.bottom - rect.top;
-        if (width > max_width || height > max_height) {
-            return false;
-        }
-    }
-
-    const unsigned dirty_count = CopyDesc.DirtyCount;
-    for (unsigned i = 0; i < dirty_count; ++i)
+    for (const RECT& rect : CopyDesc.CopyRects)
     {
-        const RECT& rect = CopyDesc.DirtyRects[i];
         const int width = rect.right - rect.left;
         const int height = rect.bottom - rect.top;
         if (width > max_width || height > max_height) {
@@ -412,12 +407,49 @@ bool D3D11CrossAdapterDuplication::CanUseVrStagingPool()
     return true;
 }
 
+bool D3D11CrossAdapterDuplication::CanMoveInVrStaging()
+{
+    if (CopyDesc.MoveCount == 0 || !CopyDesc.MovesInBounds) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < CopyDesc.MoveCount; ++i)
+    {
+        const DXGI_OUTDUPL_MOVE_RECT& move = CopyDesc.MoveRects[i];
+        const RECT& dest = move.DestinationRect;
+
+        const core::RegionRect source(
+            move.SourcePoint.x,
+            move.SourcePoint.y,
+            move.SourcePoint.x + (dest.right - dest.left),
+            move.SourcePoint.y + (dest.bottom - dest.top));
+
+        if (VrStagingStale.Intersects(source)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool D3D11CrossAdapterDuplication::CopyToVrStagingPool()
 {
     ++StagingPoolEpoch;
 
+    // These updates bypass VrStaging, so it no longer holds the frame there
+    for (const RECT& rect : CopyDesc.CopyRects) {
+        VrStagingStale.Union(core::RegionRect(rect.left, rect.top, rect.right, rect.bottom));
+    }
+    for (const StoredCursor* cursor : { CopyDesc.CursorToErase, CopyDesc.CursorToWrite }) {
+        if (!cursor->Empty()) {
+            VrStagingStale.Union(core::RegionRect(
+                cursor->X, cursor->Y, cursor->X + cursor->Width, cursor->Y + cursor->Height));
+        }
+    }
+
 #ifdef DD_LOG_RECTS
-    Logger.Info("Optimized - MoveCount: ", CopyDesc.MoveCount, " DirtyCount: ", CopyDesc.DirtyCount);
+    Logger.Info("Optimized - MoveCount: ", CopyDesc.MoveCount, " DirtyCount: ", CopyDesc.DirtyCount,
+        " CopyCount: ", CopyDesc.CopyRects.size());
 #endif
 
     if (!CopyDesc.CursorToErase->Empty())
@@ -427,37 +459,14 @@ bool D3D11CrossAdapterDuplication::CopyToVrStagingPool()
         }
     }
 
-    const unsigned move_count = CopyDesc.MoveCount;
-    for (unsigned i = 0; i < move_count; ++i)
+    for (const RECT& rect : CopyDesc.CopyRects)
     {
-        const RECT& rect = CopyDesc.MoveRects[i].DestinationRect;
         if (!CopyToVrStagingPool_SingleRect(rect)) {
             return false;
         }
 
 #ifdef DD_LOG_RECTS
-        Logger.Info("Move rect size: ",
-            rect.right - rect.left,
-            " x ",
-            rect.bottom - rect.top,
-            " @ (",
-            rect.left,
-            ", ",
-            rect.top,
-            ")");
-#endif
-    }
-
-    const unsigned dirty_count = CopyDesc.DirtyCount;
-    for (unsigned i = 0; i < dirty_count; ++i)
-    {
-        const RECT& rect = CopyDesc.DirtyRects[i];
-        if (!CopyToVrStagingPool_SingleRect(rect)) {
-            return false;
-        }
-
-#ifdef DD_LOG_RECTS
-        Logger.Info("Dirty rect size: ",
+        Logger.Info("Copy rect size: ",
             rect.right - rect.left,
             " x ",
             rect.bottom - rect.top,
@@ -680,6 +689,15 @@ bool D3D11CrossAdapterDuplication::ReadFrame()
                 &PointerShapeInfo);
             if (FAILED(hr)) {
                 Logger.Warning("GetFramePointerShape: ", HresultString(hr));
+                PointerShape = nullptr;
+            }
+            else {
+                // Decoded only when the shape changes, not on every move
+                PointerShape = DecodePointerShape(
+                    PointerShapes,
+                    PointerShapeInfo,
+                    PointerShapeBuffer.data(),
+                    PointerShapeBufferBytes);
             }
         }
 
@@ -700,6 +718,7 @@ bool D3D11CrossAdapterDuplication::ReadFrame()
         {
             CopyDesc.MoveCount = 0;
             CopyDesc.DirtyCount = 0;
+            CopyDesc.PlanCopyRects(DesktopDesc.Width, DesktopDesc.Height);
 
             if (!DupeStaging.Map(DupeDC)) {
                 return false;
@@ -807,10 +826,23 @@ bool D3D11CrossAdapterDuplication::ReadFrame()
         }
     }
 
+    // Merge overlapping and nearby rects so each pixel crosses over once,
+    // and check if the moves can be applied in place
+    CopyDesc.PlanCopyRects(DesktopDesc.Width, DesktopDesc.Height);
+
     if (!CopyToStagingTexture(DesktopTexture)) {
         return false;
     }
 
+#if defined(ENABLE_DUPE_TILE_HASHING)
+    // Drop the tiles that were redrawn the same before they cross over
+    CopyDesc.RemoveUnchangedTiles(
+        TileHashes,
+        DupeStaging.GetMappedData(),
+        DupeStaging.GetMappedPitch());
+    LogTileHashStats();
+#endif
+
     // Note: MapDesktopSurface() seems to not be supported on modern NVidia
     // graphics cards so not bothering with it.
 
@@ -854,16 +886,12 @@ void D3D11CrossAdapterDuplication::DeliverFrame()
 
 bool D3D11CrossAdapterDuplication::WriteMouseCursor(const DXGI_OUTDUPL_FRAME_INFO& frame_info)
 {
-    if (PointerShapeBufferBytes == 0) {
+    if (!PointerShape) {
         return false; // No pointer
     }
 
-    int width = PointerShapeInfo.Width;
-    const unsigned pitch = PointerShapeInfo.Pitch;
-    int height = PointerShapeInfo.Height;
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME) {
-        height /= 2;
-    }
+    int width = PointerShape->Width;
+    int height = PointerShape->Height;
 
     int cursor_screen_x = frame_info.PointerPosition.Position.x;
     int cursor_screen_y = frame_info.PointerPosition.Position.y;
@@ -961,141 +989,42 @@ bool D3D11CrossAdapterDuplication::WriteMouseCursor(const DXGI_OUTDUPL_FRAME_INF
     const uint8_t* screen_src = DupeStaging.GetMappedData() + cursor_screen_x * 4 + cursor_screen_y * screen_pitch;
 
     // Copy the screen data under the cursor to UnderCursor
-    uint8_t* copy_dst = under_cursor->Rgba.data();
-    const uint8_t* copy_src = screen_src;
-    const unsigned row_copy_bytes = width * 4;
-
-    for (unsigned i = 0; i < height; ++i) {
-        memcpy(copy_dst, copy_src, row_copy_bytes);
-        copy_src += screen_pitch;
-        copy_dst += row_copy_bytes;
-    }
+    core::CopyPlane2D(
+        under_cursor->Rgba.data(),
+        width * 4,
+        screen_src,
+        screen_pitch,
+        width * 4,
+        height);
 
     // Update Cursor:
 
     Cursor.PrepareWrite(width, height, cursor_screen_x, cursor_screen_y);
 
-    const unsigned cursor_pitch = width * 4;
-    uint8_t* cursor_ptr = Cursor.Rgba.data();
-
-    // Documented here:
-    // https://docs.microsoft.com/en-us/windows/desktop/api/dxgi1_2/ne-dxgi1_2-dxgi_outdupl_pointer_shape_type
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR)
-    {
-        const uint8_t* pointer_ptr = &PointerShapeBuffer[0];
-        pointer_ptr += offset_x * 4 + offset_y * pitch;
-
-        for (int i = 0; i < height; ++i)
-        {
-            const uint32_t* cursor_row = reinterpret_cast<const uint32_t*>(pointer_ptr);
-            const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-            uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-            for (int j = 0; j < width; ++j)
-            {
-                // FIXME: Support partial alpha?
-
-                // If alpha is 50% or higher:
-                if (cursor_row[j] >= 0x80000000) {
-                    output_row[j] = cursor_row[j];
-                }
-                else {
-                    output_row[j] = input_row[j];
-                }
-            } // Next column
-
-            cursor_ptr += cursor_pitch;
-            screen_src += screen_pitch;
-            pointer_ptr += pitch;
-        } // Next row
-
-        return true;
-    }
-
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR)
-    {
-        const uint8_t* pointer_ptr = &PointerShapeBuffer[0];
-        pointer_ptr += offset_x * 4 + offset_y * pitch;
-
-        for (int i = 0; i < height; ++i)
-        {
-            const uint32_t* cursor_row = reinterpret_cast<const uint32_t*>(pointer_ptr);
-            const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-            uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-            for (int j = 0; j < width; ++j)
-            {
-                // FIXME: Support partial alpha?
-
-                // If mask value is 0:
-                if (input_row[j] < 0x80000000) {
-                    output_row[j] = (input_row[j] & 0x00ffffff) | 0xff000000;
-                }
-                else {
-                    output_row[j] ^= input_row[j] & 0x00ffffff;
-                }
-            } // Next column
-
-            cursor_ptr += cursor_pitch;
-            screen_src += screen_pitch;
-            pointer_ptr += pitch;
-        } // Next row
-
-        return true;
-    }
-
-    // Assuming DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
-
-    const uint8_t* shape_data = &PointerShapeBuffer[0];
-    const unsigned xor_offset = PointerShapeInfo.Height / 2 * pitch;
-    const unsigned skip_x = offset_x;
-    const unsigned skip_y = offset_y;
-    shape_data += skip_y * pitch;
-
-    for (int i = 0; i < height; ++i)
-    {
-        const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-        uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-        // Set mask
-        BYTE Mask = 0x80;
-        Mask = Mask >> (skip_x % 8);
-
-        for (int j = 0; j < width; ++j)
-        {
-            // Get masks using appropriate offsets
-            const unsigned mask_offset = (j + skip_x) / 8;
-            const BYTE AndMask = shape_data[mask_offset] & Mask;
-            const BYTE XorMask = shape_data[mask_offset + xor_offset] & Mask;
-
-            uint32_t AndMask32 = (AndMask != 0) ? 0xFFFFFFFF : 0xFF000000;
-            uint32_t XorMask32 = (XorMask != 0) ? 0x00FFFFFF : 0x00000000;
-
-            const uint32_t original_pixel = input_row[j];
-            const uint32_t result_pixel = (original_pixel & AndMask32) ^ XorMask32;
-            output_row[j] = result_pixel;
-
-            if (Mask == 0x01) {
-                Mask = 0x80;
-            }
-            else {
-                Mask >>= 1;
-            }
-        } // Next column
-
-        cursor_ptr += cursor_pitch;
-        screen_src += screen_pitch;
-        shape_data += pitch;
-    } // Next row
+    PointerShape->Composite(
+        Cursor.Rgba.data(),
+        width * 4,
+        screen_src,
+        screen_pitch,
+        offset_x,
+        offset_y,
+        width,
+        height);
 
     return true;
 }
 
 bool D3D11CrossAdapterDuplication::CopyToStagingTexture(ComPtr<ID3D11Texture2D>& DesktopTexture)
 {
+    // A new texture holds none of the previous frame
+    const bool dupe_current = DupeStaging.GetTexture() != nullptr &&
+        DupeStaging.Width() == DesktopDesc.Width &&
+        DupeStaging.Height() == DesktopDesc.Height &&
+        DupeStaging.Format() == DesktopDesc.Format;
+
     bool create_dupe = DupeStaging.Prepare(
         DupeDC,
-        StagingTexture::RW::ReadOnly,
+        StagingTexture::RW::ReadWrite,
         DesktopDesc.Width,
         DesktopDesc.Height,
         DesktopDesc.MipLevels,
@@ -1106,69 +1035,53 @@ bool D3D11CrossAdapterDuplication::CopyToStagingTexture(ComPtr<ID3D11Texture2D>&
         return false;
     }
 
-    const unsigned move_count = CopyDesc.MoveCount;
-    for (unsigned i = 0; i < move_count; ++i)
-    {
-        const RECT& move_rect = CopyDesc.MoveRects[i].DestinationRect;
+    // Pixels outside the copies are unknown, so no tile can be skipped
+    // until it has been copied whole
+    if (!dupe_current) {
+        TileHashes.Reset(DesktopDesc.Width, DesktopDesc.Height);
+    }
 
-#if 0
-        if (this->Info->MonitorIndex != 0) {
-            Logger.Debug("Move ", i, ": (",
-                move_rect.DestinationRect.left, ", ",
-                move_rect.DestinationRect.top, ") [w=",
-                move_rect.DestinationRect.right - move_rect.DestinationRect.left, " h=",
-                move_rect.DestinationRect.bottom - move_rect.DestinationRect.top, "]");
-        }
-#endif
+    const std::vector<RECT>* copy_rects = &CopyDesc.CopyRects;
 
-        D3D11_BOX Box;
-        Box.left = move_rect.left;
-        Box.top = move_rect.top;
-        Box.front = 0;
-        Box.right = move_rect.right;
-        Box.bottom = move_rect.bottom;
-        Box.back = 1;
+    // Moved pixels are already in the staging texture from the last frame,
+    // so shift them there instead of reading them back from the GPU again.
+    // Moves come before the dirty rects, so this is done before the copy
+    if (dupe_current && CopyDesc.MoveCount > 0 && CopyDesc.MovesInBounds)
+    {
+        if (!DupeStaging.Map(DupeDC)) {
+            return false;
+        }
+        CopyDesc.ApplyMoveRects(DupeStaging.GetMappedData(), DupeStaging.GetMappedPitch());
+        DupeStaging.Unmap(DupeDC);
 
-        DupeDC.Context->CopySubresourceRegion1(
-            DupeStaging.GetTexture(), // destination
-            0,
-            move_rect.left, // destination x
-            move_rect.top, // destination y
-            0,
-            DesktopTexture.Get(), // source
-            0,
-            &Box, // source
-            D3D11_COPY_DISCARD);
+        copy_rects = &CopyDesc.DirtyCopyRects;
     }
 
-    const unsigned dirty_count = CopyDesc.DirtyCount;
-    for (unsigned i = 0; i < dirty_count; ++i)
+    for (const RECT& copy_rect : *copy_rects)
     {
-        const RECT& dirty_rect = CopyDesc.DirtyRects[i];
-
 #if 0
         if (this->Info->MonitorIndex == 1) {
-            Logger.Debug("Dirty ", i, ": (",
-                dirty_rect.left, ", ",
-                dirty_rect.top, ") [w=",
-                dirty_rect.right - dirty_rect.left, " h=",
-                dirty_rect.bottom - dirty_rect.top, "]");
+            Logger.Debug("Copy: (",
+                copy_rect.left, ", ",
+                copy_rect.top, ") [w=",
+                copy_rect.right - copy_rect.left, " h=",
+                copy_rect.bottom - copy_rect.top, "]");
         }
 #endif
 
         D3D11_BOX Box;
-        Box.left = dirty_rect.left;
-        Box.top = dirty_rect.top;
+        Box.left = copy_rect.left;
+        Box.top = copy_rect.top;
         Box.front = 0;
-        Box.right = dirty_rect.right;
-        Box.bottom = dirty_rect.bottom;
+        Box.right = copy_rect.right;
+        Box.bottom = copy_rect.bottom;
         Box.back = 1;
 
         DupeDC.Context->CopySubresourceRegion1(
             DupeStaging.GetTexture(), // destination
             0,
-            dirty_rect.left, // destination x
-            dirty_rect.top, // destination y
+            copy_rect.left, // destination x
+            copy_rect.top, // destination y
             0,
             DesktopTexture.Get(), // source
             0,
@@ -1179,6 +1092,21 @@ bool D3D11CrossAdapterDuplication::CopyToStagingTexture(ComPtr<ID3D11Texture2D>&
     return DupeStaging.Map(DupeDC);
 }
 
+void D3D11CrossAdapterDuplication::LogTileHashStats()
+{
+    const uint64_t now_msec = GetTimeMsec();
+    if (now_msec - LastTileStatsLogMsec < 10000) {
+        return;
+    }
+    LastTileStatsLogMsec = now_msec;
+
+    const core::TileHashStats& stats = TileHashes.GetStats();
+    Logger.Info("Tile hashing: Tiles=", stats.TilesHashed,
+        " Unchanged=", stats.TilesUnchanged,
+        " Changed=", stats.ChangedBytes / 1000000, " MB",
+        " Saved=", stats.SkippedBytes / 1000000, " MB");
+}
+
 bool D3D11CrossAdapterDuplication::CreateVrRenderTexture()
 {
     // If texture must be recreated:
@@ -132,6 +132,11 @@ protected:
     std::vector<uint8_t> PointerShapeBuffer;
     UINT PointerShapeBufferBytes = 0;
 
+    // Decoded pointer shapes, and the current one.
+    // Null if there is no valid pointer shape
+    core::CursorCache PointerShapes;
+    const core::DecodedCursor* PointerShape = nullptr;
+
     // BGRA rectangle under the cursor from the current and previous frame.
     // Empty if there is nothing from the prior frame.
     // Otherwise before rendering the next desktop update these pixels should be restored
@@ -152,12 +157,21 @@ protected:
     // Texture that we can map to CPU memory (on dupe device)
     StagingTexture DupeStaging;
 
+    // Hashes of the DupeStaging tiles delivered to the VR device
+    core::TileHashTable TileHashes;
+    uint64_t LastTileStatsLogMsec = 0;
+
     // Texture that receives the mouse cursor
     StagingTexture DupeStagingMouse;
 
     // Texture that we can map to CPU memory (on VR device)
     StagingTexture VrStaging;
 
+    // Pixels where VrStaging does not hold the last delivered frame, because
+    // they were never written or were updated through VrStagingPool.
+    // Moves are only applied in place when they do not read from here
+    core::Region VrStagingStale;
+
     // Pool of smaller staging textures to greatly speed up Map() time
     StagingTexturePool VrStagingPool;
 
@@ -175,6 +189,9 @@ protected:
     // If a staging texture is needed, do the copy
     bool CopyToStagingTexture(ComPtr<ID3D11Texture2D>& DesktopTexture);
 
+    // Log the bytes that tile hashing removed from the copies
+    void LogTileHashStats();
+
     // Create RenderTexture if needed
     bool CreateVrRenderTexture();
 
@@ -193,6 +210,9 @@ protected:
     // Check if CopyToVrStaging_Small() can be used
     bool CanUseVrStagingPool();
 
+    // Check if the moves can be applied inside VrStaging
+    bool CanMoveInVrStaging();
+
     // Copy between staging textures (small copy)
     bool CopyToVrStagingPool();
     bool CopyToVrStagingPool_SingleRect(const RECT& rect);
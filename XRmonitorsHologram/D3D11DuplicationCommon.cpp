@@ -4,7 +4,6 @@
 
 #include "D3D11DuplicationCommon.hpp"
 
-#include <immintrin.h>
 #include <cstdint>
 #include <comdef.h>
 
@@ -14,31 +13,31 @@ static logger::Channel Logger("Duplication");
 
 
 //------------------------------------------------------------------------------
-// Tools
+// Constants
 
-void MemCopy2D(
-    const unsigned rows,
-    const unsigned cols_bytes,
-    uint8_t* __restrict dest,
-    const uint8_t* __restrict src,
-    const unsigned dest_pitch,
-    const unsigned src_pitch)
+// Cost model for desktop rect copies.  Each rect costs two texture copy
+// calls and a mapped row loop on the cross-adapter path, which is about as
+// long as moving 16 KB, and each row costs a memcpy() call
+static core::RegionCopyCost GetDesktopCopyCost()
 {
-    for (unsigned i = 0; i < rows; ++i)
-    {
-        memcpy(dest, src, cols_bytes);
-
-        src += src_pitch;
-        dest += dest_pitch;
-    }
+    core::RegionCopyCost cost;
+    cost.SetupBytes = 16 * 1024;
+    cost.RowBytes = 32;
+    cost.BytesPerPixel = 4;
+    return cost;
 }
 
-void AlignedCopyRectBGRA(
+
+//------------------------------------------------------------------------------
+// Tools
+
+void CopyRectBGRA(
     const RECT& rect,
     uint8_t* __restrict dest,
     unsigned dest_pitch,
     const uint8_t* __restrict src,
-    unsigned src_pitch)
+    unsigned src_pitch,
+    core::CopyScheduler* scheduler)
 {
     src += rect.top * src_pitch + rect.left * 4;
     dest += rect.top * dest_pitch + rect.left * 4;
@@ -46,88 +45,173 @@ void AlignedCopyRectBGRA(
     const unsigned rows = rect.bottom - rect.top;
     const unsigned cols_bytes = (rect.right - rect.left) * 4;
 
-    //Logger.Info("rows: ", rows, " cols_bytes: ", cols_bytes);
+    // Picks the vector kernel and store type for this CPU and rect size
+    if (scheduler) {
+        scheduler->CopyPlane2D(dest, dest_pitch, src, src_pitch, cols_bytes, rows);
+    } else {
+        core::CopyPlane2D(dest, dest_pitch, src, src_pitch, cols_bytes, rows);
+    }
+}
 
-    // If there may not be even one vector word to stream:
-    if (cols_bytes < 64) {
-        MemCopy2D(rows, cols_bytes, dest, src, dest_pitch, src_pitch);
-        return;
+const core::DecodedCursor* DecodePointerShape(
+    core::CursorCache& cache,
+    const DXGI_OUTDUPL_POINTER_SHAPE_INFO& info,
+    const uint8_t* data,
+    unsigned bytes)
+{
+    core::CursorShape shape;
+
+    // Documented here:
+    // https://docs.microsoft.com/en-us/windows/desktop/api/dxgi1_2/ne-dxgi1_2-dxgi_outdupl_pointer_shape_type
+    switch (info.Type)
+    {
+    case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
+        shape.Type = core::CursorShapeType::Monochrome;
+        break;
+    case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
+        shape.Type = core::CursorShapeType::Color;
+        break;
+    case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
+        shape.Type = core::CursorShapeType::MaskedColor;
+        break;
+    default:
+        Logger.Warning("Unsupported pointer shape type: ", info.Type);
+        return nullptr;
     }
 
-    const unsigned leading = 32 - (unsigned)((uintptr_t)dest & 31);
+    shape.Width = info.Width;
+    shape.Height = info.Height;
+    shape.Pitch = info.Pitch;
+    shape.Data = data;
+    shape.Bytes = bytes;
+
+    const core::DecodedCursor* decoded = cache.Decode(shape);
+    if (!decoded) {
+        Logger.Warning("Invalid pointer shape: ", info.Width, "x", info.Height,
+            " Pitch: ", info.Pitch, " Bytes: ", bytes);
+    }
+    return decoded;
+}
+
 
-    uintptr_t vector_start = (uintptr_t)dest + leading;
-    uintptr_t bytes_end = (uintptr_t)dest + cols_bytes;
+//------------------------------------------------------------------------------
+// DesktopCopyDesc
 
-    const unsigned nVects = (unsigned)(bytes_end - vector_start) / 32;
-    const unsigned vector_count_bytes = nVects * 32;
+void DesktopCopyDesc::PlanCopyRects(unsigned width, unsigned height)
+{
+    const core::RegionRect desktop(0, 0, (int)width, (int)height);
 
-    CORE_DEBUG_ASSERT(cols_bytes >= leading + vector_count_bytes);
-    const unsigned trailing = cols_bytes - leading - vector_count_bytes;
+    InputRects.clear();
+    for (unsigned i = 0; i < DirtyCount; ++i)
+    {
+        const RECT& rect = DirtyRects[i];
+        InputRects.push_back(core::RegionRect(rect.left, rect.top, rect.right, rect.bottom));
+    }
+
+    DirtyRegion.Set(InputRects.data(), static_cast<unsigned>(InputRects.size()));
+    DirtyRegion.Intersect(desktop);
+    PlanRegion(DirtyRegion, DirtyCopyRects);
+
+    MovesInBounds = true;
+    if (MoveCount == 0) {
+        ChangedRegion = DirtyRegion;
+        CopyRects = DirtyCopyRects;
+        return;
+    }
 
-//#pragma omp parallel for num_threads(2) default(none)
-    for (unsigned i = 0; i < rows; ++i)
+    for (unsigned i = 0; i < MoveCount; ++i)
     {
-        uint8_t* __restrict row_dest = dest + i * dest_pitch;
-        const uint8_t* __restrict row_src = src + i * src_pitch;
-
-        memcpy(row_dest, row_src, leading);
-
-        const __m256i* pSrc = reinterpret_cast<const __m256i* __restrict>(row_src + leading);
-        __m256i* pDest = reinterpret_cast<__m256i* __restrict>(row_dest + leading);
-
-#if 0
-        while (nVects >= 8) {
-            _mm256_stream_si256(pDest + 0, _mm256_stream_load_si256(pSrc + 0));
-            _mm256_stream_si256(pDest + 1, _mm256_stream_load_si256(pSrc + 1));
-            _mm256_stream_si256(pDest + 2, _mm256_stream_load_si256(pSrc + 2));
-            _mm256_stream_si256(pDest + 3, _mm256_stream_load_si256(pSrc + 3));
-            _mm256_stream_si256(pDest + 4, _mm256_stream_load_si256(pSrc + 4));
-            _mm256_stream_si256(pDest + 5, _mm256_stream_load_si256(pSrc + 5));
-            _mm256_stream_si256(pDest + 6, _mm256_stream_load_si256(pSrc + 6));
-            _mm256_stream_si256(pDest + 7, _mm256_stream_load_si256(pSrc + 7));
-
-            pDest += 8;
-            pSrc += 8;
-            nVects -= 8;
+        const DXGI_OUTDUPL_MOVE_RECT& move = MoveRects[i];
+        const RECT& rect = move.DestinationRect;
+
+        const core::RegionRect dest(rect.left, rect.top, rect.right, rect.bottom);
+        const core::RegionRect source(
+            move.SourcePoint.x,
+            move.SourcePoint.y,
+            move.SourcePoint.x + (int)dest.Width(),
+            move.SourcePoint.y + (int)dest.Height());
+
+        if (!desktop.Contains(dest) || !desktop.Contains(source)) {
+            MovesInBounds = false;
         }
+
+        InputRects.push_back(dest);
+    }
+
+    ChangedRegion.Set(InputRects.data(), static_cast<unsigned>(InputRects.size()));
+    ChangedRegion.Intersect(desktop);
+    PlanRegion(ChangedRegion, CopyRects);
+}
+
+void DesktopCopyDesc::PlanRegion(const core::Region& region, std::vector<RECT>& rects)
+{
+    core::PlanRegionCopies(region, GetDesktopCopyCost(), PlannedRects);
+
+    rects.resize(PlannedRects.size());
+    for (size_t i = 0; i < PlannedRects.size(); ++i)
+    {
+        const core::RegionRect& planned = PlannedRects[i];
+        RECT& rect = rects[i];
+        rect.left = planned.Left;
+        rect.top = planned.Top;
+        rect.right = planned.Right;
+        rect.bottom = planned.Bottom;
+    }
+
+#ifdef DD_LOG_RECTS
+    Logger.Info("Planned ", rects.size(), " copy rects from ", region.GetRectCount(),
+        " (", region.GetArea(), " pixels changed)");
 #endif
+}
 
-        for (unsigned j = 0; j < nVects; ++j) {
-            _mm256_stream_si256(pDest + j, _mm256_stream_load_si256(pSrc + j));
+void DesktopCopyDesc::ApplyMoveRects(uint8_t* data, unsigned pitch) const
+{
+    CORE_DEBUG_ASSERT(MovesInBounds);
+
+    // Applied in order, as each move may read the result of the last
+    for (unsigned i = 0; i < MoveCount; ++i)
+    {
+        const DXGI_OUTDUPL_MOVE_RECT& move = MoveRects[i];
+        const RECT& dest = move.DestinationRect;
+        if (dest.right <= dest.left || dest.bottom <= dest.top) {
+            continue;
         }
 
-        memcpy(row_dest + leading + vector_count_bytes, row_src + leading + vector_count_bytes, trailing);
+        core::MovePlane2D(
+            data + dest.top * pitch + dest.left * 4,
+            data + move.SourcePoint.y * pitch + move.SourcePoint.x * 4,
+            pitch,
+            (dest.right - dest.left) * 4,
+            dest.bottom - dest.top);
     }
-
-    _mm_sfence();
 }
 
-void CopyRectBGRA(
-    const RECT& rect,
-    uint8_t* __restrict dest,
-    unsigned dest_pitch,
-    const uint8_t* __restrict src,
-    unsigned src_pitch)
+void DesktopCopyDesc::RemoveUnchangedTiles(
+    core::TileHashTable& tiles,
+    const uint8_t* data,
+    unsigned pitch)
 {
-#if 1
-    if ((uintptr_t)dest % 32 == 0 &&
-        (uintptr_t)src % 32 == 0 &&
-        dest_pitch % 32 == 0 &&
-        src_pitch % 32 == 0)
+    // Both DirtyRegion and the move destinations were just written, so the
+    // tiles they touch are all that can differ from the delivered frame
+    if (!tiles.FindUnchanged(data, pitch, ChangedRegion, UnchangedTiles) ||
+        UnchangedTiles.Empty())
     {
-        AlignedCopyRectBGRA(rect, dest, dest_pitch, src, src_pitch);
         return;
     }
-#endif
 
-    src += rect.top * src_pitch + rect.left * 4;
-    dest += rect.top * dest_pitch + rect.left * 4;
+    // Moves are still applied in place, since their results in the
+    // unchanged tiles are the same pixels
+    DirtyRegion.Subtract(UnchangedTiles);
+    PlanRegion(DirtyRegion, DirtyCopyRects);
 
-    const unsigned rows = rect.bottom - rect.top;
-    const unsigned cols_bytes = (rect.right - rect.left) * 4;
+    if (MoveCount == 0) {
+        ChangedRegion = DirtyRegion;
+        CopyRects = DirtyCopyRects;
+        return;
+    }
 
-    MemCopy2D(rows, cols_bytes, dest, src, dest_pitch, src_pitch);
+    ChangedRegion.Subtract(UnchangedTiles);
+    PlanRegion(ChangedRegion, CopyRects);
 }
 
 
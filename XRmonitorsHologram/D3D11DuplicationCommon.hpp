@@ -6,6 +6,11 @@
 #include "MonitorEnumerator.hpp"
 #include "D3D11Tools.hpp"
 
+#include "core_copy.hpp"
+#include "core_cursor.hpp"
+#include "core_region.hpp"
+#include "core_tile_hash.hpp"
+
 namespace xrm {
 
 
@@ -25,31 +30,38 @@ static const unsigned kDupeMipLevels = 2;
 static const unsigned kDupeMipLevels = 1;
 #endif
 
+// Skip copying the 64x64 tiles of dirty rects whose pixels did not change,
+// at the cost of hashing every tile that the dirty rects touch.
+// Disabled: Hashing reads every dirty pixel an extra time, so it only pays
+// off when many dirty rects are repainted the same, and costs time on
+// updates that change every pixel, such as full screen video
+//#define ENABLE_DUPE_TILE_HASHING
 
-//------------------------------------------------------------------------------
-// Tools
+// Threads that help the render thread copy large desktop updates on the
+// cross-adapter path.  Copies are bound by memory bandwidth, which a few
+// threads already saturate
+static const unsigned kDesktopCopyWorkers = 2;
 
-void MemCopy2D(
-    const unsigned rows,
-    const unsigned cols_bytes,
-    uint8_t* __restrict dest,
-    const uint8_t* __restrict src,
-    const unsigned dest_pitch,
-    const unsigned src_pitch);
 
-void AlignedCopyRectBGRA(
-    const RECT& rect,
-    uint8_t* __restrict dest,
-    unsigned dest_pitch,
-    const uint8_t* __restrict src,
-    unsigned src_pitch);
+//------------------------------------------------------------------------------
+// Tools
 
+// If a scheduler is provided, large rects are split across its threads
 void CopyRectBGRA(
     const RECT& rect,
     uint8_t* __restrict dest,
     unsigned dest_pitch,
     const uint8_t* __restrict src,
-    unsigned src_pitch);
+    unsigned src_pitch,
+    core::CopyScheduler* scheduler = nullptr);
+
+// Decode a shape from GetFramePointerShape(), or find it in the cache.
+// Returns nullptr if the shape is invalid
+const core::DecodedCursor* DecodePointerShape(
+    core::CursorCache& cache,
+    const DXGI_OUTDUPL_POINTER_SHAPE_INFO& info,
+    const uint8_t* data,
+    unsigned bytes);
 
 
 //------------------------------------------------------------------------------
@@ -83,8 +95,8 @@ struct DesktopCopyDesc
     // Mouse cursor to erase before normal screen updates
     StoredCursor* CursorToErase = nullptr;
 
-    // Desktop duplication moved rects.  Have not seen these yet but they need
-    // to be done before the dirty rects
+    // Desktop duplication moved rects, for example a scrolled window.
+    // These are applied before the dirty rects
     DXGI_OUTDUPL_MOVE_RECT* MoveRects = nullptr;
     unsigned MoveCount = 0;
 
@@ -92,8 +104,47 @@ struct DesktopCopyDesc
     RECT* DirtyRects = nullptr;
     unsigned DirtyCount = 0;
 
+    // Move destinations and dirty rects merged by PlanCopyRects().
+    // Overlaps are removed, so no pixel is copied twice, and nearby rects
+    // are combined when that is cheaper than separate copies
+    std::vector<RECT> CopyRects;
+
+    // Dirty rects alone, planned the same way.  Copied instead of CopyRects
+    // when the moves were applied in place with ApplyMoveRects()
+    std::vector<RECT> DirtyCopyRects;
+
+    // All move sources and destinations are inside the desktop
+    bool MovesInBounds = false;
+
     // Mouse cursor that should be written for this frame
     StoredCursor* CursorToWrite = nullptr;
+
+
+    // Fill CopyRects and DirtyCopyRects, clipped to the desktop
+    void PlanCopyRects(unsigned width, unsigned height);
+
+    // Shift the moved regions of a BGRA image of the previous frame in
+    // place.  Requires MovesInBounds
+    void ApplyMoveRects(uint8_t* data, unsigned pitch) const;
+
+    // Remove the tiles whose pixels did not change from CopyRects and
+    // DirtyCopyRects.  The BGRA image must hold the whole current frame
+    void RemoveUnchangedTiles(core::TileHashTable& tiles, const uint8_t* data, unsigned pitch);
+
+protected:
+    // Dirty rects clipped to the desktop
+    core::Region DirtyRegion;
+
+    // DirtyRegion plus the move destinations
+    core::Region ChangedRegion;
+
+    core::Region UnchangedTiles;
+    std::vector<core::RegionRect> InputRects;
+    std::vector<core::RegionRect> PlannedRects;
+
+
+    // Plan the region into rects
+    void PlanRegion(const core::Region& region, std::vector<RECT>& rects);
 };
 
 
@@ -181,6 +232,10 @@ public:
     // Is rendering currently falling behind the actual desktop?
     bool RenderingFallingBehind = false;
 
+    // Shared by all duplications to split large copies across threads.
+    // Set before Initialize().  Only used by AcquireVrRenderTexture()
+    core::CopyScheduler* Copies = nullptr;
+
     // Frame texture produced by UpdateFrameTexture()
     // that can be bound for rendering on the VR context
     ComPtr<ID3D11Texture2D> VrRenderTexture;
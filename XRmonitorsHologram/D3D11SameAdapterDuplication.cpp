@@ -473,6 +473,15 @@ bool D3D11SameAdapterDuplication::ReadFrame()
                 &PointerShapeInfo);
             if (FAILED(hr)) {
                 Logger.Warning("GetFramePointerShape: ", HresultString(hr));
+                PointerShape = nullptr;
+            }
+            else {
+                // Decoded only when the shape changes, not on every move
+                PointerShape = DecodePointerShape(
+                    PointerShapes,
+                    PointerShapeInfo,
+                    PointerShapeBuffer.data(),
+                    PointerShapeBufferBytes);
             }
         }
 
@@ -701,16 +710,12 @@ void D3D11SameAdapterDuplication::DeliverFrame()
 
 bool D3D11SameAdapterDuplication::UpdateMouseCursor(const DXGI_OUTDUPL_FRAME_INFO& frame_info)
 {
-    if (PointerShapeBufferBytes == 0) {
+    if (!PointerShape) {
         return false; // No pointer
     }
 
-    int width = PointerShapeInfo.Width;
-    const unsigned pitch = PointerShapeInfo.Pitch;
-    int height = PointerShapeInfo.Height;
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME) {
-        height /= 2;
-    }
+    int width = PointerShape->Width;
+    int height = PointerShape->Height;
 
     int cursor_screen_x = frame_info.PointerPosition.Position.x;
     int cursor_screen_y = frame_info.PointerPosition.Position.y;
@@ -847,118 +852,15 @@ bool D3D11SameAdapterDuplication::UpdateMouseCursor(const DXGI_OUTDUPL_FRAME_INF
 
     Cursor.PrepareWrite(width, height, cursor_screen_x, cursor_screen_y);
 
-    const unsigned cursor_pitch = width * 4;
-    uint8_t* cursor_ptr = Cursor.Rgba.data();
-
-    // Documented here:
-    // https://docs.microsoft.com/en-us/windows/desktop/api/dxgi1_2/ne-dxgi1_2-dxgi_outdupl_pointer_shape_type
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR)
-    {
-        const uint8_t* pointer_ptr = &PointerShapeBuffer[0];
-        pointer_ptr += offset_x * 4 + offset_y * pitch;
-
-        for (int i = 0; i < height; ++i)
-        {
-            const uint32_t* cursor_row = reinterpret_cast<const uint32_t*>(pointer_ptr);
-            const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-            uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-            for (int j = 0; j < width; ++j)
-            {
-                // FIXME: Support partial alpha?
-
-                // If alpha is 50% or higher:
-                if (cursor_row[j] >= 0x80000000) {
-                    output_row[j] = cursor_row[j];
-                }
-                else {
-                    output_row[j] = input_row[j];
-                }
-            } // Next column
-
-            cursor_ptr += cursor_pitch;
-            screen_src += screen_pitch;
-            pointer_ptr += pitch;
-        } // Next row
-
-        return true;
-    }
-
-    if (PointerShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR)
-    {
-        const uint8_t* pointer_ptr = &PointerShapeBuffer[0];
-        pointer_ptr += offset_x * 4 + offset_y * pitch;
-
-        for (int i = 0; i < height; ++i)
-        {
-            const uint32_t* cursor_row = reinterpret_cast<const uint32_t*>(pointer_ptr);
-            const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-            uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-            for (int j = 0; j < width; ++j)
-            {
-                // FIXME: Support partial alpha?
-
-                // If mask value is 0:
-                if (input_row[j] < 0x80000000) {
-                    output_row[j] = (input_row[j] & 0x00ffffff) | 0xff000000;
-                }
-                else {
-                    output_row[j] ^= input_row[j] & 0x00ffffff;
-                }
-            } // Next column
-
-            cursor_ptr += cursor_pitch;
-            screen_src += screen_pitch;
-            pointer_ptr += pitch;
-        } // Next row
-
-        return true;
-    }
-
-    // Assuming DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
-
-    const uint8_t* shape_data = &PointerShapeBuffer[0];
-    const unsigned xor_offset = PointerShapeInfo.Height / 2 * pitch;
-    const unsigned skip_x = offset_x;
-    const unsigned skip_y = offset_y;
-    shape_data += skip_y * pitch;
-
-    for (int i = 0; i < height; ++i)
-    {
-        const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
-        uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
-
-        // Set mask
-        BYTE Mask = 0x80;
-        Mask = Mask >> (skip_x % 8);
-
-        for (int j = 0; j < width; ++j)
-        {
-            // Get masks using appropriate offsets
-            const unsigned mask_offset = (j + skip_x) / 8;
-            const BYTE AndMask = shape_data[mask_offset] & Mask;
-            const BYTE XorMask = shape_data[mask_offset + xor_offset] & Mask;
-
-            uint32_t AndMask32 = (AndMask != 0) ? 0xFFFFFFFF : 0xFF000000;
-            uint32_t XorMask32 = (XorMask != 0) ? 0x00FFFFFF : 0x00000000;
-
-            const uint32_t original_pixel = input_row[j];
-            const uint32_t result_pixel = (original_pixel & AndMask32) ^ XorMask32;
-            output_row[j] = result_pixel;
-
-            if (Mask == 0x01) {
-                Mask = 0x80;
-            }
-            else {
-                Mask >>= 1;
-            }
-        } // Next column
-
-        cursor_ptr += cursor_pitch;
-        screen_src += screen_pitch;
-        shape_data += pitch;
-    } // Next row
+    PointerShape->Composite(
+        Cursor.Rgba.data(),
+        width * 4,
+        screen_src,
+        screen_pitch,
+        offset_x,
+        offset_y,
+        width,
+        height);
 
     return true;
 }
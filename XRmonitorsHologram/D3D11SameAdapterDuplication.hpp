@@ -112,6 +112,11 @@ protected:
     std::vector<uint8_t> PointerShapeBuffer;
     UINT PointerShapeBufferBytes = 0;
 
+    // Decoded pointer shapes, and the current one.
+    // Null if there is no valid pointer shape
+    core::CursorCache PointerShapes;
+    const core::DecodedCursor* PointerShape = nullptr;
+
     // Cursor superimposed on the desktop for the current frame.
     // Empty if no cursor to render
     StoredCursor Cursor;
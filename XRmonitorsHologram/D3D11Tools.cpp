@@ -251,11 +251,20 @@ bool StagingTexture::Prepare(
     DXGI_FORMAT format,
     unsigned samples)
 {
+    UINT cpu_access = D3D11_CPU_ACCESS_READ | D3D11_CPU_ACCESS_WRITE;
+    if (mode == RW::ReadOnly) {
+        cpu_access = D3D11_CPU_ACCESS_READ;
+    }
+    else if (mode == RW::WriteOnly) {
+        cpu_access = D3D11_CPU_ACCESS_WRITE;
+    }
+
     // If texture must be recreated:
     if (!Texture ||
         Desc.Width != width ||
         Desc.Height != height ||
-        Desc.Format != format)
+        Desc.Format != format ||
+        Desc.CPUAccessFlags != cpu_access)
     {
         Logger.Info("Recreating staging texture ( ",
             width, "x", height, " )");
@@ -271,14 +280,16 @@ bool StagingTexture::Prepare(
         Desc.ArraySize = 1;
 
         Desc.Usage = D3D11_USAGE_STAGING;
+        Desc.CPUAccessFlags = cpu_access;
         if (mode == RW::ReadOnly) {
-            Desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
             MapType = D3D11_MAP_READ;
         }
-        else {
-            Desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        else if (mode == RW::WriteOnly) {
             MapType = D3D11_MAP_WRITE;
         }
+        else {
+            MapType = D3D11_MAP_READ_WRITE;
+        }
 
         HRESULT hr = dc.Device->CreateTexture2D(
             &Desc,
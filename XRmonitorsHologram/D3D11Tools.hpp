@@ -73,7 +73,10 @@ public:
 
     enum class RW {
         ReadOnly,
-        WriteOnly
+        WriteOnly,
+
+        // For in-place updates such as moving a scrolled region
+        ReadWrite
     };
 
     /// Recreate texture if needed
@@ -115,6 +118,10 @@ public:
     {
         return Desc.Height;
     }
+    DXGI_FORMAT Format() const
+    {
+        return Desc.Format;
+    }
 
 protected:
     D3D11_TEXTURE2D_DESC Desc{};
@@ -84,6 +84,7 @@ void MonitorRenderController::Initialize(
 void MonitorRenderController::Shutdown()
 {
     CleanupDuplicates();
+    DesktopCopies.Stop();
 }
 
 void MonitorRenderController::StartRendering(
@@ -101,6 +102,8 @@ void MonitorRenderController::StartRendering(
     Rendering = rendering;
     Plugins = plugins;
 
+    DesktopCopies.Start(kDesktopCopyWorkers);
+
     // Tell service to appl USB hub power fix
     Cameras->ApplyUsbHubPowerFix();
 
@@ -113,6 +116,9 @@ void MonitorRenderController::StartRendering(
     }
 
     RenderModel->SetDpi(Settings->MonitorDpi);
+    Imager->EnableDenoise = Settings->EnableCameraDenoise;
+    Imager->EnableStereo = Settings->EnableCameraStereo;
+    Imager->EnableContrast = Settings->EnableCameraContrast;
 
     RecenterOnFirstEnum = true;
     UpdateMonitorEnumeration();
@@ -144,10 +150,19 @@ void MonitorRenderController::UpdateModel()
 
     // Read latest camera frame:
 
+    // This runs before xrWaitFrame(), so the frame being rendered is shown
+    // one period after the last prediction
+    uint64_t display_usec = 0;
+    if (Rendering->PredictedDisplayTimeUsec != 0) {
+        display_usec = Rendering->PredictedDisplayTimeUsec + Rendering->PredictedDisplayPeriodUsec;
+    }
+
     // TBD: NowOrientation
     RenderModel->UpdatedCamerasThisFrame = Imager->AcquireImage(
         Rendering->DeviceContext,
-        Cameras);
+        Cameras,
+        display_usec,
+        Rendering->PredictedDisplayPeriodUsec);
     RenderModel->ExposureTimeUsec = Imager->ExposureTimeUsec;
 
     // Handle keystrokes:
@@ -416,6 +431,7 @@ void MonitorRenderController::UpdateMonitorEnumeration()
         RenderModel->Monitors[i]->Dupe = Duplicates[i].get();
         RenderModel->Monitors[i]->MonitorInfo = Enumerator->Monitors[i].get();
 
+        Duplicates[i]->Copies = &DesktopCopies;
         Duplicates[i]->Initialize(
             Enumerator->Monitors[i],
             &Rendering->DeviceContext);
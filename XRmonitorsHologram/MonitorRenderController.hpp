@@ -94,6 +94,9 @@ protected:
 
     std::vector<std::shared_ptr<ID3D11DesktopDuplication>> Duplicates;
 
+    // Splits large desktop copies across threads for all duplications
+    core::CopyScheduler DesktopCopies;
+
     std::vector<SortedMonitor> SortedMonitors;
     unsigned CenteredMonitorIndex = 0;
 
@@ -126,7 +126,8 @@ struct MonitorRenderModel
     int GazeX = -1;
     int GazeY = -1;
 
-    PluginRenderInfo Plugins[XRM_PLUGIN_COUNT];
+    // One per plugin directory slot
+    std::vector<PluginRenderInfo> Plugins;
 
 
     void SetDpi(float dpi);
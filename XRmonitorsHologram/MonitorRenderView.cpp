@@ -888,6 +888,11 @@ void MonitorRenderView::RenderProjectiveView(XrD3D11ProjectionView* view)
             Rendering->DeviceContext,
             view_projection_matrix,
             camera_render_params);
+
+        // Completes the latency stamps of the new frame on its first view
+        if (RenderModel->UpdatedCamerasThisFrame && Imager) {
+            Imager->OnFrameRendered();
+        }
     }
 
     //m_Cube.Render(context, view_projection_matrix);
@@ -158,39 +158,4 @@ std::string WideStringToUtf8String(const std::wstring& wide)
 }
 
 
-//------------------------------------------------------------------------------
-// RectGlomp
-
-void RectGlomp::Reset()
-{
-    Count = 0;
-
-    GlompRect.left = 0;
-    GlompRect.right = 0;
-    GlompRect.top = 0;
-    GlompRect.bottom = 0;
-}
-
-void RectGlomp::Grow(const RECT& rect)
-{
-    if (Count == 0) {
-        GlompRect = rect;
-        return;
-    }
-
-    if (GlompRect.left > rect.left) {
-        GlompRect.left = rect.left;
-    }
-    if (GlompRect.right < rect.right) {
-        GlompRect.right = rect.right;
-    }
-    if (GlompRect.top > rect.top) {
-        GlompRect.top = rect.top;
-    }
-    if (GlompRect.bottom < rect.bottom) {
-        GlompRect.bottom = rect.bottom;
-    }
-}
-
-
 } // namespace xrm
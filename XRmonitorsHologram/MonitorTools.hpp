@@ -61,34 +61,4 @@ std::string WideStringToUtf8String(const std::wstring& wide);
 void StripNonprintables(char* s);
 
 
-//------------------------------------------------------------------------------
-// RectGlomp
-
-class RectGlomp
-{
-public:
-    void Reset();
-    void Grow(const RECT& rect);
-
-    bool Empty() const
-    {
-        return Count == 0;
-    }
-
-    unsigned Width() const
-    {
-        return GlompRect.right - GlompRect.left + 1;
-    }
-
-    unsigned Height() const
-    {
-        return GlompRect.bottom - GlompRect.top + 1;
-    }
-
-protected:
-    RECT GlompRect;
-    unsigned Count = 0;
-};
-
-
 } // namespace xrm
@@ -184,6 +184,10 @@ struct XrComputerProperties
     bool UnboundedRefSpaceSupported = false;
     bool SpatialAnchorSupported = false;
     bool CylinderSupported = false;
+    bool ConvertTimeSupported = false;
+
+    // XR_KHR_win32_convert_performance_counter_time, or nullptr
+    PFN_xrConvertTimeToWin32PerformanceCounterKHR ConvertTimeToPerfCounter = nullptr;
 
     // Instance data about our application (engine name, enabled exts, etc)
     XrInstanceHandle Instance;
@@ -298,6 +302,11 @@ struct XrRenderProperties
     // Predicted display time for the current frame
     XrTime PredictedDisplayTime;
 
+    // PredictedDisplayTime in core::GetTimeUsec() units, or 0 if the runtime
+    // cannot convert it, and the predicted time between frames
+    uint64_t PredictedDisplayTimeUsec = 0;
+    uint64_t PredictedDisplayPeriodUsec = 0;
+
     // Is the tracking pose valid for this view for this frame?
     bool ViewPosesValid = false;
 
@@ -290,6 +290,32 @@ void OpenXrD3D11SwapChains::ProcessEvents(bool* exitRenderLoop, bool* requestRes
     }
 }
 
+uint64_t OpenXrD3D11SwapChains::XrTimeToUsec(XrTime time) const
+{
+    if (!Computer->ConvertTimeToPerfCounter) {
+        return 0;
+    }
+
+    LARGE_INTEGER counter{};
+    if (XR_FAILED(Computer->ConvertTimeToPerfCounter(Computer->Instance.Get(), time, &counter))) {
+        return 0;
+    }
+
+    // GetTimeUsec() is also based on QueryPerformanceCounter(), so only the
+    // offset from now needs converting
+    LARGE_INTEGER now{}, freq{};
+    if (!::QueryPerformanceCounter(&now) ||
+        !::QueryPerformanceFrequency(&freq) ||
+        freq.QuadPart == 0)
+    {
+        return 0;
+    }
+    const uint64_t now_usec = GetTimeUsec();
+    const int64_t delta_usec = (counter.QuadPart - now.QuadPart) * 1000000 / freq.QuadPart;
+
+    return now_usec + delta_usec;
+}
+
 void OpenXrD3D11SwapChains::RenderFrame()
 {
     XR_CHECK(Headset->Session.Get() != XR_NULL_HANDLE);
@@ -299,6 +325,8 @@ void OpenXrD3D11SwapChains::RenderFrame()
     XR_CHECK_XRCMD(xrWaitFrame(Headset->Session.Get(), &wait_info, &frame_state));
 
     Rendering->PredictedDisplayTime = frame_state.predictedDisplayTime;
+    Rendering->PredictedDisplayTimeUsec = XrTimeToUsec(frame_state.predictedDisplayTime);
+    Rendering->PredictedDisplayPeriodUsec = static_cast<uint64_t>(frame_state.predictedDisplayPeriod / 1000);
 
     XrFrameBeginInfo begin_info{ XR_TYPE_FRAME_BEGIN_INFO }; // empty
     XR_CHECK_XRCMD(xrBeginFrame(Headset->Session.Get(), &begin_info));
@@ -671,6 +699,16 @@ bool OpenXrD3D11SwapChains::CreateInstanceAndLogger()
             &createInfo,
             Computer->Instance.Put()));
 
+        if (Computer->ConvertTimeSupported) {
+            XR_CHECK_XRCMD(xrGetInstanceProcAddr(
+                Computer->Instance.Get(),
+                "xrConvertTimeToWin32PerformanceCounterKHR",
+                reinterpret_cast<PFN_xrVoidFunction*>(&Computer->ConvertTimeToPerfCounter)));
+        }
+        else {
+            Logger.Warning("OpenXR runtime cannot convert display times: Camera frames will not be scheduled");
+        }
+
 #if 0
         // Set up logging messenger:
         XR_CHECK(Computer->Messenger.Get() == XR_NULL_HANDLE);
@@ -748,6 +786,9 @@ std::vector<const char*> OpenXrD3D11SwapChains::SelectExtensions()
     // False- Microsoft does not support cylindrical layers
     Computer->CylinderSupported = AddExtIfSupported(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME);
 
+    // Used to schedule camera frames against the display time
+    Computer->ConvertTimeSupported = AddExtIfSupported(XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME);
+
     Logger.Debug("OpenXR cylindrical layer supported: ", Computer->CylinderSupported);
 
     return enabledExtensions;
@@ -127,6 +127,9 @@ protected:
     void ProcessEvents(bool* exitRenderLoop, bool* requestRestart);
     void RenderFrame();
 
+    // Convert an OpenXR time to core::GetTimeUsec() units, or 0 if unsupported
+    uint64_t XrTimeToUsec(XrTime time) const;
+
     void RenderFrameViews();
     void RenderFrameQuads();
 };
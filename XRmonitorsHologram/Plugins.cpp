@@ -4,6 +4,7 @@
 
 #include "Plugins.hpp"
 #include "MonitorTools.hpp"
+#include "D3D11DuplicationCommon.hpp"
 
 namespace xrm {
 
@@ -52,8 +53,12 @@ void PluginServer::Initialize(
     memset(&HostData, 0, sizeof(HostData));
     memset(&PluginData, 0, sizeof(PluginData));
 
-    HostToPlugin = &shared_memory->HostToPlugin[PluginIndex];
-    PluginToHost = &shared_memory->PluginToHost[PluginIndex];
+    SharedMemory = shared_memory;
+    Slot = shared_memory->GetSlot(PluginIndex);
+    HostToPlugin = &Slot->HostToPlugin;
+    PluginToHost = &Slot->PluginToHost;
+    Events = &Slot->Events;
+    Owner = 0;
 
     HostData.Shutdown = 0;
     HostData.TerminateEpoch = 0;
@@ -84,6 +89,12 @@ void PluginServer::Shutdown()
 void PluginServer::SetFocusAndGaze(int screen_x, int screen_y, bool focus)
 {
     const bool focus_changed = ((HostData.HasFocus != 0) != focus);
+    const bool gaze_changed = HostData.GazeScreenX != screen_x ||
+                              HostData.GazeScreenY != screen_y;
+
+    if (!focus_changed && !gaze_changed) {
+        return;
+    }
 
     if (focus_changed) {
         Logger.Info("Gaze focus: ", focus);
@@ -94,6 +105,20 @@ void PluginServer::SetFocusAndGaze(int screen_x, int screen_y, bool focus)
     HostData.GazeScreenY = screen_y;
     HostToPlugin->Write(HostData);
 
+    // Only owned slots have a reader for the ring
+    if (IsOwned())
+    {
+        if (focus_changed) {
+            PushEvent(focus ? XRM_PLUGIN_EVENT_FOCUS_IN : XRM_PLUGIN_EVENT_FOCUS_OUT, screen_x, screen_y);
+        }
+        else if (focus) {
+            // Gaze samples are only sent while the plugin has focus
+            PushEvent(XRM_PLUGIN_EVENT_GAZE, screen_x, screen_y);
+        }
+    }
+
+    // Focus changes must wake plugins that wait on the event without using
+    // the ring, so they react faster to gaining focus
     if (focus_changed) {
         UpdateEvent.Signal();
     }
@@ -103,9 +128,34 @@ void PluginServer::SignalTerminate()
 {
     HostData.TerminateEpoch++;
     HostToPlugin->Write(HostData);
+
+    // Terminate must arrive even if the ring is full or nobody is waiting
+    PushEvent(XRM_PLUGIN_EVENT_TERMINATE);
     UpdateEvent.Signal();
 }
 
+void PluginServer::PushEvent(uint32_t type, int x, int y)
+{
+    XrmPluginEvent event{};
+    event.TimestampUsec = GetTimeUsec();
+    event.Type = type;
+    event.X = x;
+    event.Y = y;
+
+    bool wake = false;
+    if (!Events->Push(event, wake)) {
+        // The plugin can still read the latest state from HostToPlugin
+        if (DroppedEvents++ == 0) {
+            Logger.Warning("Plugin is not reading input events: Dropping them");
+        }
+        return;
+    }
+
+    if (wake) {
+        UpdateEvent.Signal();
+    }
+}
+
 bool PluginServer::HitTest(int screen_x, int screen_y)
 {
     if (std::abs(PluginData.X - screen_x) > PluginData.Width / 2) {
@@ -128,6 +178,15 @@ bool PluginServer::UpdateRenderModel()
         return false;
     }
 
+    // If the slot was claimed, released, or reclaimed:
+    const uint64_t owner = Slot->Owner.load(std::memory_order_acquire);
+    if (owner != Owner) {
+        OnOwnerChanged(owner);
+    }
+    if (!IsOwned()) {
+        return false;
+    }
+
     const uint32_t old_keep_alive_epoch = PluginData.KeepAliveEpoch;
     const uint32_t old_texture_handle_epoch = PluginData.TextureHandleEpoch;
     const uint32_t old_texture_release_epoch = PluginData.TextureReleaseEpoch;
@@ -138,6 +197,11 @@ bool PluginServer::UpdateRenderModel()
 
     const bool success = PluginToHost->Read(PluginEpoch, PluginData);
 
+    // If the plugin was mid-write, ring the doorbell again to retry next frame
+    if (!success) {
+        SharedMemory->MarkPluginDirty(PluginIndex);
+    }
+
     // If keepalive is received:
     if (old_keep_alive_epoch != PluginData.KeepAliveEpoch) {
         Timeout.Reset();
@@ -148,10 +212,18 @@ bool PluginServer::UpdateRenderModel()
         return false; // No shared texture update
     }
 
+    const bool cpu_surface = (PluginData.SurfaceType == XRM_PLUGIN_SURFACE_CPU);
+
     // If shared texture changed:
     const bool tex_changed = (PluginData.TextureHandleEpoch != old_texture_handle_epoch);
     if (tex_changed) {
-        if (!UpdateSharedTexture()) {
+        if (cpu_surface) {
+            if (!OpenSurface()) {
+                Logger.Error("OpenSurface failed");
+                return false;
+            }
+        }
+        else if (!UpdateSharedTexture()) {
             Logger.Error("UpdateSharedTexture failed");
             return false;
         }
@@ -164,12 +236,12 @@ bool PluginServer::UpdateRenderModel()
     }
 
     // Ignore texture updates if we failed during setup
-    if (!VrRenderTexture || !SharedTexture) {
+    if (!VrRenderTexture || (!SharedTexture && !Surface)) {
         return false;
     }
 
     info->Texture = VrRenderTexture.Get();
-    info->TextureFormat = (DXGI_FORMAT)HostData.Format;
+    info->TextureFormat = GetVrTextureFormat();
     info->MultisamplingEnabled = HostData.SampleCount > 1;
 
     //Logger.Info("Texture ready: X=", PluginData.X, " Y=", PluginData.Y);
@@ -197,10 +269,20 @@ bool PluginServer::UpdateRenderModel()
     info->VertexBuffer = VertexBuffer.Get();
     info->IndexCount = IndexCount;
 
+    // CPU surfaces are uploaded by UpdateSurface() instead
+    if (cpu_surface) {
+        return true;
+    }
+
     // If texture release epoch changed implying texture mutex released to host:
     if (old_texture_release_epoch != PluginData.TextureReleaseEpoch)
     {
-        if (!CopyTexture()) {
+        // Dirty rects only describe changes since the previous release, and
+        // a new VR texture has no previous contents
+        const bool full_copy = FullCopyPending || tex_changed ||
+            PluginData.TextureReleaseEpoch != old_texture_release_epoch + 1;
+
+        if (!CopyTexture(full_copy)) {
             Logger.Error("CopyTexture failed");
             return false;
         }
@@ -209,18 +291,48 @@ bool PluginServer::UpdateRenderModel()
     return true;
 }
 
+void PluginServer::OnOwnerChanged(uint64_t owner)
+{
+    const uint32_t pid = XrmPluginOwnerProcessId(owner);
+    if (pid != 0) {
+        Logger.Info("Slot claimed by pid=", pid, " epoch=", XrmPluginOwnerEpoch(owner));
+    }
+    else {
+        Logger.Info("Slot released");
+    }
+
+    // Nothing from the previous owner carries over
+    if (SharedTexture || VrRenderTexture) {
+        ReleaseRemoteTexture();
+    }
+    memset(&PluginData, 0, sizeof(PluginData));
+    PluginEpoch = 0;
+    DroppedEvents = 0;
+    Owner = owner;
+    Timeout.Reset();
+}
+
 void PluginServer::CheckTimeout()
 {
     // If already inactive:
-    if (!VrRenderTexture) {
+    if (!IsOwned()) {
         return;
     }
 
     if (Timeout.Timeout())
     {
         Logger.Warning("Plugin application timed out");
-        ReleaseRemoteTexture();
+        if (VrRenderTexture) {
+            ReleaseRemoteTexture();
+        }
         SignalTerminate();
+
+        // Free the slot for other plugins.  If the owner changed meanwhile
+        // this fails, and either way the next update reads the new owner
+        if (SharedMemory->ReclaimSlot(PluginIndex, Owner)) {
+            Logger.Info("Reclaimed slot from pid=", XrmPluginOwnerProcessId(Owner));
+        }
+        SharedMemory->MarkPluginDirty(PluginIndex);
         return;
     }
 }
@@ -408,15 +520,28 @@ void PluginServer::ReleaseRemoteTexture()
     SharedTexture.Reset();
     MutexAcquired = false;
     VrRenderTexture.Reset();
+    FullCopyPending = true;
+
+    // Release CPU surface
+    Surface = nullptr;
+    SurfaceFile.Close();
+    SurfaceWidth = 0;
+    SurfaceHeight = 0;
+    SurfaceStaging.Reset();
+    SurfaceFrontIndex = 2;
+    SurfaceFrameNumber = 0;
     RenderModel->Plugins[PluginIndex].Texture = nullptr;
 }
 
 bool PluginServer::UpdateVrTexture()
 {
+    const DXGI_FORMAT format = GetVrTextureFormat();
+
     // If texture must be recreated:
     if (!VrRenderTexture ||
         PluginData.Width != VrRenderTextureDesc.Width ||
-        PluginData.Height != VrRenderTextureDesc.Height)
+        PluginData.Height != VrRenderTextureDesc.Height ||
+        format != VrRenderTextureDesc.Format)
     {
         Logger.Info("Recreating VrRenderTexture ( ",
             PluginData.Width, "x", PluginData.Height, " )");
@@ -428,7 +553,7 @@ bool PluginServer::UpdateVrTexture()
         desc.Height = PluginData.Height;
         desc.MipLevels = HostData.MipLevels;
         desc.ArraySize = 1;
-        desc.Format = (DXGI_FORMAT)HostData.Format;
+        desc.Format = format;
         desc.SampleDesc.Count = HostData.SampleCount;
         desc.SampleDesc.Quality = 0;
         desc.Usage = D3D11_USAGE_DEFAULT;
@@ -451,35 +576,277 @@ bool PluginServer::UpdateVrTexture()
     return true;
 }
 
-bool PluginServer::CopyTexture()
+/*
+    Convert plugin dirty rects into copy boxes clipped to the surface.
+    Falls back to one full box if full_copy is set or the list is empty or
+    has overflowed.  Returns the number of boxes written
+*/
+static int GatherCopyBoxes(
+    bool full_copy,
+    uint32_t rect_count,
+    const XrmPluginRect* rects,
+    int32_t width,
+    int32_t height,
+    D3D11_BOX* boxes)
+{
+    int box_count = 0;
+
+    if (full_copy ||
+        rect_count == 0 ||
+        rect_count > XRM_PLUGIN_MAX_DIRTY_RECTS)
+    {
+        D3D11_BOX& box = boxes[box_count++];
+        box.left = 0;
+        box.right = width;
+        box.top = 0;
+        box.bottom = height;
+        box.front = 0;
+        box.back = 1;
+        return box_count;
+    }
+
+    for (uint32_t i = 0; i < rect_count; ++i)
+    {
+        const XrmPluginRect& rect = rects[i];
+
+        const int32_t left = (std::max)(rect.Left, 0);
+        const int32_t top = (std::max)(rect.Top, 0);
+        const int32_t right = (std::min)(rect.Right, width);
+        const int32_t bottom = (std::min)(rect.Bottom, height);
+
+        if (left >= right || top >= bottom) {
+            continue; // Empty after clipping
+        }
+
+        D3D11_BOX& box = boxes[box_count++];
+        box.left = left;
+        box.right = right;
+        box.top = top;
+        box.bottom = bottom;
+        box.front = 0;
+        box.back = 1;
+    }
+
+    return box_count;
+}
+
+// Partial copies must preserve the rest of the VR texture, so only a full
+// copy may discard it
+static UINT CopyFlagsForBoxes(const D3D11_BOX* boxes, int box_count, int32_t width, int32_t height)
+{
+    const bool full = box_count == 1 &&
+        boxes[0].left == 0 && boxes[0].top == 0 &&
+        boxes[0].right == (UINT)width &&
+        boxes[0].bottom == (UINT)height;
+    return full ? D3D11_COPY_DISCARD : 0;
+}
+
+DXGI_FORMAT PluginServer::GetVrTextureFormat() const
+{
+    if (Surface) {
+        return DXGI_FORMAT_B8G8R8A8_UNORM;
+    }
+    return (DXGI_FORMAT)HostData.Format;
+}
+
+bool PluginServer::OpenSurface()
+{
+    Logger.Info("OpenSurface");
+
+    ReleaseRemoteTexture();
+
+    XrmPluginSurfaceGeometry geometry;
+    XrmPluginSurfaceLayout* surface = OpenXrmPluginSurface(SurfaceFile, PluginIndex, geometry);
+    if (!surface) {
+        Logger.Error("OpenXrmPluginSurface failed: ", LastIpcErrorString());
+        return false;
+    }
+
+    // Keep our own copy of the geometry so the plugin cannot change it later
+    if ((int64_t)geometry.Width != PluginData.Width ||
+        (int64_t)geometry.Height != PluginData.Height)
+    {
+        Logger.Error("Surface size ", geometry.Width, "x", geometry.Height,
+            " does not match plugin size ", PluginData.Width, "x", PluginData.Height);
+        SurfaceFile.Close();
+        return false;
+    }
+    SurfaceWidth = geometry.Width;
+    SurfaceHeight = geometry.Height;
+    SurfacePitch = geometry.Pitch;
+    SurfaceBufferBytes = geometry.BufferBytes;
+
+    Surface = surface;
+    SurfaceFrontIndex = 2;
+    SurfaceFrameNumber = 0;
+    return true;
+}
+
+void PluginServer::UpdateSurface()
+{
+    if (!Surface || !VrRenderTexture) {
+        return;
+    }
+
+    // The VR texture and the mapping were sized when the surface was opened,
+    // so a resize without a new surface cannot be uploaded
+    if (PluginData.Width != (int32_t)SurfaceWidth ||
+        PluginData.Height != (int32_t)SurfaceHeight)
+    {
+        Logger.Error("Plugin size ", PluginData.Width, "x", PluginData.Height,
+            " no longer matches surface size ", SurfaceWidth, "x", SurfaceHeight);
+        ReleaseRemoteTexture();
+        return;
+    }
+
+    if (!Surface->AcquireLatest(SurfaceFrontIndex)) {
+        return; // No new frame
+    }
+
+    if (SurfaceFrontIndex >= XRM_PLUGIN_SURFACE_BUFFER_COUNT)
+    {
+        Logger.Error("Plugin corrupted the surface buffer index");
+        ReleaseRemoteTexture();
+        SignalTerminate();
+        return;
+    }
+
+    if (!UploadSurface()) {
+        Logger.Error("UploadSurface failed");
+        return;
+    }
+
+    // A new frame shows the plugin is alive
+    Timeout.Reset();
+}
+
+bool PluginServer::UploadSurface()
+{
+    const XrmPluginSurfaceBuffer& buffer = Surface->Buffers[SurfaceFrontIndex];
+    const uint32_t frame_number = buffer.FrameNumber;
+    const uint32_t rect_count = buffer.DirtyRectCount;
+
+    // Dirty rects are relative to the previous frame, so they only apply if
+    // that is the frame we uploaded last
+    const bool full_copy = FullCopyPending || frame_number != SurfaceFrameNumber + 1;
+
+    D3D11_BOX boxes[XRM_PLUGIN_MAX_DIRTY_RECTS];
+    const int box_count = GatherCopyBoxes(
+        full_copy,
+        rect_count,
+        buffer.DirtyRects,
+        (int32_t)SurfaceWidth,
+        (int32_t)SurfaceHeight,
+        boxes);
+
+    D3D11DeviceContext& dc = Rendering->DeviceContext;
+
+    // Same path as cross-adapter duplication: CPU -> staging -> VR texture
+    bool staging = SurfaceStaging.Prepare(
+        dc,
+        StagingTexture::RW::WriteOnly,
+        SurfaceWidth,
+        SurfaceHeight,
+        1, // mip levels
+        DXGI_FORMAT_B8G8R8A8_UNORM,
+        1); // samples
+    if (!staging) {
+        return false;
+    }
+
+    // Staging must be fully written before the first partial update
+    if (!SurfaceStaging.Map(dc)) {
+        FullCopyPending = true;
+        return false;
+    }
+
+    const uint8_t* pixels = SurfaceFile.GetFront() +
+        XrmPluginSurfaceLayout::PixelOffset() +
+        SurfaceBufferBytes * SurfaceFrontIndex;
+
+    for (int i = 0; i < box_count; ++i)
+    {
+        RECT rect;
+        rect.left = boxes[i].left;
+        rect.top = boxes[i].top;
+        rect.right = boxes[i].right;
+        rect.bottom = boxes[i].bottom;
+
+        CopyRectBGRA(
+            rect,
+            SurfaceStaging.GetMappedData(),
+            SurfaceStaging.GetMappedPitch(),
+            pixels,
+            SurfacePitch);
+    }
+
+    SurfaceStaging.Unmap(dc);
+
+    const UINT copy_flags = CopyFlagsForBoxes(boxes, box_count, (int32_t)SurfaceWidth, (int32_t)SurfaceHeight);
+
+    for (int i = 0; i < box_count; ++i)
+    {
+        const D3D11_BOX& box = boxes[i];
+
+        dc.Context->CopySubresourceRegion1(
+            VrRenderTexture.Get(),
+            0, // subresource 0
+            box.left, // X
+            box.top, // Y
+            0, // Z
+            SurfaceStaging.GetTexture(),
+            0, // subresource 0,
+            &box,
+            copy_flags);
+    }
+
+    SurfaceFrameNumber = frame_number;
+    FullCopyPending = false;
+    return true;
+}
+
+bool PluginServer::CopyTexture(bool full_copy)
 {
     //Logger.Info("CopyTexture");
 
+    // Clip dirty rects to the texture before taking the mutex.
+    // Partial copies are not supported for multisampled resources
+    D3D11_BOX boxes[XRM_PLUGIN_MAX_DIRTY_RECTS];
+    const int box_count = GatherCopyBoxes(
+        full_copy || HostData.SampleCount > 1,
+        PluginData.DirtyRectCount,
+        PluginData.DirtyRects,
+        PluginData.Width,
+        PluginData.Height,
+        boxes);
+
     HRESULT hr = KeyedMutex->AcquireSync(kKeyedMutex_Host, 0);
     if (FAILED(hr))
     {
         Logger.Error("AcquireSync failed: ", HresultString(hr));
+        // These dirty rects are lost, so copy everything next time
+        FullCopyPending = true;
         return false;
     }
+    FullCopyPending = false;
 
-    D3D11_BOX box;
-    box.left = 0;
-    box.right = PluginData.Width;
-    box.top = 0;
-    box.bottom = PluginData.Height;
-    box.front = 0;
-    box.back = 1;
-
-    Rendering->DeviceContext.Context->CopySubresourceRegion1(
-        VrRenderTexture.Get(),
-        0, // subresource 0
-        0, // X
-        0, // Y
-        0, // Z
-        SharedTexture.Get(),
-        0, // subresource 0,
-        &box,
-        D3D11_COPY_DISCARD);
+    const UINT copy_flags = CopyFlagsForBoxes(boxes, box_count, PluginData.Width, PluginData.Height);
+
+    for (int i = 0; i < box_count; ++i)
+    {
+        const D3D11_BOX& box = boxes[i];
+
+        Rendering->DeviceContext.Context->CopySubresourceRegion1(
+            VrRenderTexture.Get(),
+            0, // subresource 0
+            box.left, // X
+            box.top, // Y
+            0, // Z
+            SharedTexture.Get(),
+            0, // subresource 0,
+            &box,
+            copy_flags);
+    }
 
     // Release shared texture access
     hr = KeyedMutex->ReleaseSync(kKeyedMutex_Plugin);
@@ -772,17 +1139,23 @@ void PluginManager::Initialize(
     //--------------------------------------------------------------------------
     // Global shared memory file: Plugins
 
-    if (!PluginsSharedFile.Open(kXrmPluginsMemoryLayoutBytes, XRM_PLUGINS_SHARED_MEMORY_NAME)) {
-        Logger.Error("PluginsSharedFile.Open failed: ", WindowsErrorString(::GetLastError()));
-        PluginsSharedMemory = nullptr;
+    PluginsSharedMemory = OpenXrmPluginsSharedMemory(PluginsSharedFile);
+    if (!PluginsSharedMemory) {
+        Logger.Error("OpenXrmPluginsSharedMemory failed: ", LastIpcErrorString());
         return;
     }
 
     // TBD: Enable MSAA?
     const int sample_count = 1;
 
-    PluginsSharedMemory = reinterpret_cast<XrmPluginsMemoryLayout*>(PluginsSharedFile.GetFront());
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i) {
+    const int slot_count = (int)PluginsSharedMemory->SlotCount;
+    Logger.Info("Plugin directory has ", slot_count, " slots");
+
+    RenderModel->Plugins.clear();
+    RenderModel->Plugins.resize(slot_count);
+
+    PluginServers.resize(slot_count);
+    for (int i = 0; i < slot_count; ++i) {
         PluginServers[i] = std::make_unique<PluginServer>();
         PluginServers[i]->Initialize(
             i,
@@ -792,38 +1165,62 @@ void PluginManager::Initialize(
             model,
             kDupeMipLevels,
             sample_count);
+
+        // Read every slot once, since plugins may have written before we opened
+        PluginsSharedMemory->MarkPluginDirty(i);
     }
+    ActivePlugins = 0;
 }
 
 void PluginManager::Shutdown()
 {
     Logger.Info("PluginManager: Shutting down");
 
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i) {
-        if (PluginServers[i]) {
-            PluginServers[i]->Shutdown();
-            PluginServers[i].reset();
+    for (auto& server : PluginServers) {
+        if (server) {
+            server->Shutdown();
         }
     }
+    PluginServers.clear();
 
     PluginsSharedFile.Close();
+    PluginsSharedMemory = nullptr;
+    ActivePlugins = 0;
 
     CylinderRenderer.reset();
 }
 
 void PluginManager::Update()
 {
+    if (!PluginsSharedMemory) {
+        return;
+    }
+
+    // Only visit slots whose plugin wrote since last frame, plus slots that
+    // still need timeout and gaze handling
+    const uint64_t dirty = PluginsSharedMemory->DrainDirtyPlugins();
+    ActivePlugins |= dirty;
+
     bool selected_one = false;
 
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i)
+    for (uint64_t remaining = ActivePlugins; remaining != 0; remaining &= remaining - 1)
     {
+        const unsigned i = NonzeroTrailingZeros64(remaining);
+        const uint64_t bit = UINT64_C(1) << i;
+
         PluginServer* server = PluginServers[i].get();
         if (!server) {
+            ActivePlugins &= ~bit;
             continue;
         }
 
-        // If no updated occurred:
-        server->UpdateRenderModel();
+        // If an update occurred:
+        if (dirty & bit) {
+            server->UpdateRenderModel();
+        }
+
+        // CPU surfaces publish frames without ringing the doorbell
+        server->UpdateSurface();
 
         // Check for timeouts
         server->CheckTimeout();
@@ -839,14 +1236,20 @@ void PluginManager::Update()
             }
         }
         server->SetFocusAndGaze(RenderModel->GazeX, RenderModel->GazeY, gaze_active);
+
+        // Idle until a plugin claims the slot.  Focus was cleared above
+        if (!server->IsOwned() && !server->VrRenderTexture) {
+            ActivePlugins &= ~bit;
+        }
     }
 }
 
 void PluginManager::Render(const DirectX::SimpleMath::Matrix& view_projection_matrix)
 {
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i)
+    // Slots that are not active have no texture
+    for (uint64_t remaining = ActivePlugins; remaining != 0; remaining &= remaining - 1)
     {
-        PluginRenderInfo* info = &RenderModel->Plugins[i];
+        PluginRenderInfo* info = &RenderModel->Plugins[NonzeroTrailingZeros64(remaining)];
 
         if (!info->Texture) {
             continue;
@@ -860,9 +1263,8 @@ void PluginManager::Render(const DirectX::SimpleMath::Matrix& view_projection_ma
 
 void PluginManager::SolveDesktopPositions()
 {
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i)
+    for (auto& server : PluginServers)
     {
-        PluginServer* server = PluginServers[i].get();
         if (!server) {
             continue;
         }
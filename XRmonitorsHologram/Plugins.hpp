@@ -42,12 +42,23 @@ public:
         uint32_t sample_count);
     void Shutdown();
 
+    // Called when the plugin rang its doorbell.
     // Returns true if the texture should be rendered.
     // Returns false if the texture is hidden
     bool UpdateRenderModel();
 
+    // Reclaims the slot if the owner stops sending keep-alives
     void CheckTimeout();
 
+    // Upload the newest frame of a CPU surface, if any
+    void UpdateSurface();
+
+    // Is the slot claimed by a plugin process?
+    bool IsOwned() const
+    {
+        return XrmPluginOwnerProcessId(Owner) != 0;
+    }
+
     void UpdateMesh();
 
     bool HitTest(int screen_x, int screen_y);
@@ -70,10 +81,21 @@ protected:
 
     int PluginIndex = -1;
 
+    // Shared memory containing the doorbell and the slot directory
+    XrmPluginsMemoryLayout* SharedMemory = nullptr;
+    XrmPluginSlot* Slot = nullptr;
+
+    // Last owner word read from the slot
+    uint64_t Owner = 0;
+
     // Host -> Plugin
     XrmHostToPluginUpdater* HostToPlugin = nullptr;
     XrmHostToPluginData HostData{};
 
+    // Host -> Plugin input events
+    XrmPluginEventRing* Events = nullptr;
+    uint32_t DroppedEvents = 0;
+
     // Plugin -> Host
     XrmPluginToHostUpdater* PluginToHost = nullptr;
     XrmPluginToHostData PluginData{};
@@ -89,6 +111,27 @@ protected:
     // KeyedMutex acquired by VR code?
     bool MutexAcquired = false;
 
+    // VrRenderTexture is missing updates, so ignore the next dirty rects
+    bool FullCopyPending = true;
+
+    // CPU surface from external process, used instead of SharedTexture
+    SharedMemoryFile SurfaceFile;
+    XrmPluginSurfaceLayout* Surface = nullptr;
+
+    // Geometry validated when the surface was opened.  Only these are used
+    // to address the pixels, since the plugin can change PluginData
+    uint32_t SurfaceWidth = 0;
+    uint32_t SurfaceHeight = 0;
+    uint32_t SurfacePitch = 0;
+    uint32_t SurfaceBufferBytes = 0;
+
+    // Buffer owned by the host, and the frame number last uploaded from it
+    uint32_t SurfaceFrontIndex = 2;
+    uint32_t SurfaceFrameNumber = 0;
+
+    // CPU-writable staging texture for uploads
+    StagingTexture SurfaceStaging;
+
     // Cylinder geometry for each monitor
     std::vector<DirectX::VertexPositionTexture> Vertices;
     ComPtr<ID3D11Buffer> VertexBuffer;
@@ -103,15 +146,28 @@ protected:
     HostToPluginEvent UpdateEvent;
 
 
-    bool CopyTexture();
+    // Copy the dirty rects, or the whole texture if full_copy is set
+    bool CopyTexture(bool full_copy);
 
     bool UpdateSharedTexture();
 
+    bool OpenSurface();
+
+    bool UploadSurface();
+
+    // BGRA for CPU surfaces, otherwise the swapchain format
+    DXGI_FORMAT GetVrTextureFormat() const;
+
     bool UpdateVrTexture();
 
     void ReleaseRemoteTexture();
 
     void SignalTerminate();
+
+    // Queue an input event and ring the doorbell if the plugin is asleep
+    void PushEvent(uint32_t type, int x = 0, int y = 0);
+
+    void OnOwnerChanged(uint64_t owner);
 };
 
 
@@ -171,8 +227,13 @@ protected:
     SharedMemoryFile PluginsSharedFile;
     XrmPluginsMemoryLayout* PluginsSharedMemory = nullptr;
 
-    // Texture and mesh for each plugin
-    std::unique_ptr<PluginServer> PluginServers[XRM_PLUGIN_COUNT];
+    // Texture and mesh for each slot in the plugin directory
+    std::vector<std::unique_ptr<PluginServer>> PluginServers;
+
+    // Bit i is set while PluginServers[i] has a plugin attached.
+    // Slots join when their doorbell rings and leave once they are
+    // unclaimed and have no texture, so per-frame work is O(active)
+    uint64_t ActivePlugins = 0;
 
     // Renderer for all the plugins
     std::unique_ptr<PluginCylinderRenderer> CylinderRenderer;
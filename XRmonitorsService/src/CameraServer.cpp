@@ -123,20 +123,6 @@ static bool FileExists(const std::string& name)
     return (stat(name.c_str(), &buffer) == 0);
 }
 
-static HANDLE CreateGlobalFrameEvent(const char* event_name)
-{
-    std::vector<uint8_t> desc(SECURITY_DESCRIPTOR_MIN_LENGTH);
-    SECURITY_ATTRIBUTES sa;
-    sa.lpSecurityDescriptor = (PSECURITY_DESCRIPTOR)desc.data();
-    InitializeSecurityDescriptor(sa.lpSecurityDescriptor, SECURITY_DESCRIPTOR_REVISION);
-    // ACL is set as NULL in order to allow all access to the object.
-    SetSecurityDescriptorDacl(sa.lpSecurityDescriptor, TRUE, NULL, FALSE);
-    sa.nLength = sizeof(sa);
-    sa.bInheritHandle = FALSE;
-
-    return ::CreateEventA(&sa, FALSE, FALSE, event_name);
-}
-
 
 //------------------------------------------------------------------------------
 // Find Process ID
@@ -215,9 +201,8 @@ static bool FindMrUsbHostProcesses(std::vector<uint32_t>& pids)
 
 bool CameraServer::Start()
 {
-    FrameEvent = CreateGlobalFrameEvent(CAMERA_IMPLANT_FRAME_EVENT_NAME);
-    if (FrameEvent.Invalid()) {
-        Logger.Error("CreateGlobalFrameEvent failed: ", WindowsErrorString(::GetLastError()));
+    if (!FrameEvent.Create(CAMERA_IMPLANT_FRAME_EVENT_NAME)) {
+        Logger.Error("FrameEvent.Create failed: ", LastIpcErrorString());
         return false;
     }
 
@@ -225,7 +210,7 @@ bool CameraServer::Start()
     // Global shared memory file: Implant
 
     if (!ImplantSharedFile.Create(kImplantSharedMemoryBytes, CAMERA_IMPLANT_SHARED_MEMORY_NAME)) {
-        Logger.Error("ImplantSharedFile.Create failed: ", WindowsErrorString(::GetLastError()));
+        Logger.Error("ImplantSharedFile.Create failed: ", LastIpcErrorString());
         return false;
     }
     ImplantSharedMemory = reinterpret_cast<ImplantSharedMemoryLayout*>(ImplantSharedFile.GetFront());
@@ -235,7 +220,7 @@ bool CameraServer::Start()
     // Global shared memory file: UI
 
     if (!UiSharedFile.Create(kXrmUiSharedMemoryBytes, XRM_UI_SHARED_MEMORY_NAME)) {
-        Logger.Error("UiSharedFile.Create failed: ", WindowsErrorString(::GetLastError()));
+        Logger.Error("UiSharedFile.Create failed: ", LastIpcErrorString());
         return false;
     }
     UiSharedMemory = reinterpret_cast<XrmUiSharedMemoryLayout*>(UiSharedFile.GetFront());
@@ -247,26 +232,30 @@ bool CameraServer::Start()
     //--------------------------------------------------------------------------
     // Global shared memory file: Plugins
 
-    if (!PluginsSharedFile.Create(kXrmPluginsMemoryLayoutBytes, XRM_PLUGINS_SHARED_MEMORY_NAME)) {
-        Logger.Error("PluginsSharedFile.Create failed: ", WindowsErrorString(::GetLastError()));
+    const uint32_t plugin_slot_count = XRM_PLUGIN_DEFAULT_SLOTS;
+    const uint32_t plugins_bytes = XrmPluginsLayoutBytes(plugin_slot_count);
+
+    if (!PluginsSharedFile.Create(plugins_bytes, XRM_PLUGINS_SHARED_MEMORY_NAME)) {
+        Logger.Error("PluginsSharedFile.Create failed: ", LastIpcErrorString());
         return false;
     }
     PluginsSharedMemory = reinterpret_cast<XrmPluginsMemoryLayout*>(PluginsSharedFile.GetFront());
-    memset(PluginsSharedMemory, 0, kXrmPluginsMemoryLayoutBytes);
+    memset(PluginsSharedMemory, 0, plugins_bytes);
+    PluginsSharedMemory->InitializeDirectory(plugin_slot_count);
 
     //--------------------------------------------------------------------------
     // Global events triggered by host indicating the plugin has data to read
 
-    for (int i = 0; i < XRM_PLUGIN_COUNT; ++i)
+    HostToPluginEvents.reset(new IpcEvent[plugin_slot_count]);
+
+    for (int i = 0; i < (int)plugin_slot_count; ++i)
     {
         std::string event_name = XRM_PLUGINS_S2C_EVENT_PREFIX;
         event_name += std::to_string(i);
 
-        HostToPluginEvents[i] = CreateGlobalFrameEvent(event_name.c_str());
-
-        if (HostToPluginEvents[i].Invalid())
+        if (!HostToPluginEvents[i].Create(event_name))
         {
-            Logger.Error("HostToPluginEvents CreateEventA failed: ", WindowsErrorString(::GetLastError()), " for plugin ", i);
+            Logger.Error("HostToPluginEvents Create failed: ", LastIpcErrorString(), " for plugin ", i);
             return false;
         }
     }
@@ -397,7 +386,7 @@ void CameraServer::InjectPid(uint32_t pid)
     ImplantSharedMemory->ImplantRemoveFail = 0;
     ImplantSharedMemory->ImplantRemoveGood = 0;
     ImplantSharedMemory->RemoveServiceHook = 0;
-    ::ResetEvent(FrameEvent.Get());
+    FrameEvent.Reset();
 
     int remote_load_result = RemoteLoadLibrary(
         RemoteProcess.Get(),
@@ -40,10 +40,11 @@ protected:
     XrmPluginsMemoryLayout* PluginsSharedMemory = nullptr;
 
     // Global events triggered by host indicating the plugin has data to read
-    AutoEvent HostToPluginEvents[XRM_PLUGIN_COUNT];
+    // One for each slot in the plugin directory
+    std::unique_ptr<IpcEvent[]> HostToPluginEvents;
 
     // Global event set from implant to wake up listeners for frames
-    AutoEvent FrameEvent;
+    IpcEvent FrameEvent;
 
     // Last epoch for USB hub power fix
     uint32_t EpochUsbHubPower = 0;
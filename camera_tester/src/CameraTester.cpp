@@ -1,33 +1,293 @@
 #include "CameraClient.hpp"
+#include "CameraRecording.hpp"
+#include "CameraImplantHost.hpp"
+#include "CameraKernels.hpp"
+#include "CameraLatency.hpp"
+#include "CameraTesterReport.hpp"
 #include "core_logger.hpp"
 
 #include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
 using namespace std;
 
 using namespace core;
 
 static logger::Channel Logger("CameraTester");
 
+/*
+	Usage:
+		camera_tester [options]                        Watch the live camera
+		camera_tester [options] record <file>          Record the live camera
+		camera_tester [options] replay <file> [speed]  Replay a recording
+		camera_tester [options] synthetic [rate_hz] [payload_bytes] [jitter_usec]
+		                                               Publish generated frames
+
+	Options:
+		--seconds=<n>  Stop after n seconds, instead of on a key press or at
+		               the end of a replay
+		--report=<n>   Seconds between reports.  Default 10, 0 = final only
+
+	Speed 1 replays with the original timing, and 0 as fast as possible.
+	Synthetic rate 0 publishes as fast as possible.
+
+	Reports are printed as JSON lines, described in CameraTesterReport.hpp.
+*/
+
+static void PrintUsage()
+{
+	Logger.Info("Usage: camera_tester [--seconds=<n>] [--report=<n>] "
+		"[record <file> | replay <file> [speed] | synthetic [rate_hz] [payload_bytes] [jitter_usec]]");
+}
+
+
+//------------------------------------------------------------------------------
+// Tester
+
+struct TesterContext
+{
+	string Mode;
+	CameraClient Client;
+	CameraReplayServer Replay;
+	CameraSyntheticServer Synthetic;
+
+	std::atomic<bool> Stop = ATOMIC_VAR_INIT(false);
+	uint64_t ReportUsec = 0;
+
+	// Owned by the poller thread until it is joined
+	FrameStats Window;
+	FrameStats Total;
+};
+
+// Read the counters published by a running renderer, if there is one
+static bool ReadRendererLatency(CameraLatencyCounters& counters)
+{
+	SharedMemoryFile file;
+	if (!file.Open(kCameraLatencySharedMemoryBytes, CAMERA_LATENCY_SHARED_MEMORY_NAME)) {
+		return false;
+	}
+	const CameraLatencySharedMemoryLayout* layout =
+		reinterpret_cast<const CameraLatencySharedMemoryLayout*>(file.GetFront());
+
+	uint32_t epoch = 0;
+	return layout->Read(epoch, counters);
+}
+
+static void PrintReport(TesterContext& ctx, const char* type, const FrameStats& stats, uint64_t now_usec)
+{
+	TesterCounters counters;
+	counters.Client = ctx.Client.GetStats();
+
+	if (ctx.Mode == "replay") {
+		counters.HasServer = true;
+		counters.Published = ctx.Replay.GetFramesPublished();
+	}
+	else if (ctx.Mode == "synthetic") {
+		counters.HasServer = true;
+		counters.HasSynthetic = true;
+		counters.Synthetic = ctx.Synthetic.GetStats();
+		counters.Published = counters.Synthetic.Published;
+	}
+
+	counters.HasRenderer = ReadRendererLatency(counters.Renderer);
+
+	cout << FormatTesterReport(type, ctx.Mode, stats, counters, now_usec) << endl;
+}
+
+// Acquire frames until stopped, as the hologram app would
+static void PollFrames(TesterContext& ctx)
+{
+	const unsigned eye_width = 640;
+	const unsigned height = 480;
+	vector<uint8_t> planes_buffer(eye_width * height * 2);
+
+	CameraEyePlanes planes;
+	planes.Left = planes_buffer.data();
+	planes.LeftPitch = eye_width;
+	planes.Right = planes_buffer.data() + eye_width * height;
+	planes.RightPitch = eye_width;
+
+	uint64_t last_acquire_usec = 0;
+	ctx.Window.Reset(GetTimeUsec());
+	ctx.Total.Reset(ctx.Window.StartUsec);
+
+	while (!ctx.Stop)
+	{
+		const uint64_t now_usec = GetTimeUsec();
+		if (ctx.ReportUsec > 0 && now_usec - ctx.Window.StartUsec >= ctx.ReportUsec) {
+			PrintReport(ctx, "window", ctx.Window, now_usec);
+			ctx.Total.Merge(ctx.Window);
+			ctx.Window.Reset(now_usec);
+		}
+
+		CameraFrame frame;
+		if (!ctx.Client.AcquireNextFrame(frame))
+		{
+			// Short sleeps keep the measured latency close to the real one
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+
+		const uint64_t acquire_usec = GetTimeUsec();
+		ctx.Window.Latency.Add(acquire_usec > frame.ReceiveTimeUsec ? acquire_usec - frame.ReceiveTimeUsec : 0);
+		if (last_acquire_usec != 0) {
+			ctx.Window.Interval.Add(acquire_usec - last_acquire_usec);
+		}
+		last_acquire_usec = acquire_usec;
+
+		const bool copied = StripTagsAndSplitEyes(
+			frame.Buffer,
+			frame.BufferBytes,
+			eye_width,
+			height,
+			planes);
+		ctx.Window.Copy.Add(GetTimeUsec() - acquire_usec);
+
+		ctx.Client.ReleaseFrame();
+
+		if (!copied) {
+			Logger.Warning("Camera transfer is truncated");
+		}
+	}
+
+	ctx.Total.Merge(ctx.Window);
+}
+
+// Strip "--name=value" options from args.  Returns false on an unknown option
+static bool ParseOptions(vector<string>& args, uint64_t& seconds, uint64_t& report_seconds)
+{
+	vector<string> positional;
+	for (const string& arg : args)
+	{
+		if (arg.compare(0, 2, "--") != 0) {
+			positional.push_back(arg);
+			continue;
+		}
+		const size_t equals = arg.find('=');
+		if (equals == string::npos) {
+			return false;
+		}
+		const string name = arg.substr(2, equals - 2);
+		const uint64_t value = strtoull(arg.c_str() + equals + 1, nullptr, 10);
+		if (name == "seconds") {
+			seconds = value;
+		}
+		else if (name == "report") {
+			report_seconds = value;
+		}
+		else {
+			return false;
+		}
+	}
+	args = positional;
+	return true;
+}
+
 int main(int argc, const char* argv[])
 {
-	(void)argc;
-	(void)argv;
+	vector<string> args(argv + 1, argv + argc);
+	uint64_t seconds = 0;
+	uint64_t report_seconds = 10;
+	if (!ParseOptions(args, seconds, report_seconds)) {
+		PrintUsage();
+		return -1;
+	}
+
+	TesterContext ctx;
+	ctx.Mode = !args.empty() ? args[0] : "";
+	ctx.ReportUsec = report_seconds * 1000000;
+
+	const string& mode = ctx.Mode;
+	if (!mode.empty() && mode != "record" && mode != "replay" && mode != "synthetic") {
+		PrintUsage();
+		return -1;
+	}
+	if ((mode == "record" || mode == "replay") && args.size() < 2) {
+		PrintUsage();
+		return -1;
+	}
 
 	Logger.Info("Starting");
 
-	CameraClient client;
+	if (mode == "replay")
+	{
+		const double speed = args.size() >= 3 ? atof(args[2].c_str()) : 1.;
+		if (!ctx.Replay.Start(args[1], speed, false)) {
+			Logger.Error("Failed to start replay");
+			return -1;
+		}
+	}
+	else if (mode == "synthetic")
+	{
+		CameraSyntheticParams params;
+		if (args.size() >= 2) {
+			params.RateHz = atof(args[1].c_str());
+		}
+		if (args.size() >= 3) {
+			params.PayloadBytes = (unsigned)strtoul(args[2].c_str(), nullptr, 10);
+		}
+		if (args.size() >= 4) {
+			params.JitterUsec = (unsigned)strtoul(args[3].c_str(), nullptr, 10);
+		}
+		if (!ctx.Synthetic.Start(params)) {
+			Logger.Error("Failed to start synthetic frames");
+			return -1;
+		}
+	}
 
-	if (!client.Start()) {
+	if (!ctx.Client.Start()) {
 		Logger.Error("Failed to start");
 		return -1;
 	}
 
-	Logger.Info("Press any key to stop");
-	string pause;
-	cin >> pause;
+	if (mode == "record" && !ctx.Client.StartRecording(args[1])) {
+		Logger.Error("Failed to start recording");
+		ctx.Client.Stop();
+		return -1;
+	}
+
+	std::thread poller(PollFrames, std::ref(ctx));
+
+	if (seconds > 0)
+	{
+		Logger.Info("Running for ", seconds, " seconds");
+		const uint64_t end_usec = GetTimeUsec() + seconds * 1000000;
+		while (GetTimeUsec() < end_usec && !(mode == "replay" && ctx.Replay.IsFinished())) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	else if (mode == "replay")
+	{
+		Logger.Info("Replaying until the end of the file");
+		while (!ctx.Replay.IsFinished()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	else
+	{
+		Logger.Info("Press any key to stop");
+		string pause;
+		cin >> pause;
+	}
+
+	if (mode == "replay") {
+		// Let the client pick up the last frame
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	ctx.Stop = true;
+	poller.join();
+
+	PrintReport(ctx, "final", ctx.Total, GetTimeUsec());
 
 	Logger.Info("Stopping");
-	client.Stop();
+	ctx.Client.Stop();
+	ctx.Replay.Stop();
+	ctx.Synthetic.Stop();
 
 	Logger.Info("Terminated");
 	return 0;
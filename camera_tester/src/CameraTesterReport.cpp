@@ -0,0 +1,157 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraTesterReport.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// UsecHistogram
+
+UsecHistogram::UsecHistogram()
+	: Bins(kMaxUsec + 1, 0)
+{
+}
+
+void UsecHistogram::Add(uint64_t usec)
+{
+	if (Max < usec) {
+		Max = usec;
+	}
+	++Bins[usec < kMaxUsec ? (unsigned)usec : kMaxUsec];
+	++Count;
+}
+
+void UsecHistogram::Merge(const UsecHistogram& other)
+{
+	for (unsigned i = 0; i <= kMaxUsec; ++i) {
+		Bins[i] += other.Bins[i];
+	}
+	Count += other.Count;
+	if (Max < other.Max) {
+		Max = other.Max;
+	}
+}
+
+void UsecHistogram::Reset()
+{
+	std::fill(Bins.begin(), Bins.end(), 0);
+	Count = 0;
+	Max = 0;
+}
+
+uint64_t UsecHistogram::GetPercentile(double percent) const
+{
+	if (Count == 0) {
+		return 0;
+	}
+	uint64_t target = (uint64_t)(Count * percent / 100.);
+	if (target >= Count) {
+		target = Count - 1;
+	}
+	uint64_t seen = 0;
+	for (unsigned i = 0; i <= kMaxUsec; ++i) {
+		seen += Bins[i];
+		if (seen > target) {
+			return i;
+		}
+	}
+	return kMaxUsec;
+}
+
+std::string UsecHistogram::ToJson() const
+{
+	std::ostringstream oss;
+	oss << "{\"p50\":" << GetPercentile(50.)
+		<< ",\"p90\":" << GetPercentile(90.)
+		<< ",\"p99\":" << GetPercentile(99.)
+		<< ",\"p999\":" << GetPercentile(99.9)
+		<< ",\"max\":" << Max << "}";
+	return oss.str();
+}
+
+
+//------------------------------------------------------------------------------
+// FrameStats
+
+void FrameStats::Reset(uint64_t now_usec)
+{
+	Interval.Reset();
+	Latency.Reset();
+	Copy.Reset();
+	StartUsec = now_usec;
+}
+
+void FrameStats::Merge(const FrameStats& other)
+{
+	Interval.Merge(other.Interval);
+	Latency.Merge(other.Latency);
+	Copy.Merge(other.Copy);
+}
+
+
+//------------------------------------------------------------------------------
+// Report
+
+static void AppendRendererLatency(std::ostringstream& oss, const CameraLatencyCounters& counters)
+{
+	oss << ",\"renderer_frames\":" << counters.Frames
+		<< ",\"renderer_latency_usec\":{";
+	for (unsigned i = 0; i < kCameraLatencyIntervalCount; ++i)
+	{
+		const CameraLatencyHistogram& histogram = counters.Intervals[i];
+		oss << (i > 0 ? "," : "") << "\"" << CameraLatencyIntervalName(i) << "\":{"
+			<< "\"p50\":" << histogram.GetPercentileUsec(50)
+			<< ",\"p99\":" << histogram.GetPercentileUsec(99)
+			<< ",\"avg\":" << histogram.GetAverageUsec()
+			<< ",\"max\":" << histogram.MaxUsec << "}";
+	}
+	oss << "}";
+}
+
+std::string FormatTesterReport(
+	const char* type,
+	const std::string& mode,
+	const FrameStats& stats,
+	const TesterCounters& counters,
+	uint64_t now_usec)
+{
+	const uint64_t frames = stats.Latency.GetCount();
+	const double elapsed_sec = (now_usec - stats.StartUsec) / 1000000.;
+
+	std::ostringstream oss;
+	oss << "{\"type\":\"" << type << "\""
+		<< ",\"mode\":\"" << (mode.empty() ? "live" : mode) << "\""
+		<< ",\"elapsed_sec\":" << elapsed_sec
+		<< ",\"frames\":" << frames
+		<< ",\"fps\":" << (elapsed_sec > 0. ? frames / elapsed_sec : 0.)
+		<< ",\"interval_usec\":" << stats.Interval.ToJson()
+		<< ",\"latency_usec\":" << stats.Latency.ToJson()
+		<< ",\"copy_usec\":" << stats.Copy.ToJson()
+		<< ",\"skipped_total\":" << counters.Client.Skipped
+		<< ",\"acquire_retries_total\":" << counters.Client.AcquireRetries
+		<< ",\"implant_dropped_total\":" << counters.Client.ImplantDropped;
+
+	if (counters.HasServer) {
+		oss << ",\"published_total\":" << counters.Published;
+	}
+	if (counters.HasSynthetic)
+	{
+		const CameraSyntheticStats& synthetic = counters.Synthetic;
+		const uint64_t writes = synthetic.Published + synthetic.Dropped;
+		oss << ",\"write_usec_avg\":" << (writes > 0 ? synthetic.WriteUsecTotal / writes : 0)
+			<< ",\"write_usec_max\":" << synthetic.WriteUsecMax;
+	}
+	if (counters.HasRenderer) {
+		AppendRendererLatency(oss, counters.Renderer);
+	}
+
+	oss << "}";
+	return oss.str();
+}
+
+
+} // namespace core
@@ -0,0 +1,119 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+	Statistics kept by camera_tester and the JSON reports it prints.
+
+	Reports go to stdout as one JSON object per line, so they can be picked
+	out of the log by their leading '{'.  "window" reports cover the time
+	since the previous report and the "final" report the whole run.
+	Fields ending in _total count since the start instead.  Fields:
+
+		frames, fps          Frames acquired
+		interval_usec        Time between acquired frames
+		latency_usec         Implant write to client acquire
+		copy_usec            Tag strip and eye split of the acquired frame
+		skipped_total        Frames replaced before the client saw them
+		acquire_retries_total
+		                     Frames replaced while the client pinned them
+		implant_dropped_total
+		                     Frames dropped because every slot was pinned
+		published_total      Frames published by the replay/synthetic server
+		write_usec_avg/max   Synthetic implant-side copy time, since the start
+		renderer_frames      Frames the running renderer has timed
+		renderer_latency_usec
+		                     Renderer per-stage latency since it started,
+		                     by the stage each interval ends at
+*/
+
+#pragma once
+
+#include "CameraClient.hpp"
+#include "CameraImplantHost.hpp"
+#include "CameraLatency.hpp"
+
+#include <string>
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// UsecHistogram
+
+/// Exact percentiles for microsecond samples up to kMaxUsec
+class UsecHistogram
+{
+public:
+	static const unsigned kMaxUsec = 100 * 1000;
+
+	UsecHistogram();
+
+	void Add(uint64_t usec);
+	void Merge(const UsecHistogram& other);
+	void Reset();
+
+	// Samples over kMaxUsec count as kMaxUsec
+	uint64_t GetPercentile(double percent) const;
+
+	uint64_t GetCount() const
+	{
+		return Count;
+	}
+
+	// {"p50":..,"p90":..,"p99":..,"p999":..,"max":..}
+	std::string ToJson() const;
+
+protected:
+	std::vector<uint64_t> Bins;
+	uint64_t Count = 0;
+	uint64_t Max = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// FrameStats
+
+struct FrameStats
+{
+	UsecHistogram Interval;
+	UsecHistogram Latency;
+	UsecHistogram Copy;
+	uint64_t StartUsec = 0;
+
+	void Reset(uint64_t now_usec);
+	void Merge(const FrameStats& other);
+};
+
+
+//------------------------------------------------------------------------------
+// Report
+
+/// Counters read when a report is printed
+struct TesterCounters
+{
+	CameraClientStats Client;
+
+	// Set for "replay" and "synthetic" modes
+	bool HasServer = false;
+	uint64_t Published = 0;
+
+	// Set for "synthetic" mode
+	bool HasSynthetic = false;
+	CameraSyntheticStats Synthetic;
+
+	// Set if a renderer is publishing its latency counters
+	bool HasRenderer = false;
+	CameraLatencyCounters Renderer;
+};
+
+/// Format one report line, without the newline.
+/// type: "window" or "final"
+std::string FormatTesterReport(
+	const char* type,
+	const std::string& mode,
+	const FrameStats& stats,
+	const TesterCounters& counters,
+	uint64_t now_usec);
+
+
+} // namespace core
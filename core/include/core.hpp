@@ -165,6 +165,16 @@ bool IsAlreadyRunning(const std::string& name);
 void SetCurrentThreadName(const char* name);
 
 
+//------------------------------------------------------------------------------
+// SIMD-Safe Aligned Memory Allocations
+
+/// Allocate zeroed memory aligned to 32 bytes.  Free with SIMDSafeFree()
+uint8_t* SIMDSafeAllocate(size_t size);
+
+/// Free memory from SIMDSafeAllocate().  Accepts nullptr
+void SIMDSafeFree(void* ptr);
+
+
 //------------------------------------------------------------------------------
 // Shared Pointers
 
@@ -54,6 +54,21 @@ CORE_INLINE unsigned NonzeroLowestBitIndex(uint32_t x)
 #endif
 }
 
+/// Returns number of zero bits below the lowest set bit
+/// Precondition: x != 0
+CORE_INLINE unsigned NonzeroTrailingZeros64(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    // Note: Ignoring result because x != 0
+    _BitScanForward64(&index, x);
+    return (unsigned)index;
+#else
+    // Note: Ignoring return value of 0 because x != 0
+    return (unsigned)__builtin_ctzll(x);
+#endif
+}
+
 
 //------------------------------------------------------------------------------
 // Integer Hash Functions
@@ -72,5 +87,17 @@ CORE_INLINE uint32_t wellons_triple32(uint32_t x)
     return x;
 }
 
+// 64-bit integer hash
+// Stafford's Mix13 variant of the SplitMix64 finalizer
+CORE_INLINE uint64_t stafford_mix13(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return x;
+}
+
 
 } // namespace core
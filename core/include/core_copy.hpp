@@ -0,0 +1,206 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Runtime-dispatched 2D memory copies.
+
+    CopyPlane2D() copies a block of rows between two pitched surfaces, for
+    example a dirty rect from a mapped desktop texture into a staging
+    texture.  Pointers and pitches may have any alignment: The vector
+    kernels use unaligned loads and align only the destination stores.
+
+    Large copies use non-temporal stores so they do not evict the rest of
+    the working set from the cache, and small copies use regular stores so
+    the data is still cached for the next reader.  The switch happens when
+    the copy is a fraction of the last level cache.
+
+    MovePlane2D() moves a block within one surface, for example a scrolled
+    region, where the source and destination may overlap.
+
+    CopyScheduler splits copies that would take too long on one thread into
+    row bands that run on a persistent WorkerPool.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_parallel.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Used when the last level cache size cannot be detected
+static const uint64_t kCopyDefaultCacheBytes = 8 * 1024 * 1024;
+
+// Copies larger than 1/N of the last level cache use non-temporal stores
+static const unsigned kCopyNonTemporalCacheDivisor = 2;
+
+// Rows shorter than this always use regular stores, since a partially
+// written line in the write-combining buffer is flushed as a slow partial
+// write
+static const unsigned kCopyNonTemporalMinRowBytes = 256;
+
+// Copies smaller than this always run inline, since waking the workers
+// takes longer than the copy
+static const uint64_t kCopyParallelMinBytes = 256 * 1024;
+
+// Bytes per row band of a parallel copy: About a core's share of L2
+static const unsigned kCopyBandBytes = 256 * 1024;
+
+// Copies estimated to take longer than this on one thread are split
+static const unsigned kCopyDefaultLatencyTargetUsec = 500;
+
+// Single thread copy rate assumed until one is measured: 4 GB/s
+static const uint64_t kCopyInitialBytesPerUsec = 4000;
+
+// Inline copies at least this large update the measured copy rate
+static const uint64_t kCopyMeasureMinBytes = 64 * 1024;
+
+
+//------------------------------------------------------------------------------
+// CopyKernelPath
+
+enum class CopyKernelPath
+{
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON
+};
+
+/// Returns the path that Auto resolves to on this CPU
+CopyKernelPath GetBestCopyKernelPath();
+
+/// Returns false if the path cannot run on this CPU
+bool IsCopyKernelPathSupported(CopyKernelPath path);
+
+const char* CopyKernelPathToString(CopyKernelPath path);
+
+
+//------------------------------------------------------------------------------
+// CopyStores
+
+enum class CopyStores
+{
+    // Pick by copy size against the last level cache
+    Auto,
+
+    // Regular stores that leave the destination in the cache
+    Temporal,
+
+    // Streaming stores that bypass the cache.  Ignored on NEON
+    NonTemporal
+};
+
+/// Returns the stores that Auto resolves to for a copy of this size
+CopyStores GetBestCopyStores(unsigned row_bytes, unsigned rows);
+
+const char* CopyStoresToString(CopyStores stores);
+
+
+//------------------------------------------------------------------------------
+// CopyPlane2D
+
+/**
+    Copy `rows` rows of `row_bytes` bytes each from src to dest.
+
+    The source and destination must not overlap.
+
+    Returns false if the path cannot run on this CPU.
+*/
+bool CopyPlane2D(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    CopyKernelPath path = CopyKernelPath::Auto,
+    CopyStores stores = CopyStores::Auto);
+
+
+//------------------------------------------------------------------------------
+// MovePlane2D
+
+/**
+    Move `rows` rows of `row_bytes` bytes each from src to dest within one
+    surface with the given pitch.  The source and destination may overlap:
+    The result is as if the source were copied to a temporary first.
+
+    Rows must not be longer than the pitch.
+
+    Returns false if the path cannot run on this CPU.
+*/
+bool MovePlane2D(
+    uint8_t* dest,
+    const uint8_t* src,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    CopyKernelPath path = CopyKernelPath::Auto);
+
+
+//------------------------------------------------------------------------------
+// CopyScheduler
+
+/**
+    Runs large copies as row bands across a worker pool.
+
+    A copy runs inline when it is small, or when the measured single thread
+    copy rate says it will finish within the latency target.  Otherwise it
+    is split into bands of about kCopyBandBytes, with at least one band per
+    thread, so every thread copies cache-sized pieces.
+
+    Not thread-safe: Copies are submitted from one thread at a time.
+*/
+class CopyScheduler : NoCopy
+{
+public:
+    /// Start worker_count threads in addition to the caller.
+    /// 0 = one less than the number of hardware threads
+    void Start(unsigned worker_count = 0);
+    void Stop();
+
+    /// Copies that take longer than this on one thread are split
+    void SetLatencyTargetUsec(unsigned usec)
+    {
+        LatencyTargetUsec = usec;
+    }
+
+    /// Number of threads that run bands, including the caller
+    unsigned GetThreadCount() const
+    {
+        return Pool.GetThreadCount();
+    }
+
+    /// Measured single thread copy rate
+    uint64_t GetBytesPerUsec() const
+    {
+        return BytesPerUsec;
+    }
+
+    /// Same as core::CopyPlane2D(), but may run in parallel
+    bool CopyPlane2D(
+        uint8_t* dest,
+        unsigned dest_pitch,
+        const uint8_t* src,
+        unsigned src_pitch,
+        unsigned row_bytes,
+        unsigned rows,
+        CopyKernelPath path = CopyKernelPath::Auto,
+        CopyStores stores = CopyStores::Auto);
+
+protected:
+    WorkerPool Pool;
+
+    unsigned LatencyTargetUsec = kCopyDefaultLatencyTargetUsec;
+
+    // Moving average of inline copy rates
+    uint64_t BytesPerUsec = kCopyInitialBytesPerUsec;
+};
+
+
+} // namespace core
@@ -0,0 +1,58 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    CPU feature detection for runtime-dispatched kernels.
+
+    Kernels are compiled for every instruction set the compiler can target
+    and the fastest one this CPU supports is picked at runtime.  On GCC and
+    Clang, functions that use AVX2 must be marked CORE_TARGET_AVX2 so they
+    can be built without raising the baseline for the whole file.
+*/
+
+#pragma once
+
+#include "core.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Architecture Macros
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define CORE_CPU_X86
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+    #define CORE_CPU_ARM64
+#endif
+
+#if defined(CORE_CPU_X86) && !defined(_MSC_VER)
+    #define CORE_TARGET_AVX2 __attribute__((target("avx2")))
+    #define CORE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+    #define CORE_TARGET_AVX2
+    #define CORE_TARGET_SSSE3
+#endif
+
+
+//------------------------------------------------------------------------------
+// CpuFeatures
+
+struct CpuFeatures
+{
+    bool SSE2 = false;
+    bool SSSE3 = false;
+    bool SSE41 = false;
+    bool AVX2 = false;
+    bool NEON = false;
+
+    // Size of the largest data cache, or 0 if it could not be detected
+    uint64_t LastLevelCacheBytes = 0;
+};
+
+/// Detected once on first call.  Thread-safe
+const CpuFeatures& GetCpuFeatures();
+
+
+} // namespace core
@@ -0,0 +1,197 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Mouse cursor decoding and compositing.
+
+    Desktop duplication reports the cursor as a shape in one of three
+    formats, documented here:
+    https://docs.microsoft.com/en-us/windows/desktop/api/dxgi1_2/ne-dxgi1_2-dxgi_outdupl_pointer_shape_type
+
+    DecodedCursor converts any of them into one AND and one XOR mask per
+    pixel, so every format composites with the same kernel:
+
+        out = (screen & and) ^ xor
+
+    Color cursors can instead be alpha blended over the screen.
+
+    The shape only changes when the cursor changes, but the cursor is
+    composited on every pointer move, so CursorCache keeps the decoded
+    shapes and compositing does no per-pixel decoding.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_copy.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Number of decoded shapes kept by CursorCache.
+// Applications switch between a handful of cursors
+static const unsigned kCursorCacheMaxEntries = 16;
+
+// Shapes larger than this are rejected as invalid
+static const unsigned kCursorMaxDimension = 1024;
+
+
+//------------------------------------------------------------------------------
+// CursorShape
+
+enum class CursorShapeType
+{
+    // 1 bpp AND mask followed by a 1 bpp XOR mask
+    Monochrome,
+
+    // 32 bpp BGRA with alpha
+    Color,
+
+    // 32 bpp BGRA where alpha 0 replaces the screen and 0xFF XORs with it
+    MaskedColor
+};
+
+enum class CursorAlpha
+{
+    // Color pixels with alpha >= 0x80 replace the screen and others are
+    // transparent.  This is exact for the masks Windows generates
+    Threshold,
+
+    // Color pixels are blended over the screen by their alpha
+    Blend
+};
+
+/// Shape as reported by GetFramePointerShape()
+struct CursorShape
+{
+    CursorShapeType Type = CursorShapeType::Color;
+
+    // Height is doubled for Monochrome, which stacks the two masks
+    unsigned Width = 0, Height = 0;
+
+    // Bytes between rows
+    unsigned Pitch = 0;
+
+    const uint8_t* Data = nullptr;
+    unsigned Bytes = 0;
+
+
+    /// Height of the cursor image
+    unsigned ImageHeight() const
+    {
+        return Type == CursorShapeType::Monochrome ? Height / 2 : Height;
+    }
+
+    /// Bytes of Data the shape covers
+    uint64_t GetRequiredBytes() const;
+
+    /// Returns false if the data is too small for the dimensions
+    bool IsValid() const;
+};
+
+
+//------------------------------------------------------------------------------
+// DecodedCursor
+
+class DecodedCursor
+{
+public:
+    unsigned Width = 0, Height = 0;
+
+    // If set, XorMask holds colors that are blended over the screen by
+    // their alpha, and AndMask is unused
+    bool Blend = false;
+
+    // One entry per pixel, row by row without padding
+    std::vector<uint32_t> AndMask, XorMask;
+
+
+    /// Returns false if the shape is invalid
+    bool Decode(const CursorShape& shape, CursorAlpha alpha = CursorAlpha::Threshold);
+
+    /**
+        Composite the cursor over the screen into dest, both width x height.
+        The top-left pixel is at (offset_x, offset_y) in the cursor, which is
+        non-zero when the cursor is clipped by the top or left screen edge.
+        dest may be the same as screen.
+
+        Returns false if the rect is outside the cursor, or if the path
+        cannot run on this CPU.
+    */
+    bool Composite(
+        uint8_t* dest,
+        unsigned dest_pitch,
+        const uint8_t* screen,
+        unsigned screen_pitch,
+        unsigned offset_x,
+        unsigned offset_y,
+        unsigned width,
+        unsigned height,
+        CopyKernelPath path = CopyKernelPath::Auto) const;
+};
+
+
+//------------------------------------------------------------------------------
+// CursorCache
+
+/**
+    Keeps recently used decoded cursors, looked up by a hash of the shape
+    and then compared byte for byte, so a new shape never matches an old
+    one by accident.
+
+    Look up a shape only when it changes, and keep the returned pointer for
+    the pointer moves in between.
+*/
+class CursorCache
+{
+public:
+    CursorAlpha Alpha = CursorAlpha::Threshold;
+
+
+    void Clear()
+    {
+        Entries.clear();
+    }
+
+    /// Returns the decoded shape, or nullptr if the shape is invalid.
+    /// The pointer is valid until the next call to Decode() or Clear()
+    const DecodedCursor* Decode(const CursorShape& shape);
+
+    /// Number of Decode() calls that found the shape in the cache
+    uint64_t GetHits() const
+    {
+        return Hits;
+    }
+
+    uint64_t GetMisses() const
+    {
+        return Misses;
+    }
+
+protected:
+    struct Entry
+    {
+        uint64_t Hash = 0;
+        uint64_t LastUse = 0;
+
+        CursorShapeType Type = CursorShapeType::Color;
+        CursorAlpha Alpha = CursorAlpha::Threshold;
+        unsigned Width = 0, Height = 0, Pitch = 0;
+        std::vector<uint8_t> Data;
+
+        DecodedCursor Decoded;
+    };
+
+    std::vector<Entry> Entries;
+
+    uint64_t UseCounter = 0;
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+};
+
+
+} // namespace core
@@ -0,0 +1,137 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Cross-process IPC primitives shared by the service, the implant, the
+    hologram app and the plugins.
+
+    SharedMemoryFile: Named shared memory region.
+        Windows: CreateFileMappingA / OpenFileMappingA
+        POSIX: shm_open + ftruncate + mmap
+
+    IpcEvent: Named auto-reset event.
+        Windows: CreateEventA / OpenEventA
+        Linux: futex on a word in a small named shared memory object
+        Other POSIX: the same word, polled
+
+    Names use the Windows form (for example "Global\\mrcam_frame").  On POSIX
+    the "Global\\" or "Local\\" prefix is dropped and the name becomes
+    "/mrcam_frame", so the protocol headers can keep a single set of names.
+
+    The Windows objects are compatible with peers that open the same names
+    with raw Win32 calls, such as the implant.
+*/
+
+#pragma once
+
+#include "core.hpp"
+
+#include <string>
+#include <atomic>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/// Convert a Windows-style object name into a POSIX shm_open() name
+std::string PosixIpcName(const std::string& name);
+
+/// Describe the last error set by an IPC call on this thread
+std::string LastIpcErrorString();
+
+
+//------------------------------------------------------------------------------
+// SharedMemoryFile
+
+class SharedMemoryFile : NoCopy
+{
+public:
+    ~SharedMemoryFile();
+
+    bool Create(int fileBytes, const std::string& filename);
+    bool Open(int fileBytes, const std::string& filename);
+    void Close();
+    uint8_t* GetFront() const
+    {
+        return Front;
+    }
+
+protected:
+#if defined(_WIN32)
+    /*HANDLE*/ void* File = nullptr;
+#else
+    int File = -1;
+
+    // Name to unlink on Close(), set only for the creator
+    std::string UnlinkName;
+#endif
+    uint8_t* Front = nullptr;
+    int FileSizeBytes = -1;
+
+    // Map file to memory
+    bool mapFile();
+};
+
+
+//------------------------------------------------------------------------------
+// IpcEvent
+
+enum class IpcWaitResult
+{
+    Signaled,
+    Timeout,
+    Error
+};
+
+/// Named auto-reset event: Signal() releases at most one Wait() call
+class IpcEvent : NoCopy
+{
+public:
+    ~IpcEvent();
+
+    // Server-side: Create the event in the non-signaled state
+    bool Create(const std::string& name);
+
+    // Client-side: Open an event created by another process
+    bool Open(const std::string& name);
+
+    void Close();
+
+    bool Valid() const;
+    bool Invalid() const
+    {
+        return !Valid();
+    }
+
+    // Set the event, waking one waiter
+    void Signal();
+
+    // Clear the event without waking anyone
+    void Reset();
+
+    // Wait for the event and clear it.  Negative timeout waits forever
+    IpcWaitResult Wait(int timeout_msec);
+
+protected:
+#if defined(_WIN32)
+    /*HANDLE*/ void* Handle = nullptr;
+#else
+    struct SharedState
+    {
+        // 1 when signaled, 0 otherwise.  Futex word
+        std::atomic<uint32_t> Signaled;
+
+        // Number of threads blocked in Wait(), so Signal() can skip the wake
+        std::atomic<uint32_t> Waiters;
+    };
+
+    SharedMemoryFile File;
+    SharedState* State = nullptr;
+
+    bool mapState();
+#endif
+};
+
+
+} // namespace core
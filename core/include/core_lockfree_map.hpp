@@ -0,0 +1,312 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Lock-free open-addressed map from pointers to small values.
+
+    Built for hooks that run on threads we do not own, such as the USB pump
+    thread inside the Mixed Reality runtime, where taking a lock could stall
+    the headset.
+
+    Keys are hashed with wellons_triple32() and live within kMaxProbes slots
+    of their home slot, so every operation touches a bounded number of slots
+    and never waits on another thread.
+
+    Each slot has a generation tag that is odd while a writer owns the slot.
+    Writers claim a slot by moving the tag from even to odd with a CAS, and
+    readers copy the value between two loads of the tag like a seqlock.  A
+    reader that sees the tag change retries, so a slot that is reused for a
+    different key can never be returned by mistake.
+
+    When every slot in the probe window is taken, the entry that was inserted
+    longest ago is evicted.  Callers that forget to remove keys therefore
+    behave like a ring of recent entries instead of filling up.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_bit_math.hpp"
+
+#include <atomic>
+#include <type_traits>
+#include <string.h> // memcpy
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// LockFreePointerMapStats
+
+struct LockFreePointerMapStats
+{
+    // Entries replaced by Insert() to make room
+    std::atomic<uint64_t> Evictions = ATOMIC_VAR_INIT(0);
+
+    // Operations that gave up because other writers held every candidate
+    std::atomic<uint64_t> Contended = ATOMIC_VAR_INIT(0);
+};
+
+
+//------------------------------------------------------------------------------
+// LockFreePointerMap
+
+template<typename T, unsigned kSlotCount = 64, unsigned kMaxProbes = 8>
+class LockFreePointerMap : NoCopy
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Value must be trivially copyable");
+    static_assert((kSlotCount & (kSlotCount - 1)) == 0, "Slot count must be a power of two");
+    static_assert(kMaxProbes >= 1 && kMaxProbes <= kSlotCount, "Invalid probe count");
+
+public:
+    LockFreePointerMap()
+    {
+        Clear();
+    }
+
+    /// Remove all entries.  Not safe to call concurrently with other methods
+    void Clear()
+    {
+        for (unsigned i = 0; i < kSlotCount; ++i) {
+            Slots[i].Generation.store(0, std::memory_order_relaxed);
+            Slots[i].InsertStamp.store(0, std::memory_order_relaxed);
+            Slots[i].Key.store(0, std::memory_order_relaxed);
+        }
+        NextStamp.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /// Insert or replace the value for a key.
+    /// Returns false if key is null or other writers held every candidate
+    bool Insert(const void* key, const T& value)
+    {
+        const uintptr_t k = reinterpret_cast<uintptr_t>(key);
+        if (k == 0) {
+            return false;
+        }
+
+        const unsigned home = HomeSlot(k);
+        const uint32_t stamp = NextStamp.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        // Pass 1: Replace the key if present, else take an empty slot
+        int empty = -1;
+        for (unsigned i = 0; i < kMaxProbes; ++i)
+        {
+            const unsigned index = (home + i) & kSlotMask;
+            const uintptr_t slot_key = Slots[index].Key.load(std::memory_order_relaxed);
+            if (slot_key == k) {
+                if (WriteSlot(index, k, k, value, stamp)) {
+                    return true;
+                }
+                break; // Raced with a remove or eviction
+            }
+            if (slot_key == 0 && empty < 0) {
+                empty = (int)index;
+            }
+        }
+        if (empty >= 0 && WriteSlot((unsigned)empty, 0, k, value, stamp)) {
+            return true;
+        }
+
+        // Pass 2: Evict the oldest entry in the window
+        for (unsigned attempt = 0; attempt < kMaxProbes; ++attempt)
+        {
+            unsigned victim = home & kSlotMask;
+            int32_t victim_age = -1;
+            for (unsigned i = 0; i < kMaxProbes; ++i)
+            {
+                const unsigned index = (home + i) & kSlotMask;
+                const uint32_t generation = Slots[index].Generation.load(std::memory_order_relaxed);
+                if (generation & 1) {
+                    continue; // Busy
+                }
+                // Stamps wrap, so compare by distance from the newest
+                const int32_t age = (int32_t)(stamp - Slots[index].InsertStamp.load(std::memory_order_relaxed));
+                if (Slots[index].Key.load(std::memory_order_relaxed) == 0) {
+                    victim = index;
+                    victim_age = INT32_MAX;
+                    break;
+                }
+                if (age > victim_age) {
+                    victim_age = age;
+                    victim = index;
+                }
+            }
+            if (victim_age < 0) {
+                break; // All busy
+            }
+
+            const uintptr_t old_key = Slots[victim].Key.load(std::memory_order_relaxed);
+            if (WriteSlot(victim, old_key, k, value, stamp)) {
+                if (old_key != 0 && old_key != k) {
+                    Stats.Evictions.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+
+        Stats.Contended.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /// Copy out the value for a key.  Returns false if not found
+    bool Find(const void* key, T& value) const
+    {
+        const uintptr_t k = reinterpret_cast<uintptr_t>(key);
+        if (k == 0) {
+            return false;
+        }
+
+        const unsigned home = HomeSlot(k);
+        for (unsigned i = 0; i < kMaxProbes; ++i)
+        {
+            const Slot& slot = Slots[(home + i) & kSlotMask];
+            if (slot.Key.load(std::memory_order_relaxed) != k) {
+                continue;
+            }
+
+            // Bounded: A writer only holds the slot for a short copy
+            for (unsigned attempt = 0; attempt < kReadAttempts; ++attempt)
+            {
+                const uint32_t before = slot.Generation.load(std::memory_order_acquire);
+                if (before & 1) {
+                    continue;
+                }
+
+                const uintptr_t check_key = slot.Key.load(std::memory_order_relaxed);
+                memcpy(&value, &slot.Value, sizeof(T));
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const uint32_t after = slot.Generation.load(std::memory_order_relaxed);
+
+                if (before == after) {
+                    if (check_key == k) {
+                        return true;
+                    }
+                    break; // Slot was reused for another key
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /// Remove a key.  Returns false if not found
+    bool Remove(const void* key)
+    {
+        const uintptr_t k = reinterpret_cast<uintptr_t>(key);
+        if (k == 0) {
+            return false;
+        }
+
+        const unsigned home = HomeSlot(k);
+        for (unsigned i = 0; i < kMaxProbes; ++i)
+        {
+            const unsigned index = (home + i) & kSlotMask;
+            Slot& slot = Slots[index];
+            if (slot.Key.load(std::memory_order_relaxed) != k) {
+                continue;
+            }
+
+            uint32_t generation;
+            if (!ClaimSlot(slot, generation)) {
+                return false;
+            }
+            const bool found = slot.Key.load(std::memory_order_relaxed) == k;
+            if (found) {
+                slot.Key.store(0, std::memory_order_relaxed);
+            }
+            slot.Generation.store(generation + 1, std::memory_order_release);
+            return found;
+        }
+
+        return false;
+    }
+
+    LockFreePointerMapStats Stats;
+
+protected:
+    static const unsigned kSlotMask = kSlotCount - 1;
+    static const unsigned kReadAttempts = 64;
+
+    struct Slot
+    {
+        // Odd while a writer owns the slot.  Incremented twice per write
+        std::atomic<uint32_t> Generation;
+
+        // Value of NextStamp when the key was inserted, for eviction order
+        std::atomic<uint32_t> InsertStamp;
+
+        // 0 when empty
+        std::atomic<uintptr_t> Key;
+
+        T Value;
+    };
+
+    Slot Slots[kSlotCount];
+
+    std::atomic<uint32_t> NextStamp = ATOMIC_VAR_INIT(0);
+
+
+    static unsigned HomeSlot(uintptr_t k)
+    {
+        uint32_t x = (uint32_t)k;
+#if UINTPTR_MAX > 0xffffffffu
+        x ^= (uint32_t)((uint64_t)k >> 32);
+#endif
+        return wellons_triple32(x) & kSlotMask;
+    }
+
+    /**
+        Take exclusive ownership of the slot.  On success generation is odd.
+
+        The fence orders the odd generation before every store the caller
+        makes to the slot, so a reader that sees any of those stores also
+        sees the generation change and retries.  The acquire CAS alone only
+        orders the caller's loads.
+    */
+    static bool ClaimSlot(Slot& slot, uint32_t& generation)
+    {
+        for (unsigned attempt = 0; attempt < kReadAttempts; ++attempt)
+        {
+            uint32_t expected = slot.Generation.load(std::memory_order_relaxed);
+            if (expected & 1) {
+                continue;
+            }
+            if (slot.Generation.compare_exchange_weak(
+                expected,
+                expected + 1,
+                std::memory_order_acquire,
+                std::memory_order_relaxed))
+            {
+                std::atomic_thread_fence(std::memory_order_release);
+                generation = expected + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Write the slot if it still holds expected_key
+    bool WriteSlot(unsigned index, uintptr_t expected_key, uintptr_t k, const T& value, uint32_t stamp)
+    {
+        Slot& slot = Slots[index];
+
+        uint32_t generation;
+        if (!ClaimSlot(slot, generation)) {
+            return false;
+        }
+
+        const bool still_valid = slot.Key.load(std::memory_order_relaxed) == expected_key;
+        if (still_valid) {
+            slot.Key.store(k, std::memory_order_relaxed);
+            memcpy(&slot.Value, &value, sizeof(T));
+            slot.InsertStamp.store(stamp, std::memory_order_relaxed);
+        }
+
+        slot.Generation.store(generation + 1, std::memory_order_release);
+        return still_valid;
+    }
+};
+
+
+} // namespace core
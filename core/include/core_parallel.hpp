@@ -0,0 +1,79 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Small fixed pool of worker threads for data-parallel loops.
+
+    The calling thread always takes part, so a pool with no workers simply
+    runs the loop inline.  Workers sleep on a condition variable between
+    loops and are meant to be created once and reused every frame.
+*/
+
+#pragma once
+
+#include "core.hpp"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// WorkerPool
+
+class WorkerPool : NoCopy
+{
+public:
+    ~WorkerPool();
+
+    /// Start worker_count threads in addition to the caller.
+    /// 0 = one less than the number of hardware threads
+    void Start(unsigned worker_count = 0);
+    void Stop();
+
+    /// Number of threads that run items, including the caller
+    unsigned GetThreadCount() const
+    {
+        return static_cast<unsigned>(Threads.size()) + 1;
+    }
+
+    /// Call fn(i) for every i in [0, count) and return when all are done.
+    /// Items run in any order on any thread.  Calls are serialized, so fn
+    /// must not call ParallelFor() on the same pool
+    void ParallelFor(unsigned count, const std::function<void(unsigned)>& fn);
+
+protected:
+    std::vector<std::shared_ptr<std::thread>> Threads;
+
+    // Serializes ParallelFor() callers
+    std::mutex CallLock;
+
+    // Protects the fields below
+    std::mutex Lock;
+    std::condition_variable StartCondition;
+    std::condition_variable DoneCondition;
+
+    // Current loop, or nullptr between loops
+    const std::function<void(unsigned)>* Job = nullptr;
+    unsigned JobCount = 0;
+    uint64_t JobEpoch = 0;
+
+    // Workers inside the current loop
+    unsigned ActiveWorkers = 0;
+
+    bool Terminated = false;
+
+    std::atomic<unsigned> NextIndex = ATOMIC_VAR_INIT(0);
+
+
+    void WorkerLoop();
+    void RunItems(const std::function<void(unsigned)>& fn, unsigned count);
+};
+
+
+} // namespace core
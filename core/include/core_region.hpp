@@ -0,0 +1,227 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Band-based 2D region algebra for dirty rect tracking.
+
+    A Region is a set of pixels stored as horizontal bands sorted top to
+    bottom.  Each band covers a range of rows and holds sorted, disjoint,
+    non-touching column spans that apply to every row of the band.
+    Vertically adjacent bands always have different spans, because equal
+    ones are coalesced, so the representation of a set of pixels is unique
+    and GetRects() returns the fewest rects the band structure allows.
+
+    Overlapping input rects are merged, so a region never holds a pixel
+    twice.
+
+    PlanRegionCopies() then trades copy setup cost against bytes moved: It
+    merges nearby rects into their bounding box when copying the pixels in
+    between is cheaper than another copy call.
+*/
+
+#pragma once
+
+#include "core.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// RegionRect
+
+/// Right and bottom are exclusive, as in the Windows RECT convention
+struct RegionRect
+{
+    int Left = 0, Top = 0;
+    int Right = 0, Bottom = 0;
+
+
+    RegionRect() = default;
+    RegionRect(int left, int top, int right, int bottom)
+        : Left(left), Top(top), Right(right), Bottom(bottom)
+    {
+    }
+
+    bool Empty() const
+    {
+        return Right <= Left || Bottom <= Top;
+    }
+
+    unsigned Width() const
+    {
+        return Right > Left ? static_cast<unsigned>(Right - Left) : 0;
+    }
+
+    unsigned Height() const
+    {
+        return Bottom > Top ? static_cast<unsigned>(Bottom - Top) : 0;
+    }
+
+    uint64_t Area() const
+    {
+        return static_cast<uint64_t>(Width()) * Height();
+    }
+
+    bool Intersects(const RegionRect& other) const
+    {
+        return Left < other.Right && other.Left < Right &&
+            Top < other.Bottom && other.Top < Bottom;
+    }
+
+    bool Contains(const RegionRect& other) const
+    {
+        return Left <= other.Left && other.Right <= Right &&
+            Top <= other.Top && other.Bottom <= Bottom;
+    }
+
+    /// Smallest rect containing both
+    RegionRect BoundingUnion(const RegionRect& other) const;
+};
+
+
+//------------------------------------------------------------------------------
+// Region
+
+class Region
+{
+public:
+    void Clear()
+    {
+        Bands.clear();
+        Spans.clear();
+    }
+
+    bool Empty() const
+    {
+        return Bands.empty();
+    }
+
+    /// Number of bands
+    unsigned GetBandCount() const
+    {
+        return static_cast<unsigned>(Bands.size());
+    }
+
+    /// Number of rects GetRects() returns
+    unsigned GetRectCount() const
+    {
+        return static_cast<unsigned>(Spans.size() / 2);
+    }
+
+    uint64_t GetArea() const;
+    RegionRect GetBounds() const;
+
+    /// Replace the region with a single rect
+    void Set(const RegionRect& rect);
+
+    /// Replace the region with the union of many rects.
+    /// This sweeps all of them at once, so it is much faster than a Union()
+    /// per rect when there are more than a few
+    void Set(const RegionRect* rects, unsigned count);
+
+    void Union(const RegionRect& rect);
+    void Union(const Region& other);
+
+    void Subtract(const RegionRect& rect);
+    void Subtract(const Region& other);
+
+    void Intersect(const RegionRect& rect);
+    void Intersect(const Region& other);
+
+    bool Contains(int x, int y) const;
+
+    /// True if any pixel of the rect is in the region
+    bool Intersects(const RegionRect& rect) const;
+
+    /// Append disjoint rects that cover the region exactly, in band order
+    void GetRects(std::vector<RegionRect>& rects) const;
+
+protected:
+    struct Band
+    {
+        int Top, Bottom;
+
+        // Index of the first span in Spans, and span count
+        unsigned SpanStart, SpanCount;
+    };
+
+    std::vector<Band> Bands;
+
+    // Left, Right pairs for all bands
+    std::vector<int> Spans;
+
+    // Result of Combine() before it is swapped in
+    std::vector<Band> ScratchBands;
+    std::vector<int> ScratchSpans;
+
+    // Used by Set() for many rects
+    std::vector<RegionRect> SortedRects;
+    std::vector<RegionRect> ActiveRects;
+    std::vector<int> RowEdges;
+
+
+    enum class Op
+    {
+        Union,
+        Subtract,
+        Intersect
+    };
+
+    /// this = this op (bands, spans)
+    void Combine(const Band* bands, unsigned band_count, const int* spans, Op op);
+    void Combine(const RegionRect& rect, Op op);
+
+    /// Append a band with the spans added to `spans` since span_start, or
+    /// extend the previous band if it has the same spans
+    static void AppendBand(
+        std::vector<Band>& bands,
+        std::vector<int>& spans,
+        int top,
+        int bottom,
+        unsigned span_start);
+};
+
+
+//------------------------------------------------------------------------------
+// PlanRegionCopies
+
+/// Relative cost of a rect copy in bytes moved
+struct RegionCopyCost
+{
+    // Fixed cost of each copy call, as the bytes that could be moved instead
+    unsigned SetupBytes = 4096;
+
+    // Cost of each row, for example a memcpy() call or a cache line split
+    unsigned RowBytes = 64;
+
+    unsigned BytesPerPixel = 4;
+
+
+    uint64_t Cost(const RegionRect& rect) const
+    {
+        return SetupBytes +
+            static_cast<uint64_t>(RowBytes) * rect.Height() +
+            rect.Area() * BytesPerPixel;
+    }
+};
+
+/// Rects above this count are not considered for merging, which is
+/// quadratic in the rect count
+static const unsigned kRegionPlanMaxMergeRects = 64;
+
+/**
+    Replace `rects` with disjoint rects that cover the region and may also
+    cover pixels outside of it, chosen to lower the total cost.  Rects are
+    merged into their bounding box while that is cheaper, and the whole
+    bounds are used if they are cheaper than the plan.
+
+    Returns the total cost of the plan.
+*/
+uint64_t PlanRegionCopies(
+    const Region& region,
+    const RegionCopyCost& cost,
+    std::vector<RegionRect>& rects);
+
+
+} // namespace core
@@ -0,0 +1,180 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Per-tile content hashing for change detection.
+
+    Desktop duplication often reports large dirty rects whose pixels did not
+    change, for example a window frame that was repainted the same.
+    TileHashTable keeps a hash of each 64x64 tile of an image, and finds
+    the tiles in an updated region that hash the same as last time, so
+    their copies can be skipped.
+
+    HashPlane2D() is a keyed multiply-accumulate hash in the style of XXH3:
+    Eight 64-bit lanes each add a 32x32-bit product of the data XOR a key,
+    which maps onto one SSE2/AVX2/NEON multiply per lane pair.  Keys change
+    with the row and the position in the row, so moved or swapped pixels
+    change the hash, and the lanes are only scrambled once at the end.
+    All paths produce the same hash.
+
+    HashTiles2D() hashes a band of tiles side by side in one pass, reading
+    each row in memory order into the lanes of the tile it belongs to,
+    instead of walking down one tile at a time.
+
+    A hash is not a proof of equality, but with 64 bits a false match is
+    about as likely as a memory error.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_copy.hpp"
+#include "core_region.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Width and height of a tile in pixels
+static const unsigned kTileHashSize = 64;
+
+// Pixels are BGRA
+static const unsigned kTileHashBytesPerPixel = 4;
+
+
+//------------------------------------------------------------------------------
+// HashPlane2D
+
+/**
+    Hash `rows` rows of `row_bytes` bytes each.
+
+    Returns false if the path cannot run on this CPU.
+*/
+bool HashPlane2D(
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    uint64_t& hash_out,
+    CopyKernelPath path = CopyKernelPath::Auto);
+
+/**
+    Hash each `tile_bytes` wide column of `rows` rows of `row_bytes` bytes.
+
+    Writes (row_bytes + tile_bytes - 1) / tile_bytes hashes to `hashes_out`,
+    each the same as HashPlane2D() of that column.  The last one may be
+    narrower than `tile_bytes`.
+
+    Returns false if the path cannot run on this CPU.
+*/
+bool HashTiles2D(
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes,
+    uint64_t* hashes_out,
+    CopyKernelPath path = CopyKernelPath::Auto);
+
+
+//------------------------------------------------------------------------------
+// TileHashStats
+
+struct TileHashStats
+{
+    // Calls to FindUnchanged()
+    uint64_t Updates = 0;
+
+    // Tiles hashed, and the ones that matched their last hash
+    uint64_t TilesHashed = 0;
+    uint64_t TilesUnchanged = 0;
+
+    // Bytes in the changed regions, and the ones inside unchanged tiles
+    uint64_t ChangedBytes = 0;
+    uint64_t SkippedBytes = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// TileHashTable
+
+/**
+    Tracks which tiles of an image hold the same pixels as the copy of the
+    image they are delivered to.
+
+    A tile is only known after every pixel of it has been in a changed
+    region, since before that the copy may hold different pixels.  After
+    that the hash stays correct as long as every changed region is passed
+    to FindUnchanged() and then delivered, minus the unchanged tiles.
+
+    Not thread-safe.
+*/
+class TileHashTable
+{
+public:
+    /// Forget all tiles, for an image of this size
+    void Reset(unsigned width, unsigned height);
+
+    unsigned GetWidth() const
+    {
+        return Width;
+    }
+
+    unsigned GetHeight() const
+    {
+        return Height;
+    }
+
+    /**
+        Hash the tiles of the image that intersect `changed`, the pixels
+        that differ from the last call.  The image must hold every pixel of
+        those tiles, not only the changed ones.
+
+        Tiles that hash the same as the last time are set in `unchanged`,
+        and the hashes of the others are updated.
+
+        Returns false if the path cannot run on this CPU.
+    */
+    bool FindUnchanged(
+        const uint8_t* image,
+        unsigned pitch,
+        const Region& changed,
+        Region& unchanged,
+        CopyKernelPath path = CopyKernelPath::Auto);
+
+    const TileHashStats& GetStats() const
+    {
+        return Stats;
+    }
+
+protected:
+    unsigned Width = 0, Height = 0;
+    unsigned TilesX = 0, TilesY = 0;
+
+    struct Tile
+    {
+        uint64_t Hash = 0;
+
+        // Update that last visited the tile
+        uint64_t Visited = 0;
+
+        // Hash matches the delivered copy of the tile
+        bool Known = false;
+    };
+
+    std::vector<Tile> Tiles;
+
+    TileHashStats Stats;
+
+    // Used by FindUnchanged()
+    std::vector<RegionRect> ChangedRects;
+    std::vector<RegionRect> UnchangedRects;
+    std::vector<uint64_t> BandHashes;
+    Region Scratch;
+};
+
+
+} // namespace core
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core.hpp"
+#include "core_ipc.hpp"
 
 #include <string>
 
@@ -107,32 +108,6 @@ protected:
 };
 
 
-//-----------------------------------------------------------------------------
-// SharedMemoryFile
-
-class SharedMemoryFile : NoCopy
-{
-public:
-    ~SharedMemoryFile();
-
-    bool Create(int fileBytes, const std::string& filename);
-    bool Open(int fileBytes, const std::string& filename);
-    void Close();
-    uint8_t* GetFront() const
-    {
-        return Front;
-    }
-
-protected:
-    AutoEvent File;
-    uint8_t* Front = nullptr;
-    int FileSizeBytes = -1;
-
-    // Map file to memory
-    bool mapFile();
-};
-
-
 //-----------------------------------------------------------------------------
 // Module Tools
 
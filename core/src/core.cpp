@@ -229,7 +229,7 @@ void SetCurrentThreadName(const char* threadName)
 
 static const unsigned kAlignmentBytes = 32;
 
-static inline uint8_t* SIMDSafeAllocate(size_t size)
+uint8_t* SIMDSafeAllocate(size_t size)
 {
     uint8_t* data = (uint8_t*)calloc(1, kAlignmentBytes + size);
     if (!data) {
@@ -241,7 +241,7 @@ static inline uint8_t* SIMDSafeAllocate(size_t size)
     return data;
 }
 
-static inline void SIMDSafeFree(void* ptr)
+void SIMDSafeFree(void* ptr)
 {
     if (!ptr) {
         return;
@@ -0,0 +1,805 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_copy.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h> // memcpy
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CopyKernelPath
+
+CopyKernelPath GetBestCopyKernelPath()
+{
+    const CpuFeatures& cpu = GetCpuFeatures();
+    if (cpu.AVX2) {
+        return CopyKernelPath::AVX2;
+    }
+    if (cpu.SSE2) {
+        return CopyKernelPath::SSE2;
+    }
+    if (cpu.NEON) {
+        return CopyKernelPath::NEON;
+    }
+    return CopyKernelPath::Scalar;
+}
+
+bool IsCopyKernelPathSupported(CopyKernelPath path)
+{
+    const CpuFeatures& cpu = GetCpuFeatures();
+    switch (path)
+    {
+    case CopyKernelPath::Auto:
+    case CopyKernelPath::Scalar:
+        return true;
+#if defined(CORE_CPU_X86)
+    case CopyKernelPath::SSE2: return cpu.SSE2;
+    case CopyKernelPath::AVX2: return cpu.AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CopyKernelPath::NEON: return cpu.NEON;
+#endif
+    default:
+        break;
+    }
+    CORE_UNUSED(cpu);
+    return false;
+}
+
+const char* CopyKernelPathToString(CopyKernelPath path)
+{
+    switch (path)
+    {
+    case CopyKernelPath::Auto: return "Auto";
+    case CopyKernelPath::Scalar: return "Scalar";
+    case CopyKernelPath::SSE2: return "SSE2";
+    case CopyKernelPath::AVX2: return "AVX2";
+    case CopyKernelPath::NEON: return "NEON";
+    default: break;
+    }
+    return "Unknown";
+}
+
+
+//------------------------------------------------------------------------------
+// CopyStores
+
+CopyStores GetBestCopyStores(unsigned row_bytes, unsigned rows)
+{
+#if defined(CORE_CPU_X86)
+    if (row_bytes < kCopyNonTemporalMinRowBytes) {
+        return CopyStores::Temporal;
+    }
+
+    uint64_t cache_bytes = GetCpuFeatures().LastLevelCacheBytes;
+    if (cache_bytes == 0) {
+        cache_bytes = kCopyDefaultCacheBytes;
+    }
+
+    const uint64_t bytes = static_cast<uint64_t>(row_bytes) * rows;
+    if (bytes > cache_bytes / kCopyNonTemporalCacheDivisor) {
+        return CopyStores::NonTemporal;
+    }
+#else
+    CORE_UNUSED(row_bytes);
+    CORE_UNUSED(rows);
+#endif
+    return CopyStores::Temporal;
+}
+
+const char* CopyStoresToString(CopyStores stores)
+{
+    switch (stores)
+    {
+    case CopyStores::Auto: return "Auto";
+    case CopyStores::Temporal: return "Temporal";
+    case CopyStores::NonTemporal: return "NonTemporal";
+    default: break;
+    }
+    return "Unknown";
+}
+
+
+//------------------------------------------------------------------------------
+// Row Kernels
+
+typedef void (*CopyRowsFn)(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows);
+
+static void CopyRows_Scalar(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        memcpy(dest, src, row_bytes);
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static void CopyRows_SSE2(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    if (row_bytes < 16) {
+        CopyRows_Scalar(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+        return;
+    }
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        const __m128i* s = reinterpret_cast<const __m128i*>(src);
+        __m128i* d = reinterpret_cast<__m128i*>(dest);
+
+        unsigned i = 0;
+        for (; i + 64 <= row_bytes; i += 64, s += 4, d += 4) {
+            const __m128i x0 = _mm_loadu_si128(s + 0);
+            const __m128i x1 = _mm_loadu_si128(s + 1);
+            const __m128i x2 = _mm_loadu_si128(s + 2);
+            const __m128i x3 = _mm_loadu_si128(s + 3);
+            _mm_storeu_si128(d + 0, x0);
+            _mm_storeu_si128(d + 1, x1);
+            _mm_storeu_si128(d + 2, x2);
+            _mm_storeu_si128(d + 3, x3);
+        }
+        for (; i + 16 <= row_bytes; i += 16, ++s, ++d) {
+            _mm_storeu_si128(d, _mm_loadu_si128(s));
+        }
+
+        // Overlap the last vector with the previous one
+        if (i < row_bytes) {
+            const unsigned last = row_bytes - 16;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + last),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + last)));
+        }
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+}
+
+static void CopyRows_SSE2_NonTemporal(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    if (row_bytes < 32) {
+        CopyRows_SSE2(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+        return;
+    }
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        // Unaligned head up to the first aligned destination vector
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        unsigned i = static_cast<unsigned>(-reinterpret_cast<uintptr_t>(dest) & 15);
+
+        for (; i + 64 <= row_bytes; i += 64) {
+            const __m128i* s = reinterpret_cast<const __m128i*>(src + i);
+            __m128i* d = reinterpret_cast<__m128i*>(dest + i);
+            const __m128i x0 = _mm_loadu_si128(s + 0);
+            const __m128i x1 = _mm_loadu_si128(s + 1);
+            const __m128i x2 = _mm_loadu_si128(s + 2);
+            const __m128i x3 = _mm_loadu_si128(s + 3);
+            _mm_stream_si128(d + 0, x0);
+            _mm_stream_si128(d + 1, x1);
+            _mm_stream_si128(d + 2, x2);
+            _mm_stream_si128(d + 3, x3);
+        }
+        for (; i + 16 <= row_bytes; i += 16) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        }
+
+        if (i < row_bytes) {
+            const unsigned last = row_bytes - 16;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + last),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + last)));
+        }
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+
+    // Order the streaming stores before whoever reads the destination
+    _mm_sfence();
+}
+
+CORE_TARGET_AVX2 static void CopyRows_AVX2(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    if (row_bytes < 32) {
+        CopyRows_SSE2(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+        return;
+    }
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        const __m256i* s = reinterpret_cast<const __m256i*>(src);
+        __m256i* d = reinterpret_cast<__m256i*>(dest);
+
+        unsigned i = 0;
+        for (; i + 128 <= row_bytes; i += 128, s += 4, d += 4) {
+            const __m256i x0 = _mm256_loadu_si256(s + 0);
+            const __m256i x1 = _mm256_loadu_si256(s + 1);
+            const __m256i x2 = _mm256_loadu_si256(s + 2);
+            const __m256i x3 = _mm256_loadu_si256(s + 3);
+            _mm256_storeu_si256(d + 0, x0);
+            _mm256_storeu_si256(d + 1, x1);
+            _mm256_storeu_si256(d + 2, x2);
+            _mm256_storeu_si256(d + 3, x3);
+        }
+        for (; i + 32 <= row_bytes; i += 32, ++s, ++d) {
+            _mm256_storeu_si256(d, _mm256_loadu_si256(s));
+        }
+
+        if (i < row_bytes) {
+            const unsigned last = row_bytes - 32;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + last),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + last)));
+        }
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+}
+
+CORE_TARGET_AVX2 static void CopyRows_AVX2_NonTemporal(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    if (row_bytes < 64) {
+        CopyRows_AVX2(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+        return;
+    }
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+        unsigned i = static_cast<unsigned>(-reinterpret_cast<uintptr_t>(dest) & 31);
+
+        for (; i + 128 <= row_bytes; i += 128) {
+            const __m256i* s = reinterpret_cast<const __m256i*>(src + i);
+            __m256i* d = reinterpret_cast<__m256i*>(dest + i);
+            const __m256i x0 = _mm256_loadu_si256(s + 0);
+            const __m256i x1 = _mm256_loadu_si256(s + 1);
+            const __m256i x2 = _mm256_loadu_si256(s + 2);
+            const __m256i x3 = _mm256_loadu_si256(s + 3);
+            _mm256_stream_si256(d + 0, x0);
+            _mm256_stream_si256(d + 1, x1);
+            _mm256_stream_si256(d + 2, x2);
+            _mm256_stream_si256(d + 3, x3);
+        }
+        for (; i + 32 <= row_bytes; i += 32) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+        }
+
+        if (i < row_bytes) {
+            const unsigned last = row_bytes - 32;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + last),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + last)));
+        }
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+
+    _mm_sfence();
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void CopyRows_NEON(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    if (row_bytes < 16) {
+        CopyRows_Scalar(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+        return;
+    }
+
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        unsigned i = 0;
+        for (; i + 64 <= row_bytes; i += 64) {
+            const uint8x16_t x0 = vld1q_u8(src + i);
+            const uint8x16_t x1 = vld1q_u8(src + i + 16);
+            const uint8x16_t x2 = vld1q_u8(src + i + 32);
+            const uint8x16_t x3 = vld1q_u8(src + i + 48);
+            vst1q_u8(dest + i, x0);
+            vst1q_u8(dest + i + 16, x1);
+            vst1q_u8(dest + i + 32, x2);
+            vst1q_u8(dest + i + 48, x3);
+        }
+        for (; i + 16 <= row_bytes; i += 16) {
+            vst1q_u8(dest + i, vld1q_u8(src + i));
+        }
+
+        if (i < row_bytes) {
+            const unsigned last = row_bytes - 16;
+            vst1q_u8(dest + last, vld1q_u8(src + last));
+        }
+
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+}
+
+#endif // CORE_CPU_ARM64
+
+static CopyRowsFn SelectCopyRows(CopyKernelPath path, CopyStores stores)
+{
+    if (path == CopyKernelPath::Auto) {
+        path = GetBestCopyKernelPath();
+    }
+    if (!IsCopyKernelPathSupported(path)) {
+        return nullptr;
+    }
+
+    const bool non_temporal = (stores == CopyStores::NonTemporal);
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CopyKernelPath::SSE2:
+        return non_temporal ? CopyRows_SSE2_NonTemporal : CopyRows_SSE2;
+    case CopyKernelPath::AVX2:
+        return non_temporal ? CopyRows_AVX2_NonTemporal : CopyRows_AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CopyKernelPath::NEON:
+        return CopyRows_NEON;
+#endif
+    default:
+        break;
+    }
+    CORE_UNUSED(non_temporal);
+    return CopyRows_Scalar;
+}
+
+
+//------------------------------------------------------------------------------
+// CopyPlane2D
+
+bool CopyPlane2D(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    CopyKernelPath path,
+    CopyStores stores)
+{
+    if (stores == CopyStores::Auto) {
+        stores = GetBestCopyStores(row_bytes, rows);
+    }
+
+    CopyRowsFn copy_rows = SelectCopyRows(path, stores);
+    if (!copy_rows) {
+        return false;
+    }
+    if (row_bytes == 0 || rows == 0) {
+        return true;
+    }
+
+    // Rows without padding between them are one long row
+    const uint64_t total_bytes = static_cast<uint64_t>(row_bytes) * rows;
+    if (dest_pitch == row_bytes && src_pitch == row_bytes &&
+        total_bytes <= 0xffffffffu)
+    {
+        row_bytes = static_cast<unsigned>(total_bytes);
+        rows = 1;
+    }
+
+    copy_rows(dest, dest_pitch, src, src_pitch, row_bytes, rows);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Overlapping Row Kernels
+
+// Move bytes from src to dest, which may overlap, as if through a temporary
+typedef void (*MoveRowFn)(uint8_t* dest, const uint8_t* src, unsigned bytes);
+
+static void MoveRow_Scalar(uint8_t* dest, const uint8_t* src, unsigned bytes)
+{
+    memmove(dest, src, bytes);
+}
+
+// Copying forward is safe unless dest starts inside the source
+static inline bool MoveRowIsBackward(uint8_t* dest, const uint8_t* src, unsigned bytes)
+{
+    return dest > src && dest < src + bytes;
+}
+
+#if defined(CORE_CPU_X86)
+
+static void MoveRow_SSE2(uint8_t* dest, const uint8_t* src, unsigned bytes)
+{
+    if (bytes < 16) {
+        memmove(dest, src, bytes);
+        return;
+    }
+
+    if (!MoveRowIsBackward(dest, src, bytes))
+    {
+        // Loaded before any store can overwrite it
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + bytes - 16));
+
+        unsigned i = 0;
+        for (; i + 64 <= bytes; i += 64) {
+            const __m128i* s = reinterpret_cast<const __m128i*>(src + i);
+            __m128i* d = reinterpret_cast<__m128i*>(dest + i);
+            const __m128i x0 = _mm_loadu_si128(s + 0);
+            const __m128i x1 = _mm_loadu_si128(s + 1);
+            const __m128i x2 = _mm_loadu_si128(s + 2);
+            const __m128i x3 = _mm_loadu_si128(s + 3);
+            _mm_storeu_si128(d + 0, x0);
+            _mm_storeu_si128(d + 1, x1);
+            _mm_storeu_si128(d + 2, x2);
+            _mm_storeu_si128(d + 3, x3);
+        }
+        for (; i + 16 <= bytes; i += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + bytes - 16), tail);
+    }
+    else
+    {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+
+        unsigned i = bytes;
+        for (; i >= 64; i -= 64) {
+            const __m128i* s = reinterpret_cast<const __m128i*>(src + i - 64);
+            __m128i* d = reinterpret_cast<__m128i*>(dest + i - 64);
+            const __m128i x0 = _mm_loadu_si128(s + 0);
+            const __m128i x1 = _mm_loadu_si128(s + 1);
+            const __m128i x2 = _mm_loadu_si128(s + 2);
+            const __m128i x3 = _mm_loadu_si128(s + 3);
+            _mm_storeu_si128(d + 3, x3);
+            _mm_storeu_si128(d + 2, x2);
+            _mm_storeu_si128(d + 1, x1);
+            _mm_storeu_si128(d + 0, x0);
+        }
+        for (; i >= 16; i -= 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i - 16),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i - 16)));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), head);
+    }
+}
+
+CORE_TARGET_AVX2 static void MoveRow_AVX2(uint8_t* dest, const uint8_t* src, unsigned bytes)
+{
+    if (bytes < 32) {
+        MoveRow_SSE2(dest, src, bytes);
+        return;
+    }
+
+    if (!MoveRowIsBackward(dest, src, bytes))
+    {
+        const __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + bytes - 32));
+
+        unsigned i = 0;
+        for (; i + 128 <= bytes; i += 128) {
+            const __m256i* s = reinterpret_cast<const __m256i*>(src + i);
+            __m256i* d = reinterpret_cast<__m256i*>(dest + i);
+            const __m256i x0 = _mm256_loadu_si256(s + 0);
+            const __m256i x1 = _mm256_loadu_si256(s + 1);
+            const __m256i x2 = _mm256_loadu_si256(s + 2);
+            const __m256i x3 = _mm256_loadu_si256(s + 3);
+            _mm256_storeu_si256(d + 0, x0);
+            _mm256_storeu_si256(d + 1, x1);
+            _mm256_storeu_si256(d + 2, x2);
+            _mm256_storeu_si256(d + 3, x3);
+        }
+        for (; i + 32 <= bytes; i += 32) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + bytes - 32), tail);
+    }
+    else
+    {
+        const __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+
+        unsigned i = bytes;
+        for (; i >= 128; i -= 128) {
+            const __m256i* s = reinterpret_cast<const __m256i*>(src + i - 128);
+            __m256i* d = reinterpret_cast<__m256i*>(dest + i - 128);
+            const __m256i x0 = _mm256_loadu_si256(s + 0);
+            const __m256i x1 = _mm256_loadu_si256(s + 1);
+            const __m256i x2 = _mm256_loadu_si256(s + 2);
+            const __m256i x3 = _mm256_loadu_si256(s + 3);
+            _mm256_storeu_si256(d + 3, x3);
+            _mm256_storeu_si256(d + 2, x2);
+            _mm256_storeu_si256(d + 1, x1);
+            _mm256_storeu_si256(d + 0, x0);
+        }
+        for (; i >= 32; i -= 32) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i - 32),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i - 32)));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), head);
+    }
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void MoveRow_NEON(uint8_t* dest, const uint8_t* src, unsigned bytes)
+{
+    if (bytes < 16) {
+        memmove(dest, src, bytes);
+        return;
+    }
+
+    if (!MoveRowIsBackward(dest, src, bytes))
+    {
+        const uint8x16_t tail = vld1q_u8(src + bytes - 16);
+
+        unsigned i = 0;
+        for (; i + 64 <= bytes; i += 64) {
+            const uint8x16_t x0 = vld1q_u8(src + i);
+            const uint8x16_t x1 = vld1q_u8(src + i + 16);
+            const uint8x16_t x2 = vld1q_u8(src + i + 32);
+            const uint8x16_t x3 = vld1q_u8(src + i + 48);
+            vst1q_u8(dest + i, x0);
+            vst1q_u8(dest + i + 16, x1);
+            vst1q_u8(dest + i + 32, x2);
+            vst1q_u8(dest + i + 48, x3);
+        }
+        for (; i + 16 <= bytes; i += 16) {
+            vst1q_u8(dest + i, vld1q_u8(src + i));
+        }
+
+        vst1q_u8(dest + bytes - 16, tail);
+    }
+    else
+    {
+        const uint8x16_t head = vld1q_u8(src);
+
+        unsigned i = bytes;
+        for (; i >= 64; i -= 64) {
+            const uint8x16_t x0 = vld1q_u8(src + i - 64);
+            const uint8x16_t x1 = vld1q_u8(src + i - 48);
+            const uint8x16_t x2 = vld1q_u8(src + i - 32);
+            const uint8x16_t x3 = vld1q_u8(src + i - 16);
+            vst1q_u8(dest + i - 16, x3);
+            vst1q_u8(dest + i - 32, x2);
+            vst1q_u8(dest + i - 48, x1);
+            vst1q_u8(dest + i - 64, x0);
+        }
+        for (; i >= 16; i -= 16) {
+            vst1q_u8(dest + i - 16, vld1q_u8(src + i - 16));
+        }
+
+        vst1q_u8(dest, head);
+    }
+}
+
+#endif // CORE_CPU_ARM64
+
+static MoveRowFn SelectMoveRow(CopyKernelPath path)
+{
+    if (path == CopyKernelPath::Auto) {
+        path = GetBestCopyKernelPath();
+    }
+    if (!IsCopyKernelPathSupported(path)) {
+        return nullptr;
+    }
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CopyKernelPath::SSE2: return MoveRow_SSE2;
+    case CopyKernelPath::AVX2: return MoveRow_AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CopyKernelPath::NEON: return MoveRow_NEON;
+#endif
+    default:
+        break;
+    }
+    return MoveRow_Scalar;
+}
+
+
+//------------------------------------------------------------------------------
+// MovePlane2D
+
+bool MovePlane2D(
+    uint8_t* dest,
+    const uint8_t* src,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    CopyKernelPath path)
+{
+    MoveRowFn move_row = SelectMoveRow(path);
+    if (!move_row) {
+        return false;
+    }
+    if (row_bytes == 0 || rows == 0) {
+        return true;
+    }
+
+    // Moving down: Start at the bottom so every source row is read before
+    // a destination row overwrites it
+    if (dest > src)
+    {
+        const size_t last_row = static_cast<size_t>(rows - 1) * pitch;
+        dest += last_row;
+        src += last_row;
+
+        for (unsigned y = 0; y < rows; ++y)
+        {
+            move_row(dest, src, row_bytes);
+
+            dest -= pitch;
+            src -= pitch;
+        }
+    }
+    else
+    {
+        for (unsigned y = 0; y < rows; ++y)
+        {
+            move_row(dest, src, row_bytes);
+
+            dest += pitch;
+            src += pitch;
+        }
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CopyScheduler
+
+void CopyScheduler::Start(unsigned worker_count)
+{
+    Pool.Start(worker_count);
+    BytesPerUsec = kCopyInitialBytesPerUsec;
+}
+
+void CopyScheduler::Stop()
+{
+    Pool.Stop();
+}
+
+bool CopyScheduler::CopyPlane2D(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    CopyKernelPath path,
+    CopyStores stores)
+{
+    const unsigned thread_count = Pool.GetThreadCount();
+    const uint64_t bytes = static_cast<uint64_t>(row_bytes) * rows;
+
+    const bool inline_copy = thread_count <= 1 || rows < 2 ||
+        bytes < kCopyParallelMinBytes ||
+        bytes <= BytesPerUsec * LatencyTargetUsec;
+
+    if (inline_copy)
+    {
+        const uint64_t t0 = GetTimeUsec();
+        if (!core::CopyPlane2D(dest, dest_pitch, src, src_pitch, row_bytes, rows, path, stores)) {
+            return false;
+        }
+        const uint64_t elapsed_usec = GetTimeUsec() - t0;
+
+        if (bytes >= kCopyMeasureMinBytes && elapsed_usec > 0) {
+            BytesPerUsec = (BytesPerUsec * 3 + bytes / elapsed_usec) / 4;
+            if (BytesPerUsec < 1) {
+                BytesPerUsec = 1;
+            }
+        }
+        return true;
+    }
+
+    // Resolve once for the whole copy, since each band alone would look small
+    if (path == CopyKernelPath::Auto) {
+        path = GetBestCopyKernelPath();
+    }
+    if (!IsCopyKernelPathSupported(path)) {
+        return false;
+    }
+    if (stores == CopyStores::Auto) {
+        stores = GetBestCopyStores(row_bytes, rows);
+    }
+
+    unsigned band_rows = kCopyBandBytes / row_bytes;
+    if (band_rows < 1) {
+        band_rows = 1;
+    }
+    unsigned band_count = (rows + band_rows - 1) / band_rows;
+
+    // At least one band per thread
+    if (band_count < thread_count) {
+        band_rows = (rows + thread_count - 1) / thread_count;
+        band_count = (rows + band_rows - 1) / band_rows;
+    }
+
+    Pool.ParallelFor(band_count, [&](unsigned band) {
+        const unsigned first_row = band * band_rows;
+        unsigned band_row_count = rows - first_row;
+        if (band_row_count > band_rows) {
+            band_row_count = band_rows;
+        }
+
+        core::CopyPlane2D(
+            dest + static_cast<size_t>(first_row) * dest_pitch,
+            dest_pitch,
+            src + static_cast<size_t>(first_row) * src_pitch,
+            src_pitch,
+            row_bytes,
+            band_row_count,
+            path,
+            stores);
+    });
+
+    return true;
+}
+
+
+} // namespace core
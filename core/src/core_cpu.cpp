@@ -0,0 +1,142 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_cpu.hpp"
+
+#if defined(CORE_CPU_X86)
+    #if defined(_MSC_VER)
+        #include <intrin.h> // __cpuidex, _xgetbv
+    #else
+        #include <cpuid.h> // __get_cpuid_count
+    #endif
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CpuFeatures
+
+#if defined(CORE_CPU_X86)
+
+static void CpuId(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = (unsigned)info[i];
+    }
+#else
+    if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    }
+#endif
+}
+
+static uint64_t ReadXCR0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+// Largest data or unified cache in the deterministic cache parameter leaf:
+// 4 on Intel and 0x8000001D on AMD, which share the same layout
+static uint64_t DetectLastLevelCacheBytes(unsigned leaf)
+{
+    uint64_t largest = 0;
+
+    for (unsigned subleaf = 0; subleaf < 16; ++subleaf)
+    {
+        unsigned regs[4];
+        CpuId(leaf, subleaf, regs);
+
+        // 0 = no more caches, 2 = instruction cache
+        const unsigned type = regs[0] & 31;
+        if (type == 0) {
+            break;
+        }
+        if (type == 2) {
+            continue;
+        }
+
+        const uint64_t ways = ((regs[1] >> 22) & 0x3ff) + 1;
+        const uint64_t partitions = ((regs[1] >> 12) & 0x3ff) + 1;
+        const uint64_t line_bytes = (regs[1] & 0xfff) + 1;
+        const uint64_t sets = (uint64_t)regs[2] + 1;
+
+        const uint64_t bytes = ways * partitions * line_bytes * sets;
+        if (largest < bytes) {
+            largest = bytes;
+        }
+    }
+
+    return largest;
+}
+
+#endif // CORE_CPU_X86
+
+static CpuFeatures DetectCpuFeatures()
+{
+    CpuFeatures features;
+
+#if defined(CORE_CPU_X86)
+    unsigned regs[4];
+
+    CpuId(0, 0, regs);
+    const unsigned max_leaf = regs[0];
+
+    // Vendor string is in EBX, EDX, ECX
+    const bool intel = regs[1] == 0x756e6547 && regs[3] == 0x49656e69 && regs[2] == 0x6c65746e;
+
+    CpuId(1, 0, regs);
+    features.SSE2 = (regs[3] & (1u << 26)) != 0;
+    features.SSSE3 = (regs[2] & (1u << 9)) != 0;
+    features.SSE41 = (regs[2] & (1u << 19)) != 0;
+
+    // AVX state must also be enabled by the OS
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    const bool ymm_enabled = osxsave && (ReadXCR0() & 6) == 6;
+
+    if (max_leaf >= 7 && avx && ymm_enabled) {
+        CpuId(7, 0, regs);
+        features.AVX2 = (regs[1] & (1u << 5)) != 0;
+    }
+
+    if (intel) {
+        if (max_leaf >= 4) {
+            features.LastLevelCacheBytes = DetectLastLevelCacheBytes(4);
+        }
+    } else {
+        CpuId(0x80000000, 0, regs);
+        const unsigned max_extended_leaf = regs[0];
+
+        // Requires the topology extensions bit
+        if (max_extended_leaf >= 0x8000001D) {
+            CpuId(0x80000001, 0, regs);
+            if ((regs[2] & (1u << 22)) != 0) {
+                features.LastLevelCacheBytes = DetectLastLevelCacheBytes(0x8000001D);
+            }
+        }
+    }
+#elif defined(CORE_CPU_ARM64)
+    // NEON is mandatory on AArch64
+    features.NEON = true;
+#endif
+
+    return features;
+}
+
+const CpuFeatures& GetCpuFeatures()
+{
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+
+} // namespace core
@@ -0,0 +1,543 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_cursor.hpp"
+#include "core_bit_math.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h> // memcpy, memcmp
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CursorShape
+
+uint64_t CursorShape::GetRequiredBytes() const
+{
+    if (Width == 0 || Height == 0) {
+        return 0;
+    }
+
+    uint64_t row_bytes = Width;
+    if (Type == CursorShapeType::Monochrome) {
+        row_bytes = (row_bytes + 7) / 8;
+    }
+    else {
+        row_bytes *= 4;
+    }
+
+    return static_cast<uint64_t>(Pitch) * (Height - 1) + row_bytes;
+}
+
+bool CursorShape::IsValid() const
+{
+    if (!Data || Width == 0 || ImageHeight() == 0) {
+        return false;
+    }
+    if (Width > kCursorMaxDimension || ImageHeight() > kCursorMaxDimension) {
+        return false;
+    }
+
+    const uint64_t row_bytes = Type == CursorShapeType::Monochrome ?
+        (Width + 7) / 8 : Width * 4;
+    if (Pitch < row_bytes) {
+        return false;
+    }
+
+    return GetRequiredBytes() <= Bytes;
+}
+
+
+//------------------------------------------------------------------------------
+// Row Kernels
+
+// Blend one 8-bit channel of c over s by alpha a, rounded exactly:
+// (t + (t >> 8)) >> 8 == round(t' / 255) for t = t' + 128 and t' <= 255 * 255
+static CORE_INLINE uint32_t BlendChannel(uint32_t c, uint32_t s, uint32_t a)
+{
+    const uint32_t t = c * a + s * (255 - a) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static CORE_INLINE uint32_t BlendPixel(uint32_t color, uint32_t screen)
+{
+    const uint32_t a = color >> 24;
+    uint32_t result = 0;
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        const uint32_t c = (color >> shift) & 0xff;
+        const uint32_t s = (screen >> shift) & 0xff;
+        result |= BlendChannel(c, s, a) << shift;
+    }
+    return result;
+}
+
+// dest = (screen & and_mask) ^ xor_mask for `count` pixels
+typedef void (*MaskRowFn)(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* and_mask,
+    const uint32_t* xor_mask,
+    unsigned count);
+
+// dest = color blended over screen for `count` pixels
+typedef void (*BlendRowFn)(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* color,
+    unsigned count);
+
+static void MaskRow_Scalar(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* and_mask,
+    const uint32_t* xor_mask,
+    unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        dest[i] = (screen[i] & and_mask[i]) ^ xor_mask[i];
+    }
+}
+
+static void BlendRow_Scalar(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* color,
+    unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        dest[i] = BlendPixel(color[i], screen[i]);
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static void MaskRow_SSE2(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* and_mask,
+    const uint32_t* xor_mask,
+    unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(screen + i));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(and_mask + i));
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xor_mask + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+            _mm_xor_si128(_mm_and_si128(s, a), x));
+    }
+
+    MaskRow_Scalar(dest + i, screen + i, and_mask + i, xor_mask + i, count - i);
+}
+
+// Blend 2 pixels unpacked to 16 bits per channel
+static CORE_INLINE __m128i BlendPixels16_SSE2(__m128i c, __m128i s)
+{
+    const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xff), 0xff);
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_mullo_epi16(s, ia));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void BlendRow_SSE2(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* color,
+    unsigned count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(screen + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color + i));
+
+        const __m128i lo = BlendPixels16_SSE2(
+            _mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(s, zero));
+        const __m128i hi = BlendPixels16_SSE2(
+            _mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(s, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    BlendRow_Scalar(dest + i, screen + i, color + i, count - i);
+}
+
+CORE_TARGET_AVX2 static void MaskRow_AVX2(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* and_mask,
+    const uint32_t* xor_mask,
+    unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(screen + i));
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(and_mask + i));
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xor_mask + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+            _mm256_xor_si256(_mm256_and_si256(s, a), x));
+    }
+
+    MaskRow_Scalar(dest + i, screen + i, and_mask + i, xor_mask + i, count - i);
+}
+
+// Blend 4 pixels unpacked to 16 bits per channel
+CORE_TARGET_AVX2 static CORE_INLINE __m256i BlendPixels16_AVX2(__m256i c, __m256i s)
+{
+    const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c, 0xff), 0xff);
+    const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_mullo_epi16(s, ia));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+CORE_TARGET_AVX2 static void BlendRow_AVX2(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* color,
+    unsigned count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Unpack and pack both work within 128-bit lanes, so pixels keep their order
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(screen + i));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(color + i));
+
+        const __m256i lo = BlendPixels16_AVX2(
+            _mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(s, zero));
+        const __m256i hi = BlendPixels16_AVX2(
+            _mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(s, zero));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    BlendRow_SSE2(dest + i, screen + i, color + i, count - i);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void MaskRow_NEON(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* and_mask,
+    const uint32_t* xor_mask,
+    unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t s = vld1q_u32(screen + i);
+        const uint32x4_t a = vld1q_u32(and_mask + i);
+        const uint32x4_t x = vld1q_u32(xor_mask + i);
+        vst1q_u32(dest + i, veorq_u32(vandq_u32(s, a), x));
+    }
+
+    MaskRow_Scalar(dest + i, screen + i, and_mask + i, xor_mask + i, count - i);
+}
+
+// Blend 2 pixels of 8-bit channels
+static CORE_INLINE uint8x8_t BlendPixels8_NEON(uint8x8_t c, uint8x8_t s, uint8x8_t a)
+{
+    uint16x8_t t = vmull_u8(c, a);
+    t = vmlal_u8(t, s, vmvn_u8(a));
+    t = vaddq_u16(t, vdupq_n_u16(128));
+    return vshrn_n_u16(vsraq_n_u16(t, t, 8), 8);
+}
+
+static void BlendRow_NEON(
+    uint32_t* dest,
+    const uint32_t* screen,
+    const uint32_t* color,
+    unsigned count)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t c32 = vld1q_u32(color + i);
+        const uint8x16_t s = vreinterpretq_u8_u32(vld1q_u32(screen + i));
+        const uint8x16_t c = vreinterpretq_u8_u32(c32);
+
+        // Copy each alpha byte to all four channels of its pixel
+        const uint8x16_t a = vreinterpretq_u8_u32(
+            vmulq_n_u32(vshrq_n_u32(c32, 24), 0x01010101));
+
+        const uint8x8_t lo = BlendPixels8_NEON(vget_low_u8(c), vget_low_u8(s), vget_low_u8(a));
+        const uint8x8_t hi = BlendPixels8_NEON(vget_high_u8(c), vget_high_u8(s), vget_high_u8(a));
+
+        vst1q_u32(dest + i, vreinterpretq_u32_u8(vcombine_u8(lo, hi)));
+    }
+
+    BlendRow_Scalar(dest + i, screen + i, color + i, count - i);
+}
+
+#endif // CORE_CPU_ARM64
+
+static bool SelectCursorRows(CopyKernelPath path, MaskRowFn& mask_row, BlendRowFn& blend_row)
+{
+    if (path == CopyKernelPath::Auto) {
+        path = GetBestCopyKernelPath();
+    }
+    if (!IsCopyKernelPathSupported(path)) {
+        return false;
+    }
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CopyKernelPath::SSE2:
+        mask_row = MaskRow_SSE2;
+        blend_row = BlendRow_SSE2;
+        return true;
+    case CopyKernelPath::AVX2:
+        mask_row = MaskRow_AVX2;
+        blend_row = BlendRow_AVX2;
+        return true;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CopyKernelPath::NEON:
+        mask_row = MaskRow_NEON;
+        blend_row = BlendRow_NEON;
+        return true;
+#endif
+    default:
+        break;
+    }
+    mask_row = MaskRow_Scalar;
+    blend_row = BlendRow_Scalar;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// DecodedCursor
+
+static CORE_INLINE uint32_t ReadPixel(const uint8_t* data)
+{
+    uint32_t pixel;
+    memcpy(&pixel, data, 4);
+    return pixel;
+}
+
+bool DecodedCursor::Decode(const CursorShape& shape, CursorAlpha alpha)
+{
+    if (!shape.IsValid()) {
+        Width = Height = 0;
+        AndMask.clear();
+        XorMask.clear();
+        return false;
+    }
+
+    Width = shape.Width;
+    Height = shape.ImageHeight();
+    Blend = (shape.Type == CursorShapeType::Color && alpha == CursorAlpha::Blend);
+
+    const size_t pixel_count = static_cast<size_t>(Width) * Height;
+    AndMask.resize(Blend ? 0 : pixel_count);
+    XorMask.resize(pixel_count);
+
+    uint32_t* and_mask = AndMask.data();
+    uint32_t* xor_mask = XorMask.data();
+
+    if (shape.Type == CursorShapeType::Monochrome)
+    {
+        // The XOR mask rows follow the AND mask rows
+        const uint8_t* and_bits = shape.Data;
+        const uint8_t* xor_bits = shape.Data + static_cast<size_t>(Height) * shape.Pitch;
+
+        for (unsigned y = 0; y < Height; ++y)
+        {
+            for (unsigned x = 0; x < Width; ++x)
+            {
+                const uint8_t bit = static_cast<uint8_t>(0x80 >> (x % 8));
+
+                // AND 0 blacks out the color and keeps the alpha
+                *and_mask++ = (and_bits[x / 8] & bit) ? 0xffffffff : 0xff000000;
+                *xor_mask++ = (xor_bits[x / 8] & bit) ? 0x00ffffff : 0x00000000;
+            }
+
+            and_bits += shape.Pitch;
+            xor_bits += shape.Pitch;
+        }
+
+        return true;
+    }
+
+    const uint8_t* row = shape.Data;
+    for (unsigned y = 0; y < Height; ++y, row += shape.Pitch)
+    {
+        for (unsigned x = 0; x < Width; ++x)
+        {
+            const uint32_t pixel = ReadPixel(row + x * 4);
+
+            if (Blend) {
+                *xor_mask++ = pixel;
+            }
+            else if (shape.Type == CursorShapeType::Color) {
+                // If alpha is 50% or higher, replace the screen pixel
+                const bool opaque = pixel >= 0x80000000;
+                *and_mask++ = opaque ? 0 : 0xffffffff;
+                *xor_mask++ = opaque ? pixel : 0;
+            }
+            else {
+                // Mask 0 replaces the screen color and mask 0xFF XORs with it
+                const bool replace = (pixel >> 24) == 0;
+                *and_mask++ = replace ? 0 : 0xffffffff;
+                *xor_mask++ = replace ? (pixel | 0xff000000) : (pixel & 0x00ffffff);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool DecodedCursor::Composite(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* screen,
+    unsigned screen_pitch,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    CopyKernelPath path) const
+{
+    if (offset_x > Width || width > Width - offset_x ||
+        offset_y > Height || height > Height - offset_y)
+    {
+        return false;
+    }
+
+    MaskRowFn mask_row = nullptr;
+    BlendRowFn blend_row = nullptr;
+    if (!SelectCursorRows(path, mask_row, blend_row)) {
+        return false;
+    }
+
+    const size_t first = static_cast<size_t>(offset_y) * Width + offset_x;
+    const uint32_t* xor_mask = XorMask.data() + first;
+    const uint32_t* and_mask = Blend ? nullptr : AndMask.data() + first;
+
+    for (unsigned y = 0; y < height; ++y)
+    {
+        uint32_t* dest_row = reinterpret_cast<uint32_t*>(dest);
+        const uint32_t* screen_row = reinterpret_cast<const uint32_t*>(screen);
+
+        if (Blend) {
+            blend_row(dest_row, screen_row, xor_mask, width);
+        }
+        else {
+            mask_row(dest_row, screen_row, and_mask, xor_mask, width);
+            and_mask += Width;
+        }
+        xor_mask += Width;
+
+        dest += dest_pitch;
+        screen += screen_pitch;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CursorCache
+
+static uint64_t HashShapeBytes(const uint8_t* data, size_t bytes)
+{
+    static const uint64_t kMul0 = UINT64_C(0x9e3779b97f4a7c15);
+    static const uint64_t kMul1 = UINT64_C(0xc2b2ae3d27d4eb4f);
+
+    uint64_t h = kMul0 ^ bytes;
+
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = rotl64(h ^ (word * kMul1), 31) * kMul0;
+    }
+    for (; i < bytes; ++i) {
+        h = rotl64(h ^ (data[i] * kMul1), 31) * kMul0;
+    }
+
+    h ^= h >> 33;
+    h *= kMul1;
+    h ^= h >> 29;
+    return h;
+}
+
+const DecodedCursor* CursorCache::Decode(const CursorShape& shape)
+{
+    if (!shape.IsValid()) {
+        return nullptr;
+    }
+
+    const size_t bytes = static_cast<size_t>(shape.GetRequiredBytes());
+    const uint64_t hash = HashShapeBytes(shape.Data, bytes);
+    const CursorAlpha alpha = Alpha;
+
+    ++UseCounter;
+
+    for (Entry& entry : Entries)
+    {
+        if (entry.Hash == hash &&
+            entry.Type == shape.Type &&
+            entry.Alpha == alpha &&
+            entry.Width == shape.Width &&
+            entry.Height == shape.Height &&
+            entry.Pitch == shape.Pitch &&
+            entry.Data.size() == bytes &&
+            memcmp(entry.Data.data(), shape.Data, bytes) == 0)
+        {
+            entry.LastUse = UseCounter;
+            ++Hits;
+            return &entry.Decoded;
+        }
+    }
+
+    ++Misses;
+
+    // Replace the least recently used entry when full
+    Entry* entry = nullptr;
+    if (Entries.size() < kCursorCacheMaxEntries) {
+        Entries.reserve(kCursorCacheMaxEntries);
+        Entries.emplace_back();
+        entry = &Entries.back();
+    }
+    else {
+        entry = &Entries[0];
+        for (Entry& candidate : Entries) {
+            if (candidate.LastUse < entry->LastUse) {
+                entry = &candidate;
+            }
+        }
+    }
+
+    entry->Hash = hash;
+    entry->LastUse = UseCounter;
+    entry->Type = shape.Type;
+    entry->Alpha = alpha;
+    entry->Width = shape.Width;
+    entry->Height = shape.Height;
+    entry->Pitch = shape.Pitch;
+    entry->Data.assign(shape.Data, shape.Data + bytes);
+
+    // Cannot fail: The shape was validated above
+    entry->Decoded.Decode(shape, alpha);
+
+    return &entry->Decoded;
+}
+
+
+} // namespace core
@@ -0,0 +1,539 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_ipc.hpp"
+
+#if defined(_WIN32)
+    #include "core_win32.hpp"
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <string.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <unistd.h>
+
+    #if defined(__linux__)
+        #include <linux/futex.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+#include <chrono>
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+std::string PosixIpcName(const std::string& name)
+{
+    static const char* kGlobalPrefix = "Global\\";
+    static const size_t kGlobalPrefixLen = 7;
+    static const char* kLocalPrefix = "Local\\";
+    static const size_t kLocalPrefixLen = 6;
+
+    std::string result = "/";
+
+    // POSIX has one namespace, so both Windows namespaces map onto it
+    size_t start = 0;
+    if (name.compare(0, kGlobalPrefixLen, kGlobalPrefix) == 0) {
+        start = kGlobalPrefixLen;
+    }
+    else if (name.compare(0, kLocalPrefixLen, kLocalPrefix) == 0) {
+        start = kLocalPrefixLen;
+    }
+
+    for (size_t i = start; i < name.size(); ++i)
+    {
+        const char c = name[i];
+        result += (c == '\\' || c == '/') ? '_' : c;
+    }
+
+    return result;
+}
+
+std::string LastIpcErrorString()
+{
+#if defined(_WIN32)
+    return WindowsErrorString(::GetLastError());
+#else
+    const int code = errno;
+    return std::string(strerror(code)) + " (errno=" + std::to_string(code) + ")";
+#endif
+}
+
+
+#if defined(_WIN32)
+
+//------------------------------------------------------------------------------
+// Windows: Security Attributes
+
+// Allows all access to the object so that the service, the implant, and the
+// user-mode apps can all open it
+struct NullDaclAttributes
+{
+    std::vector<uint8_t> Desc;
+    SECURITY_ATTRIBUTES Attributes;
+
+    NullDaclAttributes()
+        : Desc(SECURITY_DESCRIPTOR_MIN_LENGTH)
+    {
+        Attributes.lpSecurityDescriptor = (PSECURITY_DESCRIPTOR)Desc.data();
+        InitializeSecurityDescriptor(Attributes.lpSecurityDescriptor, SECURITY_DESCRIPTOR_REVISION);
+        // ACL is set as NULL in order to allow all access to the object.
+        SetSecurityDescriptorDacl(Attributes.lpSecurityDescriptor, TRUE, NULL, FALSE);
+        Attributes.nLength = sizeof(Attributes);
+        Attributes.bInheritHandle = FALSE;
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Windows: SharedMemoryFile
+
+SharedMemoryFile::~SharedMemoryFile()
+{
+    Close();
+}
+
+void SharedMemoryFile::Close()
+{
+    if (Front)
+    {
+        ::UnmapViewOfFile(Front);
+        Front = nullptr;
+    }
+
+    if (File)
+    {
+        ::CloseHandle(File);
+        File = nullptr;
+    }
+}
+
+bool SharedMemoryFile::Create(int fileBytes, const std::string& filename)
+{
+    Close();
+
+    FileSizeBytes = fileBytes;
+    if (fileBytes <= 0)
+    {
+        CORE_DEBUG_BREAK(); // Invalid input
+        return false;
+    }
+
+    NullDaclAttributes sa;
+
+    // Create the file
+    File = ::CreateFileMappingA(
+        INVALID_HANDLE_VALUE,
+        &sa.Attributes,
+        PAGE_READWRITE,
+        0,
+        fileBytes,
+        filename.c_str());
+
+    if (!File) {
+        return false;
+    }
+
+    // Map file to memory
+    return mapFile();
+}
+
+bool SharedMemoryFile::Open(int fileBytes, const std::string& filename)
+{
+    Close();
+
+    FileSizeBytes = fileBytes;
+    if (fileBytes <= 0)
+    {
+        CORE_DEBUG_BREAK(); // Invalid input
+        return false;
+    }
+
+    // Open file mapping
+    File = ::OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, TRUE, filename.c_str());
+
+    if (!File)
+    {
+        std::string str = "SharedMemoryFile: OpenFileMappingA failed for '";
+        str += filename;
+        str += "' err=";
+        str += std::to_string(GetLastError());
+        str += "'\n";
+        ::OutputDebugStringA(str.c_str());
+        return false;
+    }
+
+    // Map file to memory
+    return mapFile();
+}
+
+bool SharedMemoryFile::mapFile()
+{
+    // Map file to memory
+    Front = reinterpret_cast<uint8_t*>(::MapViewOfFile(
+        File,
+        FILE_MAP_READ | FILE_MAP_WRITE,
+        0, // offset = 0
+        0, // offset = 0
+        FileSizeBytes));
+
+    if (!Front)
+    {
+        std::string str = "SharedMemoryFile: MapViewOfFile failed err=";
+        str += std::to_string(GetLastError());
+        str += "'\n";
+        ::OutputDebugStringA(str.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Windows: IpcEvent
+
+IpcEvent::~IpcEvent()
+{
+    Close();
+}
+
+bool IpcEvent::Create(const std::string& name)
+{
+    Close();
+
+    NullDaclAttributes sa;
+
+    // Auto-reset, initially non-signaled
+    Handle = ::CreateEventA(&sa.Attributes, FALSE, FALSE, name.c_str());
+    return Handle != nullptr;
+}
+
+bool IpcEvent::Open(const std::string& name)
+{
+    Close();
+
+    Handle = ::OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, name.c_str());
+    return Handle != nullptr;
+}
+
+void IpcEvent::Close()
+{
+    if (Handle)
+    {
+        ::CloseHandle(Handle);
+        Handle = nullptr;
+    }
+}
+
+bool IpcEvent::Valid() const
+{
+    return Handle != nullptr;
+}
+
+void IpcEvent::Signal()
+{
+    ::SetEvent(Handle);
+}
+
+void IpcEvent::Reset()
+{
+    ::ResetEvent(Handle);
+}
+
+IpcWaitResult IpcEvent::Wait(int timeout_msec)
+{
+    const DWORD timeout = timeout_msec < 0 ? INFINITE : static_cast<DWORD>(timeout_msec);
+    const DWORD result = ::WaitForSingleObject(Handle, timeout);
+    if (result == WAIT_OBJECT_0) {
+        return IpcWaitResult::Signaled;
+    }
+    if (result == WAIT_TIMEOUT) {
+        return IpcWaitResult::Timeout;
+    }
+    return IpcWaitResult::Error;
+}
+
+
+#else // _WIN32
+
+//------------------------------------------------------------------------------
+// POSIX: SharedMemoryFile
+
+SharedMemoryFile::~SharedMemoryFile()
+{
+    Close();
+}
+
+void SharedMemoryFile::Close()
+{
+    if (Front)
+    {
+        ::munmap(Front, static_cast<size_t>(FileSizeBytes));
+        Front = nullptr;
+    }
+
+    if (File != -1)
+    {
+        ::close(File);
+        File = -1;
+    }
+
+    // The creator owns the name, like the last handle to a Windows mapping
+    if (!UnlinkName.empty())
+    {
+        ::shm_unlink(UnlinkName.c_str());
+        UnlinkName.clear();
+    }
+}
+
+bool SharedMemoryFile::Create(int fileBytes, const std::string& filename)
+{
+    Close();
+
+    FileSizeBytes = fileBytes;
+    if (fileBytes <= 0)
+    {
+        CORE_DEBUG_BREAK(); // Invalid input
+        return false;
+    }
+
+    const std::string name = PosixIpcName(filename);
+
+    // Like CreateFileMappingA, attach to an existing object of the same name
+    File = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (File == -1) {
+        return false;
+    }
+    UnlinkName = name;
+
+    // shm_open() is subject to the umask, so open up access explicitly
+    ::fchmod(File, 0666);
+
+    struct stat st {};
+    if (::fstat(File, &st) != 0) {
+        return false;
+    }
+
+    // New objects are zero-filled after growing
+    if (st.st_size < fileBytes && ::ftruncate(File, fileBytes) != 0) {
+        return false;
+    }
+
+    // Map file to memory
+    return mapFile();
+}
+
+bool SharedMemoryFile::Open(int fileBytes, const std::string& filename)
+{
+    Close();
+
+    FileSizeBytes = fileBytes;
+    if (fileBytes <= 0)
+    {
+        CORE_DEBUG_BREAK(); // Invalid input
+        return false;
+    }
+
+    // Open file mapping
+    File = ::shm_open(PosixIpcName(filename).c_str(), O_RDWR, 0);
+    if (File == -1) {
+        return false;
+    }
+
+    // Reject objects that are too small rather than faulting on access
+    struct stat st {};
+    if (::fstat(File, &st) != 0 || st.st_size < fileBytes)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    // Map file to memory
+    return mapFile();
+}
+
+bool SharedMemoryFile::mapFile()
+{
+    // Map file to memory
+    void* front = ::mmap(
+        nullptr,
+        static_cast<size_t>(FileSizeBytes),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        File,
+        0); // offset = 0
+
+    if (front == MAP_FAILED) {
+        return false;
+    }
+
+    Front = reinterpret_cast<uint8_t*>(front);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// POSIX: IpcEvent
+
+// Suffix so that an event never aliases a shared memory file of the same name
+static const char* kEventNameSuffix = "_event";
+
+#if defined(__linux__)
+
+// Process-shared futex operations on a word in shared memory.
+// The non-private ops are required since the waiter and waker may be in
+// different processes
+static int FutexWait(std::atomic<uint32_t>* word, uint32_t expected, const struct timespec* timeout)
+{
+    return static_cast<int>(::syscall(SYS_futex,
+        reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout, nullptr, 0));
+}
+
+static void FutexWake(std::atomic<uint32_t>* word, int count)
+{
+    ::syscall(SYS_futex,
+        reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+#endif // __linux__
+
+IpcEvent::~IpcEvent()
+{
+    Close();
+}
+
+bool IpcEvent::Create(const std::string& name)
+{
+    Close();
+
+    if (!File.Create(static_cast<int>(sizeof(SharedState)), name + kEventNameSuffix)) {
+        return false;
+    }
+
+    if (!mapState()) {
+        return false;
+    }
+
+    // Non-signaled like CreateEventA(..., FALSE, FALSE, ...)
+    State->Signaled.store(0, std::memory_order_release);
+    return true;
+}
+
+bool IpcEvent::Open(const std::string& name)
+{
+    Close();
+
+    if (!File.Open(static_cast<int>(sizeof(SharedState)), name + kEventNameSuffix)) {
+        return false;
+    }
+
+    return mapState();
+}
+
+bool IpcEvent::mapState()
+{
+    State = reinterpret_cast<SharedState*>(File.GetFront());
+    return State != nullptr;
+}
+
+void IpcEvent::Close()
+{
+    State = nullptr;
+    File.Close();
+}
+
+bool IpcEvent::Valid() const
+{
+    return State != nullptr;
+}
+
+void IpcEvent::Signal()
+{
+    if (!State) {
+        return;
+    }
+
+    // Already signaled: Auto-reset events do not count signals
+    if (State->Signaled.exchange(1, std::memory_order_seq_cst) != 0) {
+        return;
+    }
+
+#if defined(__linux__)
+    // Skip the syscall when nobody is blocked.  Seq-cst pairs with the
+    // waiter incrementing Waiters before re-checking Signaled
+    if (State->Waiters.load(std::memory_order_seq_cst) != 0) {
+        FutexWake(&State->Signaled, 1);
+    }
+#endif
+}
+
+void IpcEvent::Reset()
+{
+    if (State) {
+        State->Signaled.store(0, std::memory_order_release);
+    }
+}
+
+IpcWaitResult IpcEvent::Wait(int timeout_msec)
+{
+    if (!State) {
+        errno = EBADF;
+        return IpcWaitResult::Error;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(timeout_msec < 0 ? 0 : timeout_msec);
+
+    for (;;)
+    {
+        // Consume the signal so that only one waiter is released
+        uint32_t expected = 1;
+        if (State->Signaled.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+            return IpcWaitResult::Signaled;
+        }
+
+        int64_t remaining_usec = -1;
+        if (timeout_msec >= 0)
+        {
+            remaining_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining_usec <= 0) {
+                return IpcWaitResult::Timeout;
+            }
+        }
+
+#if defined(__linux__)
+        struct timespec ts {};
+        ts.tv_sec = static_cast<time_t>(remaining_usec / 1000000);
+        ts.tv_nsec = static_cast<long>(remaining_usec % 1000000) * 1000;
+
+        State->Waiters.fetch_add(1, std::memory_order_seq_cst);
+        const int result = FutexWait(&State->Signaled, 0, remaining_usec < 0 ? nullptr : &ts);
+        const int error = errno;
+        State->Waiters.fetch_sub(1, std::memory_order_seq_cst);
+
+        // EAGAIN: Signaled changed before we slept.  ETIMEDOUT: Checked above
+        if (result != 0 && error != EAGAIN && error != EINTR && error != ETIMEDOUT)
+        {
+            errno = error;
+            return IpcWaitResult::Error;
+        }
+#else
+        // No futex: Poll at a rate well above the camera frame rate
+        CORE_UNUSED(remaining_usec);
+        ::usleep(500);
+#endif
+    }
+}
+
+#endif // _WIN32
+
+
+} // namespace core
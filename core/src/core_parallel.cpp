@@ -0,0 +1,130 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_parallel.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// WorkerPool
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+}
+
+void WorkerPool::Start(unsigned worker_count)
+{
+    Stop();
+
+    if (worker_count == 0) {
+        const unsigned hardware_threads = std::thread::hardware_concurrency();
+        worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Terminated = false;
+        Job = nullptr;
+        ActiveWorkers = 0;
+    }
+
+    for (unsigned i = 0; i < worker_count; ++i) {
+        Threads.push_back(std::make_shared<std::thread>(&WorkerPool::WorkerLoop, this));
+    }
+}
+
+void WorkerPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Terminated = true;
+    }
+    StartCondition.notify_all();
+
+    for (auto& thread : Threads) {
+        JoinThread(thread);
+    }
+    Threads.clear();
+}
+
+void WorkerPool::RunItems(const std::function<void(unsigned)>& fn, unsigned count)
+{
+    for (;;)
+    {
+        const unsigned index = NextIndex++;
+        if (index >= count) {
+            break;
+        }
+        fn(index);
+    }
+}
+
+void WorkerPool::WorkerLoop()
+{
+    SetCurrentThreadName("WorkerPool");
+
+    uint64_t seen_epoch = 0;
+
+    std::unique_lock<std::mutex> locker(Lock);
+    for (;;)
+    {
+        StartCondition.wait(locker, [&]() {
+            return Terminated || JobEpoch != seen_epoch;
+        });
+        if (Terminated) {
+            break;
+        }
+        seen_epoch = JobEpoch;
+
+        // Woke up after the caller finished the loop without us
+        if (!Job) {
+            continue;
+        }
+
+        const std::function<void(unsigned)>* job = Job;
+        const unsigned count = JobCount;
+        ++ActiveWorkers;
+
+        locker.unlock();
+        RunItems(*job, count);
+        locker.lock();
+
+        if (--ActiveWorkers == 0) {
+            DoneCondition.notify_all();
+        }
+    }
+}
+
+void WorkerPool::ParallelFor(unsigned count, const std::function<void(unsigned)>& fn)
+{
+    std::lock_guard<std::mutex> call_locker(CallLock);
+
+    if (Threads.empty() || count <= 1) {
+        for (unsigned i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Job = &fn;
+        JobCount = count;
+        NextIndex = 0;
+        ++JobEpoch;
+    }
+    StartCondition.notify_all();
+
+    RunItems(fn, count);
+
+    // Every item has been claimed, so wait for the workers still running one
+    std::unique_lock<std::mutex> locker(Lock);
+    DoneCondition.wait(locker, [&]() {
+        return ActiveWorkers == 0;
+    });
+    Job = nullptr;
+}
+
+
+} // namespace core
@@ -0,0 +1,565 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_region.hpp"
+
+#include <string.h> // memcmp
+#include <limits.h>
+#include <algorithm>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/// Combine two sorted lists of disjoint spans (Left, Right pairs)
+static void CombineSpans(
+    const int* a,
+    unsigned a_count,
+    const int* b,
+    unsigned b_count,
+    bool keep_a_only,
+    bool keep_b_only,
+    bool keep_both,
+    std::vector<int>& out)
+{
+    const unsigned a_end = a_count * 2;
+    const unsigned b_end = b_count * 2;
+    unsigned i = 0, j = 0;
+    bool in_a = false, in_b = false, inside = false;
+
+    // Walk the span edges left to right, toggling which input we are in
+    while (i < a_end || j < b_end)
+    {
+        int x;
+        if (j >= b_end || (i < a_end && a[i] <= b[j])) {
+            x = a[i];
+        }
+        else {
+            x = b[j];
+        }
+
+        while (i < a_end && a[i] == x) {
+            in_a = !in_a;
+            ++i;
+        }
+        while (j < b_end && b[j] == x) {
+            in_b = !in_b;
+            ++j;
+        }
+
+        const bool now = in_a ? (in_b ? keep_both : keep_a_only) : (in_b && keep_b_only);
+        if (now != inside) {
+            out.push_back(x);
+            inside = now;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// RegionRect
+
+RegionRect RegionRect::BoundingUnion(const RegionRect& other) const
+{
+    return RegionRect(
+        std::min(Left, other.Left),
+        std::min(Top, other.Top),
+        std::max(Right, other.Right),
+        std::max(Bottom, other.Bottom));
+}
+
+
+//------------------------------------------------------------------------------
+// Region
+
+uint64_t Region::GetArea() const
+{
+    uint64_t area = 0;
+    for (const Band& band : Bands)
+    {
+        uint64_t width = 0;
+        const int* spans = Spans.data() + band.SpanStart * 2;
+        for (unsigned i = 0; i < band.SpanCount; ++i) {
+            width += static_cast<unsigned>(spans[i * 2 + 1] - spans[i * 2]);
+        }
+        area += width * static_cast<unsigned>(band.Bottom - band.Top);
+    }
+    return area;
+}
+
+RegionRect Region::GetBounds() const
+{
+    if (Bands.empty()) {
+        return RegionRect();
+    }
+
+    RegionRect bounds(INT_MAX, Bands.front().Top, INT_MIN, Bands.back().Bottom);
+    for (const Band& band : Bands)
+    {
+        const int* spans = Spans.data() + band.SpanStart * 2;
+        bounds.Left = std::min(bounds.Left, spans[0]);
+        bounds.Right = std::max(bounds.Right, spans[band.SpanCount * 2 - 1]);
+    }
+    return bounds;
+}
+
+void Region::Set(const RegionRect& rect)
+{
+    Clear();
+    if (rect.Empty()) {
+        return;
+    }
+
+    Band band;
+    band.Top = rect.Top;
+    band.Bottom = rect.Bottom;
+    band.SpanStart = 0;
+    band.SpanCount = 1;
+    Bands.push_back(band);
+    Spans.push_back(rect.Left);
+    Spans.push_back(rect.Right);
+}
+
+void Region::Set(const RegionRect* rects, unsigned count)
+{
+    Clear();
+
+    SortedRects.clear();
+    RowEdges.clear();
+    for (unsigned i = 0; i < count; ++i) {
+        if (!rects[i].Empty()) {
+            SortedRects.push_back(rects[i]);
+            RowEdges.push_back(rects[i].Top);
+            RowEdges.push_back(rects[i].Bottom);
+        }
+    }
+    if (SortedRects.empty()) {
+        return;
+    }
+
+    std::sort(SortedRects.begin(), SortedRects.end(),
+        [](const RegionRect& a, const RegionRect& b) {
+            return a.Top < b.Top;
+        });
+    std::sort(RowEdges.begin(), RowEdges.end());
+    RowEdges.erase(std::unique(RowEdges.begin(), RowEdges.end()), RowEdges.end());
+
+    // Sweep down the row edges, keeping the rects that cover each band
+    // sorted by their left edge
+    ActiveRects.clear();
+    unsigned next = 0;
+    const unsigned sorted_count = static_cast<unsigned>(SortedRects.size());
+    const unsigned edge_count = static_cast<unsigned>(RowEdges.size());
+
+    for (unsigned e = 0; e + 1 < edge_count; ++e)
+    {
+        const int top = RowEdges[e];
+        const int bottom = RowEdges[e + 1];
+
+        ActiveRects.erase(
+            std::remove_if(ActiveRects.begin(), ActiveRects.end(),
+                [top](const RegionRect& rect) {
+                    return rect.Bottom <= top;
+                }),
+            ActiveRects.end());
+
+        bool added = false;
+        while (next < sorted_count && SortedRects[next].Top == top) {
+            ActiveRects.push_back(SortedRects[next++]);
+            added = true;
+        }
+        if (added) {
+            std::sort(ActiveRects.begin(), ActiveRects.end(),
+                [](const RegionRect& a, const RegionRect& b) {
+                    return a.Left < b.Left;
+                });
+        }
+
+        // Merge overlapping and touching spans
+        const unsigned span_start = static_cast<unsigned>(Spans.size() / 2);
+        for (const RegionRect& rect : ActiveRects)
+        {
+            if (Spans.size() / 2 > span_start && rect.Left <= Spans.back()) {
+                Spans.back() = std::max(Spans.back(), rect.Right);
+            }
+            else {
+                Spans.push_back(rect.Left);
+                Spans.push_back(rect.Right);
+            }
+        }
+        AppendBand(Bands, Spans, top, bottom, span_start);
+    }
+}
+
+void Region::Union(const RegionRect& rect)
+{
+    if (rect.Empty()) {
+        return;
+    }
+    if (Bands.empty()) {
+        Set(rect);
+        return;
+    }
+    Combine(rect, Op::Union);
+}
+
+void Region::Union(const Region& other)
+{
+    Combine(other.Bands.data(), other.GetBandCount(), other.Spans.data(), Op::Union);
+}
+
+void Region::Subtract(const RegionRect& rect)
+{
+    if (rect.Empty() || Bands.empty()) {
+        return;
+    }
+    Combine(rect, Op::Subtract);
+}
+
+void Region::Subtract(const Region& other)
+{
+    Combine(other.Bands.data(), other.GetBandCount(), other.Spans.data(), Op::Subtract);
+}
+
+void Region::Intersect(const RegionRect& rect)
+{
+    if (rect.Empty()) {
+        Clear();
+        return;
+    }
+    Combine(rect, Op::Intersect);
+}
+
+void Region::Intersect(const Region& other)
+{
+    Combine(other.Bands.data(), other.GetBandCount(), other.Spans.data(), Op::Intersect);
+}
+
+bool Region::Contains(int x, int y) const
+{
+    for (const Band& band : Bands)
+    {
+        if (y < band.Top) {
+            break;
+        }
+        if (y >= band.Bottom) {
+            continue;
+        }
+        const int* spans = Spans.data() + band.SpanStart * 2;
+        for (unsigned i = 0; i < band.SpanCount; ++i) {
+            if (x >= spans[i * 2] && x < spans[i * 2 + 1]) {
+                return true;
+            }
+        }
+        break;
+    }
+    return false;
+}
+
+bool Region::Intersects(const RegionRect& rect) const
+{
+    if (rect.Empty()) {
+        return false;
+    }
+
+    for (const Band& band : Bands)
+    {
+        if (band.Top >= rect.Bottom) {
+            break;
+        }
+        if (band.Bottom <= rect.Top) {
+            continue;
+        }
+        const int* spans = Spans.data() + band.SpanStart * 2;
+        for (unsigned i = 0; i < band.SpanCount; ++i) {
+            if (spans[i * 2] < rect.Right && rect.Left < spans[i * 2 + 1]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Region::GetRects(std::vector<RegionRect>& rects) const
+{
+    for (const Band& band : Bands)
+    {
+        const int* spans = Spans.data() + band.SpanStart * 2;
+        for (unsigned i = 0; i < band.SpanCount; ++i) {
+            rects.push_back(RegionRect(spans[i * 2], band.Top, spans[i * 2 + 1], band.Bottom));
+        }
+    }
+}
+
+void Region::Combine(const RegionRect& rect, Op op)
+{
+    Band band;
+    band.Top = rect.Top;
+    band.Bottom = rect.Bottom;
+    band.SpanStart = 0;
+    band.SpanCount = 1;
+    const int spans[2] = { rect.Left, rect.Right };
+
+    Combine(&band, rect.Empty() ? 0 : 1, spans, op);
+}
+
+void Region::AppendBand(
+    std::vector<Band>& bands,
+    std::vector<int>& spans,
+    int top,
+    int bottom,
+    unsigned span_start)
+{
+    const unsigned span_count = static_cast<unsigned>(spans.size() / 2) - span_start;
+    if (span_count == 0) {
+        return;
+    }
+
+    if (!bands.empty())
+    {
+        Band& last = bands.back();
+        if (last.Bottom == top &&
+            last.SpanCount == span_count &&
+            0 == memcmp(
+                spans.data() + last.SpanStart * 2,
+                spans.data() + span_start * 2,
+                span_count * 2 * sizeof(int)))
+        {
+            // Coalesce with the band above
+            last.Bottom = bottom;
+            spans.resize(span_start * 2);
+            return;
+        }
+    }
+
+    Band band;
+    band.Top = top;
+    band.Bottom = bottom;
+    band.SpanStart = span_start;
+    band.SpanCount = span_count;
+    bands.push_back(band);
+}
+
+void Region::Combine(const Band* other_bands, unsigned other_count, const int* other_spans, Op op)
+{
+    ScratchBands.clear();
+    ScratchSpans.clear();
+
+    const bool keep_a_only = (op != Op::Intersect);
+    const bool keep_b_only = (op == Op::Union);
+    const bool keep_both = (op != Op::Subtract);
+
+    const Band* a_bands = Bands.data();
+    const unsigned a_count = static_cast<unsigned>(Bands.size());
+    const int* a_spans = Spans.data();
+
+    unsigned ia = 0, ib = 0;
+    int y = INT_MIN;
+
+    // Sweep down through both band lists, splitting at every band edge
+    for (;;)
+    {
+        while (ia < a_count && a_bands[ia].Bottom <= y) {
+            ++ia;
+        }
+        while (ib < other_count && other_bands[ib].Bottom <= y) {
+            ++ib;
+        }
+
+        const Band* a = ia < a_count ? &a_bands[ia] : nullptr;
+        const Band* b = ib < other_count ? &other_bands[ib] : nullptr;
+
+        // Stop when nothing more can be kept
+        if (!a && (!b || !keep_b_only)) {
+            break;
+        }
+        if (!b && !keep_a_only) {
+            break;
+        }
+
+        // Skip rows that neither covers
+        int top = y;
+        const int next_top = std::min(a ? a->Top : INT_MAX, b ? b->Top : INT_MAX);
+        if (top < next_top) {
+            top = next_top;
+        }
+
+        const bool a_in = a && a->Top <= top;
+        const bool b_in = b && b->Top <= top;
+
+        int bottom = INT_MAX;
+        if (a) {
+            bottom = std::min(bottom, a_in ? a->Bottom : a->Top);
+        }
+        if (b) {
+            bottom = std::min(bottom, b_in ? b->Bottom : b->Top);
+        }
+
+        const unsigned span_start = static_cast<unsigned>(ScratchSpans.size() / 2);
+        CombineSpans(
+            a_in ? a_spans + a->SpanStart * 2 : nullptr,
+            a_in ? a->SpanCount : 0,
+            b_in ? other_spans + b->SpanStart * 2 : nullptr,
+            b_in ? b->SpanCount : 0,
+            keep_a_only,
+            keep_b_only,
+            keep_both,
+            ScratchSpans);
+        AppendBand(ScratchBands, ScratchSpans, top, bottom, span_start);
+
+        y = bottom;
+    }
+
+    Bands.swap(ScratchBands);
+    Spans.swap(ScratchSpans);
+}
+
+
+//------------------------------------------------------------------------------
+// PlanRegionCopies
+
+/// Join rects that exactly stack on top of each other.  Bands split the
+/// input rects wherever another rect starts or ends, and this puts most of
+/// them back together without covering any extra pixels
+static void JoinStackedRects(std::vector<RegionRect>& rects)
+{
+    // Rects are in band order, so the one below a rect comes later
+    const unsigned count = static_cast<unsigned>(rects.size());
+    unsigned kept = 0;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        RegionRect& rect = rects[i];
+        if (rect.Empty()) {
+            continue;
+        }
+
+        for (unsigned j = i + 1; j < count; ++j)
+        {
+            const RegionRect& below = rects[j];
+            if (below.Top > rect.Bottom) {
+                break;
+            }
+            if (below.Top == rect.Bottom &&
+                below.Left == rect.Left &&
+                below.Right == rect.Right)
+            {
+                rect.Bottom = below.Bottom;
+                rects[j] = RegionRect();
+            }
+        }
+
+        rects[kept++] = rect;
+    }
+    rects.resize(kept);
+}
+
+/// Returns the cost saved by replacing rects i and j with their bounding
+/// box, which also swallows any rect inside it.  Returns 0 if the box would
+/// partly overlap another rect
+static int64_t GetMergeGain(
+    const std::vector<RegionRect>& rects,
+    unsigned i,
+    unsigned j,
+    const RegionCopyCost& cost,
+    RegionRect& merged)
+{
+    merged = rects[i].BoundingUnion(rects[j]);
+
+    int64_t gain = static_cast<int64_t>(cost.Cost(rects[i]) + cost.Cost(rects[j])) -
+        static_cast<int64_t>(cost.Cost(merged));
+
+    // Swallowed rects only add to the gain, so skip the scan for merges
+    // that cannot pay off
+    if (gain <= 0) {
+        return 0;
+    }
+
+    const unsigned count = static_cast<unsigned>(rects.size());
+    for (unsigned k = 0; k < count; ++k)
+    {
+        if (k == i || k == j || !merged.Intersects(rects[k])) {
+            continue;
+        }
+        if (!merged.Contains(rects[k])) {
+            return 0;
+        }
+        gain += static_cast<int64_t>(cost.Cost(rects[k]));
+    }
+    return gain;
+}
+
+uint64_t PlanRegionCopies(
+    const Region& region,
+    const RegionCopyCost& cost,
+    std::vector<RegionRect>& rects)
+{
+    rects.clear();
+    region.GetRects(rects);
+    if (rects.empty()) {
+        return 0;
+    }
+
+    JoinStackedRects(rects);
+
+    uint64_t total = 0;
+    for (const RegionRect& rect : rects) {
+        total += cost.Cost(rect);
+    }
+
+    // Take any merge that saves cost, and repeat until a pass finds none.
+    // A merged rect may swallow other rects whole, but partial overlaps are
+    // not allowed, so no pixel is ever copied twice
+    bool merged_any = true;
+    while (merged_any && rects.size() >= 2 && rects.size() <= kRegionPlanMaxMergeRects)
+    {
+        merged_any = false;
+
+        for (unsigned i = 0; i < rects.size(); ++i)
+        {
+            for (unsigned j = i + 1; j < rects.size(); ++j)
+            {
+                RegionRect merged;
+                const int64_t gain = GetMergeGain(rects, i, j, cost, merged);
+                if (gain <= 0) {
+                    continue;
+                }
+
+                // Replace i with the box and drop j and everything it swallowed
+                const unsigned count = static_cast<unsigned>(rects.size());
+                unsigned kept = 0, new_i = 0;
+                for (unsigned k = 0; k < count; ++k)
+                {
+                    if (k == i) {
+                        new_i = kept;
+                        rects[kept++] = merged;
+                    }
+                    else if (!merged.Contains(rects[k])) {
+                        rects[kept++] = rects[k];
+                    }
+                }
+                rects.resize(kept);
+                total -= static_cast<uint64_t>(gain);
+                merged_any = true;
+
+                // The box may now reach rects that were checked already
+                i = new_i;
+                j = i;
+            }
+        }
+    }
+
+    // Many scattered rects can still lose to one big copy
+    const RegionRect bounds = region.GetBounds();
+    const uint64_t bounds_cost = cost.Cost(bounds);
+    if (rects.size() > 1 && bounds_cost <= total) {
+        rects.clear();
+        rects.push_back(bounds);
+        total = bounds_cost;
+    }
+
+    return total;
+}
+
+
+} // namespace core
@@ -0,0 +1,648 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "core_tile_hash.hpp"
+#include "core_bit_math.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h> // memcpy
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Hash Constants
+
+// Each stripe of 64 bytes is accumulated into 8 lanes of 64 bits
+static const unsigned kHashStripeBytes = 64;
+static const unsigned kHashLanes = 8;
+
+// Stripe s of a row uses keys (s % 16) .. (s % 16) + 7, mixed with a key
+// for the row and the block of 16 stripes
+static const unsigned kHashStripesPerBlock = 16;
+
+static const uint32_t kHashScrambleMul = 0x9e3779b1;
+static const uint64_t kHashPositionMul = UINT64_C(0x9e3779b97f4a7c15);
+
+// Tiles hashed per walk of the band, so the accumulators stay on the stack
+static const unsigned kHashMaxBandTiles = 64;
+
+static const uint64_t kHashStripeKeys[kHashStripesPerBlock + kHashLanes - 1] = {
+    UINT64_C(0xba8894fa3be59747), UINT64_C(0x069945dea82460da), UINT64_C(0xf2b5717db02809ea),
+    UINT64_C(0x4604208f575a097a), UINT64_C(0x9b2af0a33458f9d3), UINT64_C(0x0036c74e48fed613),
+    UINT64_C(0x250924992b7b8fb9), UINT64_C(0x11c2dd5402147e8b), UINT64_C(0xa150217aa00ce50f),
+    UINT64_C(0x1b08078cdca13467), UINT64_C(0x0ba8d4827c1ac113), UINT64_C(0x10f3ff5b71bb3208),
+    UINT64_C(0x378ae3c511f071f3), UINT64_C(0x2edc5bbc191f9c16), UINT64_C(0x8f4870d0d2ffeaca),
+    UINT64_C(0x0bdfe62b0dad52f6), UINT64_C(0x81b330eb8eb7f693), UINT64_C(0xde7c4e8eb1d4ec36),
+    UINT64_C(0x5a3a88dd3d4ce484), UINT64_C(0xac4ee57bbf8f82b3), UINT64_C(0x8aa01872aaa66025),
+    UINT64_C(0xf994dede4ff35e16), UINT64_C(0xe9e99704acc43221)
+};
+
+static const uint64_t kHashScrambleKeys[kHashLanes] = {
+    UINT64_C(0xf77540e67c5ce006), UINT64_C(0x7fb67aa2839a3afa), UINT64_C(0x62eaa7be3a969775),
+    UINT64_C(0xed7c7e7471f81d3e), UINT64_C(0x44b9b8e7c416531e), UINT64_C(0xa0bae0a52ba38c20),
+    UINT64_C(0xb03722d1167c9ae4), UINT64_C(0x74f6872f327d115b)
+};
+
+static const uint64_t kHashInitialLanes[kHashLanes] = {
+    UINT64_C(0x242f45bd13afd80c), UINT64_C(0x8886c14a554c590d), UINT64_C(0x1fa3d4a9cdcbb1b8),
+    UINT64_C(0xbbfc2f7d4c8891b0), UINT64_C(0x112ba465a31fe637), UINT64_C(0x8f29233ff329b0b9),
+    UINT64_C(0xdfcde354ed423444), UINT64_C(0xaaed96625e0c5294)
+};
+
+// Key shared by the stripes of a block in a row of a tile.  Both steps can
+// be undone, so each position gets its own key, and the shift brings the
+// row into the low half that the products multiply by
+static CORE_INLINE uint64_t PositionKey(unsigned row, unsigned block)
+{
+    const uint64_t key = ((static_cast<uint64_t>(row) << 32) | block) * kHashPositionMul;
+    return key ^ (key >> 29);
+}
+
+
+//------------------------------------------------------------------------------
+// Band Kernels
+
+// Accumulate `rows` rows into 8 lanes per tile in `acc`, where each tile is
+// `tile_bytes` of the row and the last one may be narrower
+typedef void (*HashTilesFn)(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes);
+
+static CORE_INLINE uint64_t ReadU64(const uint8_t* data)
+{
+    uint64_t x;
+    memcpy(&x, data, 8);
+    return x;
+}
+
+static CORE_INLINE void AccumulateStripe_Scalar(
+    uint64_t* acc,
+    const uint8_t* data,
+    const uint64_t* keys,
+    uint64_t position_key)
+{
+    for (unsigned i = 0; i < kHashLanes; ++i)
+    {
+        const uint64_t d = ReadU64(data + i * 8);
+        const uint64_t dk = d ^ keys[i] ^ position_key;
+        acc[i ^ 1] += d;
+        acc[i] += (dk & 0xffffffff) * (dk >> 32);
+    }
+}
+
+static CORE_INLINE void Scramble_Scalar(uint64_t* acc)
+{
+    for (unsigned i = 0; i < kHashLanes; ++i)
+    {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= kHashScrambleKeys[i];
+        acc[i] = a * kHashScrambleMul;
+    }
+}
+
+// Every path walks the band the same way: Each row is read once in memory
+// order, and each tile's part of it goes into that tile's lanes.  The end
+// of a tile row that does not fill a stripe is zero padded.  Lanes are
+// only scrambled when the tile is finished, by FinalizeTile()
+static CORE_INLINE void HashTileRow_Scalar(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned bytes,
+    unsigned row)
+{
+    unsigned stripe = 0, block = 0;
+    uint64_t position_key = PositionKey(row, 0);
+    unsigned i = 0;
+    for (; i + kHashStripeBytes <= bytes; i += kHashStripeBytes) {
+        AccumulateStripe_Scalar(acc, data + i, kHashStripeKeys + stripe, position_key);
+        if (++stripe == kHashStripesPerBlock) {
+            position_key = PositionKey(row, ++block);
+            stripe = 0;
+        }
+    }
+    if (i < bytes) {
+        uint8_t tail[kHashStripeBytes] = {};
+        memcpy(tail, data + i, bytes - i);
+        AccumulateStripe_Scalar(acc, tail, kHashStripeKeys + stripe, position_key);
+    }
+}
+
+static void HashTiles_Scalar(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes)
+{
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        uint64_t* tile_acc = acc;
+        for (unsigned x = 0; x < row_bytes; x += tile_bytes, tile_acc += kHashLanes) {
+            const unsigned bytes = row_bytes - x < tile_bytes ? row_bytes - x : tile_bytes;
+            HashTileRow_Scalar(tile_acc, data + x, bytes, y);
+        }
+
+        data += pitch;
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static CORE_INLINE void AccumulateStripe_SSE2(
+    __m128i* acc,
+    const uint8_t* data,
+    const uint64_t* keys,
+    __m128i position_key)
+{
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16));
+        const __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i * 2));
+        const __m128i dk = _mm_xor_si128(d, _mm_xor_si128(k, position_key));
+
+        // Low times high half of each lane
+        const __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+
+        // Swap the two lanes
+        const __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+
+        acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+    }
+}
+
+static CORE_INLINE void HashTileRow_SSE2(
+    uint64_t* acc_io,
+    const uint8_t* data,
+    unsigned bytes,
+    unsigned row)
+{
+    __m128i acc[4];
+    for (unsigned i = 0; i < 4; ++i) {
+        acc[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc_io + i * 2));
+    }
+
+    unsigned stripe = 0, block = 0;
+    __m128i position_key = _mm_set1_epi64x(static_cast<int64_t>(PositionKey(row, 0)));
+    unsigned i = 0;
+    for (; i + kHashStripeBytes <= bytes; i += kHashStripeBytes) {
+        AccumulateStripe_SSE2(acc, data + i, kHashStripeKeys + stripe, position_key);
+        if (++stripe == kHashStripesPerBlock) {
+            position_key = _mm_set1_epi64x(static_cast<int64_t>(PositionKey(row, ++block)));
+            stripe = 0;
+        }
+    }
+    if (i < bytes) {
+        uint8_t tail[kHashStripeBytes] = {};
+        memcpy(tail, data + i, bytes - i);
+        AccumulateStripe_SSE2(acc, tail, kHashStripeKeys + stripe, position_key);
+    }
+
+    for (unsigned i = 0; i < 4; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc_io + i * 2), acc[i]);
+    }
+}
+
+static void HashTiles_SSE2(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes)
+{
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        uint64_t* tile_acc = acc;
+        for (unsigned x = 0; x < row_bytes; x += tile_bytes, tile_acc += kHashLanes) {
+            const unsigned bytes = row_bytes - x < tile_bytes ? row_bytes - x : tile_bytes;
+            HashTileRow_SSE2(tile_acc, data + x, bytes, y);
+        }
+
+        data += pitch;
+    }
+}
+
+CORE_TARGET_AVX2 static CORE_INLINE void AccumulateStripe_AVX2(
+    __m256i* acc,
+    const uint8_t* data,
+    const uint64_t* keys,
+    __m256i position_key)
+{
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 32));
+        const __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i * 4));
+        const __m256i dk = _mm256_xor_si256(d, _mm256_xor_si256(k, position_key));
+
+        const __m256i product = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        const __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+
+        acc[i] = _mm256_add_epi64(acc[i], _mm256_add_epi64(product, swapped));
+    }
+}
+
+CORE_TARGET_AVX2 static CORE_INLINE void HashTileRow_AVX2(
+    uint64_t* acc_io,
+    const uint8_t* data,
+    unsigned bytes,
+    unsigned row)
+{
+    __m256i acc[2];
+    for (unsigned i = 0; i < 2; ++i) {
+        acc[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc_io + i * 4));
+    }
+
+    unsigned stripe = 0, block = 0;
+    __m256i position_key = _mm256_set1_epi64x(static_cast<int64_t>(PositionKey(row, 0)));
+    unsigned i = 0;
+    for (; i + kHashStripeBytes <= bytes; i += kHashStripeBytes) {
+        AccumulateStripe_AVX2(acc, data + i, kHashStripeKeys + stripe, position_key);
+        if (++stripe == kHashStripesPerBlock) {
+            position_key = _mm256_set1_epi64x(static_cast<int64_t>(PositionKey(row, ++block)));
+            stripe = 0;
+        }
+    }
+    if (i < bytes) {
+        uint8_t tail[kHashStripeBytes] = {};
+        memcpy(tail, data + i, bytes - i);
+        AccumulateStripe_AVX2(acc, tail, kHashStripeKeys + stripe, position_key);
+    }
+
+    for (unsigned i = 0; i < 2; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc_io + i * 4), acc[i]);
+    }
+}
+
+CORE_TARGET_AVX2 static void HashTiles_AVX2(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes)
+{
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        uint64_t* tile_acc = acc;
+        for (unsigned x = 0; x < row_bytes; x += tile_bytes, tile_acc += kHashLanes) {
+            const unsigned bytes = row_bytes - x < tile_bytes ? row_bytes - x : tile_bytes;
+            HashTileRow_AVX2(tile_acc, data + x, bytes, y);
+        }
+
+        data += pitch;
+    }
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static CORE_INLINE void AccumulateStripe_NEON(
+    uint64x2_t* acc,
+    const uint8_t* data,
+    const uint64_t* keys,
+    uint64x2_t position_key)
+{
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        const uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(data + i * 16));
+        const uint64x2_t dk = veorq_u64(d, veorq_u64(vld1q_u64(keys + i * 2), position_key));
+
+        const uint64x2_t product = vmull_u32(vmovn_u64(dk), vshrn_n_u64(dk, 32));
+        const uint64x2_t swapped = vextq_u64(d, d, 1);
+
+        acc[i] = vaddq_u64(acc[i], vaddq_u64(product, swapped));
+    }
+}
+
+static CORE_INLINE void HashTileRow_NEON(
+    uint64_t* acc_io,
+    const uint8_t* data,
+    unsigned bytes,
+    unsigned row)
+{
+    uint64x2_t acc[4];
+    for (unsigned i = 0; i < 4; ++i) {
+        acc[i] = vld1q_u64(acc_io + i * 2);
+    }
+
+    unsigned stripe = 0, block = 0;
+    uint64x2_t position_key = vdupq_n_u64(PositionKey(row, 0));
+    unsigned i = 0;
+    for (; i + kHashStripeBytes <= bytes; i += kHashStripeBytes) {
+        AccumulateStripe_NEON(acc, data + i, kHashStripeKeys + stripe, position_key);
+        if (++stripe == kHashStripesPerBlock) {
+            position_key = vdupq_n_u64(PositionKey(row, ++block));
+            stripe = 0;
+        }
+    }
+    if (i < bytes) {
+        uint8_t tail[kHashStripeBytes] = {};
+        memcpy(tail, data + i, bytes - i);
+        AccumulateStripe_NEON(acc, tail, kHashStripeKeys + stripe, position_key);
+    }
+
+    for (unsigned i = 0; i < 4; ++i) {
+        vst1q_u64(acc_io + i * 2, acc[i]);
+    }
+}
+
+static void HashTiles_NEON(
+    uint64_t* acc,
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes)
+{
+    for (unsigned y = 0; y < rows; ++y)
+    {
+        uint64_t* tile_acc = acc;
+        for (unsigned x = 0; x < row_bytes; x += tile_bytes, tile_acc += kHashLanes) {
+            const unsigned bytes = row_bytes - x < tile_bytes ? row_bytes - x : tile_bytes;
+            HashTileRow_NEON(tile_acc, data + x, bytes, y);
+        }
+
+        data += pitch;
+    }
+}
+
+#endif // CORE_CPU_ARM64
+
+static HashTilesFn SelectHashTiles(CopyKernelPath path)
+{
+    if (path == CopyKernelPath::Auto) {
+        path = GetBestCopyKernelPath();
+    }
+    if (!IsCopyKernelPathSupported(path)) {
+        return nullptr;
+    }
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CopyKernelPath::SSE2: return HashTiles_SSE2;
+    case CopyKernelPath::AVX2: return HashTiles_AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CopyKernelPath::NEON: return HashTiles_NEON;
+#endif
+    default:
+        break;
+    }
+    return HashTiles_Scalar;
+}
+
+// Scramble the lanes once and fold them into the hash
+static uint64_t FinalizeTile(uint64_t* acc, unsigned row_bytes, unsigned rows)
+{
+    Scramble_Scalar(acc);
+
+    // Fold in the dimensions, since rows are zero padded
+    uint64_t hash = (static_cast<uint64_t>(row_bytes) << 32) | rows;
+    for (unsigned i = 0; i < kHashLanes; ++i) {
+        hash = stafford_mix13(hash ^ acc[i]);
+    }
+    return hash;
+}
+
+
+//------------------------------------------------------------------------------
+// HashPlane2D
+
+bool HashTiles2D(
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    unsigned tile_bytes,
+    uint64_t* hashes_out,
+    CopyKernelPath path)
+{
+    HashTilesFn hash_tiles = SelectHashTiles(path);
+    if (!hash_tiles) {
+        return false;
+    }
+    if (tile_bytes == 0 || tile_bytes > row_bytes) {
+        tile_bytes = row_bytes;
+    }
+
+    uint64_t acc[kHashMaxBandTiles * kHashLanes];
+
+    // Bands wider than kHashMaxBandTiles are walked in parts
+    const unsigned tile_count = row_bytes == 0 ? 0 : (row_bytes - 1) / tile_bytes + 1;
+    for (unsigned first = 0; first < tile_count; first += kHashMaxBandTiles)
+    {
+        const unsigned tiles = tile_count - first < kHashMaxBandTiles ? tile_count - first : kHashMaxBandTiles;
+        const size_t x = static_cast<size_t>(first) * tile_bytes;
+        const size_t band_bytes = static_cast<size_t>(tiles) * tile_bytes;
+        const unsigned bytes = static_cast<unsigned>(row_bytes - x < band_bytes ? row_bytes - x : band_bytes);
+
+        for (unsigned i = 0; i < tiles; ++i) {
+            memcpy(acc + i * kHashLanes, kHashInitialLanes, sizeof(kHashInitialLanes));
+        }
+
+        hash_tiles(acc, data + x, pitch, bytes, rows, tile_bytes);
+
+        for (unsigned i = 0; i < tiles; ++i) {
+            const unsigned tile_x = i * tile_bytes;
+            const unsigned width = bytes - tile_x < tile_bytes ? bytes - tile_x : tile_bytes;
+            *hashes_out++ = FinalizeTile(acc + i * kHashLanes, width, rows);
+        }
+    }
+    return true;
+}
+
+bool HashPlane2D(
+    const uint8_t* data,
+    unsigned pitch,
+    unsigned row_bytes,
+    unsigned rows,
+    uint64_t& hash_out,
+    CopyKernelPath path)
+{
+    if (row_bytes == 0)
+    {
+        if (!IsCopyKernelPathSupported(path)) {
+            return false;
+        }
+        uint64_t acc[kHashLanes];
+        memcpy(acc, kHashInitialLanes, sizeof(acc));
+        hash_out = FinalizeTile(acc, 0, rows);
+        return true;
+    }
+    return HashTiles2D(data, pitch, row_bytes, rows, row_bytes, &hash_out, path);
+}
+
+
+//------------------------------------------------------------------------------
+// TileHashTable
+
+void TileHashTable::Reset(unsigned width, unsigned height)
+{
+    Width = width;
+    Height = height;
+    TilesX = (width + kTileHashSize - 1) / kTileHashSize;
+    TilesY = (height + kTileHashSize - 1) / kTileHashSize;
+
+    Tiles.clear();
+    Tiles.resize(static_cast<size_t>(TilesX) * TilesY);
+}
+
+bool TileHashTable::FindUnchanged(
+    const uint8_t* image,
+    unsigned pitch,
+    const Region& changed,
+    Region& unchanged,
+    CopyKernelPath path)
+{
+    unchanged.Clear();
+
+    if (!IsCopyKernelPathSupported(path)) {
+        return false;
+    }
+    if (changed.Empty() || Tiles.empty()) {
+        return true;
+    }
+
+    // Marks tiles visited by this update, so each is hashed once
+    const uint64_t update = ++Stats.Updates;
+
+    ChangedRects.clear();
+    changed.GetRects(ChangedRects);
+    UnchangedRects.clear();
+
+    const int width = static_cast<int>(Width);
+    const int height = static_cast<int>(Height);
+    const int tile_size = static_cast<int>(kTileHashSize);
+
+    int ty_begin = static_cast<int>(TilesY), ty_end = -1;
+
+    for (const RegionRect& changed_rect : ChangedRects)
+    {
+        RegionRect rect = changed_rect;
+        if (rect.Left < 0) {
+            rect.Left = 0;
+        }
+        if (rect.Top < 0) {
+            rect.Top = 0;
+        }
+        if (rect.Right > width) {
+            rect.Right = width;
+        }
+        if (rect.Bottom > height) {
+            rect.Bottom = height;
+        }
+        if (rect.Empty()) {
+            continue;
+        }
+
+        const int tx_last = (rect.Right - 1) / tile_size;
+        const int ty_last = (rect.Bottom - 1) / tile_size;
+
+        for (int ty = rect.Top / tile_size; ty <= ty_last; ++ty) {
+            for (int tx = rect.Left / tile_size; tx <= tx_last; ++tx) {
+                Tiles[static_cast<size_t>(ty) * TilesX + tx].Visited = update;
+            }
+        }
+
+        if (ty_begin > rect.Top / tile_size) {
+            ty_begin = rect.Top / tile_size;
+        }
+        if (ty_end < ty_last) {
+            ty_end = ty_last;
+        }
+    }
+
+    BandHashes.resize(TilesX);
+
+    // Each run of visited tiles in a band of tile rows is hashed in one
+    // pass over its rows, which reads memory in order
+    for (int ty = ty_begin; ty <= ty_end; ++ty)
+    {
+        Tile* band = &Tiles[static_cast<size_t>(ty) * TilesX];
+        const int top = ty * tile_size;
+        const int bottom = top + tile_size < height ? top + tile_size : height;
+
+        for (int tx_begin = 0; tx_begin < static_cast<int>(TilesX); ++tx_begin)
+        {
+            if (band[tx_begin].Visited != update) {
+                continue;
+            }
+            int tx_end = tx_begin + 1;
+            while (tx_end < static_cast<int>(TilesX) && band[tx_end].Visited == update) {
+                ++tx_end;
+            }
+
+            const int left = tx_begin * tile_size;
+            const int right = tx_end * tile_size < width ? tx_end * tile_size : width;
+
+            HashTiles2D(
+                image + static_cast<size_t>(top) * pitch + static_cast<size_t>(left) * kTileHashBytesPerPixel,
+                pitch,
+                (right - left) * kTileHashBytesPerPixel,
+                bottom - top,
+                kTileHashSize * kTileHashBytesPerPixel,
+                BandHashes.data(),
+                path);
+
+            for (int tx = tx_begin; tx < tx_end; ++tx)
+            {
+                Tile& tile = band[tx];
+                const uint64_t hash = BandHashes[tx - tx_begin];
+                ++Stats.TilesHashed;
+
+                RegionRect tile_rect(tx * tile_size, top, (tx + 1) * tile_size, bottom);
+                if (tile_rect.Right > width) {
+                    tile_rect.Right = width;
+                }
+
+                if (tile.Known && tile.Hash == hash) {
+                    ++Stats.TilesUnchanged;
+                    UnchangedRects.push_back(tile_rect);
+                    continue;
+                }
+
+                tile.Hash = hash;
+
+                // Pixels outside the changed region were not delivered,
+                // so the tile is only known if it is entirely changed
+                if (!tile.Known) {
+                    Scratch.Set(tile_rect);
+                    Scratch.Subtract(changed);
+                    tile.Known = Scratch.Empty();
+                }
+            }
+
+            tx_begin = tx_end;
+        }
+    }
+
+    Stats.ChangedBytes += changed.GetArea() * kTileHashBytesPerPixel;
+
+    if (!UnchangedRects.empty())
+    {
+        unchanged.Set(UnchangedRects.data(), static_cast<unsigned>(UnchangedRects.size()));
+
+        Scratch.Set(UnchangedRects.data(), static_cast<unsigned>(UnchangedRects.size()));
+        Scratch.Intersect(changed);
+        Stats.SkippedBytes += Scratch.GetArea() * kTileHashBytesPerPixel;
+    }
+
+    return true;
+}
+
+
+} // namespace core
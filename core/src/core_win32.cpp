@@ -73,114 +73,6 @@ void AutoEvent::Clear()
 }
 
 
-//-----------------------------------------------------------------------------
-// SharedMemoryFile
-
-SharedMemoryFile::~SharedMemoryFile()
-{
-    Close();
-}
-
-void SharedMemoryFile::Close()
-{
-    if (Front)
-    {
-        ::UnmapViewOfFile(Front);
-        Front = nullptr;
-    }
-
-    File.Clear();
-}
-
-bool SharedMemoryFile::Create(int fileBytes, const std::string& filename)
-{
-    Close();
-
-    FileSizeBytes = fileBytes;
-    if (fileBytes <= 0)
-    {
-        CORE_DEBUG_BREAK(); // Invalid input
-        return false;
-    }
-
-    std::vector<uint8_t> desc(SECURITY_DESCRIPTOR_MIN_LENGTH);
-    SECURITY_ATTRIBUTES sa;
-    sa.lpSecurityDescriptor = (PSECURITY_DESCRIPTOR)desc.data();
-    InitializeSecurityDescriptor(sa.lpSecurityDescriptor, SECURITY_DESCRIPTOR_REVISION);
-    // ACL is set as NULL in order to allow all access to the object.
-    SetSecurityDescriptorDacl(sa.lpSecurityDescriptor, TRUE, NULL, FALSE);
-    sa.nLength = sizeof(sa);
-    sa.bInheritHandle = FALSE;
-
-    // Create the file
-    File = ::CreateFileMappingA(
-        INVALID_HANDLE_VALUE,
-        &sa,
-        PAGE_READWRITE,
-        0,
-        fileBytes,
-        filename.c_str());
-
-    if (File.Invalid()) {
-        return false;
-    }
-
-    // Map file to memory
-    return mapFile();
-}
-
-bool SharedMemoryFile::Open(int fileBytes, const std::string& filename)
-{
-    Close();
-
-    FileSizeBytes = fileBytes;
-    if (fileBytes <= 0)
-    {
-        CORE_DEBUG_BREAK(); // Invalid input
-        return false;
-    }
-
-    // Open file mapping
-    File = ::OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, TRUE, filename.c_str());
-
-    if (File.Invalid())
-    {
-        std::string str = "SharedMemoryFile: OpenFileMappingA failed for '";
-        str += filename;
-        str += "' err=";
-        str += std::to_string(GetLastError());
-        str += "'\n";
-        ::OutputDebugStringA(str.c_str());
-        return false;
-    }
-
-    // Map file to memory
-    return mapFile();
-}
-
-bool SharedMemoryFile::mapFile()
-{
-    // Map file to memory
-    Front = reinterpret_cast<uint8_t*>(::MapViewOfFile(
-        File.Get(),
-        FILE_MAP_READ | FILE_MAP_WRITE,
-        0, // offset = 0
-        0, // offset = 0
-        FileSizeBytes));
-
-    if (!Front)
-    {
-        std::string str = "SharedMemoryFile: MapViewOfFile failed err=";
-        str += std::to_string(GetLastError());
-        str += "'\n";
-        ::OutputDebugStringA(str.c_str());
-        return false;
-    }
-
-    return true;
-}
-
-
 //-----------------------------------------------------------------------------
 // Module Tools
 
@@ -0,0 +1,473 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraContrast.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraContrastTests");
+
+
+//------------------------------------------------------------------------------
+// Reference
+
+/*
+    CLAHE written directly from the description in CameraContrast.hpp, in
+    floating point: Per-tile histograms clipped at ClipLimit times the
+    average bin, the excess spread evenly, equalized through the CDF, and
+    each pixel blending the curves of its four nearest tile centers.
+*/
+class ReferenceContrast
+{
+public:
+    ReferenceContrast(const CameraContrastParams& params, const uint8_t* image, unsigned pitch, unsigned width, unsigned height)
+        : Params(params)
+        , Width(width)
+        , Height(height)
+    {
+        Curves.resize(params.TilesX * params.TilesY);
+        for (unsigned ty = 0; ty < params.TilesY; ++ty) {
+            for (unsigned tx = 0; tx < params.TilesX; ++tx) {
+                BuildCurve(image, pitch, tx, ty, Curves[ty * params.TilesX + tx]);
+            }
+        }
+    }
+
+    double Enhance(unsigned x, unsigned y, uint8_t value) const
+    {
+        unsigned tx0, tx1, ty0, ty1;
+        double wx, wy;
+        Neighbors(x, Width, Params.TilesX, tx0, tx1, wx);
+        Neighbors(y, Height, Params.TilesY, ty0, ty1, wy);
+
+        const double top =
+            Curves[ty0 * Params.TilesX + tx0][value] * (1. - wx) +
+            Curves[ty0 * Params.TilesX + tx1][value] * wx;
+        const double bottom =
+            Curves[ty1 * Params.TilesX + tx0][value] * (1. - wx) +
+            Curves[ty1 * Params.TilesX + tx1][value] * wx;
+        return top * (1. - wy) + bottom * wy;
+    }
+
+protected:
+    CameraContrastParams Params;
+    unsigned Width, Height;
+    std::vector<std::vector<double>> Curves;
+
+
+    void BuildCurve(const uint8_t* image, unsigned pitch, unsigned tx, unsigned ty, std::vector<double>& curve) const
+    {
+        const unsigned x0 = tx * Width / Params.TilesX, x1 = (tx + 1) * Width / Params.TilesX;
+        const unsigned y0 = ty * Height / Params.TilesY, y1 = (ty + 1) * Height / Params.TilesY;
+        const unsigned count = (x1 - x0) * (y1 - y0);
+
+        std::vector<uint64_t> bins(kCameraHistogramBins, 0);
+        for (unsigned y = y0; y < y1; ++y) {
+            for (unsigned x = x0; x < x1; ++x) {
+                ++bins[image[y * pitch + x]];
+            }
+        }
+
+        const uint64_t clip = std::max<uint64_t>(1, (uint64_t)(Params.ClipLimit * count / kCameraHistogramBins));
+        uint64_t excess = 0;
+        for (uint64_t& bin : bins) {
+            if (bin > clip) {
+                excess += bin - clip;
+                bin = clip;
+            }
+        }
+        for (unsigned i = 0; i < kCameraHistogramBins; ++i) {
+            bins[i] += excess / kCameraHistogramBins + (i < excess % kCameraHistogramBins ? 1 : 0);
+        }
+
+        curve.resize(kCameraHistogramBins);
+        uint64_t cdf = 0;
+        for (unsigned i = 0; i < kCameraHistogramBins; ++i) {
+            cdf += bins[i];
+            const double equalized = floor(255. * cdf / count + 0.5);
+            curve[i] = (i * (16. - Params.Strength) + equalized * Params.Strength) / 16.;
+        }
+    }
+
+    // Tiles whose centers surround position i, and the weight of the second
+    static void Neighbors(unsigned i, unsigned size, unsigned tiles, unsigned& t0, unsigned& t1, double& weight)
+    {
+        const double f = (i + 0.5) * tiles / size - 0.5;
+        if (f <= 0.) {
+            t0 = t1 = 0;
+            weight = 0.;
+        }
+        else if (f >= tiles - 1) {
+            t0 = t1 = tiles - 1;
+            weight = 0.;
+        }
+        else {
+            t0 = (unsigned)f;
+            t1 = t0 + 1;
+            weight = f - t0;
+        }
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/*
+    Dim room: A gradient with noise and a bright window in one corner, in a
+    plane whose pitch leaves sentinel bytes after every row
+*/
+static std::vector<uint8_t> MakeDimImage(unsigned pitch, unsigned width, unsigned height, uint64_t seed)
+{
+    std::vector<uint8_t> image = MakeSentinelPlane(pitch, height);
+    TestRandom rng(seed);
+    for (unsigned y = 0; y < height; ++y) {
+        for (unsigned x = 0; x < width; ++x) {
+            unsigned v = 10 + x * 40 / width + rng.NextRange(9);
+            if (x > width * 2 / 3 && y < height / 4) {
+                v += 120;
+            }
+            image[y * pitch + x] = (uint8_t)v;
+        }
+    }
+    return image;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Histograms must count every pixel exactly on every path, for widths that
+    leave tails after the SIMD loads
+*/
+static bool TestHistogram()
+{
+    static const unsigned kWidths[] = { 1, 3, 15, 16, 17, 33, 640 };
+
+    for (unsigned width : kWidths)
+    {
+        const unsigned height = 37, pitch = width + 9;
+        std::vector<uint8_t> image(pitch * height);
+        TestRandom rng(width);
+        rng.Fill(image.data(), image.size());
+
+        // Skewed toward a few values, so neighbors often share a bin
+        for (unsigned i = 0; i < image.size(); i += 3) {
+            image[i] = 200;
+        }
+
+        CameraHistogram expected;
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                ++expected.Bins[image[y * pitch + x]];
+            }
+        }
+        expected.PixelCount = width * height;
+
+        for (CameraKernelPath path : kCameraKernelPaths)
+        {
+            if (!IsCameraKernelPathSupported(path)) {
+                continue;
+            }
+
+            CameraHistogram actual;
+            actual.Bins[0] = 12345;
+            TEST_CHECK(ComputeCameraHistogram(image.data(), pitch, width, height, actual, path));
+            TEST_CHECK(memcmp(actual.Bins, expected.Bins, sizeof(expected.Bins)) == 0);
+            TEST_CHECK(actual.PixelCount == expected.PixelCount);
+        }
+    }
+    return true;
+}
+
+/// Percentile and trimmed mean against a sorted list of the pixels
+static bool TestHistogramStatistics()
+{
+    TestRandom rng(2);
+    for (unsigned trial = 0; trial < 50; ++trial)
+    {
+        const unsigned count = 1 + rng.NextRange(5000);
+        std::vector<uint8_t> pixels(count);
+        const unsigned range = 1 + rng.NextRange(256);
+        for (uint8_t& p : pixels) {
+            p = (uint8_t)rng.NextRange(range);
+        }
+
+        // Two halves added together
+        CameraHistogram a, b;
+        const unsigned split = count / 2;
+        TEST_CHECK(ComputeCameraHistogram(pixels.data(), split, split, 1, a));
+        TEST_CHECK(ComputeCameraHistogram(pixels.data() + split, count - split, count - split, 1, b));
+        a.Add(b);
+        TEST_CHECK(a.PixelCount == count);
+
+        std::sort(pixels.begin(), pixels.end());
+
+        for (unsigned percent = 0; percent <= 100; percent += 5)
+        {
+            const uint64_t target = ((uint64_t)count * percent + 99) / 100;
+            // 0 percent of the pixels are at or below 0
+            const unsigned expected = target > 0 ? pixels[target - 1] : 0;
+            TEST_CHECK(a.GetPercentile(percent) == expected);
+
+            const uint64_t keep = count - (uint64_t)count * percent / 100;
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < keep; ++i) {
+                sum += pixels[i];
+            }
+            const int expected_mean = keep > 0 ? (int)(sum * 16 / keep) : 0;
+            TEST_CHECK(a.GetTrimmedMean16(percent) == expected_mean);
+        }
+        TEST_CHECK(a.GetTrimmedMean16(200) == 0);
+    }
+    return true;
+}
+
+/*
+    The enhanced image must match the floating point reference within the
+    rounding of the 1/128 blend weights and fixed point curves
+*/
+static bool TestMatchesReference()
+{
+    struct Case { unsigned Width, Height, TilesX, TilesY; float ClipLimit; unsigned Strength; };
+    static const Case kCases[] = {
+        { 640, 480, 8, 8, 2.5f, 16 },
+        { 333, 481, 5, 7, 4.f, 16 },
+        { 96, 64, 12, 8, 1.f, 10 },
+        { 200, 100, 1, 1, 100.f, 16 },
+    };
+
+    for (const Case& c : kCases)
+    {
+        const unsigned pitch = c.Width + 19;
+        const std::vector<uint8_t> input = MakeDimImage(pitch, c.Width, c.Height, c.Width);
+
+        CameraContrastParams params;
+        params.TilesX = c.TilesX;
+        params.TilesY = c.TilesY;
+        params.ClipLimit = c.ClipLimit;
+        params.Strength = c.Strength;
+
+        CameraContrastEnhancer enhancer;
+        enhancer.SetParams(params);
+
+        std::vector<uint8_t> output = input;
+        TEST_CHECK(enhancer.Process(output.data(), pitch, c.Width, c.Height, nullptr, CameraKernelPath::Scalar));
+        TEST_CHECK(CheckSentinelPadding(output.data(), pitch, c.Width, c.Height));
+
+        const ReferenceContrast reference(params, input.data(), pitch, c.Width, c.Height);
+
+        double max_error = 0., error_sum = 0.;
+        for (unsigned y = 0; y < c.Height; ++y)
+        {
+            for (unsigned x = 0; x < c.Width; ++x)
+            {
+                const double expected = reference.Enhance(x, y, input[y * pitch + x]);
+                const double error = fabs(output[y * pitch + x] - expected);
+                max_error = error > max_error ? error : max_error;
+                error_sum += error;
+            }
+        }
+        const double mean_error = error_sum / (c.Width * c.Height);
+
+        Logger.Info(c.Width, "x", c.Height, " tiles ", c.TilesX, "x", c.TilesY, " clip ", c.ClipLimit,
+            ": Max error ", max_error, ", mean ", mean_error);
+        TEST_CHECK(max_error <= 2.);
+        TEST_CHECK(mean_error < 0.6);
+    }
+    return true;
+}
+
+/*
+    With one tile every pixel goes through the same tone curve, which must
+    be non-decreasing, and a full strength curve stretches a dim image
+*/
+static bool TestSingleTileCurve()
+{
+    static const unsigned kWidth = 160, kHeight = 120;
+    const std::vector<uint8_t> input = MakeDimImage(kWidth, kWidth, kHeight, 9);
+
+    CameraContrastParams params;
+    params.TilesX = 1;
+    params.TilesY = 1;
+    params.ClipLimit = 1000.f;
+
+    CameraContrastEnhancer enhancer;
+    enhancer.SetParams(params);
+    std::vector<uint8_t> output = input;
+    TEST_CHECK(enhancer.Process(output.data(), kWidth, kWidth, kHeight));
+
+    int curve[kCameraHistogramBins];
+    for (int& v : curve) {
+        v = -1;
+    }
+    // Range of the dim part of the room, without the window
+    unsigned in_min = 255, in_max = 0, out_min = 255, out_max = 0;
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        TEST_CHECK(curve[input[i]] < 0 || curve[input[i]] == output[i]);
+        curve[input[i]] = output[i];
+        if (input[i] < 100) {
+            in_min = std::min<unsigned>(in_min, input[i]);
+            in_max = std::max<unsigned>(in_max, input[i]);
+            out_min = std::min<unsigned>(out_min, output[i]);
+            out_max = std::max<unsigned>(out_max, output[i]);
+        }
+    }
+
+    int last = -1;
+    for (int v : curve) {
+        if (v >= 0) {
+            TEST_CHECK(v >= last);
+            last = v;
+        }
+    }
+
+    // Plain equalization puts the brightest pixel at 255, and the dim pixels
+    // that cover most of the image get most of the range
+    TEST_CHECK(*std::max_element(output.begin(), output.end()) == 255);
+    TEST_CHECK(out_max - out_min > 2 * (in_max - in_min));
+    return true;
+}
+
+static bool TestInvalidParams()
+{
+    std::vector<uint8_t> image = MakeDimImage(64, 64, 64, 1);
+    const std::vector<uint8_t> original = image;
+
+    CameraContrastEnhancer enhancer;
+    CameraContrastParams params;
+
+    params.TilesX = 0;
+    enhancer.SetParams(params);
+    TEST_CHECK(!enhancer.Process(image.data(), 64, 64, 64));
+
+    params.TilesX = 65;
+    enhancer.SetParams(params);
+    TEST_CHECK(!enhancer.Process(image.data(), 64, 64, 64));
+
+    // Tiles smaller than 8x8
+    params.TilesX = 9;
+    enhancer.SetParams(params);
+    TEST_CHECK(!enhancer.Process(image.data(), 64, 64, 64));
+    TEST_CHECK(image == original);
+
+    // Strength 0 is valid and changes nothing
+    params = CameraContrastParams();
+    params.Strength = 0;
+    enhancer.SetParams(params);
+    TEST_CHECK(enhancer.Process(image.data(), 64, 64, 64));
+    TEST_CHECK(image == original);
+
+    // Out of range values are clamped
+    params.Strength = 100;
+    params.ClipLimit = 0.f;
+    enhancer.SetParams(params);
+    TEST_CHECK(enhancer.GetParams().Strength == 16);
+    TEST_CHECK(enhancer.GetParams().ClipLimit == 1.f);
+    return true;
+}
+
+/*
+    Every path and the worker pool must match the scalar output bit for bit,
+    and one enhancer must handle changing sizes
+*/
+static bool TestPathsMatchScalar()
+{
+    struct Size { unsigned Width, Height; };
+    static const Size kSizes[] = { { 640, 480 }, { 333, 481 }, { 64, 64 }, { 71, 65 } };
+
+    WorkerPool pool;
+    pool.Start(3);
+
+    CameraContrastEnhancer reused;
+    for (const Size& size : kSizes)
+    {
+        const unsigned pitch = size.Width + 13;
+        const std::vector<uint8_t> input = MakeDimImage(pitch, size.Width, size.Height, size.Height);
+
+        CameraContrastEnhancer reference;
+        std::vector<uint8_t> expected = input;
+        TEST_CHECK(reference.Process(expected.data(), pitch, size.Width, size.Height, nullptr, CameraKernelPath::Scalar));
+
+        for (CameraKernelPath path : kCameraKernelPaths)
+        {
+            if (!IsCameraKernelPathSupported(path)) {
+                continue;
+            }
+
+            for (unsigned use_pool = 0; use_pool < 2; ++use_pool)
+            {
+                std::vector<uint8_t> actual = input;
+                TEST_CHECK(reused.Process(actual.data(), pitch, size.Width, size.Height, use_pool ? &pool : nullptr, path));
+                TEST_CHECK(actual == expected);
+            }
+        }
+    }
+
+    pool.Stop();
+    return true;
+}
+
+bool TestCameraContrast()
+{
+    return TestHistogram() &&
+        TestHistogramStatistics() &&
+        TestInvalidParams() &&
+        TestSingleTileCurve() &&
+        TestMatchesReference() &&
+        TestPathsMatchScalar();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkCameraContrast()
+{
+    static const unsigned kWidth = 640, kHeight = 480;
+    const std::vector<uint8_t> input = MakeDimImage(kWidth, kWidth, kHeight, 1);
+    std::vector<uint8_t> image = input;
+
+    WorkerPool pool;
+    pool.Start(2);
+
+    for (CameraKernelPath path : kCameraKernelPaths)
+    {
+        if (!IsCameraKernelPathSupported(path)) {
+            continue;
+        }
+
+        CameraHistogram histogram;
+        const double histogram_usec = MeasureUsecPerCall([&]() {
+            ComputeCameraHistogram(input.data(), kWidth, kWidth, kHeight, histogram, path);
+        });
+
+        // Restoring the input is part of the timing, but small next to CLAHE
+        CameraContrastEnhancer enhancer;
+        const double usec = MeasureUsecPerCall([&]() {
+            memcpy(image.data(), input.data(), image.size());
+            enhancer.Process(image.data(), kWidth, kWidth, kHeight, nullptr, path);
+        });
+        const double pool_usec = MeasureUsecPerCall([&]() {
+            memcpy(image.data(), input.data(), image.size());
+            enhancer.Process(image.data(), kWidth, kWidth, kHeight, &pool, path);
+        });
+
+        Logger.Info(CameraKernelPathToString(path), " one eye: Histogram ", histogram_usec,
+            " usec, CLAHE ", usec, " usec, ", pool_usec, " usec with 2 workers (budget ",
+            kCameraContrastBudgetUsec / 2, " usec)");
+    }
+
+    pool.Stop();
+}
+
+
+} // namespace core
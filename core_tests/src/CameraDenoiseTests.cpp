@@ -0,0 +1,293 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraDenoise.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraDenoiseTests");
+
+
+//------------------------------------------------------------------------------
+// Reference
+
+/*
+    One pixel of the filter written directly from the description in
+    CameraDenoise.hpp, with the shift done as a floored division
+*/
+static uint8_t ReferenceDenoise(const CameraDenoiseParams& params, uint8_t input, uint8_t history)
+{
+    const int diff = (int)input - (int)history;
+    const int weight = (unsigned)abs(diff) > params.MotionThreshold ? 16 : (int)params.Strength;
+    return (uint8_t)(history + (int)floor((diff * weight + 8) / 16.));
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Frames of a static scene with sensor noise, where some pixels jump by
+// more than the motion threshold.  Values reach 0 and 255 to catch overflow
+class TestCameraSequence
+{
+public:
+    TestCameraSequence(unsigned width, unsigned height, unsigned pitch, uint64_t seed)
+        : Width(width)
+        , Height(height)
+        , Pitch(pitch)
+        , Rng(seed)
+    {
+        Scene.resize(width * height);
+        Rng.Fill(Scene.data(), Scene.size());
+        for (unsigned i = 0; i < Scene.size(); i += 7) {
+            Scene[i] = (i & 8) ? 255 : 0;
+        }
+    }
+
+    // Returns a frame with the bytes past width left as kTestSentinel
+    std::vector<uint8_t> Next()
+    {
+        std::vector<uint8_t> frame = MakeSentinelPlane(Pitch, Height);
+        for (unsigned y = 0; y < Height; ++y) {
+            for (unsigned x = 0; x < Width; ++x) {
+                int v = Scene[y * Width + x];
+                if (Rng.NextRange(8) == 0) {
+                    v = (int)Rng.NextRange(256);
+                }
+                else {
+                    v += (int)Rng.NextRange(25) - 12;
+                }
+                frame[y * Pitch + x] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+        return frame;
+    }
+
+protected:
+    unsigned Width, Height, Pitch;
+    TestRandom Rng;
+    std::vector<uint8_t> Scene;
+};
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    The first frame passes through, and every later frame matches the
+    reference for each pixel given the previous output
+*/
+static bool TestMatchesReference()
+{
+    const unsigned width = 37, height = 11, pitch = 40;
+
+    CameraDenoiseParams params;
+    params.Strength = 5;
+    params.MotionThreshold = 10;
+
+    CameraTemporalDenoiser denoiser;
+    denoiser.SetParams(params);
+
+    TestCameraSequence sequence(width, height, pitch, 1);
+    std::vector<uint8_t> previous;
+
+    for (unsigned frame_index = 0; frame_index < 20; ++frame_index)
+    {
+        const std::vector<uint8_t> input = sequence.Next();
+        std::vector<uint8_t> output = MakeSentinelPlane(pitch, height);
+        TEST_CHECK(denoiser.Process(0, input.data(), pitch, output.data(), pitch,
+            width, height, CameraKernelPath::Scalar));
+        TEST_CHECK(CheckSentinelPadding(output.data(), pitch, width, height));
+
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                const unsigned i = y * pitch + x;
+                const uint8_t expected = frame_index == 0 ? input[i] :
+                    ReferenceDenoise(params, input[i], previous[i]);
+                TEST_CHECK(output[i] == expected);
+            }
+        }
+        previous = output;
+    }
+    return true;
+}
+
+/*
+    Every SIMD path matches the scalar path bit for bit over a sequence of
+    frames, for odd widths and pitches and when filtering in place
+*/
+static bool TestPathsMatchScalar()
+{
+    static const unsigned kWidths[] = { 1, 7, 15, 16, 17, 31, 32, 33, 63, 65, 97, 640 };
+    static const unsigned kFrames = 8;
+
+    for (unsigned width : kWidths)
+    {
+        const unsigned height = width == 640 ? 480 : 5;
+        const unsigned pitch = width + 3;
+
+        for (CameraKernelPath path : kCameraKernelPaths)
+        {
+            if (path == CameraKernelPath::Scalar || !IsCameraKernelPathSupported(path)) {
+                continue;
+            }
+
+            CameraTemporalDenoiser scalar, simd, in_place;
+            TestCameraSequence sequence(width, height, pitch, width);
+
+            for (unsigned frame_index = 0; frame_index < kFrames; ++frame_index)
+            {
+                const std::vector<uint8_t> input = sequence.Next();
+
+                std::vector<uint8_t> expected = MakeSentinelPlane(pitch, height);
+                TEST_CHECK(scalar.Process(1, input.data(), pitch, expected.data(), pitch,
+                    width, height, CameraKernelPath::Scalar));
+
+                // Output with its own pitch
+                const unsigned output_pitch = width + 17;
+                std::vector<uint8_t> actual = MakeSentinelPlane(output_pitch, height);
+                TEST_CHECK(simd.Process(1, input.data(), pitch, actual.data(), output_pitch,
+                    width, height, path));
+                TEST_CHECK(CheckSentinelPadding(actual.data(), output_pitch, width, height));
+                for (unsigned y = 0; y < height; ++y) {
+                    TEST_CHECK(memcmp(&actual[y * output_pitch], &expected[y * pitch], width) == 0);
+                }
+
+                std::vector<uint8_t> image = input;
+                TEST_CHECK(in_place.Process(1, image.data(), pitch, image.data(), pitch,
+                    width, height, path));
+                TEST_CHECK(image == expected);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Pixels that change by more than the motion threshold take the new value
+    unfiltered, and pixels at the threshold are filtered
+*/
+static bool TestMotionPassesThrough()
+{
+    const unsigned width = 100, height = 3;
+
+    CameraDenoiseParams params;
+    params.Strength = 4;
+    params.MotionThreshold = 12;
+
+    for (CameraKernelPath path : kCameraKernelPaths)
+    {
+        if (!IsCameraKernelPathSupported(path)) {
+            continue;
+        }
+
+        CameraTemporalDenoiser denoiser;
+        denoiser.SetParams(params);
+
+        std::vector<uint8_t> first(width * height, 128), output(width * height);
+        TEST_CHECK(denoiser.Process(0, first.data(), width, output.data(), width, width, height, path));
+
+        // Alternate still, at the threshold and moving pixels, both ways
+        std::vector<uint8_t> second(width * height);
+        for (unsigned i = 0; i < second.size(); ++i) {
+            static const int kOffsets[] = { 0, 12, -12, 13, -13, 100, -128, 127 };
+            second[i] = (uint8_t)(128 + kOffsets[i % 8]);
+        }
+        TEST_CHECK(denoiser.Process(0, second.data(), width, output.data(), width, width, height, path));
+
+        for (unsigned i = 0; i < second.size(); ++i)
+        {
+            const unsigned abs_diff = (unsigned)abs((int)second[i] - 128);
+            if (abs_diff > params.MotionThreshold) {
+                TEST_CHECK(output[i] == second[i]);
+            }
+            else {
+                TEST_CHECK(output[i] == ReferenceDenoise(params, second[i], 128));
+                TEST_CHECK(abs_diff == 0 || output[i] != second[i]);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    A change in size or a Reset() starts the history over, so the next
+    frame passes through.  Each eye keeps its own history
+*/
+static bool TestHistoryReset()
+{
+    CameraTemporalDenoiser denoiser;
+
+    std::vector<uint8_t> dark(64 * 16, 100), bright(64 * 16, 110), output(64 * 16);
+
+    // Eye 0 holds dark history, eye 1 has none yet
+    TEST_CHECK(denoiser.Process(0, dark.data(), 64, output.data(), 64, 64, 16));
+    TEST_CHECK(denoiser.Process(1, bright.data(), 64, output.data(), 64, 64, 16));
+    TEST_CHECK(output == bright);
+    TEST_CHECK(denoiser.Process(0, bright.data(), 64, output.data(), 64, 64, 16));
+    TEST_CHECK(output[0] > 100 && output[0] < 110);
+
+    // Same bytes, new shape
+    TEST_CHECK(denoiser.Process(0, dark.data(), 32, output.data(), 32, 32, 32));
+    TEST_CHECK(output == dark);
+    TEST_CHECK(denoiser.Process(0, bright.data(), 32, output.data(), 32, 32, 32));
+    TEST_CHECK(output[0] > 100 && output[0] < 110);
+
+    denoiser.Reset();
+    TEST_CHECK(denoiser.Process(0, dark.data(), 32, output.data(), 32, 32, 32));
+    TEST_CHECK(output == dark);
+    TEST_CHECK(denoiser.Process(1, dark.data(), 64, output.data(), 64, 64, 16));
+    TEST_CHECK(output == dark);
+
+    TEST_CHECK(!denoiser.Process(kCameraDenoiseEyeCount, dark.data(), 64, output.data(), 64, 64, 16));
+    return true;
+}
+
+bool TestCameraDenoise()
+{
+    return TestMatchesReference() &&
+        TestPathsMatchScalar() &&
+        TestMotionPassesThrough() &&
+        TestHistoryReset();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkCameraDenoise()
+{
+    const unsigned eye_width = 640, height = 480;
+
+    TestCameraSequence sequence(eye_width, height, eye_width, 1);
+    const std::vector<uint8_t> left = sequence.Next();
+    const std::vector<uint8_t> right = sequence.Next();
+    std::vector<uint8_t> output(eye_width * height);
+
+    for (CameraKernelPath path : kCameraKernelPaths)
+    {
+        if (!IsCameraKernelPathSupported(path)) {
+            continue;
+        }
+
+        CameraTemporalDenoiser denoiser;
+        const double usec = MeasureUsecPerCall([&]() {
+            denoiser.Process(0, left.data(), eye_width, output.data(), eye_width, eye_width, height, path);
+            denoiser.Process(1, right.data(), eye_width, output.data(), eye_width, eye_width, height, path);
+        });
+        Logger.Info(CameraKernelPathToString(path), " denoise both eyes: ", usec, " usec, ",
+            GigabytesPerSecond(2 * eye_width * height, usec), " GB/s");
+
+        if (path == GetBestCameraKernelPath()) {
+            BENCH_CHECK(usec < kCameraDenoiseBudgetUsec);
+        }
+    }
+}
+
+
+} // namespace core
@@ -0,0 +1,217 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraKernels.hpp"
+
+#include <string.h>
+
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraKernelTests");
+
+
+//------------------------------------------------------------------------------
+// Baseline
+
+/*
+    Tag strip loop that CameraImager::UpdateTexture used before the kernels,
+    minus its sampled brightness sum.  Writes rows of `width` pixels, both
+    eyes side by side.  Returns the number of transfer bytes it read up to.
+*/
+static unsigned BaselineTagStrip(
+    const uint8_t* transfer,
+    unsigned width,
+    unsigned height,
+    uint8_t* dest,
+    unsigned pitch)
+{
+    const uint8_t* image = transfer + kCameraImageOffset;
+
+    const unsigned offset = kCameraChunkBytes - kCameraTagBytes;
+    unsigned next_tag_offset = kCameraChunkBytes - kCameraImageOffset;
+
+    for (unsigned i = 0; i < height; ++i) {
+        if (next_tag_offset < width) {
+            memcpy(dest, image, next_tag_offset);
+            image += kCameraTagBytes;
+            memcpy(dest + next_tag_offset, image + next_tag_offset, width - next_tag_offset);
+            next_tag_offset = offset - (width - next_tag_offset);
+        }
+        else {
+            memcpy(dest, image, width);
+            next_tag_offset -= width;
+        }
+        image += width;
+        dest += pitch;
+    }
+
+    return static_cast<unsigned>(image - transfer);
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Fill a transfer with random pixels and tag blocks
+static std::vector<uint8_t> MakeTransfer(unsigned bytes, uint64_t seed)
+{
+    std::vector<uint8_t> transfer(bytes);
+    TestRandom rng(seed);
+    rng.Fill(transfer.data(), transfer.size());
+    for (unsigned offset = 0; offset + kCameraTagBytes <= bytes; offset += kCameraChunkBytes) {
+        memset(transfer.data() + offset, 0xee, kCameraTagBytes);
+    }
+    return transfer;
+}
+
+// Transfer bytes needed for an image, found with the baseline loop
+static unsigned RequiredTransferBytes(unsigned eye_width, unsigned height)
+{
+    const unsigned width = eye_width * 2;
+    const unsigned worst = kCameraImageOffset + width * height +
+        (width * height / (kCameraChunkBytes - kCameraTagBytes) + 2) * kCameraTagBytes;
+    std::vector<uint8_t> transfer(worst), dest(width * height);
+    return BaselineTagStrip(transfer.data(), width, height, dest.data(), width);
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    The split must match the baseline byte for byte for odd widths and
+    images that cross many tag blocks at every alignment
+*/
+static bool TestSplitMatchesBaseline()
+{
+    static const unsigned kEyeWidths[] = { 1, 3, 15, 16, 17, 31, 32, 33, 63, 100, 319, 641, 640 };
+
+    for (unsigned eye_width : kEyeWidths)
+    {
+        const unsigned width = eye_width * 2;
+        // Cross at least four tag blocks
+        const unsigned height = eye_width == 640 ? 480 :
+            (4 * kCameraChunkBytes) / width + 3;
+
+        const unsigned transfer_bytes = RequiredTransferBytes(eye_width, height);
+        const std::vector<uint8_t> transfer = MakeTransfer(transfer_bytes, eye_width);
+
+        // Baseline writes to a padded pitch too, to catch row overruns
+        const unsigned pitch = width + 7;
+        std::vector<uint8_t> expected = MakeSentinelPlane(pitch, height);
+        TEST_CHECK(BaselineTagStrip(transfer.data(), width, height, expected.data(), pitch) == transfer_bytes);
+
+        // Side by side in one texture, as CameraImager uses it
+        std::vector<uint8_t> actual = MakeSentinelPlane(pitch, height);
+        CameraEyePlanes planes;
+        planes.Left = actual.data();
+        planes.LeftPitch = pitch;
+        planes.Right = actual.data() + eye_width;
+        planes.RightPitch = pitch;
+
+        TEST_CHECK(StripTagsAndSplitEyes(transfer.data(), transfer_bytes,
+            eye_width, height, planes));
+        TEST_CHECK(actual == expected);
+
+        // Separate planes with their own pitches
+        const unsigned left_pitch = eye_width + 1, right_pitch = eye_width + 64;
+        std::vector<uint8_t> left = MakeSentinelPlane(left_pitch, height);
+        std::vector<uint8_t> right = MakeSentinelPlane(right_pitch, height);
+        planes.Left = left.data();
+        planes.LeftPitch = left_pitch;
+        planes.Right = right.data();
+        planes.RightPitch = right_pitch;
+
+        TEST_CHECK(StripTagsAndSplitEyes(transfer.data(), transfer_bytes,
+            eye_width, height, planes));
+        for (unsigned y = 0; y < height; ++y)
+        {
+            TEST_CHECK(memcmp(&left[y * left_pitch], &expected[y * pitch], eye_width) == 0);
+            TEST_CHECK(memcmp(&right[y * right_pitch], &expected[y * pitch + eye_width], eye_width) == 0);
+        }
+        TEST_CHECK(CheckSentinelPadding(left.data(), left_pitch, eye_width, height));
+        TEST_CHECK(CheckSentinelPadding(right.data(), right_pitch, eye_width, height));
+    }
+    return true;
+}
+
+/*
+    A transfer one byte short of the image must be rejected.  The buffers
+    are sized exactly, so a read past them shows up under a memory checker
+*/
+static bool TestTruncatedTransfer()
+{
+    static const unsigned kEyeWidths[] = { 17, 640 };
+
+    for (unsigned eye_width : kEyeWidths)
+    {
+        const unsigned height = eye_width == 640 ? 480 : 1000;
+        const unsigned required = RequiredTransferBytes(eye_width, height);
+
+        std::vector<uint8_t> left(eye_width * height), right(eye_width * height);
+        CameraEyePlanes planes;
+        planes.Left = left.data();
+        planes.LeftPitch = eye_width;
+        planes.Right = right.data();
+        planes.RightPitch = eye_width;
+
+        const std::vector<uint8_t> exact = MakeTransfer(required, 1);
+        TEST_CHECK(StripTagsAndSplitEyes(exact.data(), required,
+            eye_width, height, planes));
+
+        const std::vector<uint8_t> truncated = MakeTransfer(required - 1, 1);
+        TEST_CHECK(!StripTagsAndSplitEyes(truncated.data(), required - 1,
+            eye_width, height, planes));
+
+        // Shorter than the header
+        const std::vector<uint8_t> tiny = MakeTransfer(kCameraImageOffset, 1);
+        TEST_CHECK(!StripTagsAndSplitEyes(tiny.data(), kCameraImageOffset,
+            eye_width, height, planes));
+
+        TEST_CHECK(!StripTagsAndSplitEyes(nullptr, required,
+            eye_width, height, planes));
+    }
+    return true;
+}
+
+bool TestCameraKernels()
+{
+    return TestSplitMatchesBaseline() &&
+        TestTruncatedTransfer();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkCameraKernels()
+{
+    const unsigned eye_width = 640, height = 480, width = eye_width * 2;
+    const unsigned transfer_bytes = RequiredTransferBytes(eye_width, height);
+    const std::vector<uint8_t> transfer = MakeTransfer(transfer_bytes, 1);
+    std::vector<uint8_t> dest(width * height);
+
+    const double baseline_usec = MeasureUsecPerCall([&]() {
+        BaselineTagStrip(transfer.data(), width, height, dest.data(), width);
+    });
+    Logger.Info("Baseline memcpy loop: ", baseline_usec, " usec, ",
+        GigabytesPerSecond(width * height, baseline_usec), " GB/s");
+
+    CameraEyePlanes planes;
+    planes.Left = dest.data();
+    planes.LeftPitch = width;
+    planes.Right = dest.data() + eye_width;
+    planes.RightPitch = width;
+
+    const double usec = MeasureUsecPerCall([&]() {
+        StripTagsAndSplitEyes(transfer.data(), transfer_bytes,
+            eye_width, height, planes);
+    });
+    Logger.Info("Split: ", usec, " usec, ",
+        GigabytesPerSecond(width * height, usec), " GB/s");
+}
+
+
+} // namespace core
@@ -0,0 +1,207 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "camera_latency_abi.hpp"
+
+#include <string.h>
+
+#include <memory>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Stamps for one frame, each stage `step` after the previous one
+static void MakeStamps(uint64_t stamps[kCameraLatencyStageCount], uint64_t start, uint64_t step)
+{
+    for (unsigned i = 0; i < kCameraLatencyStageCount; ++i) {
+        stamps[i] = start + i * step;
+    }
+}
+
+static std::unique_ptr<CameraLatencyHistogram> MakeHistogram()
+{
+    std::unique_ptr<CameraLatencyHistogram> histogram(new CameraLatencyHistogram);
+    histogram->Clear();
+    return histogram;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Every bucket's lower bound maps back to it and the value just below
+    maps to the previous bucket, so buckets tile the range without gaps.
+    Linear buckets hold one value, and log buckets are within 25%
+*/
+static bool TestBucketEdges()
+{
+    for (uint64_t usec = 0; usec < 8; ++usec) {
+        TEST_CHECK(CameraLatencyBucket(usec) == usec);
+        TEST_CHECK(CameraLatencyBucketUsec((unsigned)usec) == usec);
+    }
+
+    for (unsigned bucket = 1; bucket < kCameraLatencyBucketCount; ++bucket)
+    {
+        const uint64_t lower = CameraLatencyBucketUsec(bucket);
+        const uint64_t previous = CameraLatencyBucketUsec(bucket - 1);
+        TEST_CHECK(lower > previous);
+        TEST_CHECK(CameraLatencyBucket(lower) == bucket);
+        TEST_CHECK(CameraLatencyBucket(lower - 1) == bucket - 1);
+        if (bucket > 8) {
+            TEST_CHECK((lower - previous) * 4 <= previous);
+        }
+    }
+
+    // Spot checks of the documented layout: 8..15 in steps of 2, then 16..
+    TEST_CHECK(CameraLatencyBucketUsec(8) == 8);
+    TEST_CHECK(CameraLatencyBucketUsec(9) == 10);
+    TEST_CHECK(CameraLatencyBucketUsec(12) == 16);
+    TEST_CHECK(CameraLatencyBucket(11111) == CameraLatencyBucket(10240));
+
+    // The last bucket holds everything from about 115 msec
+    const unsigned last = kCameraLatencyBucketCount - 1;
+    TEST_CHECK(CameraLatencyBucketUsec(last) == 114688);
+    TEST_CHECK(CameraLatencyBucket(1000 * 1000) == last);
+    TEST_CHECK(CameraLatencyBucket(UINT64_MAX) == last);
+    return true;
+}
+
+/*
+    Percentiles round the rank up and interpolate within a bucket, are
+    exact in the linear buckets, never pass MaxUsec, and 100 is MaxUsec
+*/
+static bool TestPercentiles()
+{
+    std::unique_ptr<CameraLatencyHistogram> histogram = MakeHistogram();
+    TEST_CHECK(histogram->GetPercentileUsec(50) == 0);
+    TEST_CHECK(histogram->GetAverageUsec() == 0);
+
+    // Linear buckets: Exact ranks
+    for (uint64_t usec = 0; usec < 8; ++usec) {
+        histogram->Add(usec);
+    }
+    TEST_CHECK(histogram->GetPercentileUsec(0) == 0);
+    TEST_CHECK(histogram->GetPercentileUsec(50) == 3);
+    TEST_CHECK(histogram->GetPercentileUsec(51) == 4);
+    TEST_CHECK(histogram->GetPercentileUsec(99) == 7);
+    TEST_CHECK(histogram->GetPercentileUsec(100) == 7);
+    TEST_CHECK(histogram->GetPercentileUsec(1000) == 7);
+
+    // 1000..1999 evenly: Interpolation lands within a few percent, where a
+    // bucket's lower bound would be up to 20% low
+    histogram = MakeHistogram();
+    for (uint64_t usec = 1000; usec < 2000; ++usec) {
+        histogram->Add(usec);
+    }
+    TEST_CHECK(histogram->Count == 1000);
+    TEST_CHECK(histogram->GetAverageUsec() == 1499);
+    static const unsigned kPercents[] = { 1, 10, 25, 50, 75, 90, 99 };
+    for (unsigned percent : kPercents)
+    {
+        const uint64_t expected = 1000 + percent * 10 - 1;
+        const uint64_t actual = histogram->GetPercentileUsec(percent);
+        TEST_CHECK(actual * 100 >= expected * 92 && actual * 100 <= expected * 108);
+    }
+    TEST_CHECK(histogram->GetPercentileUsec(100) == 1999);
+
+    // One value in a wide bucket: The bucket is cut off at MaxUsec
+    histogram = MakeHistogram();
+    histogram->Add(5000);
+    TEST_CHECK(histogram->GetPercentileUsec(0) == CameraLatencyBucketUsec(CameraLatencyBucket(5000)));
+    TEST_CHECK(histogram->GetPercentileUsec(99) <= 5000);
+    TEST_CHECK(histogram->GetPercentileUsec(100) == 5000);
+
+    // The open-ended last bucket ends at MaxUsec too
+    histogram = MakeHistogram();
+    histogram->Add(200000);
+    histogram->Add(400000);
+    TEST_CHECK(histogram->GetPercentileUsec(50) == 114688);
+    TEST_CHECK(histogram->GetPercentileUsec(99) > 114688 && histogram->GetPercentileUsec(99) < 400000);
+    TEST_CHECK(histogram->GetPercentileUsec(100) == 400000);
+    return true;
+}
+
+/*
+    A full bucket stops at UINT32_MAX instead of wrapping to zero, and
+    percentiles stay consistent with the buckets
+*/
+static bool TestBucketSaturation()
+{
+    std::unique_ptr<CameraLatencyHistogram> histogram = MakeHistogram();
+    histogram->Add(100);
+    histogram->Buckets[CameraLatencyBucket(100)] = UINT32_MAX - 1;
+
+    histogram->Add(100);
+    histogram->Add(100);
+    histogram->Add(100);
+    TEST_CHECK(histogram->Buckets[CameraLatencyBucket(100)] == UINT32_MAX);
+    TEST_CHECK(histogram->Count == 4);
+
+    // A few slow frames do not outweigh billions of fast ones
+    histogram->Add(50000);
+    TEST_CHECK(CameraLatencyBucket(histogram->GetPercentileUsec(99)) == CameraLatencyBucket(100));
+    TEST_CHECK(histogram->GetPercentileUsec(100) == 50000);
+    return true;
+}
+
+/*
+    A frame adds one sample to every interval and the total.  Missing stamps
+    skip the frame, and stamps out of order count as zero instead of
+    wrapping around
+*/
+static bool TestAddFrame()
+{
+    std::unique_ptr<CameraLatencyCounters> counters(new CameraLatencyCounters);
+    counters->Clear();
+    TEST_CHECK(counters->Version == CAMERA_LATENCY_ABI_VERSION);
+
+    uint64_t stamps[kCameraLatencyStageCount];
+    MakeStamps(stamps, 1000000, 500);
+    TEST_CHECK(counters->AddFrame(stamps));
+    TEST_CHECK(counters->Frames == 1);
+    for (unsigned i = 0; i < kCameraLatencyTotalInterval; ++i) {
+        TEST_CHECK(counters->Intervals[i].Count == 1);
+        TEST_CHECK(counters->Intervals[i].MaxUsec == 500);
+    }
+    TEST_CHECK(counters->Intervals[kCameraLatencyTotalInterval].MaxUsec ==
+        500 * (kCameraLatencyStageCount - 1));
+    TEST_CHECK(counters->LastStageUsec[kCameraLatencyStageCount - 1] == stamps[kCameraLatencyStageCount - 1]);
+
+    // Missing stage
+    MakeStamps(stamps, 2000000, 500);
+    stamps[static_cast<unsigned>(CameraLatencyStage::Select)] = 0;
+    TEST_CHECK(!counters->AddFrame(stamps));
+    TEST_CHECK(counters->Skipped == 1);
+    TEST_CHECK(counters->Frames == 1);
+    TEST_CHECK(counters->Intervals[0].Count == 1);
+
+    // Publish stamped before Receive, as from a clock that stepped back
+    MakeStamps(stamps, 3000000, 500);
+    const unsigned publish = static_cast<unsigned>(CameraLatencyStage::Publish);
+    stamps[publish] = stamps[publish - 1] - 100;
+    TEST_CHECK(counters->AddFrame(stamps));
+    TEST_CHECK(counters->Frames == 2);
+    TEST_CHECK(counters->Intervals[publish - 1].Buckets[0] == 1);
+    TEST_CHECK(counters->Intervals[publish - 1].MaxUsec == 500);
+    TEST_CHECK(counters->Intervals[publish].MaxUsec == 1100);
+
+    // Names follow the stage each interval ends at
+    TEST_CHECK(strcmp(CameraLatencyIntervalName(publish - 1), "publish") == 0);
+    TEST_CHECK(strcmp(CameraLatencyIntervalName(kCameraLatencyTotalInterval), "total") == 0);
+    return true;
+}
+
+bool TestCameraLatency()
+{
+    return TestBucketEdges() &&
+        TestPercentiles() &&
+        TestBucketSaturation() &&
+        TestAddFrame();
+}
+
+
+} // namespace core
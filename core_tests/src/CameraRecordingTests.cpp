@@ -0,0 +1,154 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraRecording.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static const char* kRecordingTestFile = "core_tests_recording.rec";
+
+static bool WriteTestRecording(const std::string& path, unsigned frames, unsigned payload_bytes)
+{
+    CameraRecordingWriter writer;
+    if (!writer.Open(path)) {
+        return false;
+    }
+
+    std::vector<uint8_t> payload(payload_bytes);
+    for (unsigned i = 0; i < frames; ++i)
+    {
+        memset(payload.data(), (int)i, payload.size());
+
+        CameraRecordingFrame info{};
+        info.PayloadBytes = payload_bytes;
+        info.ImplantFrameNumber = i + 1;
+        info.ReceiveTimeUsec = 1000 + i;
+        if (!writer.Append(info, payload.data())) {
+            return false;
+        }
+    }
+    writer.Close();
+    return true;
+}
+
+// Overwrite the PayloadBytes field of the first frame record
+static bool CorruptFirstPayloadBytes(const std::string& path, uint32_t payload_bytes)
+{
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (!file) {
+        return false;
+    }
+    const bool success =
+        fseek(file, kCameraRecordingHeaderBytes + offsetof(CameraRecordingFrame, PayloadBytes), SEEK_SET) == 0 &&
+        fwrite(&payload_bytes, sizeof(payload_bytes), 1, file) == 1;
+    fclose(file);
+    return success;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+static bool TestRecordingRoundTrip()
+{
+    const std::string path = TestTempPath(kRecordingTestFile);
+    TEST_CHECK(WriteTestRecording(path, 10, kImplantCameraBytes));
+
+    CameraRecordingReader reader;
+    TEST_CHECK(reader.Open(path));
+    TEST_CHECK(reader.GetFrameCount() == 10);
+
+    for (unsigned pass = 0; pass < 2; ++pass)
+    {
+        CameraRecordingFrame info;
+        const uint8_t* payload = nullptr;
+        for (unsigned i = 0; i < 10; ++i)
+        {
+            TEST_CHECK(reader.ReadNext(info, payload));
+            TEST_CHECK(info.PayloadBytes == kImplantCameraBytes);
+            TEST_CHECK(info.ImplantFrameNumber == i + 1);
+            TEST_CHECK(info.ReceiveTimeUsec == 1000 + i);
+            TEST_CHECK(payload[0] == (uint8_t)i && payload[kImplantCameraBytes - 1] == (uint8_t)i);
+        }
+        TEST_CHECK(!reader.ReadNext(info, payload));
+        TEST_CHECK(reader.Rewind());
+    }
+    reader.Close();
+
+    // Larger than one implant transfer
+    CameraRecordingWriter writer;
+    TEST_CHECK(writer.Open(path));
+    std::vector<uint8_t> big(kImplantCameraBytes + 1);
+    CameraRecordingFrame info{};
+    info.PayloadBytes = (uint32_t)big.size();
+    TEST_CHECK(!writer.Append(info, big.data()));
+    writer.Close();
+
+    remove(path.c_str());
+    return true;
+}
+
+/*
+    A corrupt size near UINT32_MAX used to wrap the 32-bit record size to a
+    small number, pass the bounds check, and replay a payload that runs past
+    the mapped chunk
+*/
+static bool TestCorruptPayloadBytes()
+{
+    const std::string path = TestTempPath(kRecordingTestFile);
+    static const uint32_t kCorruptSizes[] = {
+        UINT32_MAX,
+        UINT32_MAX - (uint32_t)sizeof(CameraRecordingFrame) + 1,
+        UINT32_MAX - 100,
+        kImplantCameraBytes + 1,
+        kCameraRecordingChunkBytes
+    };
+
+    for (uint32_t payload_bytes : kCorruptSizes)
+    {
+        TEST_CHECK(WriteTestRecording(path, 2, 4096));
+        TEST_CHECK(CorruptFirstPayloadBytes(path, payload_bytes));
+
+        CameraRecordingReader reader;
+        TEST_CHECK(reader.Open(path));
+
+        CameraRecordingFrame info;
+        const uint8_t* payload = nullptr;
+        TEST_CHECK(!reader.ReadNext(info, payload));
+        reader.Close();
+    }
+
+    // A size that is valid for a transfer but runs past the end of the file
+    TEST_CHECK(WriteTestRecording(path, 1, 4096));
+    TEST_CHECK(CorruptFirstPayloadBytes(path, kImplantCameraBytes));
+    {
+        CameraRecordingReader reader;
+        TEST_CHECK(reader.Open(path));
+
+        CameraRecordingFrame info;
+        const uint8_t* payload = nullptr;
+        TEST_CHECK(!reader.ReadNext(info, payload));
+    }
+
+    remove(path.c_str());
+    return true;
+}
+
+bool TestCameraRecording()
+{
+    return TestRecordingRoundTrip() &&
+        TestCorruptPayloadBytes();
+}
+
+
+} // namespace core
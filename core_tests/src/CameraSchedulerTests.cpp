@@ -0,0 +1,268 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraScheduler.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraSchedulerTests");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static const unsigned kTestImageBytes = 64;
+
+// Image contents derived from the frame number, to catch reused buffers
+static uint8_t ImageByte(uint32_t frame_number)
+{
+    return static_cast<uint8_t>(frame_number * 37 + 1);
+}
+
+static void PushFrame(CameraFrameScheduler& scheduler, uint32_t frame_number, uint64_t exposure_usec = 0)
+{
+    uint8_t* image = scheduler.BeginPush(kTestImageBytes);
+    memset(image, ImageByte(frame_number), kTestImageBytes);
+    scheduler.CommitPush(exposure_usec, frame_number);
+}
+
+// Fill a buffer and then give up on it, as CameraImager does for dark or
+// truncated frames
+static void AbandonFrame(CameraFrameScheduler& scheduler)
+{
+    uint8_t* image = scheduler.BeginPush(kTestImageBytes);
+    memset(image, 0xff, kTestImageBytes);
+}
+
+static bool CheckImage(const CameraScheduledFrame* frame, uint32_t frame_number)
+{
+    TEST_CHECK(frame != nullptr);
+    TEST_CHECK(frame->FrameNumber == frame_number);
+    TEST_CHECK(frame->Image.size() == kTestImageBytes);
+    for (uint8_t v : frame->Image) {
+        TEST_CHECK(v == ImageByte(frame_number));
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Abandoning a push must not drop queued frames or overwrite the frame on
+    screen, even with a full queue
+*/
+static bool TestAbandonedPush()
+{
+    CameraFrameScheduler scheduler;
+
+    PushFrame(scheduler, 1);
+    const CameraScheduledFrame* shown = scheduler.Select(0, 0);
+    TEST_CHECK(CheckImage(shown, 1));
+
+    for (uint32_t n = 2; n < 2 + kCameraScheduleDepth; ++n) {
+        PushFrame(scheduler, n);
+    }
+    TEST_CHECK(scheduler.GetStats().Queued == 1 + kCameraScheduleDepth);
+    TEST_CHECK(scheduler.GetStats().Dropped == 0);
+
+    for (unsigned i = 0; i < 10; ++i) {
+        AbandonFrame(scheduler);
+    }
+    TEST_CHECK(scheduler.GetStats().Dropped == 0);
+    TEST_CHECK(CheckImage(shown, 1));
+
+    // Exposure times where the oldest queued frame is closest to the target
+    // latency, so it must still be there to be picked
+    CameraFrameScheduler timed;
+    PushFrame(timed, 1, 1000);
+    TEST_CHECK(CheckImage(timed.Select(11000, 1000), 1));
+    PushFrame(timed, 2, 7000);
+    PushFrame(timed, 3, 10000);
+    PushFrame(timed, 4, 11000);
+    for (unsigned i = 0; i < 10; ++i) {
+        AbandonFrame(timed);
+    }
+    TEST_CHECK(CheckImage(timed.Select(12000, 1000), 2));
+    TEST_CHECK(timed.GetStats().Dropped == 0);
+
+    // A committed push into a full queue drops the oldest frame
+    PushFrame(scheduler, 100);
+    TEST_CHECK(scheduler.GetStats().Dropped == 1);
+    TEST_CHECK(CheckImage(scheduler.Select(0, 0), 100));
+    TEST_CHECK(scheduler.GetStats().Dropped == kCameraScheduleDepth);
+
+    // Commit without a push does nothing
+    scheduler.CommitPush(0, 200);
+    TEST_CHECK(scheduler.Select(0, 0) == nullptr);
+    return true;
+}
+
+/*
+    Random pushes, abandoned pushes and newest-frame selects against a model
+    queue.  Shown frames must keep their contents until the next Select()
+*/
+static bool TestRandomOperations()
+{
+    CameraFrameScheduler scheduler;
+    std::deque<uint32_t> model;
+    uint64_t dropped = 0;
+
+    const CameraScheduledFrame* shown = nullptr;
+    uint32_t shown_number = 0;
+    uint32_t next_number = 1;
+
+    TestRandom rng(15);
+    for (unsigned i = 0; i < 100000; ++i)
+    {
+        const unsigned op = rng.NextRange(8);
+        if (op < 3)
+        {
+            PushFrame(scheduler, next_number);
+            if (model.size() >= kCameraScheduleDepth) {
+                model.pop_front();
+                ++dropped;
+            }
+            model.push_back(next_number++);
+        }
+        else if (op < 6)
+        {
+            AbandonFrame(scheduler);
+        }
+        else if (op < 7)
+        {
+            const CameraScheduledFrame* frame = scheduler.Select(0, 0);
+            if (model.empty()) {
+                TEST_CHECK(frame == nullptr);
+            }
+            else {
+                dropped += model.size() - 1;
+                shown = frame;
+                shown_number = model.back();
+                model.clear();
+                TEST_CHECK(CheckImage(shown, shown_number));
+            }
+        }
+        else if (shown)
+        {
+            TEST_CHECK(CheckImage(shown, shown_number));
+        }
+
+        TEST_CHECK(scheduler.GetStats().Dropped == dropped);
+    }
+    return true;
+}
+
+static bool TestDarkFrames()
+{
+    CameraFrameScheduler scheduler;
+    CameraDarkFrameParams params;
+    params.DarkPercent = 25;
+    params.MaxSkips = 3;
+    scheduler.SetDarkFrameParams(params);
+
+    TEST_CHECK(scheduler.AcceptBrightness(1000));
+    TEST_CHECK(!scheduler.AcceptBrightness(100));
+    TEST_CHECK(scheduler.AcceptBrightness(1000));
+    TEST_CHECK(scheduler.AcceptBrightness(250));
+
+    // The room went dark: Accept after MaxSkips rejections in a row
+    TEST_CHECK(!scheduler.AcceptBrightness(10));
+    TEST_CHECK(!scheduler.AcceptBrightness(10));
+    TEST_CHECK(!scheduler.AcceptBrightness(10));
+    TEST_CHECK(scheduler.AcceptBrightness(10));
+    TEST_CHECK(scheduler.AcceptBrightness(10));
+
+    TEST_CHECK(scheduler.GetStats().Dark == 4);
+    return true;
+}
+
+/*
+    60 Hz camera with jittered arrival and a 90 Hz display.  Scheduling by
+    display time must hold the photon-to-display latency steadier than
+    showing the newest frame
+*/
+static bool TestLatencyJitter()
+{
+    double stddev[2] = {};
+
+    for (unsigned scheduled = 0; scheduled < 2; ++scheduled)
+    {
+        CameraFrameScheduler scheduler;
+        TestRandom rng(1);
+
+        const uint64_t camera_period = 1000000 / 60;
+        const uint64_t display_period = 1000000 / 90;
+
+        struct Pending
+        {
+            uint64_t ExposureUsec;
+            uint64_t ArrivalUsec;
+            uint32_t FrameNumber;
+        };
+        std::vector<Pending> pending;
+        uint64_t next_camera = 1000000;
+        uint32_t frame_number = 0;
+
+        double sum = 0., sum2 = 0.;
+        unsigned count = 0;
+        uint64_t shown_exposure = 0;
+
+        for (uint64_t t = 1000000; t < 11000000; t += display_period)
+        {
+            while (next_camera <= t + 1) {
+                // Up to 8 ms of transfer jitter
+                pending.push_back({ next_camera - 20000, next_camera + rng.NextRange(8000), ++frame_number });
+                next_camera += camera_period;
+            }
+            for (size_t i = 0; i < pending.size();) {
+                if (pending[i].ArrivalUsec <= t) {
+                    scheduler.BeginPush(16);
+                    scheduler.CommitPush(pending[i].ExposureUsec, pending[i].FrameNumber);
+                    pending.erase(pending.begin() + i);
+                }
+                else {
+                    ++i;
+                }
+            }
+
+            const uint64_t display_usec = t + 2 * display_period;
+            const CameraScheduledFrame* frame = scheduler.Select(scheduled ? display_usec : 0, display_period);
+            if (frame) {
+                shown_exposure = frame->ExposureTimeUsec;
+            }
+            if (t > 2000000 && shown_exposure != 0) {
+                const double latency = (double)(display_usec - shown_exposure);
+                sum += latency;
+                sum2 += latency * latency;
+                ++count;
+            }
+        }
+
+        const double mean = sum / count;
+        stddev[scheduled] = sqrt(sum2 / count - mean * mean);
+        Logger.Info(scheduled ? "Scheduled" : "Newest", ": Latency ", mean / 1000., " msec, stddev ",
+            stddev[scheduled] / 1000., " msec");
+    }
+
+    TEST_CHECK(stddev[1] < stddev[0]);
+    return true;
+}
+
+bool TestCameraScheduler()
+{
+    return TestAbandonedPush() &&
+        TestRandomOperations() &&
+        TestDarkFrames() &&
+        TestLatencyJitter();
+}
+
+
+} // namespace core
@@ -0,0 +1,381 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraStereo.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraStereoTests");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Largest full-resolution shift used by the scenes
+static const unsigned kMaxSceneShift = 100;
+
+/*
+    Eye pair with a known disparity per row: The right eye sees the texture
+    shifted left by shift_for_row(y) full-resolution pixels, so a left block
+    at x matches the right plane at x - shift / 2 after downsampling.
+    Buffers are sized exactly so overreads show up under a memory checker
+*/
+struct StereoScene
+{
+    unsigned Width = 0, Height = 0;
+    std::vector<uint8_t> Left, Right;
+};
+
+template<typename ShiftFn>
+static StereoScene MakeScene(unsigned width, unsigned height, const std::vector<uint8_t>& texture, ShiftFn shift_for_row)
+{
+    const unsigned texture_width = width + kMaxSceneShift;
+
+    StereoScene scene;
+    scene.Width = width;
+    scene.Height = height;
+    scene.Left.resize(width * height);
+    scene.Right.resize(width * height);
+    for (unsigned y = 0; y < height; ++y)
+    {
+        const unsigned shift = shift_for_row(y);
+        for (unsigned x = 0; x < width; ++x) {
+            scene.Left[y * width + x] = texture[y * texture_width + x];
+            scene.Right[y * width + x] = texture[y * texture_width + x + shift];
+        }
+    }
+    return scene;
+}
+
+static std::vector<uint8_t> MakeNoiseTexture(unsigned width, unsigned height, uint64_t seed)
+{
+    std::vector<uint8_t> texture((width + kMaxSceneShift) * height);
+    TestRandom rng(seed);
+    rng.Fill(texture.data(), texture.size());
+    return texture;
+}
+
+static bool ProcessScene(
+    CameraStereoMatcher& matcher,
+    const StereoScene& scene,
+    WorkerPool* pool,
+    CameraKernelPath path)
+{
+    return matcher.Process(
+        scene.Left.data(), scene.Width,
+        scene.Right.data(), scene.Width,
+        scene.Width, scene.Height,
+        pool, path);
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Three bands of known integer disparity.  Every block that can see its
+    match must find it, with the depth from the documented formula
+*/
+static bool TestKnownDisparity()
+{
+    static const unsigned kWidth = 640, kHeight = 480;
+
+    // Downsampled disparities per band of rows
+    auto disparity_for_row = [](unsigned y) -> unsigned {
+        return y < 120 ? 20 : (y < 400 ? 8 : 33);
+    };
+
+    const std::vector<uint8_t> texture = MakeNoiseTexture(kWidth, kHeight, 16);
+    const StereoScene scene = MakeScene(kWidth, kHeight, texture,
+        [&](unsigned y) { return disparity_for_row(y) * 2; });
+
+    CameraStereoParams params;
+    params.DisparityOffset = 2.f;
+
+    CameraStereoMatcher matcher;
+    matcher.SetParams(params);
+    TEST_CHECK(ProcessScene(matcher, scene, nullptr, CameraKernelPath::Scalar));
+
+    const CameraDepthGrid& grid = matcher.GetDepthGrid();
+    TEST_CHECK(grid.Width == kWidth / 2 / params.BlockSize);
+    TEST_CHECK(grid.Height == kHeight / 2 / params.BlockSize);
+    TEST_CHECK(grid.Disparity.size() == grid.Width * grid.Height);
+
+    const float focal = params.FocalLengthPixels * 0.5f;
+    unsigned checked = 0, valid = 0;
+    float max_error = 0.f;
+    for (unsigned by = 0; by < grid.Height; ++by)
+    {
+        const unsigned plane_y = by * params.BlockSize;
+        const unsigned expected = disparity_for_row(plane_y * 2);
+        // Blocks straddling two bands have no single answer
+        if (disparity_for_row((plane_y + params.BlockSize - 1) * 2) != expected) {
+            continue;
+        }
+
+        for (unsigned bx = 0; bx < grid.Width; ++bx)
+        {
+            const unsigned index = by * grid.Width + bx;
+            if (grid.Disparity[index] != 0.f) {
+                ++valid;
+            }
+
+            // The search needs one disparity past the match
+            if (bx * params.BlockSize <= expected) {
+                continue;
+            }
+            ++checked;
+
+            const float disparity = grid.Disparity[index];
+            const float error = fabsf(disparity - (float)expected);
+            max_error = error > max_error ? error : max_error;
+            TEST_CHECK(error < 0.25f);
+
+            const float depth = params.BaselineMeters * focal / (disparity - params.DisparityOffset);
+            TEST_CHECK(fabsf(grid.DepthMeters[index] - depth) <= depth * 1e-5f);
+        }
+    }
+    TEST_CHECK(checked > grid.Width * grid.Height / 2);
+    TEST_CHECK(grid.ValidCount >= valid);
+
+    // Most blocks are in the 8 pixel band
+    const float distance = matcher.EstimateSceneDistance();
+    const float expected_distance = params.BaselineMeters * focal / (8.f - params.DisparityOffset);
+    TEST_CHECK(fabsf(distance - expected_distance) < expected_distance * 0.05f);
+
+    Logger.Info("Known disparity: ", checked, " blocks checked, max error ", max_error,
+        " px, scene distance ", distance, " m");
+    return true;
+}
+
+/*
+    Odd full-resolution shifts land between downsampled pixels, so the
+    parabola refinement must find the half pixel
+*/
+static bool TestSubPixelDisparity()
+{
+    static const unsigned kWidth = 320, kHeight = 240;
+
+    // Smooth texture, so the half-pixel blend is close to a real shift
+    const unsigned texture_width = kWidth + kMaxSceneShift;
+    const std::vector<uint8_t> noise = MakeNoiseTexture(kWidth, kHeight, 8);
+    std::vector<uint8_t> texture(noise.size());
+    for (unsigned y = 0; y < kHeight; ++y) {
+        for (unsigned x = 0; x < texture_width; ++x) {
+            // 4x4 box blur, clamped at the edges
+            unsigned sum = 0;
+            for (unsigned dy = 0; dy < 4; ++dy) {
+                for (unsigned dx = 0; dx < 4; ++dx) {
+                    const unsigned sy = y + dy < kHeight ? y + dy : kHeight - 1;
+                    const unsigned sx = x + dx < texture_width ? x + dx : texture_width - 1;
+                    sum += noise[sy * texture_width + sx];
+                }
+            }
+            texture[y * texture_width + x] = (uint8_t)((sum + 8) / 16);
+        }
+    }
+
+    const StereoScene scene = MakeScene(kWidth, kHeight, texture, [](unsigned) { return 2 * 12 + 1; });
+
+    CameraStereoMatcher matcher;
+    TEST_CHECK(ProcessScene(matcher, scene, nullptr, CameraKernelPath::Scalar));
+
+    const CameraDepthGrid& grid = matcher.GetDepthGrid();
+    double sum = 0.;
+    unsigned count = 0;
+    for (unsigned by = 0; by < grid.Height; ++by)
+    {
+        // Skip blocks too close to the edge to search past the match
+        for (unsigned bx = 2; bx < grid.Width; ++bx)
+        {
+            const float disparity = grid.Disparity[by * grid.Width + bx];
+            TEST_CHECK(fabsf(disparity - 12.5f) < 0.4f);
+            sum += disparity;
+            ++count;
+        }
+    }
+
+    const double mean = sum / count;
+    Logger.Info("Sub-pixel: Mean disparity ", mean, " for 12.5 over ", count, " blocks");
+    TEST_CHECK(fabs(mean - 12.5) < 0.15);
+    return true;
+}
+
+/*
+    Flat blocks have no texture and a repeating pattern matches at several
+    disparities, so neither may produce a depth
+*/
+static bool TestRejectedBlocks()
+{
+    static const unsigned kWidth = 320, kHeight = 240;
+
+    CameraStereoMatcher matcher;
+
+    std::vector<uint8_t> flat((kWidth + kMaxSceneShift) * kHeight, 100);
+    const StereoScene flat_scene = MakeScene(kWidth, kHeight, flat, [](unsigned) { return 20u; });
+    TEST_CHECK(ProcessScene(matcher, flat_scene, nullptr, CameraKernelPath::Scalar));
+    TEST_CHECK(matcher.GetDepthGrid().ValidCount == 0);
+    TEST_CHECK(matcher.EstimateSceneDistance() == 0.f);
+
+    // Columns repeat every 6 downsampled pixels
+    std::vector<uint8_t> column_values(12);
+    TestRandom rng(3);
+    rng.Fill(column_values.data(), column_values.size());
+    for (unsigned i = 0; i < 12; i += 2) {
+        column_values[i + 1] = column_values[i];
+    }
+    std::vector<uint8_t> periodic((kWidth + kMaxSceneShift) * kHeight);
+    for (unsigned y = 0; y < kHeight; ++y) {
+        for (unsigned x = 0; x < kWidth + kMaxSceneShift; ++x) {
+            periodic[y * (kWidth + kMaxSceneShift) + x] = column_values[x % 12];
+        }
+    }
+    const StereoScene periodic_scene = MakeScene(kWidth, kHeight, periodic, [](unsigned) { return 20u; });
+    TEST_CHECK(ProcessScene(matcher, periodic_scene, nullptr, CameraKernelPath::Scalar));
+
+    // Blocks near the left edge only search far enough to see one period
+    const CameraDepthGrid& grid = matcher.GetDepthGrid();
+    for (unsigned by = 0; by < grid.Height; ++by) {
+        for (unsigned bx = 2; bx < grid.Width; ++bx) {
+            TEST_CHECK(grid.Disparity[by * grid.Width + bx] == 0.f);
+        }
+    }
+
+    // A distant scene at the disparity offset is out of range
+    const std::vector<uint8_t> texture = MakeNoiseTexture(kWidth, kHeight, 4);
+    const StereoScene far_scene = MakeScene(kWidth, kHeight, texture, [](unsigned) { return 10u; });
+    CameraStereoParams params;
+    params.DisparityOffset = 5.f;
+    matcher.SetParams(params);
+    TEST_CHECK(ProcessScene(matcher, far_scene, nullptr, CameraKernelPath::Scalar));
+    TEST_CHECK(matcher.GetDepthGrid().ValidCount == 0);
+    return true;
+}
+
+static bool TestInvalidParams()
+{
+    const std::vector<uint8_t> texture = MakeNoiseTexture(64, 64, 1);
+    const StereoScene scene = MakeScene(64, 64, texture, [](unsigned) { return 8u; });
+
+    CameraStereoMatcher matcher;
+    CameraStereoParams params;
+    params.BlockSize = 16;
+    matcher.SetParams(params);
+    TEST_CHECK(!ProcessScene(matcher, scene, nullptr, CameraKernelPath::Scalar));
+
+    // Smaller than one downsampled block
+    matcher.SetParams(CameraStereoParams());
+    TEST_CHECK(!matcher.Process(scene.Left.data(), 64, scene.Right.data(), 64, 15, 64));
+    TEST_CHECK(!matcher.Process(scene.Left.data(), 64, scene.Right.data(), 64, 64, 15));
+
+    TEST_CHECK(ProcessScene(matcher, scene, nullptr, CameraKernelPath::Scalar));
+    return true;
+}
+
+/*
+    SAD is integer, so every path and the worker pool must produce the same
+    grid bit for bit, including odd widths with a downsample tail
+*/
+static bool TestPathsMatchScalar()
+{
+    struct Size { unsigned Width, Height; };
+    static const Size kSizes[] = { { 640, 480 }, { 402, 130 }, { 16, 16 }, { 97, 33 } };
+
+    WorkerPool pool;
+    pool.Start(3);
+
+    unsigned seed = 0;
+    for (const Size& size : kSizes)
+    {
+        const std::vector<uint8_t> texture = MakeNoiseTexture(size.Width, size.Height, ++seed);
+        const StereoScene scene = MakeScene(size.Width, size.Height, texture,
+            [](unsigned y) { return 6 + (y / 16) % 40; });
+
+        CameraStereoParams params;
+        params.MaxDisparity = 37;
+
+        CameraStereoMatcher reference;
+        reference.SetParams(params);
+        TEST_CHECK(ProcessScene(reference, scene, nullptr, CameraKernelPath::Scalar));
+        const CameraDepthGrid& expected = reference.GetDepthGrid();
+
+        for (CameraKernelPath path : kCameraKernelPaths)
+        {
+            if (!IsCameraKernelPathSupported(path)) {
+                continue;
+            }
+
+            for (unsigned use_pool = 0; use_pool < 2; ++use_pool)
+            {
+                CameraStereoMatcher matcher;
+                matcher.SetParams(params);
+                TEST_CHECK(ProcessScene(matcher, scene, use_pool ? &pool : nullptr, path));
+
+                const CameraDepthGrid& actual = matcher.GetDepthGrid();
+                TEST_CHECK(actual.Width == expected.Width && actual.Height == expected.Height);
+                TEST_CHECK(actual.ValidCount == expected.ValidCount);
+                TEST_CHECK(actual.Disparity == expected.Disparity);
+                TEST_CHECK(actual.DepthMeters == expected.DepthMeters);
+            }
+        }
+    }
+
+    pool.Stop();
+    return true;
+}
+
+bool TestCameraStereo()
+{
+    return TestInvalidParams() &&
+        TestKnownDisparity() &&
+        TestSubPixelDisparity() &&
+        TestRejectedBlocks() &&
+        TestPathsMatchScalar();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkCameraStereo()
+{
+    static const unsigned kWidth = 640, kHeight = 480;
+
+    const std::vector<uint8_t> texture = MakeNoiseTexture(kWidth, kHeight, 1);
+    const StereoScene scene = MakeScene(kWidth, kHeight, texture,
+        [](unsigned y) { return y < kHeight / 2 ? 40u : 16u; });
+
+    // As many helpers as CameraImager starts
+    WorkerPool pool;
+    pool.Start(2);
+
+    for (CameraKernelPath path : kCameraKernelPaths)
+    {
+        if (!IsCameraKernelPathSupported(path)) {
+            continue;
+        }
+
+        CameraStereoMatcher matcher;
+        const double usec = MeasureUsecPerCall([&]() {
+            ProcessScene(matcher, scene, nullptr, path);
+        });
+        const double pool_usec = MeasureUsecPerCall([&]() {
+            ProcessScene(matcher, scene, &pool, path);
+        });
+        Logger.Info(CameraKernelPathToString(path), " depth grid: ", usec, " usec, ",
+            pool_usec, " usec with 2 workers");
+
+        if (path == GetBestCameraKernelPath()) {
+            BENCH_CHECK(pool_usec < kCameraStereoBudgetUsec);
+        }
+    }
+
+    pool.Stop();
+}
+
+
+} // namespace core
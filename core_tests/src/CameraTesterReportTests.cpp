@@ -0,0 +1,186 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraTesterReport.hpp"
+
+#include <string>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Raw text of a top-level field value, or "" if the field is missing
+static std::string ReportField(const std::string& report, const char* name)
+{
+    const std::string key = std::string("\"") + name + "\":";
+
+    int depth = 0;
+    for (size_t i = 0; i < report.size(); ++i)
+    {
+        const char c = report[i];
+        if (c == '{') {
+            ++depth;
+        }
+        else if (c == '}') {
+            --depth;
+        }
+        else if (depth == 1 && report.compare(i, key.size(), key) == 0 &&
+            (report[i - 1] == '{' || report[i - 1] == ','))
+        {
+            size_t end = i + key.size();
+            int value_depth = 0;
+            while (end < report.size())
+            {
+                if (report[end] == '{') {
+                    ++value_depth;
+                }
+                else if (report[end] == '}') {
+                    if (value_depth == 0) {
+                        break;
+                    }
+                    --value_depth;
+                }
+                else if (report[end] == ',' && value_depth == 0) {
+                    break;
+                }
+                ++end;
+            }
+            return report.substr(i + key.size(), end - i - key.size());
+        }
+    }
+    return "";
+}
+
+static bool IsBalanced(const std::string& report)
+{
+    int depth = 0;
+    for (char c : report) {
+        depth += c == '{' ? 1 : (c == '}' ? -1 : 0);
+        if (depth < 0) {
+            return false;
+        }
+    }
+    return depth == 0 && !report.empty() && report.front() == '{' && report.back() == '}';
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Percentiles are exact below kMaxUsec, larger samples clamp to it, and
+    Merge() and Reset() keep the count and max consistent
+*/
+static bool TestUsecHistogram()
+{
+    UsecHistogram histogram;
+    TEST_CHECK(histogram.GetPercentile(50.) == 0);
+
+    for (uint64_t usec = 1; usec <= 100; ++usec) {
+        histogram.Add(usec);
+    }
+    TEST_CHECK(histogram.GetCount() == 100);
+    TEST_CHECK(histogram.GetPercentile(50.) == 51);
+    TEST_CHECK(histogram.GetPercentile(99.) == 100);
+    TEST_CHECK(histogram.GetPercentile(100.) == 100);
+    TEST_CHECK(histogram.ToJson() == "{\"p50\":51,\"p90\":91,\"p99\":100,\"p999\":100,\"max\":100}");
+
+    UsecHistogram slow;
+    slow.Add(UsecHistogram::kMaxUsec * 3);
+    histogram.Merge(slow);
+    TEST_CHECK(histogram.GetCount() == 101);
+    TEST_CHECK(histogram.GetPercentile(100.) == UsecHistogram::kMaxUsec);
+    TEST_CHECK(ReportField("{\"h\":" + histogram.ToJson() + "}", "h").find("\"max\":300000") != std::string::npos);
+
+    histogram.Reset();
+    TEST_CHECK(histogram.GetCount() == 0);
+    TEST_CHECK(histogram.ToJson() == "{\"p50\":0,\"p90\":0,\"p99\":0,\"p999\":0,\"max\":0}");
+    return true;
+}
+
+/*
+    Frame fields cover the report's window, counters since the start carry
+    a _total suffix, and server and renderer fields appear only when there
+    is one
+*/
+static bool TestReportFields()
+{
+    FrameStats stats;
+    stats.Reset(1000000);
+    for (unsigned i = 0; i < 30; ++i) {
+        stats.Latency.Add(500 + i);
+        stats.Copy.Add(100);
+        stats.Interval.Add(33333);
+    }
+
+    TesterCounters counters;
+    counters.Client.Skipped = 4;
+    counters.Client.AcquireRetries = 2;
+    counters.Client.ImplantDropped = 1;
+
+    const std::string live = FormatTesterReport("window", "", stats, counters, 3000000);
+    TEST_CHECK(IsBalanced(live));
+    TEST_CHECK(ReportField(live, "type") == "\"window\"");
+    TEST_CHECK(ReportField(live, "mode") == "\"live\"");
+    TEST_CHECK(ReportField(live, "elapsed_sec") == "2");
+    TEST_CHECK(ReportField(live, "frames") == "30");
+    TEST_CHECK(ReportField(live, "fps") == "15");
+    TEST_CHECK(ReportField(live, "latency_usec") == stats.Latency.ToJson());
+    TEST_CHECK(ReportField(live, "skipped_total") == "4");
+    TEST_CHECK(ReportField(live, "acquire_retries_total") == "2");
+    TEST_CHECK(ReportField(live, "implant_dropped_total") == "1");
+    TEST_CHECK(ReportField(live, "published_total").empty());
+    TEST_CHECK(ReportField(live, "write_usec_avg").empty());
+    TEST_CHECK(ReportField(live, "renderer_frames").empty());
+
+    // The window's own count is frames: No unsuffixed totals
+    TEST_CHECK(ReportField(live, "published").empty());
+    TEST_CHECK(ReportField(live, "skipped").empty());
+
+    counters.HasServer = true;
+    counters.HasSynthetic = true;
+    counters.Synthetic.Published = 90;
+    counters.Synthetic.Dropped = 10;
+    counters.Synthetic.WriteUsecTotal = 2500;
+    counters.Synthetic.WriteUsecMax = 70;
+    counters.Published = counters.Synthetic.Published;
+
+    counters.HasRenderer = true;
+    counters.Renderer.Clear();
+    uint64_t stamps[kCameraLatencyStageCount];
+    for (unsigned i = 0; i < kCameraLatencyStageCount; ++i) {
+        stamps[i] = 1000 + i * 2;
+    }
+    TEST_CHECK(counters.Renderer.AddFrame(stamps));
+
+    const std::string synthetic = FormatTesterReport("final", "synthetic", stats, counters, 2000000);
+    TEST_CHECK(IsBalanced(synthetic));
+    TEST_CHECK(ReportField(synthetic, "type") == "\"final\"");
+    TEST_CHECK(ReportField(synthetic, "mode") == "\"synthetic\"");
+    TEST_CHECK(ReportField(synthetic, "fps") == "30");
+    TEST_CHECK(ReportField(synthetic, "published_total") == "90");
+    TEST_CHECK(ReportField(synthetic, "write_usec_avg") == "25");
+    TEST_CHECK(ReportField(synthetic, "write_usec_max") == "70");
+    TEST_CHECK(ReportField(synthetic, "renderer_frames") == "1");
+
+    const std::string renderer = ReportField(synthetic, "renderer_latency_usec");
+    TEST_CHECK(renderer.find("\"upload\":{\"p50\":2,\"p99\":2,\"avg\":2,\"max\":2}") != std::string::npos);
+    TEST_CHECK(renderer.find("\"total\":{\"p50\":12,") != std::string::npos);
+
+    // No time elapsed yet
+    const std::string empty = FormatTesterReport("window", "replay", FrameStats(), TesterCounters(), 0);
+    TEST_CHECK(IsBalanced(empty));
+    TEST_CHECK(ReportField(empty, "fps") == "0");
+    return true;
+}
+
+bool TestCameraTesterReport()
+{
+    return TestUsecHistogram() &&
+        TestReportFields();
+}
+
+
+} // namespace core
@@ -0,0 +1,403 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "CameraUndistort.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CameraUndistortTests");
+
+
+//------------------------------------------------------------------------------
+// Reference
+
+/*
+    Undistortion written directly from the model in CameraUndistort.hpp, in
+    double precision.  The source radius is found by bisection instead of the
+    LUT's Newton iteration, and the sample is a floating-point bilinear blend,
+    so the two only share the documented math.
+
+    Valid for lens parameters where r / (1 + K1 r^2 + K2 r^4) increases over
+    the source image, which covers the headset calibrations.
+*/
+struct ReferenceSample
+{
+    // False if the output pixel has no source pixel
+    bool Valid = false;
+
+    // Distance of the source position from the edge where it becomes
+    // invalid, in source pixels.  Pixels right at the edge are not compared
+    double EdgeDistance = 0.;
+
+    double SourceX = 0., SourceY = 0.;
+    double Value = 0.;
+};
+
+static double ForwardRadius(double k1, double k2, double r)
+{
+    const double r2 = r * r;
+    return r / (1. + k1 * r2 + k2 * r2 * r2);
+}
+
+static ReferenceSample ReferenceUndistort(
+    const CameraUndistortParams& params,
+    const uint8_t* source,
+    unsigned x,
+    unsigned y)
+{
+    ReferenceSample sample;
+
+    const double sw = params.SourceWidth, sh = params.SourceHeight;
+    const double aspect = sw / sh;
+    const double extent_x = ForwardRadius(params.K1, params.K2, 0.5 * aspect) / params.OutputZoom;
+    const double scale = 2. * extent_x / params.OutputWidth;
+
+    const double ox = (x + 0.5 - 0.5 * params.OutputWidth) * scale;
+    const double oy = (y + 0.5 - 0.5 * params.OutputHeight) * scale;
+    const double r_out = sqrt(ox * ox + oy * oy);
+
+    // The source corner bounds every radius that can land in the image
+    const double r_max = sqrt(0.25 * aspect * aspect + 0.25) * 1.01;
+    double ratio = 1.;
+    if (r_out > 0.)
+    {
+        if (ForwardRadius(params.K1, params.K2, r_max) < r_out) {
+            sample.EdgeDistance = 1.;
+            return sample; // Outside every source pixel
+        }
+        double lo = 0., hi = r_max;
+        for (int i = 0; i < 100; ++i) {
+            const double mid = 0.5 * (lo + hi);
+            (ForwardRadius(params.K1, params.K2, mid) < r_out ? lo : hi) = mid;
+        }
+        ratio = 0.5 * (lo + hi) / r_out;
+    }
+
+    const double sx = (ox * ratio + 0.5 * aspect) * sh - 0.5;
+    const double sy = (oy * ratio + 0.5) * sh - 0.5;
+    sample.SourceX = sx;
+    sample.SourceY = sy;
+
+    // Half a pixel outside is clamped like a texture, beyond that is border
+    const double dx = fmin(sx + 0.5, sw - 0.5 - sx);
+    const double dy = fmin(sy + 0.5, sh - 0.5 - sy);
+    sample.EdgeDistance = fabs(fmin(dx, dy));
+    sample.Valid = dx >= 0. && dy >= 0.;
+    if (!sample.Valid) {
+        return sample;
+    }
+
+    const double cx = fmin(fmax(sx, 0.), sw - 1.);
+    const double cy = fmin(fmax(sy, 0.), sh - 1.);
+    const unsigned ix = (unsigned)fmin(cx, sw - 2.);
+    const unsigned iy = (unsigned)fmin(cy, sh - 2.);
+    const double fx = cx - ix, fy = cy - iy;
+
+    const uint8_t* p = source + iy * params.SourcePitch + ix;
+    const unsigned pitch = params.SourcePitch;
+    const double top = p[0] * (1. - fx) + p[1] * fx;
+    const double bottom = p[pitch] * (1. - fx) + p[pitch + 1] * fx;
+    sample.Value = top * (1. - fy) + bottom * fy;
+    return sample;
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Smooth image, so the LUT's 1/32 pixel positions stay within one level
+static std::vector<uint8_t> MakeSmoothSource(const CameraUndistortParams& params)
+{
+    std::vector<uint8_t> source(params.SourcePitch * params.SourceHeight + kCameraRemapSourcePadding, kTestSentinel);
+    for (unsigned y = 0; y < params.SourceHeight; ++y) {
+        for (unsigned x = 0; x < params.SourceWidth; ++x) {
+            const double v = 128. + 100. * sin(x * 0.05) * cos(y * 0.07 + 1.);
+            source[y * params.SourcePitch + x] = (uint8_t)(v + 0.5);
+        }
+    }
+    return source;
+}
+
+// Noise, so any wrong neighbor or weight shows up between paths
+static std::vector<uint8_t> MakeNoiseSource(const CameraUndistortParams& params, uint64_t seed)
+{
+    std::vector<uint8_t> source(params.SourcePitch * params.SourceHeight + kCameraRemapSourcePadding);
+    TestRandom rng(seed);
+    rng.Fill(source.data(), source.size());
+    return source;
+}
+
+static std::vector<CameraUndistortParams> MakeTestParams()
+{
+    std::vector<CameraUndistortParams> list;
+
+    // Headset defaults
+    list.push_back(CameraUndistortParams());
+
+    CameraUndistortParams p;
+    p.K1 = -0.3f;
+    p.K2 = -0.1f;
+    p.SourceWidth = 321;
+    p.SourceHeight = 243;
+    p.SourcePitch = 333;
+    p.OutputWidth = 301;
+    p.OutputHeight = 199;
+    p.BorderValue = 77;
+    list.push_back(p);
+
+    p = CameraUndistortParams();
+    p.K1 = 0.2f;
+    p.OutputWidth = 257;
+    p.OutputHeight = 255;
+    p.OutputZoom = 1.5f;
+    list.push_back(p);
+
+    // No distortion, smaller than one SIMD batch per row
+    p = CameraUndistortParams();
+    p.K1 = 0.f;
+    p.SourceWidth = p.SourcePitch = 37;
+    p.SourceHeight = 29;
+    p.OutputWidth = 7;
+    p.OutputHeight = 5;
+    list.push_back(p);
+
+    return list;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    The scalar path must match the reference within one level, and pixels
+    must only be border where the reference has no source pixel
+*/
+static bool TestMatchesReference()
+{
+    for (const CameraUndistortParams& params : MakeTestParams())
+    {
+        CameraRemapLut lut;
+        TEST_CHECK(lut.Build(params));
+
+        const std::vector<uint8_t> source = MakeSmoothSource(params);
+        std::vector<uint8_t> output(params.OutputWidth * params.OutputHeight, kTestSentinel);
+        lut.Apply(source.data(), output.data(), params.OutputWidth, CameraKernelPath::Scalar);
+
+        unsigned valid_count = 0;
+        double max_error = 0., max_position_error = 0.;
+        for (unsigned y = 0; y < params.OutputHeight; ++y)
+        {
+            for (unsigned x = 0; x < params.OutputWidth; ++x)
+            {
+                const ReferenceSample expected = ReferenceUndistort(params, source.data(), x, y);
+                const uint8_t actual = output[y * params.OutputWidth + x];
+
+                float source_x = 0.f, source_y = 0.f;
+                const bool has_source = lut.GetSourcePosition(x, y, source_x, source_y);
+
+                // Within rounding of the edge either answer is right
+                if (expected.EdgeDistance < 0.01) {
+                    continue;
+                }
+
+                TEST_CHECK(has_source == expected.Valid);
+                if (!expected.Valid) {
+                    TEST_CHECK(actual == params.BorderValue);
+                    continue;
+                }
+                ++valid_count;
+
+                const double error = fabs(actual - expected.Value);
+                max_error = error > max_error ? error : max_error;
+                TEST_CHECK(error <= 1.);
+
+                // Positions agree to the LUT's 1/32 pixel, except where
+                // clamped into the image
+                const double clamped_x = fmin(fmax(expected.SourceX, 0.), params.SourceWidth - 1.);
+                const double clamped_y = fmin(fmax(expected.SourceY, 0.), params.SourceHeight - 1.);
+                const double position_error = fmax(fabs(source_x - clamped_x), fabs(source_y - clamped_y));
+                max_position_error = position_error > max_position_error ? position_error : max_position_error;
+                TEST_CHECK(position_error <= 1. / kCameraRemapFracOne + 1e-3);
+            }
+        }
+
+        // Most of the output must be image, not border
+        TEST_CHECK(valid_count * 2 > params.OutputWidth * params.OutputHeight);
+
+        Logger.Info(params.OutputWidth, "x", params.OutputHeight, " K1=", params.K1, " K2=", params.K2,
+            ": Max error ", max_error, " levels, ", max_position_error, " px");
+    }
+    return true;
+}
+
+/*
+    With no distortion and matching sizes, interior pixels land exactly on
+    source pixels
+*/
+static bool TestIdentity()
+{
+    CameraUndistortParams params;
+    params.K1 = 0.f;
+    params.K2 = 0.f;
+
+    CameraRemapLut lut;
+    TEST_CHECK(lut.Build(params));
+
+    const std::vector<uint8_t> source = MakeNoiseSource(params, 5);
+    std::vector<uint8_t> output(params.OutputWidth * params.OutputHeight, kTestSentinel);
+    lut.Apply(source.data(), output.data(), params.OutputWidth);
+
+    // The last row and column sample 1/32 pixel inside, so both neighbors exist
+    for (unsigned y = 0; y + 1 < params.OutputHeight; ++y) {
+        TEST_CHECK(memcmp(&output[y * params.OutputWidth], &source[y * params.SourcePitch], params.OutputWidth - 1) == 0);
+    }
+    return true;
+}
+
+/*
+    Every path and any tiling must match the scalar path bit for bit, and a
+    tile must not write outside itself
+*/
+static bool TestPathsMatchScalar()
+{
+    unsigned seed = 0;
+    for (const CameraUndistortParams& params : MakeTestParams())
+    {
+        CameraRemapLut lut;
+        TEST_CHECK(lut.Build(params));
+
+        // Source buffer sized exactly, so overreads show up under a memory checker
+        const std::vector<uint8_t> source = MakeNoiseSource(params, ++seed);
+
+        const unsigned pitch = params.OutputWidth + 5;
+        std::vector<uint8_t> expected = MakeSentinelPlane(pitch, params.OutputHeight);
+        lut.Apply(source.data(), expected.data(), pitch, CameraKernelPath::Scalar);
+        TEST_CHECK(CheckSentinelPadding(expected.data(), pitch, params.OutputWidth, params.OutputHeight));
+
+        for (CameraKernelPath path : kCameraKernelPaths)
+        {
+            if (!IsCameraKernelPathSupported(path)) {
+                continue;
+            }
+
+            std::vector<uint8_t> actual = MakeSentinelPlane(pitch, params.OutputHeight);
+            lut.Apply(source.data(), actual.data(), pitch, path);
+            TEST_CHECK(actual == expected);
+
+            // Odd tiles, including ones that hang off the edge
+            static const unsigned kTileSizes[] = { 1, 7, 16, 61 };
+            for (unsigned tile : kTileSizes)
+            {
+                std::fill(actual.begin(), actual.end(), kTestSentinel);
+                for (unsigned y = 0; y < params.OutputHeight; y += tile) {
+                    for (unsigned x = 0; x < params.OutputWidth; x += tile) {
+                        lut.ApplyTile(source.data(), actual.data(), pitch, x, y, tile, tile, path);
+                    }
+                }
+                TEST_CHECK(actual == expected);
+            }
+
+            // One interior tile leaves the rest alone
+            if (params.OutputWidth > 20 && params.OutputHeight > 20)
+            {
+                std::fill(actual.begin(), actual.end(), kTestSentinel);
+                lut.ApplyTile(source.data(), actual.data(), pitch, 3, 4, 13, 9, path);
+                for (unsigned y = 0; y < params.OutputHeight; ++y) {
+                    for (unsigned x = 0; x < pitch; ++x) {
+                        const bool inside = x >= 3 && x < 16 && y >= 4 && y < 13;
+                        TEST_CHECK(actual[y * pitch + x] == (inside ? expected[y * pitch + x] : kTestSentinel));
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool TestInvalidParams()
+{
+    CameraRemapLut lut;
+
+    CameraUndistortParams params;
+    params.SourceWidth = 1;
+    TEST_CHECK(!lut.Build(params));
+    TEST_CHECK(!lut.IsValid());
+
+    params = CameraUndistortParams();
+    params.SourcePitch = params.SourceWidth - 1;
+    TEST_CHECK(!lut.Build(params));
+
+    params = CameraUndistortParams();
+    params.OutputZoom = 0.f;
+    TEST_CHECK(!lut.Build(params));
+
+    // Offsets must fit in the entry
+    params = CameraUndistortParams();
+    params.SourcePitch = 4096;
+    params.SourceHeight = 2048;
+    TEST_CHECK(!lut.Build(params));
+
+    // The edge of the source folds over
+    params = CameraUndistortParams();
+    params.K1 = -3.f;
+    TEST_CHECK(!lut.Build(params));
+
+    // An invalid LUT writes nothing
+    uint8_t output[16];
+    memset(output, kTestSentinel, sizeof(output));
+    lut.Apply(output, output, 4);
+    for (uint8_t v : output) {
+        TEST_CHECK(v == kTestSentinel);
+    }
+
+    TEST_CHECK(lut.Build(CameraUndistortParams()));
+    TEST_CHECK(lut.IsValid());
+    return true;
+}
+
+bool TestCameraUndistort()
+{
+    return TestInvalidParams() &&
+        TestIdentity() &&
+        TestMatchesReference() &&
+        TestPathsMatchScalar();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkCameraUndistort()
+{
+    const CameraUndistortParams params;
+
+    CameraRemapLut lut;
+    const double build_usec = MeasureUsecPerCall([&]() {
+        lut.Build(params);
+    }, 100 * 1000, 1);
+    Logger.Info("Build ", params.OutputWidth, "x", params.OutputHeight, ": ", build_usec, " usec");
+
+    const std::vector<uint8_t> source = MakeNoiseSource(params, 1);
+    std::vector<uint8_t> output(params.OutputWidth * params.OutputHeight);
+
+    for (CameraKernelPath path : kCameraKernelPaths)
+    {
+        if (!IsCameraKernelPathSupported(path)) {
+            continue;
+        }
+
+        const double usec = MeasureUsecPerCall([&]() {
+            lut.Apply(source.data(), output.data(), params.OutputWidth, path);
+        });
+        Logger.Info(CameraKernelPathToString(path), " remap one eye: ", usec, " usec, ",
+            GigabytesPerSecond(params.OutputWidth * params.OutputHeight, usec), " GB/s");
+    }
+}
+
+
+} // namespace core
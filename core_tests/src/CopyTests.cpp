@@ -0,0 +1,413 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_copy.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CopyTests");
+
+
+//------------------------------------------------------------------------------
+// Baseline
+
+// Row-by-row memcpy that MemCopy2D used before the kernels
+static void BaselineCopy2D(
+    uint8_t* dest,
+    unsigned dest_pitch,
+    const uint8_t* src,
+    unsigned src_pitch,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    for (unsigned y = 0; y < rows; ++y) {
+        memcpy(dest, src, row_bytes);
+        dest += dest_pitch;
+        src += src_pitch;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static const CopyStores kStores[] = {
+    CopyStores::Temporal,
+    CopyStores::NonTemporal
+};
+
+// Bytes checked past the end of a copy for stray writes
+static const unsigned kGuardBytes = 64;
+
+static const uint8_t kGuardByte = 0xcd;
+
+/*
+    Same split as CopyScheduler, with the band size as a parameter:  Bands
+    of about band_bytes, with at least one band per thread
+*/
+static void BandedCopy2D(
+    WorkerPool& pool,
+    unsigned band_bytes,
+    uint8_t* dest,
+    unsigned pitch,
+    const uint8_t* src,
+    unsigned row_bytes,
+    unsigned rows)
+{
+    const unsigned thread_count = pool.GetThreadCount();
+
+    unsigned band_rows = band_bytes / row_bytes;
+    if (band_rows < 1) {
+        band_rows = 1;
+    }
+    unsigned band_count = (rows + band_rows - 1) / band_rows;
+    if (band_count < thread_count) {
+        band_rows = (rows + thread_count - 1) / thread_count;
+        band_count = (rows + band_rows - 1) / band_rows;
+    }
+
+    const CopyStores stores = GetBestCopyStores(row_bytes, rows);
+
+    pool.ParallelFor(band_count, [&](unsigned band) {
+        const unsigned first_row = band * band_rows;
+        unsigned band_row_count = rows - first_row;
+        if (band_row_count > band_rows) {
+            band_row_count = band_rows;
+        }
+        const size_t offset = static_cast<size_t>(first_row) * pitch;
+        CopyPlane2D(dest + offset, pitch, src + offset, pitch, row_bytes, band_row_count,
+            CopyKernelPath::Auto, stores);
+    });
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Random offsets, pitches and row lengths, including rows shorter than a
+    vector and misaligned pointers, on every path with both store types.
+    Bytes between rows and past the end must be untouched
+*/
+static bool TestCopyPlane2D()
+{
+    std::vector<uint8_t> src(256 * 1024), dest(src.size()), expected(src.size());
+
+    TestRandom rng(21);
+    rng.Fill(src.data(), src.size());
+
+    for (unsigned i = 0; i < 2000; ++i)
+    {
+        const unsigned src_offset = rng.NextRange(64);
+        const unsigned dest_offset = rng.NextRange(64);
+        const unsigned row_bytes = rng.NextRange(i % 4 == 0 ? 4096 : 700);
+        const unsigned rows = rng.NextRange(24);
+        unsigned src_pitch = row_bytes + rng.NextRange(100);
+        unsigned dest_pitch = row_bytes + rng.NextRange(100);
+        if (i % 5 == 0) {
+            src_pitch = dest_pitch = row_bytes;
+        }
+
+        memset(expected.data(), kGuardByte, expected.size());
+        BaselineCopy2D(expected.data() + dest_offset, dest_pitch,
+            src.data() + src_offset, src_pitch, row_bytes, rows);
+        const size_t checked = dest_offset + static_cast<size_t>(rows) * dest_pitch + kGuardBytes;
+
+        for (CopyKernelPath path : kCopyKernelPaths)
+        {
+            if (!IsCopyKernelPathSupported(path)) {
+                TEST_CHECK(!CopyPlane2D(dest.data(), 0, src.data(), 0, 1, 1, path));
+                continue;
+            }
+            for (CopyStores stores : kStores)
+            {
+                memset(dest.data(), kGuardByte, checked);
+                TEST_CHECK(CopyPlane2D(dest.data() + dest_offset, dest_pitch,
+                    src.data() + src_offset, src_pitch, row_bytes, rows, path, stores));
+                TEST_CHECK(0 == memcmp(dest.data(), expected.data(), checked));
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Overlapping moves up, down, left and right within one surface must match
+    a copy through a temporary
+*/
+static bool TestMovePlane2D()
+{
+    const unsigned pitch = 1024, height = 64;
+    std::vector<uint8_t> original(pitch * height), surface, expected, temp;
+
+    TestRandom rng(22);
+    rng.Fill(original.data(), original.size());
+
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        const unsigned row_bytes = 1 + rng.NextRange(pitch / 2);
+        const unsigned rows = 1 + rng.NextRange(height / 2);
+        const unsigned src_x = rng.NextRange(pitch - row_bytes + 1);
+        const unsigned src_y = rng.NextRange(height - rows + 1);
+
+        // Mostly small shifts, like a scrolled window
+        unsigned dest_x = src_x, dest_y = src_y;
+        if (i % 2 == 0) {
+            dest_x = rng.NextRange(pitch - row_bytes + 1);
+            dest_y = rng.NextRange(height - rows + 1);
+        }
+        else if (i % 4 == 1) {
+            dest_y = rng.NextRange(height - rows + 1);
+        }
+        else {
+            dest_x = rng.NextRange(pitch - row_bytes + 1);
+        }
+
+        const size_t src_offset = static_cast<size_t>(src_y) * pitch + src_x;
+        const size_t dest_offset = static_cast<size_t>(dest_y) * pitch + dest_x;
+
+        expected = original;
+        temp.resize(static_cast<size_t>(row_bytes) * rows);
+        BaselineCopy2D(temp.data(), row_bytes, original.data() + src_offset, pitch, row_bytes, rows);
+        BaselineCopy2D(expected.data() + dest_offset, pitch, temp.data(), row_bytes, row_bytes, rows);
+
+        for (CopyKernelPath path : kCopyKernelPaths)
+        {
+            if (!IsCopyKernelPathSupported(path)) {
+                continue;
+            }
+            surface = original;
+            TEST_CHECK(MovePlane2D(surface.data() + dest_offset, surface.data() + src_offset,
+                pitch, row_bytes, rows, path));
+            TEST_CHECK(surface == expected);
+        }
+    }
+    return true;
+}
+
+/*
+    Store selection: Regular stores for short rows and small copies,
+    streaming stores for copies that would flush the cache
+*/
+static bool TestBestCopyStores()
+{
+    uint64_t cache_bytes = GetCpuFeatures().LastLevelCacheBytes;
+    if (cache_bytes == 0) {
+        cache_bytes = kCopyDefaultCacheBytes;
+    }
+    const unsigned large_rows = static_cast<unsigned>(cache_bytes / 4096) + 1;
+
+    TEST_CHECK(GetBestCopyStores(4096, 1) == CopyStores::Temporal);
+    TEST_CHECK(GetBestCopyStores(4096, large_rows) == CopyStores::NonTemporal);
+    TEST_CHECK(GetBestCopyStores(kCopyNonTemporalMinRowBytes - 1, 1000000) == CopyStores::Temporal);
+    TEST_CHECK(GetBestCopyKernelPath() != CopyKernelPath::Auto);
+    TEST_CHECK(IsCopyKernelPathSupported(CopyKernelPath::Scalar));
+    return true;
+}
+
+/*
+    Scheduled copies with 0 to 3 workers and the latency target at zero, so
+    every copy above kCopyParallelMinBytes is split into bands, must match
+    an inline copy including band remainders and single-row copies
+*/
+static bool TestCopyScheduler()
+{
+    const unsigned pitch = 4096 * 4 + 68;
+    const unsigned max_rows = 256;
+    std::vector<uint8_t> src(static_cast<size_t>(pitch) * max_rows + 16);
+    std::vector<uint8_t> dest(src.size()), expected(src.size());
+
+    TestRandom rng(23);
+    rng.Fill(src.data(), src.size());
+
+    for (unsigned workers = 0; workers < 4; ++workers)
+    {
+        CopyScheduler scheduler;
+        if (workers > 0) {
+            scheduler.Start(workers);
+        }
+        TEST_CHECK(scheduler.GetThreadCount() == workers + 1);
+        scheduler.SetLatencyTargetUsec(0);
+
+        for (unsigned i = 0; i < 40; ++i)
+        {
+            // Half the copies are large enough to be split
+            const unsigned row_bytes = 1 + rng.NextRange(pitch - 16);
+            unsigned rows = 1 + rng.NextRange(max_rows);
+            if (i % 2 == 0) {
+                rows = 1 + rng.NextRange(16);
+            }
+
+            memset(expected.data(), kGuardByte, expected.size());
+            BaselineCopy2D(expected.data() + 12, pitch, src.data() + 4, pitch, row_bytes, rows);
+
+            memset(dest.data(), kGuardByte, dest.size());
+            TEST_CHECK(scheduler.CopyPlane2D(dest.data() + 12, pitch, src.data() + 4, pitch,
+                row_bytes, rows));
+            TEST_CHECK(dest == expected);
+        }
+
+        scheduler.Stop();
+    }
+    return true;
+}
+
+bool TestCopy()
+{
+    return TestCopyPlane2D() &&
+        TestMovePlane2D() &&
+        TestBestCopyStores() &&
+        TestCopyScheduler();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+/*
+    Path x store type x rect size, for a BGRA dirty rect in a 4K desktop
+    surface.  Misaligned runs offset both pointers and pad the pitch, as a
+    mapped staging texture may be
+*/
+static void BenchmarkCopyMatrix()
+{
+    struct Rect
+    {
+        unsigned Width, Height;
+    };
+    static const Rect kRects[] = {
+        { 64, 64 },
+        { 256, 256 },
+        { 512, 512 },
+        { 1280, 720 },
+        { 1920, 1080 },
+        { 3840, 2160 }
+    };
+
+    const unsigned max_width = 3840, max_height = 2160;
+    const unsigned aligned_pitch = max_width * 4;
+    const unsigned misaligned_pitch = aligned_pitch + 68;
+
+    std::vector<uint8_t> src(static_cast<size_t>(misaligned_pitch) * max_height + 64);
+    std::vector<uint8_t> dest(src.size());
+    TestRandom rng(1);
+    rng.Fill(src.data(), src.size());
+    memset(dest.data(), 0, dest.size());
+
+    Logger.Info("Last level cache: ", GetCpuFeatures().LastLevelCacheBytes, " bytes, Auto = ",
+        CopyKernelPathToString(GetBestCopyKernelPath()));
+
+    for (unsigned misaligned = 0; misaligned < 2; ++misaligned)
+    {
+        const unsigned pitch = misaligned ? misaligned_pitch : aligned_pitch;
+        const uint8_t* src_rect = src.data() + (misaligned ? 4 : 0);
+        uint8_t* dest_rect = dest.data() + (misaligned ? 12 : 0);
+
+        for (const Rect& rect : kRects)
+        {
+            const unsigned row_bytes = rect.Width * 4;
+            const uint64_t bytes = static_cast<uint64_t>(row_bytes) * rect.Height;
+
+            const double baseline_usec = MeasureUsecPerCall([&]() {
+                BaselineCopy2D(dest_rect, pitch, src_rect, pitch, row_bytes, rect.Height);
+            });
+            Logger.Info(misaligned ? "Misaligned " : "Aligned ", rect.Width, "x", rect.Height,
+                " baseline memcpy: ", baseline_usec, " usec, ",
+                GigabytesPerSecond(bytes, baseline_usec), " GB/s");
+
+            for (CopyKernelPath path : kCopyKernelPaths)
+            {
+                if (!IsCopyKernelPathSupported(path)) {
+                    continue;
+                }
+                for (CopyStores stores : { CopyStores::Temporal, CopyStores::NonTemporal, CopyStores::Auto })
+                {
+                    const double usec = MeasureUsecPerCall([&]() {
+                        CopyPlane2D(dest_rect, pitch, src_rect, pitch, row_bytes, rect.Height, path, stores);
+                    });
+                    Logger.Info(misaligned ? "Misaligned " : "Aligned ", rect.Width, "x", rect.Height,
+                        " ", CopyKernelPathToString(path), " ", CopyStoresToString(stores), ": ",
+                        usec, " usec, ", GigabytesPerSecond(bytes, usec), " GB/s");
+                }
+            }
+        }
+    }
+}
+
+/*
+    Time vs thread count and band size for full-width desktop updates from
+    64 KiB to a whole 4K frame.  Compare the 1 thread column against the
+    others to place kCopyParallelMinBytes, the band sizes to place
+    kCopyBandBytes, and the thread counts to pick kDesktopCopyWorkers
+*/
+static void BenchmarkCopyThreads()
+{
+    static const unsigned kBandSizes[] = {
+        64 * 1024,
+        kCopyBandBytes,
+        1024 * 1024,
+        4 * 1024 * 1024
+    };
+    static const unsigned kMaxWorkers = 4;
+
+    // Rows of a 4K desktop: 60 KiB up to the whole frame
+    static const unsigned kRows[] = {
+        4, 8, 16, 32, 64, 128, 270, 540, 1080, 2160
+    };
+
+    const unsigned row_bytes = 3840 * 4;
+    const unsigned max_rows = 2160;
+
+    std::vector<uint8_t> src(static_cast<size_t>(row_bytes) * max_rows);
+    std::vector<uint8_t> dest(src.size());
+    TestRandom rng(2);
+    rng.Fill(src.data(), src.size());
+    memset(dest.data(), 0, dest.size());
+
+    Logger.Info("Hardware threads: ", std::thread::hardware_concurrency());
+
+    for (unsigned workers = 0; workers <= kMaxWorkers; ++workers)
+    {
+        WorkerPool pool;
+        if (workers > 0) {
+            pool.Start(workers);
+        }
+
+        for (unsigned rows : kRows)
+        {
+            const uint64_t bytes = static_cast<uint64_t>(row_bytes) * rows;
+
+            for (unsigned band_bytes : kBandSizes)
+            {
+                // One thread has no bands, so only measure it once
+                if (workers == 0 && band_bytes != kCopyBandBytes) {
+                    continue;
+                }
+
+                const double usec = MeasureUsecPerCall([&]() {
+                    BandedCopy2D(pool, band_bytes, dest.data(), row_bytes, src.data(), row_bytes, rows);
+                });
+                Logger.Info(pool.GetThreadCount(), " threads, ", bytes / 1024, " KiB, ",
+                    band_bytes / 1024, " KiB bands: ", usec, " usec, ",
+                    GigabytesPerSecond(bytes, usec), " GB/s");
+            }
+        }
+
+        pool.Stop();
+    }
+}
+
+void BenchmarkCopy()
+{
+    BenchmarkCopyMatrix();
+    BenchmarkCopyThreads();
+}
+
+
+} // namespace core
@@ -0,0 +1,142 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace core;
+
+static logger::Channel Logger("CoreTests");
+
+/*
+    Usage:
+        core_tests [name ...]         Run the tests, or the ones named
+        core_tests bench [name ...]   Run the benchmarks, or the ones named
+
+    Returns non-zero if any test or benchmark check failed.
+*/
+
+struct TestCase
+{
+    const char* Name;
+    bool (*Run)();
+};
+
+struct BenchmarkCase
+{
+    const char* Name;
+    void (*Run)();
+};
+
+static const TestCase kTests[] = {
+    { "camera_contrast", TestCameraContrast },
+    { "camera_denoise", TestCameraDenoise },
+    { "camera_kernels", TestCameraKernels },
+    { "camera_latency", TestCameraLatency },
+    { "camera_recording", TestCameraRecording },
+    { "camera_scheduler", TestCameraScheduler },
+    { "camera_stereo", TestCameraStereo },
+    { "camera_tester_report", TestCameraTesterReport },
+    { "camera_undistort", TestCameraUndistort },
+    { "copy", TestCopy },
+    { "cursor", TestCursor },
+    { "implant_abi", TestImplantAbi },
+    { "ipc", TestIpc },
+    { "lockfree_map", TestLockFreeMap },
+    { "plugin_abi", TestPluginAbi },
+    { "region", TestRegion },
+    { "seqlock", TestSeqLock },
+    { "tile_hash", TestTileHash },
+};
+
+static const BenchmarkCase kBenchmarks[] = {
+    { "camera_contrast", BenchmarkCameraContrast },
+    { "camera_denoise", BenchmarkCameraDenoise },
+    { "camera_kernels", BenchmarkCameraKernels },
+    { "camera_stereo", BenchmarkCameraStereo },
+    { "camera_undistort", BenchmarkCameraUndistort },
+    { "copy", BenchmarkCopy },
+    { "cursor", BenchmarkCursor },
+    { "ipc", BenchmarkIpc },
+    { "lockfree_map", BenchmarkLockFreeMap },
+    { "region", BenchmarkRegion },
+    { "seqlock", BenchmarkSeqLock },
+    { "tile_hash", BenchmarkTileHash },
+};
+
+static bool IsSelected(const char* name, const std::vector<std::string>& names)
+{
+    if (names.empty()) {
+        return true;
+    }
+    for (const std::string& selected : names) {
+        if (selected == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    SetCurrentThreadName("Main");
+
+    std::vector<std::string> names;
+    bool bench = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (i == 1 && strcmp(argv[i], "bench") == 0) {
+            bench = true;
+        }
+        else {
+            names.push_back(argv[i]);
+        }
+    }
+
+    if (bench)
+    {
+        for (const BenchmarkCase& benchmark : kBenchmarks) {
+            if (IsSelected(benchmark.Name, names)) {
+                Logger.Info("Benchmark: ", benchmark.Name);
+                benchmark.Run();
+            }
+        }
+        logger::OutputWorker::GetInstance().Flush();
+        return AnyBenchmarkFailed() ? CORE_APP_FAILURE : CORE_APP_SUCCESS;
+    }
+
+    unsigned run = 0, failed = 0;
+    for (const TestCase& test : kTests)
+    {
+        if (!IsSelected(test.Name, names)) {
+            continue;
+        }
+        ++run;
+
+        const uint64_t t0 = GetTimeUsec();
+        const bool success = test.Run();
+        const uint64_t t1 = GetTimeUsec();
+
+        if (success) {
+            Logger.Info("PASS ", test.Name, " (", (t1 - t0) / 1000, " msec)");
+        }
+        else {
+            Logger.Error("FAIL ", test.Name);
+            ++failed;
+        }
+    }
+
+    if (run == 0) {
+        Logger.Error("No tests matched");
+        failed = 1;
+    }
+    else {
+        Logger.Info(run - failed, " of ", run, " tests passed");
+    }
+
+    logger::OutputWorker::GetInstance().Flush();
+    return failed == 0 ? CORE_APP_SUCCESS : CORE_APP_FAILURE;
+}
@@ -0,0 +1,519 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_cursor.hpp"
+
+#include <string.h>
+
+#include <iterator>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("CursorTests");
+
+
+//------------------------------------------------------------------------------
+// Baseline
+
+/*
+    The WriteMouseCursor() loops from the duplication backends before
+    core_cursor.  Each composites the width x height rect of the shape at
+    (offset_x, offset_y) over the screen into dest, which has a pitch of
+    width * 4.
+*/
+
+static void BaselineColor(
+    const CursorShape& shape,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    const uint8_t* screen_src,
+    unsigned screen_pitch,
+    uint8_t* cursor_ptr)
+{
+    const unsigned cursor_pitch = width * 4;
+    const uint8_t* pointer_ptr = shape.Data + offset_x * 4 + offset_y * shape.Pitch;
+
+    for (unsigned i = 0; i < height; ++i)
+    {
+        const uint32_t* cursor_row = reinterpret_cast<const uint32_t*>(pointer_ptr);
+        const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
+        uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
+
+        for (unsigned j = 0; j < width; ++j)
+        {
+            // If alpha is 50% or higher:
+            if (cursor_row[j] >= 0x80000000) {
+                output_row[j] = cursor_row[j];
+            }
+            else {
+                output_row[j] = input_row[j];
+            }
+        }
+
+        cursor_ptr += cursor_pitch;
+        screen_src += screen_pitch;
+        pointer_ptr += shape.Pitch;
+    }
+}
+
+static void BaselineMonochrome(
+    const CursorShape& shape,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    const uint8_t* screen_src,
+    unsigned screen_pitch,
+    uint8_t* cursor_ptr)
+{
+    const unsigned cursor_pitch = width * 4;
+    const unsigned xor_offset = shape.Height / 2 * shape.Pitch;
+    const unsigned skip_x = offset_x;
+    const uint8_t* shape_data = shape.Data + offset_y * shape.Pitch;
+
+    for (unsigned i = 0; i < height; ++i)
+    {
+        const uint32_t* input_row = reinterpret_cast<const uint32_t*>(screen_src);
+        uint32_t* output_row = reinterpret_cast<uint32_t*>(cursor_ptr);
+
+        uint8_t mask = 0x80;
+        mask = mask >> (skip_x % 8);
+
+        for (unsigned j = 0; j < width; ++j)
+        {
+            const unsigned mask_offset = (j + skip_x) / 8;
+            const uint8_t and_mask = shape_data[mask_offset] & mask;
+            const uint8_t xor_mask = shape_data[mask_offset + xor_offset] & mask;
+
+            const uint32_t and_mask32 = (and_mask != 0) ? 0xFFFFFFFF : 0xFF000000;
+            const uint32_t xor_mask32 = (xor_mask != 0) ? 0x00FFFFFF : 0x00000000;
+
+            output_row[j] = (input_row[j] & and_mask32) ^ xor_mask32;
+
+            if (mask == 0x01) {
+                mask = 0x80;
+            }
+            else {
+                mask >>= 1;
+            }
+        }
+
+        cursor_ptr += cursor_pitch;
+        screen_src += screen_pitch;
+        shape_data += shape.Pitch;
+    }
+}
+
+/*
+    The old masked color loop read its mask from the screen instead of the
+    shape and XORed into an uninitialized output, so it is not a reference.
+    This follows the DXGI docs instead: Mask 0 replaces the screen color,
+    and mask 0xFF XORs the shape color with it
+*/
+static void ReferenceMaskedColor(
+    const CursorShape& shape,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    const uint8_t* screen_src,
+    unsigned screen_pitch,
+    uint8_t* cursor_ptr)
+{
+    for (unsigned i = 0; i < height; ++i)
+    {
+        const uint8_t* pointer_row = shape.Data + (offset_y + i) * shape.Pitch + offset_x * 4;
+
+        for (unsigned j = 0; j < width; ++j)
+        {
+            uint32_t pointer, input;
+            memcpy(&pointer, pointer_row + j * 4, 4);
+            memcpy(&input, screen_src + i * screen_pitch + j * 4, 4);
+
+            uint32_t output;
+            if ((pointer >> 24) == 0) {
+                output = pointer | 0xff000000;
+            }
+            else {
+                output = input ^ (pointer & 0x00ffffff);
+            }
+            memcpy(cursor_ptr + (i * width + j) * 4, &output, 4);
+        }
+    }
+}
+
+// round((c * a + s * (255 - a)) / 255) per channel, including alpha
+static void ReferenceBlend(
+    const CursorShape& shape,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    const uint8_t* screen_src,
+    unsigned screen_pitch,
+    uint8_t* cursor_ptr)
+{
+    for (unsigned i = 0; i < height; ++i)
+    {
+        const uint8_t* pointer_row = shape.Data + (offset_y + i) * shape.Pitch + offset_x * 4;
+
+        for (unsigned j = 0; j < width; ++j)
+        {
+            const unsigned a = pointer_row[j * 4 + 3];
+            for (unsigned k = 0; k < 4; ++k)
+            {
+                const unsigned c = pointer_row[j * 4 + k];
+                const unsigned s = screen_src[i * screen_pitch + j * 4 + k];
+                cursor_ptr[(i * width + j) * 4 + k] = static_cast<uint8_t>(
+                    (c * a + s * (255 - a) + 127) / 255);
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Every explicit path, then Auto, which Composite() resolves itself
+static std::vector<CopyKernelPath> CompositePaths()
+{
+    std::vector<CopyKernelPath> paths(std::begin(kCopyKernelPaths), std::end(kCopyKernelPaths));
+    paths.push_back(CopyKernelPath::Auto);
+    return paths;
+}
+
+static const uint8_t kGuardByte = 0xcd;
+
+// Random shape of the given type with an image of width x height.
+// Color alphas favor the values where the threshold matters
+static CursorShape MakeShape(
+    TestRandom& rng,
+    CursorShapeType type,
+    unsigned width,
+    unsigned height,
+    std::vector<uint8_t>& data)
+{
+    CursorShape shape;
+    shape.Type = type;
+    shape.Width = width;
+    shape.Height = type == CursorShapeType::Monochrome ? height * 2 : height;
+    if (type == CursorShapeType::Monochrome) {
+        shape.Pitch = (width + 7) / 8 + rng.NextRange(4);
+    }
+    else {
+        shape.Pitch = width * 4 + 4 * rng.NextRange(3);
+    }
+
+    data.resize(static_cast<size_t>(shape.Pitch) * shape.Height);
+    rng.Fill(data.data(), data.size());
+
+    if (type != CursorShapeType::Monochrome)
+    {
+        static const uint8_t kAlphas[] = { 0x00, 0xff, 0x7f, 0x80 };
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                uint8_t& alpha = data[y * shape.Pitch + x * 4 + 3];
+                const unsigned pick = rng.NextRange(6);
+                if (pick < 4) {
+                    alpha = kAlphas[pick];
+                }
+            }
+        }
+    }
+
+    shape.Data = data.data();
+    shape.Bytes = static_cast<unsigned>(data.size());
+    return shape;
+}
+
+typedef void (*ReferenceFn)(
+    const CursorShape& shape,
+    unsigned offset_x,
+    unsigned offset_y,
+    unsigned width,
+    unsigned height,
+    const uint8_t* screen_src,
+    unsigned screen_pitch,
+    uint8_t* cursor_ptr);
+
+/*
+    Random shapes, clip offsets, rect sizes and screen pitches.  Composite
+    on every path must match the reference, and must not write past the
+    rect in a padded destination
+*/
+static bool CheckAgainstReference(
+    CursorShapeType type,
+    CursorAlpha alpha,
+    ReferenceFn reference,
+    uint64_t seed)
+{
+    TestRandom rng(seed);
+    std::vector<uint8_t> data, screen, expected, dest;
+
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        const unsigned cursor_width = 1 + rng.NextRange(80);
+        const unsigned cursor_height = 1 + rng.NextRange(80);
+        const CursorShape shape = MakeShape(rng, type, cursor_width, cursor_height, data);
+
+        DecodedCursor decoded;
+        TEST_CHECK(decoded.Decode(shape, alpha));
+        TEST_CHECK(decoded.Width == cursor_width);
+        TEST_CHECK(decoded.Height == cursor_height);
+
+        // Clipped by the top/left edge for a non-zero offset, and by the
+        // bottom/right edge for a short rect
+        const unsigned offset_x = i % 4 == 0 ? 0 : rng.NextRange(cursor_width);
+        const unsigned offset_y = i % 4 == 1 ? 0 : rng.NextRange(cursor_height);
+        unsigned width = cursor_width - offset_x;
+        unsigned height = cursor_height - offset_y;
+        if (i % 2 == 0) {
+            width = 1 + rng.NextRange(width);
+            height = 1 + rng.NextRange(height);
+        }
+
+        const unsigned screen_pitch = width * 4 + 4 * rng.NextRange(5);
+        screen.resize(static_cast<size_t>(screen_pitch) * height);
+        rng.Fill(screen.data(), screen.size());
+
+        const unsigned row_bytes = width * 4;
+        expected.resize(static_cast<size_t>(row_bytes) * height);
+        reference(shape, offset_x, offset_y, width, height, screen.data(), screen_pitch, expected.data());
+
+        // One spare pixel per row and one spare row
+        const unsigned dest_pitch = row_bytes + 4;
+        dest.resize(static_cast<size_t>(dest_pitch) * (height + 1));
+
+        for (CopyKernelPath path : CompositePaths())
+        {
+            if (path != CopyKernelPath::Auto && !IsCopyKernelPathSupported(path)) {
+                continue;
+            }
+
+            memset(dest.data(), kGuardByte, dest.size());
+            TEST_CHECK(decoded.Composite(dest.data(), dest_pitch, screen.data(), screen_pitch,
+                offset_x, offset_y, width, height, path));
+
+            for (unsigned y = 0; y < height; ++y) {
+                const uint8_t* row = dest.data() + y * dest_pitch;
+                TEST_CHECK(0 == memcmp(row, expected.data() + y * row_bytes, row_bytes));
+                for (unsigned k = 0; k < 4; ++k) {
+                    TEST_CHECK(row[row_bytes + k] == kGuardByte);
+                }
+            }
+            for (unsigned k = 0; k < dest_pitch; ++k) {
+                TEST_CHECK(dest[height * dest_pitch + k] == kGuardByte);
+            }
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+static bool TestMonochrome()
+{
+    return CheckAgainstReference(CursorShapeType::Monochrome, CursorAlpha::Threshold, BaselineMonochrome, 24);
+}
+
+static bool TestColor()
+{
+    return CheckAgainstReference(CursorShapeType::Color, CursorAlpha::Threshold, BaselineColor, 25);
+}
+
+static bool TestMaskedColor()
+{
+    return CheckAgainstReference(CursorShapeType::MaskedColor, CursorAlpha::Threshold, ReferenceMaskedColor, 26);
+}
+
+static bool TestColorBlend()
+{
+    return CheckAgainstReference(CursorShapeType::Color, CursorAlpha::Blend, ReferenceBlend, 27);
+}
+
+/*
+    Compositing over the screen in place, as the duplication backends do,
+    must match compositing into a separate buffer
+*/
+static bool TestInPlace()
+{
+    TestRandom rng(28);
+    std::vector<uint8_t> data, screen, expected;
+
+    const unsigned width = 37, height = 29, pitch = width * 4 + 12;
+    const CursorShape shape = MakeShape(rng, CursorShapeType::Monochrome, width, height, data);
+
+    DecodedCursor decoded;
+    TEST_CHECK(decoded.Decode(shape));
+
+    screen.resize(pitch * height);
+    rng.Fill(screen.data(), screen.size());
+    expected.resize(width * 4 * height);
+    BaselineMonochrome(shape, 0, 0, width, height, screen.data(), pitch, expected.data());
+
+    TEST_CHECK(decoded.Composite(screen.data(), pitch, screen.data(), pitch, 0, 0, width, height));
+    for (unsigned y = 0; y < height; ++y) {
+        TEST_CHECK(0 == memcmp(screen.data() + y * pitch, expected.data() + y * width * 4, width * 4));
+    }
+    return true;
+}
+
+/*
+    Shapes with too little data, or too large, are rejected, and so are
+    rects that reach outside the cursor
+*/
+static bool TestInvalid()
+{
+    TestRandom rng(29);
+    std::vector<uint8_t> data;
+
+    CursorShape shape = MakeShape(rng, CursorShapeType::Color, 32, 32, data);
+    DecodedCursor decoded;
+    TEST_CHECK(decoded.Decode(shape));
+
+    uint32_t pixel = 0;
+    TEST_CHECK(decoded.Composite((uint8_t*)&pixel, 4, (uint8_t*)&pixel, 4, 31, 31, 1, 1));
+    TEST_CHECK(!decoded.Composite((uint8_t*)&pixel, 4, (uint8_t*)&pixel, 4, 32, 0, 1, 1));
+    TEST_CHECK(!decoded.Composite((uint8_t*)&pixel, 4, (uint8_t*)&pixel, 4, 31, 0, 2, 1));
+    TEST_CHECK(!decoded.Composite((uint8_t*)&pixel, 4, (uint8_t*)&pixel, 4, 0, 31, 1, 2));
+
+    CursorShape truncated = shape;
+    truncated.Bytes = static_cast<unsigned>(shape.GetRequiredBytes()) - 1;
+    TEST_CHECK(!truncated.IsValid());
+    TEST_CHECK(!decoded.Decode(truncated));
+
+    CursorShape huge = shape;
+    huge.Width = kCursorMaxDimension + 1;
+    TEST_CHECK(!decoded.Decode(huge));
+    return true;
+}
+
+/*
+    The cache hands back the same decode for the same bytes, a new decode
+    for changed bytes, and keeps at most kCursorCacheMaxEntries shapes
+*/
+static bool TestCache()
+{
+    TestRandom rng(30);
+    std::vector<uint8_t> data_a, data_b;
+    const CursorShape a = MakeShape(rng, CursorShapeType::Color, 32, 32, data_a);
+    CursorShape b = a;
+    data_b = data_a;
+    data_b[5] ^= 1;
+    b.Data = data_b.data();
+
+    CursorCache cache;
+    const DecodedCursor* decoded_a = cache.Decode(a);
+    const DecodedCursor* decoded_b = cache.Decode(b);
+    TEST_CHECK(decoded_a != nullptr && decoded_b != nullptr);
+    TEST_CHECK(decoded_a != decoded_b);
+    TEST_CHECK(cache.Decode(a) == decoded_a);
+    TEST_CHECK(cache.GetHits() == 1);
+    TEST_CHECK(cache.GetMisses() == 2);
+
+    // Same bytes decoded with a different alpha mode are a different entry
+    cache.Alpha = CursorAlpha::Blend;
+    const DecodedCursor* blended = cache.Decode(a);
+    TEST_CHECK(blended != nullptr && blended->Blend);
+    TEST_CHECK(cache.GetMisses() == 3);
+    cache.Alpha = CursorAlpha::Threshold;
+
+    // Fill the cache with new shapes, then a recently used one still hits
+    // and the first one was evicted
+    std::vector<uint8_t> data_c = data_a;
+    CursorShape c = a;
+    c.Data = data_c.data();
+    for (unsigned i = 0; i < kCursorCacheMaxEntries * 2; ++i) {
+        data_c[0] = static_cast<uint8_t>(i);
+        data_c[1] = 0xee;
+        TEST_CHECK(cache.Decode(c) != nullptr);
+    }
+    const uint64_t misses = cache.GetMisses();
+    TEST_CHECK(cache.Decode(c) != nullptr);
+    TEST_CHECK(cache.GetMisses() == misses);
+    TEST_CHECK(cache.Decode(b) != nullptr);
+    TEST_CHECK(cache.GetMisses() == misses + 1);
+
+    CursorShape truncated = a;
+    truncated.Bytes = 1;
+    TEST_CHECK(cache.Decode(truncated) == nullptr);
+    return true;
+}
+
+bool TestCursor()
+{
+    return TestMonochrome() &&
+        TestColor() &&
+        TestMaskedColor() &&
+        TestColorBlend() &&
+        TestInPlace() &&
+        TestInvalid() &&
+        TestCache();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+/*
+    One pointer move of a 64x64 cursor: The old loops against compositing
+    a cached decode
+*/
+void BenchmarkCursor()
+{
+    const unsigned width = 64, height = 64;
+    const unsigned screen_pitch = 3840 * 4;
+    const uint64_t bytes = width * height * 4;
+
+    TestRandom rng(1);
+    std::vector<uint8_t> screen(screen_pitch * height), dest(width * height * 4);
+    rng.Fill(screen.data(), screen.size());
+
+    struct Case
+    {
+        const char* Name;
+        CursorShapeType Type;
+        ReferenceFn Baseline;
+    };
+    static const Case kCases[] = {
+        { "Monochrome", CursorShapeType::Monochrome, BaselineMonochrome },
+        { "Color", CursorShapeType::Color, BaselineColor }
+    };
+
+    for (const Case& c : kCases)
+    {
+        std::vector<uint8_t> data;
+        const CursorShape shape = MakeShape(rng, c.Type, width, height, data);
+
+        const double baseline_usec = MeasureUsecPerCall([&]() {
+            c.Baseline(shape, 0, 0, width, height, screen.data(), screen_pitch, dest.data());
+        });
+        Logger.Info(c.Name, " baseline loop: ", baseline_usec, " usec, ",
+            GigabytesPerSecond(bytes, baseline_usec), " GB/s");
+
+        DecodedCursor decoded;
+        decoded.Decode(shape);
+
+        for (CopyKernelPath path : kCopyKernelPaths)
+        {
+            if (!IsCopyKernelPathSupported(path)) {
+                continue;
+            }
+            const double usec = MeasureUsecPerCall([&]() {
+                decoded.Composite(dest.data(), width * 4, screen.data(), screen_pitch,
+                    0, 0, width, height, path);
+            });
+            Logger.Info(c.Name, " ", CopyKernelPathToString(path), " composite: ", usec, " usec, ",
+                GigabytesPerSecond(bytes, usec), " GB/s");
+        }
+    }
+}
+
+
+} // namespace core
@@ -0,0 +1,279 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "implant_abi.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("ImplantAbiTests");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Frame payload: The frame serial, then bytes derived from it, then a sum of
+// everything before it
+static const unsigned kHeaderBytes = 4;
+static const unsigned kChecksumBytes = 4;
+
+static uint32_t FrameBytes(uint32_t serial)
+{
+    // Vary the size so stale bytes from an older frame are caught too
+    return 1024 + (serial * 7919) % 8192;
+}
+
+static uint32_t FrameChecksum(const uint8_t* data, uint32_t bytes)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < bytes; ++i) {
+        sum = sum * 31 + data[i];
+    }
+    return sum;
+}
+
+static void FillFrame(std::vector<uint8_t>& frame, uint32_t serial)
+{
+    const uint32_t bytes = FrameBytes(serial);
+    frame.resize(bytes);
+    memcpy(frame.data(), &serial, kHeaderBytes);
+    for (uint32_t i = kHeaderBytes; i < bytes - kChecksumBytes; ++i) {
+        frame[i] = static_cast<uint8_t>(serial * 13 + i);
+    }
+    const uint32_t sum = FrameChecksum(frame.data(), bytes - kChecksumBytes);
+    memcpy(frame.data() + bytes - kChecksumBytes, &sum, kChecksumBytes);
+}
+
+// Returns the serial of a consistent frame, or 0
+static uint32_t CheckFrame(const ImplantCameraSlot* slot)
+{
+    const uint32_t bytes = slot->CameraBytes;
+    if (bytes < kHeaderBytes + kChecksumBytes) {
+        return 0;
+    }
+    uint32_t serial = 0, sum = 0;
+    memcpy(&serial, slot->CameraData, kHeaderBytes);
+    memcpy(&sum, slot->CameraData + bytes - kChecksumBytes, kChecksumBytes);
+    if (bytes != FrameBytes(serial) ||
+        sum != FrameChecksum(slot->CameraData, bytes - kChecksumBytes))
+    {
+        return 0;
+    }
+    return serial;
+}
+
+// The layout holds several frames, so keep it off the stack
+static std::unique_ptr<ImplantSharedMemoryLayout> MakeLayout()
+{
+    std::unique_ptr<ImplantSharedMemoryLayout> layout(new ImplantSharedMemoryLayout);
+    layout->ResetCamera();
+    return layout;
+}
+
+static bool WriteFrame(ImplantSharedMemoryLayout& layout, uint32_t serial)
+{
+    std::vector<uint8_t> frame;
+    FillFrame(frame, serial);
+    return layout.WriteCamera(frame.data(), static_cast<uint32_t>(frame.size()), serial);
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Acquire returns the newest committed frame, and nothing when there is
+    no frame newer than the last one seen
+*/
+static bool TestAcquireNewest()
+{
+    std::unique_ptr<ImplantSharedMemoryLayout> layout = MakeLayout();
+
+    uint32_t frame_number = 0;
+    TEST_CHECK(layout->AcquireCamera(0, frame_number) == nullptr);
+
+    for (uint32_t serial = 1; serial <= 3 * kImplantCameraSlotCount; ++serial)
+    {
+        TEST_CHECK(WriteFrame(*layout, serial));
+
+        // Skip a frame now and then, as a slow reader would
+        if (serial % 3 == 0) {
+            continue;
+        }
+
+        const ImplantCameraSlot* slot = layout->AcquireCamera(0, frame_number);
+        TEST_CHECK(slot != nullptr);
+        TEST_CHECK(frame_number == serial);
+        TEST_CHECK(CheckFrame(slot) == serial);
+        TEST_CHECK(slot->ReceiveTimeUsec == serial);
+        layout->ReleaseCamera(slot);
+
+        TEST_CHECK(layout->AcquireCamera(frame_number, frame_number) == nullptr);
+    }
+
+    TEST_CHECK(layout->CameraDropped == 0);
+    return true;
+}
+
+/*
+    Pinned slots and the newest frame are never overwritten.  Once every
+    slot is pinned, writes are dropped and counted without blocking, and a
+    release makes its slot writable again
+*/
+static bool TestPinnedSlots()
+{
+    std::unique_ptr<ImplantSharedMemoryLayout> layout = MakeLayout();
+
+    const ImplantCameraSlot* pinned[kImplantCameraSlotCount] = {};
+    uint32_t serial = 0;
+
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i)
+    {
+        ++serial;
+        TEST_CHECK(WriteFrame(*layout, serial));
+
+        uint32_t frame_number = 0;
+        pinned[i] = layout->AcquireCamera(0, frame_number);
+        TEST_CHECK(pinned[i] != nullptr);
+        TEST_CHECK(frame_number == serial);
+        for (unsigned j = 0; j < i; ++j) {
+            TEST_CHECK(pinned[j] != pinned[i]);
+        }
+    }
+
+    // Full ring: Every write is dropped and the pinned frames stay intact
+    for (unsigned i = 0; i < 10; ++i) {
+        TEST_CHECK(!WriteFrame(*layout, serial + 1 + i));
+    }
+    TEST_CHECK(layout->CameraDropped == 10);
+    TEST_CHECK(layout->CameraPublished == serial);
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i) {
+        TEST_CHECK(CheckFrame(pinned[i]) == i + 1);
+    }
+
+    // Releasing the oldest pin frees exactly that slot
+    layout->ReleaseCamera(pinned[0]);
+    ++serial;
+    TEST_CHECK(WriteFrame(*layout, serial));
+    TEST_CHECK(layout->CameraPublished == serial);
+    TEST_CHECK(CheckFrame(pinned[0]) == serial);
+    for (unsigned i = 1; i < kImplantCameraSlotCount; ++i) {
+        TEST_CHECK(CheckFrame(pinned[i]) == i + 1);
+    }
+
+    // The newest frame is the only unpinned slot, so it is kept
+    TEST_CHECK(!WriteFrame(*layout, serial + 1));
+    TEST_CHECK(layout->CameraDropped == 11);
+    TEST_CHECK(CheckFrame(pinned[0]) == serial);
+
+    for (unsigned i = 1; i < kImplantCameraSlotCount; ++i) {
+        layout->ReleaseCamera(pinned[i]);
+    }
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i) {
+        TEST_CHECK(layout->CameraSlots[i].Pins == 0);
+    }
+    TEST_CHECK(WriteFrame(*layout, serial + 2));
+
+    // ResetCamera() forgets frames but keeps pins
+    uint32_t frame_number = 0;
+    const ImplantCameraSlot* slot = layout->AcquireCamera(0, frame_number);
+    TEST_CHECK(slot != nullptr);
+    layout->ResetCamera();
+    TEST_CHECK(layout->AcquireCamera(0, frame_number) == nullptr);
+    TEST_CHECK(slot->Pins == 1);
+    layout->ReleaseCamera(slot);
+    layout->ReleaseCamera(nullptr);
+    return true;
+}
+
+/*
+    An implant thread writes checksummed frames as fast as it can while
+    reader threads pin, verify and release them.  Every pinned frame must be
+    intact for as long as it is pinned, and frame numbers must only go up
+*/
+static bool TestReaderWriterStress()
+{
+    std::unique_ptr<ImplantSharedMemoryLayout> layout = MakeLayout();
+
+    static const unsigned kReaders = 2;
+    static const uint32_t kWrites = 10000;
+
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> bad_reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> retries = ATOMIC_VAR_INIT(0);
+    uint64_t written = 0;
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        std::vector<uint8_t> frame;
+        for (uint32_t serial = 1; serial <= kWrites; ++serial)
+        {
+            FillFrame(frame, serial);
+            if (layout->WriteCamera(frame.data(), static_cast<uint32_t>(frame.size()), serial)) {
+                ++written;
+            }
+
+            // Let the readers in on a machine with few cores
+            std::this_thread::yield();
+        }
+        stop = true;
+    });
+    for (unsigned i = 0; i < kReaders; ++i)
+    {
+        threads.emplace_back([&]() {
+            uint32_t last_frame_number = 0, last_serial = 0, reader_retries = 0;
+            while (!stop)
+            {
+                uint32_t frame_number = 0;
+                const ImplantCameraSlot* slot = layout->AcquireCamera(
+                    last_frame_number, frame_number, &reader_retries);
+                if (!slot) {
+                    continue;
+                }
+
+                // Check twice, so a write into a pinned slot is caught even
+                // if it started after the first check
+                const uint32_t serial = CheckFrame(slot);
+                std::this_thread::yield();
+                if (serial == 0 || serial <= last_serial || CheckFrame(slot) != serial) {
+                    ++bad_reads;
+                }
+                layout->ReleaseCamera(slot);
+
+                last_frame_number = frame_number;
+                last_serial = serial;
+                ++reads;
+            }
+            retries += reader_retries;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    Logger.Info("Stress: ", written, " frames written, ", layout->CameraDropped.load(),
+        " dropped, ", reads.load(), " reads, ", retries.load(), " acquire retries");
+
+    TEST_CHECK(bad_reads == 0);
+    TEST_CHECK(reads > 0);
+    TEST_CHECK(written + layout->CameraDropped == kWrites);
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i) {
+        TEST_CHECK(layout->CameraSlots[i].Pins == 0);
+    }
+    return true;
+}
+
+bool TestImplantAbi()
+{
+    return TestAcquireNewest() &&
+        TestPinnedSlots() &&
+        TestReaderWriterStress();
+}
+
+
+} // namespace core
@@ -0,0 +1,240 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_ipc.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace core {
+
+static logger::Channel Logger("IpcTests");
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+static bool TestPosixNames()
+{
+    TEST_CHECK(PosixIpcName("Global\\mrcam_frame") == "/mrcam_frame");
+    TEST_CHECK(PosixIpcName("Local\\a\\b/c") == "/a_b_c");
+    TEST_CHECK(PosixIpcName("plain") == "/plain");
+    return true;
+}
+
+/*
+    A second mapping of the same name sees the first one's writes and the
+    other way around.  Opening needs a creator and a large enough object
+*/
+static bool TestSharedMemoryFile()
+{
+    const std::string name = TestObjectName("shm");
+    const int bytes = 64 * 1024;
+
+    {
+        SharedMemoryFile missing;
+        TEST_CHECK(!missing.Open(bytes, name));
+        TEST_CHECK(missing.GetFront() == nullptr);
+    }
+
+    SharedMemoryFile creator, opener;
+    TEST_CHECK(creator.Create(bytes, name));
+    uint8_t* a = creator.GetFront();
+    TEST_CHECK(a != nullptr);
+
+    // New objects are zero-filled
+    for (int i = 0; i < bytes; ++i) {
+        TEST_CHECK(a[i] == 0);
+    }
+
+    TEST_CHECK(opener.Open(bytes, name));
+    uint8_t* b = opener.GetFront();
+    TEST_CHECK(b != nullptr);
+
+    a[0] = 1;
+    a[bytes - 1] = 2;
+    TEST_CHECK(b[0] == 1 && b[bytes - 1] == 2);
+    b[100] = 3;
+    TEST_CHECK(a[100] == 3);
+
+#if !defined(_WIN32)
+    // Views are page-granular on Windows, so only POSIX can check the size
+    SharedMemoryFile too_large;
+    TEST_CHECK(!too_large.Open(bytes * 2, name));
+#endif
+
+    // Closing one mapping leaves the other working
+    opener.Close();
+    TEST_CHECK(opener.GetFront() == nullptr);
+    a[200] = 4;
+    TEST_CHECK(opener.Open(bytes, name));
+    TEST_CHECK(opener.GetFront()[200] == 4);
+
+    // The name goes away with the last handle
+    opener.Close();
+    creator.Close();
+    TEST_CHECK(!opener.Open(bytes, name));
+    return true;
+}
+
+/*
+    Auto-reset semantics: A signal before the wait is not lost, it releases
+    exactly one wait, and Reset() clears it.  A wait without a signal times
+    out after about the timeout
+*/
+static bool TestEventSignal()
+{
+    const std::string name = TestObjectName("event");
+
+    IpcEvent server, client;
+    TEST_CHECK(server.Invalid());
+    TEST_CHECK(!client.Open(name));
+    TEST_CHECK(server.Create(name));
+    TEST_CHECK(client.Open(name));
+    TEST_CHECK(server.Valid() && client.Valid());
+
+    // Created non-signaled
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Timeout);
+
+    server.Signal();
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Signaled);
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Timeout);
+
+    // Signals do not count
+    server.Signal();
+    server.Signal();
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Signaled);
+    TEST_CHECK(server.Wait(0) == IpcWaitResult::Timeout);
+
+    client.Signal();
+    server.Reset();
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Timeout);
+
+    const int timeout_msec = 50;
+    const uint64_t t0 = GetTimeUsec();
+    TEST_CHECK(client.Wait(timeout_msec) == IpcWaitResult::Timeout);
+    const uint64_t elapsed_usec = GetTimeUsec() - t0;
+    TEST_CHECK(elapsed_usec >= (timeout_msec - 1) * 1000);
+    TEST_CHECK(elapsed_usec < 1000 * 1000);
+
+    client.Close();
+    TEST_CHECK(client.Invalid());
+    TEST_CHECK(client.Wait(0) == IpcWaitResult::Error);
+    return true;
+}
+
+/*
+    A thread blocked without a timeout wakes on a signal from another
+    handle, and every signal sent after the previous wake is delivered
+*/
+static bool TestEventWake()
+{
+    const std::string name = TestObjectName("wake");
+
+    IpcEvent server, client;
+    TEST_CHECK(server.Create(name));
+    TEST_CHECK(client.Open(name));
+
+    static const unsigned kRounds = 1000;
+    std::atomic<unsigned> woken = ATOMIC_VAR_INIT(0);
+    std::atomic<bool> failed = ATOMIC_VAR_INIT(false);
+
+    std::thread waiter([&]() {
+        for (unsigned i = 0; i < kRounds; ++i)
+        {
+            if (client.Wait(-1) != IpcWaitResult::Signaled) {
+                failed = true;
+                return;
+            }
+            ++woken;
+        }
+    });
+
+    for (unsigned i = 0; i < kRounds; ++i)
+    {
+        server.Signal();
+
+        // Wait for the wake before signaling again, since signals do not
+        // count.  Give up after a second rather than hang
+        const uint64_t t0 = GetTimeUsec();
+        while (woken.load() <= i && !failed && GetTimeUsec() - t0 < 1000 * 1000) {
+            std::this_thread::yield();
+        }
+        if (woken.load() <= i) {
+            break;
+        }
+    }
+
+    if (woken.load() < kRounds) {
+        // Release the waiter so the thread can be joined
+        failed = true;
+        for (unsigned i = 0; i < kRounds; ++i) {
+            server.Signal();
+            std::this_thread::yield();
+        }
+    }
+    waiter.join();
+
+    TEST_CHECK(!failed);
+    TEST_CHECK(woken == kRounds);
+    return true;
+}
+
+bool TestIpc()
+{
+    return TestPosixNames() &&
+        TestSharedMemoryFile() &&
+        TestEventSignal() &&
+        TestEventWake();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+/*
+    Cross-thread wake latency: One round trip signals a thread blocked in
+    Wait() and waits for its reply on a second event
+*/
+void BenchmarkIpc()
+{
+    const std::string ping_name = TestObjectName("ping");
+    const std::string pong_name = TestObjectName("pong");
+
+    IpcEvent ping, pong, ping_client, pong_client;
+    if (!ping.Create(ping_name) || !pong.Create(pong_name) ||
+        !ping_client.Open(ping_name) || !pong_client.Open(pong_name))
+    {
+        Logger.Error("Event setup failed: ", LastIpcErrorString());
+        return;
+    }
+
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::thread echo([&]() {
+        while (ping_client.Wait(-1) == IpcWaitResult::Signaled && !stop) {
+            pong_client.Signal();
+        }
+    });
+
+    const double round_trip_usec = MeasureUsecPerCall([&]() {
+        ping.Signal();
+        pong.Wait(-1);
+    });
+
+    stop = true;
+    ping.Signal();
+    echo.join();
+
+    Logger.Info("Event round trip: ", round_trip_usec, " usec, wake latency about ",
+        round_trip_usec / 2., " usec");
+
+    const double signal_usec = MeasureUsecPerCall([&]() {
+        pong.Signal();
+        pong.Reset();
+    });
+    Logger.Info("Signal with no waiter: ", signal_usec * 1000., " nsec");
+}
+
+
+} // namespace core
@@ -0,0 +1,404 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_lockfree_map.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("LockFreeMapTests");
+
+
+//------------------------------------------------------------------------------
+// Values
+
+// Every value names its key, so a value returned for the wrong key or a
+// copy that mixes two writes is detected
+struct MapTestValue
+{
+    uintptr_t Key;
+    uint64_t Serial;
+    uint64_t Check;
+
+    void Set(uintptr_t key, uint64_t serial)
+    {
+        Key = key;
+        Serial = serial;
+        Check = stafford_mix13(key ^ serial);
+    }
+
+    bool IsValidFor(uintptr_t key) const
+    {
+        return Key == key && Check == stafford_mix13(key ^ Serial);
+    }
+};
+
+static const void* MapTestKey(unsigned i)
+{
+    // Spaced like heap pointers, never null
+    return reinterpret_cast<const void*>(static_cast<uintptr_t>(i + 1) * 48);
+}
+
+static const unsigned kStressKeys = 256;
+static const unsigned kStressWriters = 2;
+static const unsigned kStressReaders = 2;
+static const uint64_t kStressUsec = 300 * 1000;
+
+
+//------------------------------------------------------------------------------
+// Baseline
+
+/*
+    What the implant used before LockFreePointerMap: A lock around a ring of
+    the 32 most recent requests, searched newest first
+*/
+template<typename T>
+class LockedRequestRing
+{
+public:
+    static const int kCount = 32;
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        for (int i = 0; i < kCount; ++i) {
+            Keys[i] = nullptr;
+        }
+        Next = 0;
+    }
+
+    bool Insert(const void* key, const T& value)
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Keys[Next] = key;
+        Values[Next] = value;
+        if (++Next >= kCount) {
+            Next = 0;
+        }
+        return true;
+    }
+
+    bool Find(const void* key, T& value)
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        const int index = FindIndex(key);
+        if (index < 0) {
+            return false;
+        }
+        value = Values[index];
+        return true;
+    }
+
+    bool Remove(const void* key)
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        const int index = FindIndex(key);
+        if (index < 0) {
+            return false;
+        }
+        Keys[index] = nullptr;
+        return true;
+    }
+
+protected:
+    std::mutex Lock;
+    const void* Keys[kCount] = {};
+    T Values[kCount];
+    int Next = 0;
+
+    int FindIndex(const void* key) const
+    {
+        int index = Next;
+        for (int i = 0; i < kCount; ++i)
+        {
+            if (--index < 0) {
+                index = kCount - 1;
+            }
+            if (Keys[index] == key) {
+                return index;
+            }
+        }
+        return -1;
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+static bool TestLockFreeMapBasics()
+{
+    LockFreePointerMap<MapTestValue> map;
+    MapTestValue value, result;
+
+    TEST_CHECK(!map.Insert(nullptr, value));
+    TEST_CHECK(!map.Find(nullptr, result));
+    TEST_CHECK(!map.Remove(nullptr));
+
+    const void* key = MapTestKey(0);
+    TEST_CHECK(!map.Find(key, result));
+
+    value.Set(reinterpret_cast<uintptr_t>(key), 1);
+    TEST_CHECK(map.Insert(key, value));
+    TEST_CHECK(map.Find(key, result));
+    TEST_CHECK(result.IsValidFor(reinterpret_cast<uintptr_t>(key)) && result.Serial == 1);
+
+    // Replace
+    value.Set(reinterpret_cast<uintptr_t>(key), 2);
+    TEST_CHECK(map.Insert(key, value));
+    TEST_CHECK(map.Find(key, result));
+    TEST_CHECK(result.Serial == 2);
+
+    TEST_CHECK(map.Remove(key));
+    TEST_CHECK(!map.Find(key, result));
+    TEST_CHECK(!map.Remove(key));
+
+    // Far more keys than slots: Old entries are evicted, never refused
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        const void* k = MapTestKey(i);
+        value.Set(reinterpret_cast<uintptr_t>(k), i);
+        TEST_CHECK(map.Insert(k, value));
+        TEST_CHECK(map.Find(k, result));
+        TEST_CHECK(result.IsValidFor(reinterpret_cast<uintptr_t>(k)) && result.Serial == i);
+    }
+    TEST_CHECK(map.Stats.Evictions > 0);
+    TEST_CHECK(map.Stats.Contended == 0);
+
+    unsigned found = 0;
+    for (unsigned i = 0; i < 1000; ++i) {
+        if (map.Find(MapTestKey(i), result)) {
+            TEST_CHECK(result.IsValidFor(reinterpret_cast<uintptr_t>(MapTestKey(i))));
+            ++found;
+        }
+    }
+    TEST_CHECK(found <= 64);
+    TEST_CHECK(found > 0);
+
+    map.Clear();
+    for (unsigned i = 0; i < 1000; ++i) {
+        TEST_CHECK(!map.Find(MapTestKey(i), result));
+    }
+    return true;
+}
+
+/*
+    Writers insert, replace and remove a small set of keys, so slots are
+    constantly reused for other keys and evicted.  Readers must only ever
+    get a whole value that belongs to the key they asked for.
+*/
+static bool TestLockFreeMapStress()
+{
+    LockFreePointerMap<MapTestValue> map;
+
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> bad_reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> hits = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> writes = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < kStressWriters; ++w)
+    {
+        threads.emplace_back([&, w]() {
+            TestRandom rng(w + 1);
+            MapTestValue value;
+            uint64_t serial = 0;
+            while (!stop)
+            {
+                const void* key = MapTestKey(rng.NextRange(kStressKeys));
+                if (rng.NextRange(4) == 0) {
+                    map.Remove(key);
+                }
+                else {
+                    value.Set(reinterpret_cast<uintptr_t>(key), ++serial);
+                    map.Insert(key, value);
+                }
+            }
+            writes += serial;
+        });
+    }
+    for (unsigned r = 0; r < kStressReaders; ++r)
+    {
+        threads.emplace_back([&, r]() {
+            TestRandom rng(100 + r);
+            MapTestValue value;
+            uint64_t local_hits = 0;
+            while (!stop)
+            {
+                const void* key = MapTestKey(rng.NextRange(kStressKeys));
+                if (map.Find(key, value)) {
+                    if (!value.IsValidFor(reinterpret_cast<uintptr_t>(key))) {
+                        ++bad_reads;
+                    }
+                    ++local_hits;
+                }
+            }
+            hits += local_hits;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(kStressUsec));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    Logger.Info("Stress: ", writes.load(), " inserts, ", hits.load(), " hits, ",
+        map.Stats.Evictions.load(), " evictions, ", map.Stats.Contended.load(), " contended");
+
+    TEST_CHECK(bad_reads == 0);
+    TEST_CHECK(hits > 0);
+    return true;
+}
+
+bool TestLockFreeMap()
+{
+    return TestLockFreeMapBasics() &&
+        TestLockFreeMapStress();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+// Run every thread for a while and return the elapsed seconds
+static double RunThreads(std::vector<std::thread>& threads, std::atomic<bool>& stop)
+{
+    const uint64_t t0 = GetTimeUsec();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return (GetTimeUsec() - t0) / 1000000.;
+}
+
+template<typename MapT>
+static void BenchmarkMap(const char* name, MapT& map)
+{
+    // The implant keeps a handful of USB reads in flight
+    static const unsigned kInFlight = 8;
+
+    MapTestValue value, result;
+    map.Clear();
+
+    unsigned next = 0;
+    const double cycle_usec = MeasureUsecPerCall([&]() {
+        const void* key = MapTestKey(next++ % kStressKeys);
+        value.Set(reinterpret_cast<uintptr_t>(key), next);
+        map.Insert(key, value);
+        map.Find(key, result);
+        map.Remove(key);
+    });
+
+    for (unsigned i = 0; i < kInFlight; ++i) {
+        value.Set(reinterpret_cast<uintptr_t>(MapTestKey(i)), i);
+        map.Insert(MapTestKey(i), value);
+    }
+    const double find_usec = MeasureUsecPerCall([&]() {
+        map.Find(MapTestKey(next++ % kInFlight), result);
+    });
+    const double miss_usec = MeasureUsecPerCall([&]() {
+        map.Find(MapTestKey(kInFlight + next++ % kStressKeys), result);
+    });
+
+    Logger.Info(name, " uncontended: insert+find+remove ", cycle_usec * 1000.,
+        " nsec, find hit ", find_usec * 1000., " nsec, find miss ", miss_usec * 1000., " nsec");
+
+    // Submit/complete pairs on separate threads, as in the implant
+    for (unsigned threads_count = 1; threads_count <= 4; threads_count *= 2)
+    {
+        map.Clear();
+        std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+        std::atomic<uint64_t> ops = ATOMIC_VAR_INIT(0);
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threads_count; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                MapTestValue local_value, local_result;
+                uint64_t count = 0;
+                while (!stop)
+                {
+                    const void* key = MapTestKey(t * kInFlight + (unsigned)(count % kInFlight));
+                    local_value.Set(reinterpret_cast<uintptr_t>(key), count);
+                    map.Insert(key, local_value);
+                    map.Find(key, local_result);
+                    map.Remove(key);
+                    ++count;
+                }
+                ops += count;
+            });
+        }
+        const double sec = RunThreads(threads, stop);
+
+        Logger.Info(name, " ", threads_count, " threads: ", ops.load() / sec / 1000000.,
+            " M insert+find+remove/sec");
+    }
+
+    // The reader/writer mix of the stress test
+    {
+        map.Clear();
+        std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+        std::atomic<uint64_t> writes = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> finds = ATOMIC_VAR_INIT(0);
+
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < kStressWriters; ++w)
+        {
+            threads.emplace_back([&, w]() {
+                TestRandom rng(w + 1);
+                MapTestValue local_value;
+                uint64_t count = 0;
+                while (!stop)
+                {
+                    const void* key = MapTestKey(rng.NextRange(kInFlight * 4));
+                    if (rng.NextRange(4) == 0) {
+                        map.Remove(key);
+                    }
+                    else {
+                        local_value.Set(reinterpret_cast<uintptr_t>(key), count);
+                        map.Insert(key, local_value);
+                    }
+                    ++count;
+                }
+                writes += count;
+            });
+        }
+        for (unsigned r = 0; r < kStressReaders; ++r)
+        {
+            threads.emplace_back([&, r]() {
+                TestRandom rng(100 + r);
+                MapTestValue local_result;
+                uint64_t count = 0;
+                while (!stop)
+                {
+                    map.Find(MapTestKey(rng.NextRange(kInFlight * 4)), local_result);
+                    ++count;
+                }
+                finds += count;
+            });
+        }
+        const double sec = RunThreads(threads, stop);
+
+        Logger.Info(name, " ", kStressWriters, " writers + ", kStressReaders, " readers: ",
+            writes.load() / sec / 1000000., " M writes/sec, ",
+            finds.load() / sec / 1000000., " M finds/sec");
+    }
+}
+
+void BenchmarkLockFreeMap()
+{
+    LockFreePointerMap<MapTestValue> map;
+    BenchmarkMap("Lock-free map", map);
+
+    LockedRequestRing<MapTestValue> ring;
+    BenchmarkMap("Locked ring (baseline)", ring);
+}
+
+
+} // namespace core
@@ -0,0 +1,841 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "xrm_plugins_abi.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("PluginAbiTests");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// Zeroed directory in process memory, as the service sees it after creating
+// the shared memory
+class TestDirectory
+{
+public:
+    explicit TestDirectory(uint32_t slot_count)
+    {
+        const size_t words = (XrmPluginsLayoutBytes(slot_count) + 7) / 8;
+        Memory.reset(new uint64_t[words]());
+        Layout = reinterpret_cast<XrmPluginsMemoryLayout*>(Memory.get());
+        Layout->InitializeDirectory(slot_count);
+    }
+
+    XrmPluginsMemoryLayout* operator->()
+    {
+        return Layout;
+    }
+
+protected:
+    std::unique_ptr<uint64_t[]> Memory;
+    XrmPluginsMemoryLayout* Layout = nullptr;
+};
+
+// Spin until the condition holds, giving up after a second rather than hang
+template<typename ConditionT>
+static bool WaitFor(ConditionT condition)
+{
+    const uint64_t t0 = GetTimeUsec();
+    while (!condition())
+    {
+        if (GetTimeUsec() - t0 > 1000 * 1000) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+
+// Exposes the back buffer index so tests can check it against the host's
+class TestSurfaceWriter : public XrmPluginSurfaceWriter
+{
+public:
+    uint32_t GetBackIndex() const
+    {
+        return BackIndex;
+    }
+};
+
+// Surface and event names are per slot, so pick a slot no real plugin uses
+static int TestPluginIndex()
+{
+    return 1000000 + static_cast<int>(GetTimeUsec() % 1000000);
+}
+
+// Fill every pixel of a surface buffer with the frame number
+static void FillSurface(uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height, uint32_t frame_number)
+{
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint32_t* row = reinterpret_cast<uint32_t*>(pixels + pitch * y);
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x] = frame_number;
+        }
+    }
+}
+
+// Returns the frame number if every pixel holds the same one, or 0
+static uint32_t CheckSurface(const uint8_t* pixels, uint32_t pitch, uint32_t width, uint32_t height)
+{
+    const uint32_t frame_number = *reinterpret_cast<const uint32_t*>(pixels);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(pixels + pitch * y);
+        for (uint32_t x = 0; x < width; ++x) {
+            if (row[x] != frame_number) {
+                return 0;
+            }
+        }
+    }
+    return frame_number;
+}
+
+
+static XrmPluginEvent MakeEvent(uint32_t sequence)
+{
+    XrmPluginEvent event{};
+    event.TimestampUsec = sequence;
+    event.Type = XRM_PLUGIN_EVENT_GAZE;
+    event.X = static_cast<int32_t>(sequence);
+    event.Y = -static_cast<int32_t>(sequence);
+    return event;
+}
+
+static bool IsEvent(const XrmPluginEvent& event, uint32_t sequence)
+{
+    return event.TimestampUsec == sequence &&
+        event.Type == XRM_PLUGIN_EVENT_GAZE &&
+        event.X == static_cast<int32_t>(sequence) &&
+        event.Y == -static_cast<int32_t>(sequence);
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    A drain returns the bits set since the previous one and leaves nothing
+    behind, whichever call set them
+*/
+static bool TestDoorbellDrain()
+{
+    TestDirectory directory(XRM_PLUGIN_MAX_SLOTS);
+
+    TEST_CHECK(directory->DrainDirtyPlugins() == 0);
+
+    directory->MarkPluginDirty(0);
+    directory->MarkPluginDirty(63);
+    directory->MarkPluginDirty(0);
+    TEST_CHECK(directory->DrainDirtyPlugins() == (UINT64_C(1) | UINT64_C(1) << 63));
+    TEST_CHECK(directory->DrainDirtyPlugins() == 0);
+
+    XrmPluginToHostData data{};
+    data.KeepAliveEpoch = 7;
+    directory->WritePluginToHost(5, data);
+    directory->MarkPluginDirty(33);
+    TEST_CHECK(directory->DrainDirtyPlugins() == (UINT64_C(1) << 5 | UINT64_C(1) << 33));
+    TEST_CHECK(directory->DrainDirtyPlugins() == 0);
+
+    uint32_t epoch = 0;
+    XrmPluginToHostData read{};
+    TEST_CHECK(directory->GetSlot(5)->PluginToHost.Read(epoch, read));
+    TEST_CHECK(read.KeepAliveEpoch == 7);
+    return true;
+}
+
+/*
+    Plugin threads write their slots while the host drains.  After the last
+    write, the host must still be told about every slot and must read the
+    last value written to it, so no bit set during a drain is lost
+*/
+static bool TestDoorbellConcurrentWrites()
+{
+    TestDirectory directory(XRM_PLUGIN_MAX_SLOTS);
+
+    static const unsigned kWriters = 4;
+    static const unsigned kSlotsPerWriter = XRM_PLUGIN_MAX_SLOTS / kWriters;
+    static const uint32_t kRounds = 2000;
+
+    std::atomic<unsigned> writers_done = ATOMIC_VAR_INIT(0);
+    uint32_t seen[XRM_PLUGIN_MAX_SLOTS] = {};
+    uint64_t drains = 0;
+
+    // Host: Read every slot the doorbell reports
+    auto drain = [&]() {
+        const uint64_t dirty = directory->DrainDirtyPlugins();
+        for (int i = 0; i < XRM_PLUGIN_MAX_SLOTS; ++i)
+        {
+            if ((dirty & (UINT64_C(1) << i)) == 0) {
+                continue;
+            }
+            uint32_t epoch = 0;
+            XrmPluginToHostData data{};
+            if (directory->GetSlot(i)->PluginToHost.Read(epoch, data)) {
+                seen[i] = data.KeepAliveEpoch;
+            }
+        }
+        ++drains;
+    };
+
+    std::vector<std::thread> writers;
+    for (unsigned w = 0; w < kWriters; ++w)
+    {
+        writers.emplace_back([&, w]() {
+            XrmPluginToHostData data{};
+            for (uint32_t round = 1; round <= kRounds; ++round)
+            {
+                data.KeepAliveEpoch = round;
+                for (unsigned j = 0; j < kSlotsPerWriter; ++j) {
+                    directory->WritePluginToHost(w * kSlotsPerWriter + j, data);
+                }
+                std::this_thread::yield();
+            }
+            ++writers_done;
+        });
+    }
+
+    while (writers_done < kWriters) {
+        drain();
+        std::this_thread::yield();
+    }
+    for (std::thread& thread : writers) {
+        thread.join();
+    }
+    drain();
+
+    Logger.Info("Doorbell: ", drains, " drains for ", kRounds * XRM_PLUGIN_MAX_SLOTS, " writes");
+
+    for (int i = 0; i < XRM_PLUGIN_MAX_SLOTS; ++i) {
+        TEST_CHECK(seen[i] == kRounds);
+    }
+    TEST_CHECK(directory->DrainDirtyPlugins() == 0);
+    return true;
+}
+
+/*
+    Each setter thread owns a range of bits and sets them in turn, setting a
+    bit again only after the host has drained it, so sets keep landing while
+    a drain is in progress.  If a drain cleared a bit it did not return, its
+    setter would wait forever; if it returned a bit without clearing it, the
+    host would count more drains than sets
+*/
+static bool TestDoorbellDrainClearsReturned()
+{
+    TestDirectory directory(XRM_PLUGIN_MAX_SLOTS);
+
+    static const unsigned kSetters = 4;
+    static const unsigned kBitsPerSetter = XRM_PLUGIN_MAX_SLOTS / kSetters;
+    static const uint32_t kRounds = 4000;
+
+    std::atomic<uint32_t> sets[XRM_PLUGIN_MAX_SLOTS] = {};
+    std::atomic<uint32_t> drained[XRM_PLUGIN_MAX_SLOTS] = {};
+    std::atomic<bool> failed = ATOMIC_VAR_INIT(false);
+    std::atomic<unsigned> setters_done = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> setters;
+    for (unsigned s = 0; s < kSetters; ++s)
+    {
+        setters.emplace_back([&, s]() {
+            for (uint32_t round = 0; round < kRounds && !failed; ++round)
+            {
+                const unsigned bit = s * kBitsPerSetter + round % kBitsPerSetter;
+                if (!WaitFor([&]() { return drained[bit].load() == sets[bit].load() || failed; })) {
+                    failed = true;
+                    break;
+                }
+                ++sets[bit];
+                directory->MarkPluginDirty(bit);
+
+                // Interleave with the host on a machine with few cores
+                std::this_thread::yield();
+            }
+            ++setters_done;
+        });
+    }
+
+    // Host: Count each returned bit
+    auto drain = [&]() {
+        const uint64_t dirty = directory->DrainDirtyPlugins();
+        for (int i = 0; i < XRM_PLUGIN_MAX_SLOTS; ++i)
+        {
+            if ((dirty & (UINT64_C(1) << i)) != 0 && ++drained[i] > sets[i]) {
+                failed = true;
+            }
+        }
+    };
+
+    while (setters_done < kSetters) {
+        drain();
+        std::this_thread::yield();
+    }
+    for (std::thread& thread : setters) {
+        thread.join();
+    }
+    drain();
+
+    TEST_CHECK(!failed);
+    for (int i = 0; i < XRM_PLUGIN_MAX_SLOTS; ++i) {
+        TEST_CHECK(sets[i] == kRounds / kBitsPerSetter);
+        TEST_CHECK(drained[i] == sets[i]);
+    }
+    return true;
+}
+
+/*
+    A claim takes the first free slot and bumps its epoch.  A released slot
+    is claimed again with the next epoch, and claims and releases ring the
+    doorbell.  Claims fail once every slot is taken
+*/
+static bool TestClaimRelease()
+{
+    static const uint32_t kSlots = 4;
+    TestDirectory directory(kSlots);
+
+    uint64_t owners[kSlots] = {};
+    for (uint32_t i = 0; i < kSlots; ++i)
+    {
+        TEST_CHECK(directory->ClaimSlot(100 + i, owners[i]) == (int)i);
+        TEST_CHECK(XrmPluginOwnerProcessId(owners[i]) == 100 + i);
+        TEST_CHECK(XrmPluginOwnerEpoch(owners[i]) == 1);
+        TEST_CHECK(directory->GetSlot(i)->Owner == owners[i]);
+    }
+    TEST_CHECK(directory->DrainDirtyPlugins() == (UINT64_C(1) << kSlots) - 1);
+
+    uint64_t owner = 0;
+    TEST_CHECK(directory->ClaimSlot(200, owner) == -1);
+
+    // Released slots are reused with the next epoch
+    directory->ReleaseSlot(2, owners[2]);
+    TEST_CHECK(XrmPluginOwnerProcessId(directory->GetSlot(2)->Owner) == 0);
+    TEST_CHECK(XrmPluginOwnerEpoch(directory->GetSlot(2)->Owner) == 1);
+    TEST_CHECK(directory->DrainDirtyPlugins() == UINT64_C(1) << 2);
+
+    TEST_CHECK(directory->ClaimSlot(200, owner) == 2);
+    TEST_CHECK(XrmPluginOwnerProcessId(owner) == 200);
+    TEST_CHECK(XrmPluginOwnerEpoch(owner) == 2);
+    TEST_CHECK(directory->DrainDirtyPlugins() == UINT64_C(1) << 2);
+
+    // The same process id claiming again still gets a new epoch
+    directory->ReleaseSlot(2, owner);
+    TEST_CHECK(directory->ClaimSlot(200, owner) == 2);
+    TEST_CHECK(XrmPluginOwnerEpoch(owner) == 3);
+    return true;
+}
+
+/*
+    The host frees a slot whose owner died, and a plugin that claims it next
+    gets a new epoch.  Releases and reclaims made with an older owner word
+    leave the new owner alone
+*/
+static bool TestReclaimSlot()
+{
+    TestDirectory directory(2);
+
+    uint64_t dead_owner = 0;
+    TEST_CHECK(directory->ClaimSlot(100, dead_owner) == 0);
+
+    // Host: The keep-alive stopped, so reclaim the owner word it last read
+    const uint64_t seen_owner = directory->GetSlot(0)->Owner;
+    TEST_CHECK(directory->ReclaimSlot(0, seen_owner));
+    TEST_CHECK(XrmPluginOwnerProcessId(directory->GetSlot(0)->Owner) == 0);
+    TEST_CHECK(!directory->ReclaimSlot(0, seen_owner));
+
+    // The process id is reused by a new plugin
+    uint64_t new_owner = 0;
+    TEST_CHECK(directory->ClaimSlot(100, new_owner) == 0);
+    TEST_CHECK(new_owner != dead_owner);
+    TEST_CHECK(XrmPluginOwnerEpoch(new_owner) == XrmPluginOwnerEpoch(dead_owner) + 1);
+
+    // Stale words from the old owner are rejected
+    directory->ReleaseSlot(0, dead_owner);
+    TEST_CHECK(directory->GetSlot(0)->Owner == new_owner);
+    TEST_CHECK(!directory->ReclaimSlot(0, seen_owner));
+    TEST_CHECK(directory->GetSlot(0)->Owner == new_owner);
+
+    TEST_CHECK(directory->ReclaimSlot(0, new_owner));
+    return true;
+}
+
+/*
+    A new owner does not see input events queued for the previous one
+*/
+static bool TestClaimDiscardsEvents()
+{
+    TestDirectory directory(1);
+
+    uint64_t owner = 0;
+    TEST_CHECK(directory->ClaimSlot(100, owner) == 0);
+
+    XrmPluginEventRing& ring = directory->GetSlot(0)->Events;
+    XrmPluginEvent event{};
+    event.Type = XRM_PLUGIN_EVENT_GAZE;
+    bool wake = false;
+    TEST_CHECK(ring.Push(event, wake));
+    TEST_CHECK(ring.Push(event, wake));
+    TEST_CHECK(directory->ReclaimSlot(0, owner));
+
+    TEST_CHECK(directory->ClaimSlot(101, owner) == 0);
+    TEST_CHECK(!ring.Pop(event));
+    return true;
+}
+
+/*
+    Readers take the slot count from the header and reject directories whose
+    header does not match the ABI or the size of the shared memory
+*/
+static bool TestOpenDirectory()
+{
+    static const uint32_t kSlots = 3;
+    const std::string name = TestObjectName("plugins");
+
+    SharedMemoryFile creator;
+    TEST_CHECK(creator.Create(XrmPluginsLayoutBytes(kSlots), name));
+    XrmPluginsMemoryLayout* created = reinterpret_cast<XrmPluginsMemoryLayout*>(creator.GetFront());
+
+    SharedMemoryFile file;
+    TEST_CHECK(OpenXrmPluginsSharedMemory(file, name) == nullptr);
+
+    created->InitializeDirectory(kSlots);
+    XrmPluginsMemoryLayout* opened = OpenXrmPluginsSharedMemory(file, name);
+    TEST_CHECK(opened != nullptr);
+    TEST_CHECK(opened->SlotCount == kSlots);
+
+    // The last slot is mapped and shared
+    uint64_t owner = 0;
+    opened->GetSlot(kSlots - 1)->Owner = 5;
+    TEST_CHECK(created->GetSlot(kSlots - 1)->Owner == 5);
+    created->GetSlot(kSlots - 1)->Owner = 0;
+    file.Close();
+
+    created->Version = XRM_PLUGINS_ABI_VERSION + 1;
+    TEST_CHECK(OpenXrmPluginsSharedMemory(file, name) == nullptr);
+    created->Version = XRM_PLUGINS_ABI_VERSION;
+
+    created->SlotCount = 0;
+    TEST_CHECK(OpenXrmPluginsSharedMemory(file, name) == nullptr);
+    created->SlotCount = XRM_PLUGIN_MAX_SLOTS + 1;
+    TEST_CHECK(OpenXrmPluginsSharedMemory(file, name) == nullptr);
+
+    // More slots than were allocated
+    created->SlotCount = XRM_PLUGIN_MAX_SLOTS;
+    TEST_CHECK(OpenXrmPluginsSharedMemory(file, name) == nullptr);
+    TEST_CHECK(file.GetFront() == nullptr);
+
+    created->SlotCount = kSlots;
+    opened = OpenXrmPluginsSharedMemory(file, name);
+    TEST_CHECK(opened != nullptr);
+    TEST_CHECK(opened->ClaimSlot(100, owner) == 0);
+    TEST_CHECK(created->GetSlot(0)->Owner == owner);
+    return true;
+}
+
+/*
+    The host acquires the newest published frame and nothing when no frame
+    was published since, and the plugin never gets back the host's buffer
+*/
+static bool TestSurfaceLatest()
+{
+    static const uint32_t kWidth = 100, kHeight = 30;
+    const int plugin_index = TestPluginIndex();
+
+    TestSurfaceWriter writer;
+    TEST_CHECK(writer.Create(plugin_index, kWidth, kHeight));
+
+    SharedMemoryFile file;
+    XrmPluginSurfaceGeometry geometry;
+    XrmPluginSurfaceLayout* surface = OpenXrmPluginSurface(file, plugin_index, geometry);
+    TEST_CHECK(surface != nullptr);
+    TEST_CHECK(geometry.Width == kWidth && geometry.Height == kHeight);
+    TEST_CHECK(geometry.Pitch == writer.GetPitch());
+
+    uint32_t front_index = 2;
+    TEST_CHECK(!surface->AcquireLatest(front_index));
+    TEST_CHECK(front_index == 2);
+
+    uint32_t frame_number = 0;
+    for (unsigned burst = 1; burst <= 5; ++burst)
+    {
+        // Publish a few frames before the host looks
+        for (unsigned i = 0; i < burst; ++i)
+        {
+            TEST_CHECK(writer.GetBackIndex() != front_index);
+            FillSurface(writer.GetBackBuffer(), writer.GetPitch(), kWidth, kHeight, ++frame_number);
+            writer.EndFrame(nullptr, 0);
+            TEST_CHECK(writer.GetBackIndex() != front_index);
+        }
+
+        TEST_CHECK(surface->AcquireLatest(front_index));
+        TEST_CHECK(front_index < XRM_PLUGIN_SURFACE_BUFFER_COUNT);
+        TEST_CHECK(front_index != writer.GetBackIndex());
+        TEST_CHECK(surface->Buffers[front_index].FrameNumber == frame_number);
+        TEST_CHECK(CheckSurface(surface->GetPixels(front_index), geometry.Pitch, kWidth, kHeight) == frame_number);
+        TEST_CHECK(!surface->AcquireLatest(front_index));
+    }
+
+    // The buffer handed back to the plugin is older than the newest frame
+    TEST_CHECK(writer.GetBackFrameNumber() < frame_number);
+
+    // Dirty rects travel with their frame, and too many means a full upload
+    XrmPluginRect rects[XRM_PLUGIN_MAX_DIRTY_RECTS + 1] = {};
+    rects[0].Right = 10;
+    rects[0].Bottom = 5;
+    writer.EndFrame(rects, 1);
+    TEST_CHECK(surface->AcquireLatest(front_index));
+    TEST_CHECK(surface->Buffers[front_index].DirtyRectCount == 1);
+    TEST_CHECK(surface->Buffers[front_index].DirtyRects[0].Right == 10);
+    writer.EndFrame(rects, XRM_PLUGIN_MAX_DIRTY_RECTS + 1);
+    TEST_CHECK(surface->AcquireLatest(front_index));
+    TEST_CHECK(surface->Buffers[front_index].DirtyRectCount > XRM_PLUGIN_MAX_DIRTY_RECTS);
+    return true;
+}
+
+/*
+    A plugin thread publishes frames as fast as it can while the host thread
+    acquires them.  Every acquired buffer must hold one whole frame for as
+    long as the host holds it, frames must only go forward, and the plugin
+    must never be drawing into the host's buffer
+*/
+static bool TestSurfaceStress()
+{
+    static const uint32_t kWidth = 64, kHeight = 64;
+    static const uint32_t kFrames = 5000;
+    const int plugin_index = TestPluginIndex();
+
+    TestSurfaceWriter writer;
+    TEST_CHECK(writer.Create(plugin_index, kWidth, kHeight));
+
+    SharedMemoryFile file;
+    XrmPluginSurfaceGeometry geometry;
+    XrmPluginSurfaceLayout* surface = OpenXrmPluginSurface(file, plugin_index, geometry);
+    TEST_CHECK(surface != nullptr);
+
+    std::atomic<uint32_t> host_front = ATOMIC_VAR_INIT(2);
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> collisions = ATOMIC_VAR_INIT(0);
+    uint64_t acquired = 0, bad_frames = 0;
+
+    std::thread plugin([&]() {
+        for (uint32_t frame_number = 1; frame_number <= kFrames; ++frame_number)
+        {
+            if (writer.GetBackIndex() == host_front.load()) {
+                ++collisions;
+            }
+            FillSurface(writer.GetBackBuffer(), writer.GetPitch(), kWidth, kHeight, frame_number);
+            writer.EndFrame(nullptr, 0);
+            std::this_thread::yield();
+        }
+        stop = true;
+    });
+
+    // Hold frames for varying times so the plugin sometimes laps the host
+    TestRandom random(plugin_index);
+    uint32_t front_index = 2, last_frame_number = 0;
+    while (!stop)
+    {
+        if (!surface->AcquireLatest(front_index)) {
+            std::this_thread::yield();
+            continue;
+        }
+        host_front = front_index;
+
+        // Check twice, so a write into the host's buffer is caught even if
+        // it started after the first check
+        const uint8_t* pixels = surface->GetPixels(front_index);
+        const uint32_t frame_number = CheckSurface(pixels, geometry.Pitch, kWidth, kHeight);
+        for (unsigned i = random.NextRange(4); i > 0; --i) {
+            std::this_thread::yield();
+        }
+        if (frame_number == 0 ||
+            frame_number <= last_frame_number ||
+            frame_number != surface->Buffers[front_index].FrameNumber ||
+            CheckSurface(pixels, geometry.Pitch, kWidth, kHeight) != frame_number)
+        {
+            ++bad_frames;
+        }
+        last_frame_number = frame_number;
+        ++acquired;
+    }
+    plugin.join();
+
+    // The last frame is always delivered
+    TEST_CHECK(surface->AcquireLatest(front_index) || last_frame_number == kFrames);
+    TEST_CHECK(surface->Buffers[front_index].FrameNumber == kFrames);
+
+    Logger.Info("Surface: ", acquired, " of ", kFrames, " frames acquired");
+
+    TEST_CHECK(bad_frames == 0);
+    TEST_CHECK(collisions == 0);
+    TEST_CHECK(acquired > 0);
+    return true;
+}
+
+/*
+    The host rejects surfaces whose header does not match the ABI or does
+    not fit the shared memory, since the plugin controls the header
+*/
+static bool TestOpenSurface()
+{
+    static const uint32_t kWidth = 50, kHeight = 20;
+    const int plugin_index = TestPluginIndex();
+
+    SharedMemoryFile file;
+    XrmPluginSurfaceGeometry geometry;
+    TEST_CHECK(OpenXrmPluginSurface(file, plugin_index, geometry) == nullptr);
+
+    TEST_CHECK(!XrmPluginSurfaceWriter().Create(plugin_index, 0, kHeight));
+    TEST_CHECK(!XrmPluginSurfaceWriter().Create(plugin_index, kWidth, 16385));
+
+    XrmPluginSurfaceWriter writer;
+    TEST_CHECK(writer.Create(plugin_index, kWidth, kHeight));
+
+    // Tamper with the header through a second mapping
+    SharedMemoryFile tamper_file;
+    TEST_CHECK(tamper_file.Open(static_cast<int>(sizeof(XrmPluginSurfaceLayout)), XrmPluginSurfaceName(plugin_index)));
+    XrmPluginSurfaceLayout* header = reinterpret_cast<XrmPluginSurfaceLayout*>(tamper_file.GetFront());
+    const uint32_t pitch = header->Pitch;
+    const uint32_t buffer_bytes = header->BufferBytes;
+    const uint32_t total_bytes = header->TotalBytes;
+    TEST_CHECK(pitch % XrmPluginSurfaceLayout::kPitchAlign == 0);
+    TEST_CHECK(buffer_bytes % XrmPluginSurfaceLayout::kBufferAlign == 0);
+
+    TEST_CHECK(OpenXrmPluginSurface(file, plugin_index, geometry) != nullptr);
+    TEST_CHECK(geometry.BufferBytes == buffer_bytes);
+
+    struct Tamper
+    {
+        uint32_t XrmPluginSurfaceLayout::* Field;
+        uint32_t Value;
+    };
+    const Tamper tampers[] = {
+        { &XrmPluginSurfaceLayout::Version, XRM_PLUGINS_ABI_VERSION + 1 },
+        { &XrmPluginSurfaceLayout::Width, 0 },
+        { &XrmPluginSurfaceLayout::Height, 0 },
+        { &XrmPluginSurfaceLayout::Pitch, kWidth * 4 - 1 },
+        { &XrmPluginSurfaceLayout::Height, buffer_bytes / pitch + 1 },
+        { &XrmPluginSurfaceLayout::BufferBytes, buffer_bytes * 2 },
+        { &XrmPluginSurfaceLayout::TotalBytes, total_bytes - 1 },
+        // Larger than the shared memory
+        { &XrmPluginSurfaceLayout::TotalBytes, total_bytes * 4 },
+        { &XrmPluginSurfaceLayout::TotalBytes, 0x80000000u },
+    };
+    for (const Tamper& tamper : tampers)
+    {
+        geometry = XrmPluginSurfaceGeometry();
+        const uint32_t saved = header->*tamper.Field;
+        header->*tamper.Field = tamper.Value;
+        TEST_CHECK(OpenXrmPluginSurface(file, plugin_index, geometry) == nullptr);
+        TEST_CHECK(file.GetFront() == nullptr);
+        TEST_CHECK(geometry.Width == 0);
+        header->*tamper.Field = saved;
+    }
+
+    TEST_CHECK(OpenXrmPluginSurface(file, plugin_index, geometry) != nullptr);
+    return true;
+}
+
+/*
+    Events come out in the order they went in across many trips around the
+    ring, including when the 32-bit counters wrap
+*/
+static bool TestEventRingOrder()
+{
+    std::unique_ptr<XrmPluginEventRing> ring(new XrmPluginEventRing());
+
+    // Start just before the counters wrap
+    ring->WriteCount = ring->ReadCount = UINT32_MAX - 100;
+
+    TestRandom random(8);
+    uint32_t pushed = 0, popped = 0;
+    XrmPluginEvent event{};
+    bool wake = false;
+
+    for (unsigned round = 0; round < 1000; ++round)
+    {
+        const unsigned push_count = random.NextRange(XRM_PLUGIN_EVENT_RING_SIZE - (pushed - popped) + 1);
+        for (unsigned i = 0; i < push_count; ++i)
+        {
+            TEST_CHECK(ring->Push(MakeEvent(pushed++), wake));
+            TEST_CHECK(!wake);
+        }
+
+        const unsigned pop_count = random.NextRange(pushed - popped + 1);
+        for (unsigned i = 0; i < pop_count; ++i)
+        {
+            TEST_CHECK(ring->Pop(event));
+            TEST_CHECK(IsEvent(event, popped++));
+        }
+    }
+    while (popped < pushed)
+    {
+        TEST_CHECK(ring->Pop(event));
+        TEST_CHECK(IsEvent(event, popped++));
+    }
+    TEST_CHECK(!ring->Pop(event));
+
+    TEST_CHECK(pushed > 10 * XRM_PLUGIN_EVENT_RING_SIZE);
+    TEST_CHECK(ring->WriteCount < UINT32_MAX - 100);
+    TEST_CHECK(ring->Dropped == 0);
+    return true;
+}
+
+/*
+    A full ring drops and counts new events and keeps the queued ones.  A
+    push only asks for a wake while the reader is waiting
+*/
+static bool TestEventRingFull()
+{
+    std::unique_ptr<XrmPluginEventRing> ring(new XrmPluginEventRing());
+
+    XrmPluginEvent event{};
+    bool wake = false;
+
+    for (uint32_t i = 0; i < XRM_PLUGIN_EVENT_RING_SIZE; ++i) {
+        TEST_CHECK(ring->Push(MakeEvent(i), wake));
+    }
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        TEST_CHECK(!ring->Push(MakeEvent(1000 + i), wake));
+        TEST_CHECK(!wake);
+    }
+    TEST_CHECK(ring->Dropped == 3);
+
+    // One pop makes room for exactly one more
+    TEST_CHECK(ring->Pop(event));
+    TEST_CHECK(IsEvent(event, 0));
+    TEST_CHECK(ring->Push(MakeEvent(XRM_PLUGIN_EVENT_RING_SIZE), wake));
+    TEST_CHECK(!ring->Push(MakeEvent(2000), wake));
+    TEST_CHECK(ring->Dropped == 4);
+
+    for (uint32_t i = 1; i <= XRM_PLUGIN_EVENT_RING_SIZE; ++i)
+    {
+        TEST_CHECK(ring->Pop(event));
+        TEST_CHECK(IsEvent(event, i));
+    }
+    TEST_CHECK(!ring->Pop(event));
+
+    ring->ReaderWaiting = 1;
+    TEST_CHECK(ring->Push(MakeEvent(0), wake));
+    TEST_CHECK(wake);
+    ring->ReaderWaiting = 0;
+
+    // A new owner starts with an empty ring
+    TEST_CHECK(ring->Push(MakeEvent(1), wake));
+    ring->DiscardPending();
+    TEST_CHECK(!ring->Pop(event));
+    return true;
+}
+
+/*
+    The host pushes events as fast as it can, retrying when the ring is full
+    and signaling only when asked to.  The plugin pops and sleeps on its
+    event when the ring is empty.  Every event must arrive once and in
+    order, and no wake may be lost, which would show up as a wait running
+    into its timeout
+*/
+static bool TestEventRingStress()
+{
+    std::unique_ptr<XrmPluginEventRing> ring(new XrmPluginEventRing());
+
+    const int plugin_index = TestPluginIndex();
+    IpcEvent host_event;
+    TEST_CHECK(host_event.Create(XRM_PLUGINS_S2C_EVENT_PREFIX + std::to_string(plugin_index)));
+    HostToPluginEvent doorbell;
+    TEST_CHECK(doorbell.Open(plugin_index));
+
+    static const uint32_t kEvents = 20000;
+    static const int kTimeoutMsec = 1000;
+
+    std::atomic<bool> failed = ATOMIC_VAR_INIT(false);
+    uint64_t waits = 0, slow_waits = 0, bad_events = 0;
+
+    std::thread plugin([&]() {
+        XrmPluginEvent event{};
+        uint32_t popped = 0;
+        while (popped < kEvents && !failed)
+        {
+            if (ring->Pop(event))
+            {
+                if (!IsEvent(event, popped)) {
+                    ++bad_events;
+                }
+                ++popped;
+                continue;
+            }
+
+            const uint64_t t0 = GetTimeUsec();
+            ring->Wait(doorbell, kTimeoutMsec);
+            if (GetTimeUsec() - t0 >= kTimeoutMsec * 1000 / 2) {
+                ++slow_waits;
+            }
+            ++waits;
+        }
+    });
+
+    // Push in bursts and let the plugin go back to sleep between them, so
+    // a lost wake leaves events waiting for the timeout
+    TestRandom random(plugin_index);
+    uint64_t signals = 0, full = 0;
+    uint32_t sequence = 0;
+    while (sequence < kEvents && !failed)
+    {
+        const uint32_t burst = 1 + random.NextRange(2 * XRM_PLUGIN_EVENT_RING_SIZE);
+        for (uint32_t i = 0; i < burst && sequence < kEvents && !failed; ++i, ++sequence)
+        {
+            bool wake = false;
+            while (!ring->Push(MakeEvent(sequence), wake))
+            {
+                ++full;
+                std::this_thread::yield();
+            }
+            if (wake) {
+                host_event.Signal();
+                ++signals;
+            }
+        }
+
+        if (!WaitFor([&]() { return ring->ReadCount.load() == sequence; })) {
+            failed = true;
+        }
+    }
+    plugin.join();
+
+    Logger.Info("Event ring: ", kEvents, " events, ", signals, " signals, ",
+        waits, " waits, ", full, " pushes to a full ring");
+
+    TEST_CHECK(!failed);
+    TEST_CHECK(bad_events == 0);
+    TEST_CHECK(slow_waits == 0);
+    TEST_CHECK(ring->Dropped == full);
+    TEST_CHECK(ring->ReadCount == kEvents);
+    return true;
+}
+
+bool TestPluginAbi()
+{
+    return TestDoorbellDrain() &&
+        TestDoorbellConcurrentWrites() &&
+        TestDoorbellDrainClearsReturned() &&
+        TestClaimRelease() &&
+        TestReclaimSlot() &&
+        TestClaimDiscardsEvents() &&
+        TestOpenDirectory() &&
+        TestSurfaceLatest() &&
+        TestSurfaceStress() &&
+        TestOpenSurface() &&
+        TestEventRingOrder() &&
+        TestEventRingFull() &&
+        TestEventRingStress();
+}
+
+
+} // namespace core
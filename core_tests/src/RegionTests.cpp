@@ -0,0 +1,446 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_region.hpp"
+
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("RegionTests");
+
+
+//------------------------------------------------------------------------------
+// Bitmap Model
+
+/*
+    One byte per pixel over a small canvas.  Rects may start off the canvas
+    on the top and left, so negative coordinates are covered too
+*/
+static const int kCanvasMin = -8;
+static const int kCanvasMax = 72;
+static const int kCanvasSize = kCanvasMax - kCanvasMin;
+
+struct Bitmap
+{
+    std::vector<uint8_t> Pixels = std::vector<uint8_t>(kCanvasSize * kCanvasSize, 0);
+
+
+    uint8_t& At(int x, int y)
+    {
+        return Pixels[(y - kCanvasMin) * kCanvasSize + (x - kCanvasMin)];
+    }
+    uint8_t At(int x, int y) const
+    {
+        return Pixels[(y - kCanvasMin) * kCanvasSize + (x - kCanvasMin)];
+    }
+
+    void Fill(const RegionRect& rect, uint8_t value)
+    {
+        for (int y = rect.Top; y < rect.Bottom; ++y) {
+            for (int x = rect.Left; x < rect.Right; ++x) {
+                At(x, y) = value;
+            }
+        }
+    }
+
+    void Intersect(const Bitmap& other)
+    {
+        for (size_t i = 0; i < Pixels.size(); ++i) {
+            Pixels[i] &= other.Pixels[i];
+        }
+    }
+
+    void Union(const Bitmap& other)
+    {
+        for (size_t i = 0; i < Pixels.size(); ++i) {
+            Pixels[i] |= other.Pixels[i];
+        }
+    }
+
+    void Subtract(const Bitmap& other)
+    {
+        for (size_t i = 0; i < Pixels.size(); ++i) {
+            Pixels[i] &= !other.Pixels[i];
+        }
+    }
+};
+
+// Random rect inside the canvas, sometimes empty or inverted
+static RegionRect RandomRect(TestRandom& rng)
+{
+    const int left = kCanvasMin + (int)rng.NextRange(kCanvasSize - 1);
+    const int top = kCanvasMin + (int)rng.NextRange(kCanvasSize - 1);
+    const int max_w = kCanvasMax - left, max_h = kCanvasMax - top;
+    int w = (int)rng.NextRange(max_w < 30 ? max_w + 1 : 31);
+    int h = (int)rng.NextRange(max_h < 30 ? max_h + 1 : 31);
+    if (rng.NextRange(16) == 0) {
+        w = -w;
+    }
+    return RegionRect(left, top, left + w, top + h);
+}
+
+// Random region built the same way in the model
+static void RandomRegion(TestRandom& rng, Region& region, Bitmap& bitmap)
+{
+    std::vector<RegionRect> rects(rng.NextRange(6));
+    for (RegionRect& rect : rects) {
+        rect = RandomRect(rng);
+        bitmap.Fill(rect, 1);
+    }
+    region.Set(rects.data(), (unsigned)rects.size());
+}
+
+/*
+    The region must hold exactly the bitmap's pixels, and GetRects() must
+    cover them once each.  The band form is unique, so a region built from
+    single-row spans of the same pixels must produce identical rects
+*/
+static bool CheckRegion(const Region& region, const Bitmap& bitmap)
+{
+    uint64_t area = 0;
+    RegionRect bounds(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+    std::vector<RegionRect> row_spans;
+    for (int y = kCanvasMin; y < kCanvasMax; ++y)
+    {
+        for (int x = kCanvasMin; x < kCanvasMax; ++x)
+        {
+            TEST_CHECK(region.Contains(x, y) == (bitmap.At(x, y) != 0));
+            if (!bitmap.At(x, y)) {
+                continue;
+            }
+            ++area;
+            bounds.Left = x < bounds.Left ? x : bounds.Left;
+            bounds.Top = y < bounds.Top ? y : bounds.Top;
+            bounds.Right = x + 1 > bounds.Right ? x + 1 : bounds.Right;
+            bounds.Bottom = y + 1 > bounds.Bottom ? y + 1 : bounds.Bottom;
+
+            if (x > kCanvasMin && bitmap.At(x - 1, y)) {
+                ++row_spans.back().Right;
+            }
+            else {
+                row_spans.push_back(RegionRect(x, y, x + 1, y + 1));
+            }
+        }
+    }
+
+    TEST_CHECK(region.GetArea() == area);
+    TEST_CHECK(region.Empty() == (area == 0));
+    if (area > 0) {
+        const RegionRect actual = region.GetBounds();
+        TEST_CHECK(actual.Left == bounds.Left && actual.Top == bounds.Top &&
+            actual.Right == bounds.Right && actual.Bottom == bounds.Bottom);
+    }
+
+    std::vector<RegionRect> rects;
+    region.GetRects(rects);
+    TEST_CHECK(rects.size() == region.GetRectCount());
+
+    Bitmap covered;
+    for (const RegionRect& rect : rects)
+    {
+        TEST_CHECK(!rect.Empty());
+        for (int y = rect.Top; y < rect.Bottom; ++y) {
+            for (int x = rect.Left; x < rect.Right; ++x) {
+                TEST_CHECK(covered.At(x, y) == 0);
+                covered.At(x, y) = 1;
+            }
+        }
+    }
+    TEST_CHECK(covered.Pixels == bitmap.Pixels);
+
+    Region canonical;
+    canonical.Set(row_spans.data(), (unsigned)row_spans.size());
+    std::vector<RegionRect> canonical_rects;
+    canonical.GetRects(canonical_rects);
+    TEST_CHECK(canonical_rects.size() == rects.size());
+    TEST_CHECK(canonical.GetBandCount() == region.GetBandCount());
+    for (size_t i = 0; i < rects.size(); ++i) {
+        TEST_CHECK(canonical_rects[i].Left == rects[i].Left && canonical_rects[i].Top == rects[i].Top &&
+            canonical_rects[i].Right == rects[i].Right && canonical_rects[i].Bottom == rects[i].Bottom);
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/// Random sequences of every operation against the bitmap model
+static bool TestRandomOperations()
+{
+    TestRandom rng(20);
+
+    for (unsigned trial = 0; trial < 3000; ++trial)
+    {
+        Region region;
+        Bitmap bitmap;
+
+        const unsigned op_count = 1 + rng.NextRange(12);
+        for (unsigned op = 0; op < op_count; ++op)
+        {
+            const unsigned kind = rng.NextRange(8);
+            if (kind < 3)
+            {
+                const RegionRect rect = RandomRect(rng);
+                Bitmap other;
+                other.Fill(rect, 1);
+
+                if (kind == 0) {
+                    region.Union(rect);
+                    bitmap.Union(other);
+                }
+                else if (kind == 1) {
+                    region.Subtract(rect);
+                    bitmap.Subtract(other);
+                }
+                else {
+                    region.Intersect(rect);
+                    bitmap.Intersect(other);
+                }
+            }
+            else if (kind < 6)
+            {
+                Region other_region;
+                Bitmap other;
+                RandomRegion(rng, other_region, other);
+
+                if (kind == 3) {
+                    region.Union(other_region);
+                    bitmap.Union(other);
+                }
+                else if (kind == 4) {
+                    region.Subtract(other_region);
+                    bitmap.Subtract(other);
+                }
+                else {
+                    region.Intersect(other_region);
+                    bitmap.Intersect(other);
+                }
+            }
+            else if (kind == 6)
+            {
+                // Intersects() agrees with a pixel scan
+                const RegionRect rect = RandomRect(rng);
+                bool expected = false;
+                for (int y = rect.Top; y < rect.Bottom && !expected; ++y) {
+                    for (int x = rect.Left; x < rect.Right && !expected; ++x) {
+                        expected = bitmap.At(x, y) != 0;
+                    }
+                }
+                TEST_CHECK(region.Intersects(rect) == expected);
+            }
+            else
+            {
+                bitmap = Bitmap();
+                RandomRegion(rng, region, bitmap);
+            }
+
+            TEST_CHECK(CheckRegion(region, bitmap));
+        }
+    }
+    return true;
+}
+
+/// Set() with many rects must match a Union() per rect exactly
+static bool TestSetMatchesUnion()
+{
+    TestRandom rng(21);
+
+    for (unsigned trial = 0; trial < 3000; ++trial)
+    {
+        std::vector<RegionRect> rects(rng.NextRange(24));
+        Region unioned;
+        Bitmap bitmap;
+        for (RegionRect& rect : rects) {
+            rect = RandomRect(rng);
+            unioned.Union(rect);
+            bitmap.Fill(rect, 1);
+        }
+
+        Region set;
+        set.Union(RegionRect(0, 0, 5, 5)); // Replaced by Set()
+        set.Set(rects.data(), (unsigned)rects.size());
+
+        TEST_CHECK(CheckRegion(set, bitmap));
+        TEST_CHECK(CheckRegion(unioned, bitmap));
+    }
+    return true;
+}
+
+/*
+    A copy plan must cover the region with disjoint rects, report its own
+    cost, and cost no more than copying the region's rects one by one
+*/
+static bool TestCopyPlan()
+{
+    TestRandom rng(22);
+
+    for (unsigned trial = 0; trial < 3000; ++trial)
+    {
+        Region region;
+        Bitmap bitmap;
+        RandomRegion(rng, region, bitmap);
+        if (rng.NextRange(2)) {
+            const RegionRect hole = RandomRect(rng);
+            region.Subtract(hole);
+            Bitmap other;
+            other.Fill(hole, 1);
+            bitmap.Subtract(other);
+        }
+
+        RegionCopyCost cost;
+        cost.SetupBytes = rng.NextRange(8192);
+        cost.RowBytes = rng.NextRange(128);
+        cost.BytesPerPixel = 1 + rng.NextRange(4);
+
+        std::vector<RegionRect> plan;
+        const uint64_t total = PlanRegionCopies(region, cost, plan);
+
+        std::vector<RegionRect> rects;
+        region.GetRects(rects);
+        uint64_t naive = 0;
+        for (const RegionRect& rect : rects) {
+            naive += cost.Cost(rect);
+        }
+        TEST_CHECK(total <= naive);
+
+        uint64_t sum = 0;
+        Bitmap covered;
+        for (const RegionRect& rect : plan)
+        {
+            sum += cost.Cost(rect);
+            for (int y = rect.Top; y < rect.Bottom; ++y) {
+                for (int x = rect.Left; x < rect.Right; ++x) {
+                    TEST_CHECK(covered.At(x, y) == 0);
+                    covered.At(x, y) = 1;
+                }
+            }
+        }
+        TEST_CHECK(sum == total);
+        for (size_t i = 0; i < bitmap.Pixels.size(); ++i) {
+            TEST_CHECK(!bitmap.Pixels[i] || covered.Pixels[i]);
+        }
+    }
+    return true;
+}
+
+static bool TestEdgeCases()
+{
+    Region region;
+    TEST_CHECK(region.Empty());
+    TEST_CHECK(region.GetArea() == 0);
+    TEST_CHECK(!region.Intersects(RegionRect(-100, -100, 100, 100)));
+
+    // Empty and inverted rects are ignored
+    region.Union(RegionRect(5, 5, 5, 10));
+    region.Union(RegionRect(5, 10, 10, 5));
+    TEST_CHECK(region.Empty());
+
+    // Touching rects merge into one
+    region.Union(RegionRect(0, 0, 10, 10));
+    region.Union(RegionRect(10, 0, 20, 10));
+    region.Union(RegionRect(0, 10, 20, 20));
+    TEST_CHECK(region.GetRectCount() == 1);
+    TEST_CHECK(region.GetBandCount() == 1);
+
+    // A hole splits the region into three bands
+    region.Subtract(RegionRect(5, 5, 15, 15));
+    TEST_CHECK(region.GetBandCount() == 3);
+    TEST_CHECK(region.GetRectCount() == 4);
+    TEST_CHECK(region.GetArea() == 300);
+
+    // Filling it back coalesces the bands again
+    region.Union(RegionRect(5, 5, 15, 15));
+    TEST_CHECK(region.GetRectCount() == 1);
+
+    region.Intersect(RegionRect(30, 30, 40, 40));
+    TEST_CHECK(region.Empty());
+
+    std::vector<RegionRect> plan;
+    TEST_CHECK(PlanRegionCopies(region, RegionCopyCost(), plan) == 0);
+    TEST_CHECK(plan.empty());
+    return true;
+}
+
+bool TestRegion()
+{
+    return TestEdgeCases() &&
+        TestRandomOperations() &&
+        TestSetMatchesUnion() &&
+        TestCopyPlan();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkRegion()
+{
+    struct Trace
+    {
+        const char* Name;
+        std::vector<RegionRect> Rects;
+    };
+    std::vector<Trace> traces;
+
+    {
+        Trace trace{ "Typing", {} };
+        for (int i = 0; i < 6; ++i) {
+            trace.Rects.push_back(RegionRect(200 + i * 9, 300, 216 + i * 9, 332));
+        }
+        traces.push_back(trace);
+    }
+    {
+        Trace trace{ "Window drag", {} };
+        trace.Rects.push_back(RegionRect(100, 100, 900, 700));
+        trace.Rects.push_back(RegionRect(116, 108, 916, 708));
+        trace.Rects.push_back(RegionRect(90, 95, 110, 720));
+        traces.push_back(trace);
+    }
+    {
+        Trace trace{ "Text lines", {} };
+        for (int i = 0; i < 40; ++i) {
+            trace.Rects.push_back(RegionRect(50, 100 + i * 20, 350 + (i * 37) % 400, 116 + i * 20));
+        }
+        traces.push_back(trace);
+    }
+    {
+        Trace trace{ "Scatter", {} };
+        TestRandom rng(1);
+        for (int i = 0; i < 100; ++i) {
+            const int x = (int)rng.NextRange(3800), y = (int)rng.NextRange(2100);
+            trace.Rects.push_back(RegionRect(x, y, x + 16 + (int)rng.NextRange(40), y + 16 + (int)rng.NextRange(40)));
+        }
+        traces.push_back(trace);
+    }
+
+    const RegionRect screen(0, 0, 3840, 2160);
+    RegionCopyCost cost;
+
+    Region region;
+    std::vector<RegionRect> plan;
+    for (const Trace& trace : traces)
+    {
+        const double set_usec = MeasureUsecPerCall([&]() {
+            region.Set(trace.Rects.data(), (unsigned)trace.Rects.size());
+            region.Intersect(screen);
+        });
+
+        uint64_t total = 0;
+        const double plan_usec = MeasureUsecPerCall([&]() {
+            total = PlanRegionCopies(region, cost, plan);
+        });
+
+        uint64_t naive = 0;
+        for (const RegionRect& rect : trace.Rects) {
+            naive += cost.Cost(rect);
+        }
+
+        Logger.Info(trace.Name, ": ", trace.Rects.size(), " rects -> ", plan.size(),
+            ", cost ", naive, " -> ", total, ", Set ", set_usec, " usec, plan ", plan_usec, " usec");
+    }
+}
+
+
+} // namespace core
@@ -0,0 +1,313 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "seqlock.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("SeqLockTests");
+
+
+//------------------------------------------------------------------------------
+// Payload
+
+// Large enough that a copy spans several cache lines
+static const unsigned kPayloadWords = 62;
+
+struct StressPayload
+{
+    uint64_t Words[kPayloadWords];
+    uint64_t Serial;
+    uint64_t Checksum;
+
+    void Fill(uint64_t serial)
+    {
+        Serial = serial;
+        uint64_t sum = serial;
+        for (unsigned i = 0; i < kPayloadWords; ++i) {
+            Words[i] = serial * (i + 1) + UINT64_C(0x9e3779b97f4a7c15);
+            sum = sum * 31 + Words[i];
+        }
+        Checksum = sum;
+    }
+
+    bool IsConsistent() const
+    {
+        uint64_t sum = Serial;
+        for (unsigned i = 0; i < kPayloadWords; ++i) {
+            if (Words[i] != Serial * (i + 1) + UINT64_C(0x9e3779b97f4a7c15)) {
+                return false;
+            }
+            sum = sum * 31 + Words[i];
+        }
+        return sum == Checksum;
+    }
+};
+
+static const unsigned kStressWriters = 2;
+static const unsigned kStressReaders = 4;
+static const uint64_t kStressUsec = 300 * 1000;
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    SeqLock has a single writer, so the writers take turns under a mutex,
+    as the shared memory updaters do when several threads publish.  Readers
+    must never return a copy that mixes two writes, and the epoch must match
+    the serial of the write they read.
+*/
+static bool TestSeqLockStress()
+{
+    SeqLock<StressPayload> lock;
+    lock.Reset();
+    {
+        StressPayload initial;
+        initial.Fill(0);
+        lock.Write(initial);
+    }
+
+    std::mutex writer_lock;
+    uint64_t next_serial = 1;
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> bad_reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> torn = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < kStressWriters; ++i)
+    {
+        threads.emplace_back([&]() {
+            StressPayload payload;
+            while (!stop)
+            {
+                std::lock_guard<std::mutex> locker(writer_lock);
+                payload.Fill(next_serial++);
+                lock.Write(payload);
+            }
+        });
+    }
+    for (unsigned i = 0; i < kStressReaders; ++i)
+    {
+        threads.emplace_back([&]() {
+            SeqLockStats stats;
+            StressPayload payload;
+            uint32_t last_epoch = 0;
+            while (!stop)
+            {
+                uint32_t epoch = 0;
+                if (!lock.Read(payload, epoch, &stats)) {
+                    continue;
+                }
+                // Epoch 0 is Reset(), and epoch 1 the initial write
+                if (!payload.IsConsistent() ||
+                    payload.Serial + 1 != epoch ||
+                    epoch < last_epoch)
+                {
+                    ++bad_reads;
+                }
+                last_epoch = epoch;
+            }
+            reads += stats.Reads;
+            torn += stats.TornReads;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(kStressUsec));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    Logger.Info("Stress: ", next_serial, " writes, ", reads.load(), " reads, ",
+        torn.load(), " torn copies retried");
+
+    TEST_CHECK(bad_reads == 0);
+    TEST_CHECK(reads > 0);
+    TEST_CHECK(next_serial > 1);
+
+    uint32_t epoch = 0;
+    StressPayload payload;
+    TEST_CHECK(lock.Read(payload, epoch));
+    TEST_CHECK(payload.IsConsistent());
+    TEST_CHECK(payload.Serial == next_serial - 1);
+    TEST_CHECK(epoch == next_serial);
+    return true;
+}
+
+/*
+    The UI writes the two-counter layout from C#: `before`, then the data,
+    then `after`.  The reader must reject copies that overlap a write.
+*/
+static bool TestSeqLockTwoCounterStress()
+{
+    std::atomic<uint32_t> before_counter = ATOMIC_VAR_INIT(0);
+    std::atomic<uint32_t> after_counter = ATOMIC_VAR_INIT(0);
+    StressPayload shared;
+    shared.Fill(0);
+
+    std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+    std::atomic<uint64_t> bad_reads = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> reads = ATOMIC_VAR_INIT(0);
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        StressPayload payload;
+        uint32_t serial = 0;
+        while (!stop)
+        {
+            ++serial;
+            payload.Fill(serial);
+            before_counter.store(serial, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(&shared, &payload, sizeof(payload));
+            after_counter.store(serial, std::memory_order_release);
+        }
+    });
+    for (unsigned i = 0; i < kStressReaders; ++i)
+    {
+        threads.emplace_back([&]() {
+            SeqLockStats stats;
+            StressPayload payload;
+            while (!stop)
+            {
+                uint32_t epoch = 0;
+                if (!SeqLockReadTwoCounter(before_counter, after_counter,
+                    shared, payload, epoch, &stats))
+                {
+                    continue;
+                }
+                if (!payload.IsConsistent() || payload.Serial != epoch) {
+                    ++bad_reads;
+                }
+            }
+            reads += stats.Reads;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(kStressUsec));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    TEST_CHECK(bad_reads == 0);
+    TEST_CHECK(reads > 0);
+    return true;
+}
+
+static bool TestSeqLockEpoch()
+{
+    SeqLock<StressPayload> lock;
+    lock.Reset();
+
+    StressPayload payload, result;
+    for (uint64_t i = 0; i < 10; ++i)
+    {
+        payload.Fill(i);
+        lock.Write(payload);
+
+        uint32_t epoch = 0;
+        SeqLockStats stats;
+        TEST_CHECK(lock.Read(result, epoch, &stats));
+        TEST_CHECK(epoch == i + 1);
+        TEST_CHECK(result.Serial == i);
+        TEST_CHECK(stats.Reads == 1 && stats.Retries == 0);
+    }
+
+    // A writer that never finishes makes readers give up, not hang
+    lock.BeginWrite();
+    uint32_t epoch = 0;
+    SeqLockStats stats;
+    TEST_CHECK(!lock.Read(result, epoch, &stats));
+    TEST_CHECK(stats.Failures == 1);
+    TEST_CHECK(stats.Retries == SeqLockBackoff::kMaxAttempts - 1);
+    lock.EndWrite();
+    TEST_CHECK(lock.Read(result, epoch));
+    return true;
+}
+
+bool TestSeqLock()
+{
+    return TestSeqLockEpoch() &&
+        TestSeqLockStress() &&
+        TestSeqLockTwoCounterStress();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+void BenchmarkSeqLock()
+{
+    SeqLock<StressPayload> lock;
+    lock.Reset();
+
+    StressPayload payload, result;
+    payload.Fill(1);
+    lock.Write(payload);
+
+    const double write_usec = MeasureUsecPerCall([&]() {
+        lock.Write(payload);
+    });
+    uint32_t epoch = 0;
+    const double read_usec = MeasureUsecPerCall([&]() {
+        lock.Read(result, epoch);
+    });
+    Logger.Info("Uncontended ", sizeof(StressPayload), " bytes: write ",
+        write_usec * 1000., " nsec, read ", read_usec * 1000., " nsec");
+
+    // Readers against a writer that publishes as fast as it can
+    for (unsigned readers = 1; readers <= kStressReaders; readers *= 2)
+    {
+        std::atomic<bool> stop = ATOMIC_VAR_INIT(false);
+        std::atomic<uint64_t> reads = ATOMIC_VAR_INIT(0);
+        std::atomic<uint64_t> retries = ATOMIC_VAR_INIT(0);
+        uint64_t writes = 0;
+
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]() {
+            StressPayload data;
+            while (!stop) {
+                data.Fill(++writes);
+                lock.Write(data);
+            }
+        });
+        for (unsigned i = 0; i < readers; ++i)
+        {
+            threads.emplace_back([&]() {
+                SeqLockStats stats;
+                StressPayload data;
+                uint32_t read_epoch = 0;
+                while (!stop) {
+                    lock.Read(data, read_epoch, &stats);
+                }
+                reads += stats.Reads;
+                retries += stats.Retries;
+            });
+        }
+
+        const uint64_t t0 = GetTimeUsec();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        stop = true;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const double sec = (GetTimeUsec() - t0) / 1000000.;
+
+        Logger.Info("Contended, ", readers, " readers: ",
+            writes / sec / 1000000., " M writes/sec, ",
+            reads.load() / sec / 1000000., " M reads/sec, ",
+            reads.load() > 0 ? retries.load() / static_cast<double>(reads.load()) : 0.,
+            " retries/read");
+    }
+}
+
+
+} // namespace core
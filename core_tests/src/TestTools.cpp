@@ -0,0 +1,159 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+
+#include <stdlib.h> // getenv
+
+#include <atomic>
+
+namespace core {
+
+static logger::Channel Logger("Test");
+
+
+//------------------------------------------------------------------------------
+// Checks
+
+void ReportCheckFailure(const char* expr, const char* file, int line)
+{
+    Logger.Error("Check failed: ", expr, " at ", file, ":", line);
+}
+
+static std::atomic<bool> BenchmarkFailed = ATOMIC_VAR_INIT(false);
+
+void ReportBenchmarkFailure(const char* expr, const char* file, int line)
+{
+    Logger.Error("Benchmark check failed: ", expr, " at ", file, ":", line);
+    BenchmarkFailed = true;
+}
+
+bool AnyBenchmarkFailed()
+{
+    return BenchmarkFailed;
+}
+
+
+//------------------------------------------------------------------------------
+// TestRandom
+
+void TestRandom::Seed(uint64_t seed)
+{
+    State = seed;
+    Next64();
+}
+
+// SplitMix64
+uint64_t TestRandom::Next64()
+{
+    uint64_t z = (State += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+void TestRandom::Fill(uint8_t* data, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        data[i] = static_cast<uint8_t>(Next32());
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Kernel Paths
+
+const CameraKernelPath kCameraKernelPaths[4] = {
+    CameraKernelPath::Scalar,
+    CameraKernelPath::SSE2,
+    CameraKernelPath::AVX2,
+    CameraKernelPath::NEON
+};
+
+const CopyKernelPath kCopyKernelPaths[4] = {
+    CopyKernelPath::Scalar,
+    CopyKernelPath::SSE2,
+    CopyKernelPath::AVX2,
+    CopyKernelPath::NEON
+};
+
+
+//------------------------------------------------------------------------------
+// Sentinels
+
+std::vector<uint8_t> MakeSentinelPlane(unsigned pitch, unsigned height)
+{
+    return std::vector<uint8_t>((size_t)pitch * height, kTestSentinel);
+}
+
+bool CheckSentinelPadding(const uint8_t* plane, unsigned pitch, unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; ++y) {
+        for (unsigned x = width; x < pitch; ++x) {
+            TEST_CHECK(plane[(size_t)y * pitch + x] == kTestSentinel);
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Files
+
+std::string TestTempPath(const char* name)
+{
+    const char* dir = getenv("TMPDIR");
+#if defined(_WIN32)
+    if (!dir) {
+        dir = getenv("TEMP");
+    }
+#endif
+    if (!dir) {
+        dir = "/tmp";
+    }
+    return std::string(dir) + "/" + name;
+}
+
+std::string TestObjectName(const char* name)
+{
+    return std::string("Local\\core_tests_") + name + "_" + std::to_string(GetTimeUsec());
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmark Tools
+
+double MeasureUsecPerCall(
+    const std::function<void()>& fn,
+    uint64_t min_usec,
+    unsigned trials)
+{
+    double best = 0.;
+
+    for (unsigned trial = 0; trial < trials; ++trial)
+    {
+        // Read the clock between batches so it does not dominate short calls
+        uint64_t calls = 0, batch = 1;
+        const uint64_t t0 = GetTimeUsec();
+        uint64_t t1 = t0;
+        do {
+            for (uint64_t i = 0; i < batch; ++i) {
+                fn();
+            }
+            calls += batch;
+            if (batch < 1024) {
+                batch *= 2;
+            }
+            t1 = GetTimeUsec();
+        } while (t1 - t0 < min_usec);
+
+        const double usec = (t1 - t0) / static_cast<double>(calls);
+        if (trial == 0 || usec < best) {
+            best = usec;
+        }
+    }
+
+    return best;
+}
+
+
+} // namespace core
@@ -0,0 +1,198 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Tools shared by the core_tests suites.
+
+    A test is a function returning true on success.  TEST_CHECK() logs the
+    failed expression and returns false from the test.
+
+    A benchmark is a function that logs its own results.  Benchmarks only
+    run when requested, since their timing depends on the machine.
+    BENCH_CHECK() logs a missed budget and fails the run without stopping
+    the benchmark.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_logger.hpp"
+#include "core_copy.hpp"
+#include "CameraKernels.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Checks
+
+/// Log a failed TEST_CHECK()
+void ReportCheckFailure(const char* expr, const char* file, int line);
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            core::ReportCheckFailure(#cond, __FILE__, __LINE__); \
+            return false; \
+        } \
+    } while (0)
+
+/// Log a failed BENCH_CHECK() and remember it for the exit code
+void ReportBenchmarkFailure(const char* expr, const char* file, int line);
+
+/// True once any BENCH_CHECK() has failed
+bool AnyBenchmarkFailed();
+
+#define BENCH_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            core::ReportBenchmarkFailure(#cond, __FILE__, __LINE__); \
+        } \
+    } while (0)
+
+
+//------------------------------------------------------------------------------
+// TestRandom
+
+/// Deterministic generator, so failures reproduce
+class TestRandom
+{
+public:
+    explicit TestRandom(uint64_t seed = 0)
+    {
+        Seed(seed);
+    }
+
+    void Seed(uint64_t seed);
+
+    uint64_t Next64();
+
+    uint32_t Next32()
+    {
+        return static_cast<uint32_t>(Next64() >> 32);
+    }
+
+    /// Returns a value in [0, n)
+    unsigned NextRange(unsigned n)
+    {
+        return static_cast<unsigned>((static_cast<uint64_t>(Next32()) * n) >> 32);
+    }
+
+    void Fill(uint8_t* data, size_t bytes);
+
+protected:
+    uint64_t State = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// Kernel Paths
+
+/// Every explicit camera kernel path.  Skip the ones that
+/// IsCameraKernelPathSupported() rejects on this CPU
+extern const CameraKernelPath kCameraKernelPaths[4];
+
+/// Every explicit copy kernel path.  Skip the ones that
+/// IsCopyKernelPathSupported() rejects on this CPU
+extern const CopyKernelPath kCopyKernelPaths[4];
+
+
+//------------------------------------------------------------------------------
+// Sentinels
+
+/// Fills the bytes around a kernel's output, so writes outside it show up
+static const uint8_t kTestSentinel = 0xa5;
+
+/// Returns pitch * height bytes of kTestSentinel
+std::vector<uint8_t> MakeSentinelPlane(unsigned pitch, unsigned height);
+
+/// Check that the bytes past width in every row are still kTestSentinel
+bool CheckSentinelPadding(const uint8_t* plane, unsigned pitch, unsigned width, unsigned height);
+
+
+//------------------------------------------------------------------------------
+// Files
+
+/// Path for a scratch file in the temporary directory
+std::string TestTempPath(const char* name);
+
+/// Shared memory or event name that is unique per run, so a crashed run
+/// does not leave objects behind for the next
+std::string TestObjectName(const char* name);
+
+
+//------------------------------------------------------------------------------
+// Benchmark Tools
+
+/**
+    Call fn until at least min_usec have passed, a few times over, and
+    return the lowest average time per call in microseconds.
+*/
+double MeasureUsecPerCall(
+    const std::function<void()>& fn,
+    uint64_t min_usec = 100 * 1000,
+    unsigned trials = 3);
+
+/// Returns bytes / usec in GB/s
+inline double GigabytesPerSecond(uint64_t bytes, double usec)
+{
+    return usec > 0. ? bytes / (usec * 1000.) : 0.;
+}
+
+
+//------------------------------------------------------------------------------
+// Suites
+
+bool TestCameraContrast();
+void BenchmarkCameraContrast();
+
+bool TestCameraDenoise();
+void BenchmarkCameraDenoise();
+
+bool TestCameraKernels();
+void BenchmarkCameraKernels();
+
+bool TestCameraLatency();
+
+bool TestCameraRecording();
+
+bool TestCameraScheduler();
+
+bool TestCameraStereo();
+void BenchmarkCameraStereo();
+
+bool TestCameraTesterReport();
+
+bool TestCameraUndistort();
+void BenchmarkCameraUndistort();
+
+bool TestCopy();
+void BenchmarkCopy();
+
+bool TestCursor();
+void BenchmarkCursor();
+
+bool TestImplantAbi();
+
+bool TestIpc();
+void BenchmarkIpc();
+
+bool TestLockFreeMap();
+void BenchmarkLockFreeMap();
+
+bool TestPluginAbi();
+
+bool TestRegion();
+void BenchmarkRegion();
+
+bool TestSeqLock();
+void BenchmarkSeqLock();
+
+bool TestTileHash();
+void BenchmarkTileHash();
+
+
+} // namespace core
@@ -0,0 +1,502 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "TestTools.hpp"
+#include "core_tile_hash.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace core {
+
+static logger::Channel Logger("TileHashTests");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static uint64_t Hash(const uint8_t* data, unsigned pitch, unsigned row_bytes, unsigned rows)
+{
+    uint64_t hash = 0;
+    HashPlane2D(data, pitch, row_bytes, rows, hash, CopyKernelPath::Scalar);
+    return hash;
+}
+
+/*
+    BGRA image and the copy it is delivered to.  Delivered marks the pixels
+    that have been copied at least once, since before that the copy holds
+    different pixels
+*/
+struct DeliveryModel
+{
+    unsigned Width = 0, Height = 0;
+    std::vector<uint32_t> Image, Copy;
+    std::vector<uint8_t> Delivered;
+
+
+    void Reset(unsigned width, unsigned height, TestRandom& rng)
+    {
+        Width = width;
+        Height = height;
+        Image.resize(static_cast<size_t>(width) * height);
+        for (uint32_t& pixel : Image) {
+            pixel = rng.Next32();
+        }
+        Copy.assign(Image.size(), 0);
+        Delivered.assign(Image.size(), 0);
+    }
+
+    const uint8_t* ImageData() const
+    {
+        return reinterpret_cast<const uint8_t*>(Image.data());
+    }
+
+    unsigned Pitch() const
+    {
+        return Width * 4;
+    }
+
+    void Deliver(const Region& region)
+    {
+        std::vector<RegionRect> rects;
+        region.GetRects(rects);
+        for (RegionRect rect : rects)
+        {
+            rect.Left = std::max(rect.Left, 0);
+            rect.Top = std::max(rect.Top, 0);
+            rect.Right = std::min(rect.Right, static_cast<int>(Width));
+            rect.Bottom = std::min(rect.Bottom, static_cast<int>(Height));
+            for (int y = rect.Top; y < rect.Bottom; ++y) {
+                for (int x = rect.Left; x < rect.Right; ++x) {
+                    const size_t i = static_cast<size_t>(y) * Width + x;
+                    Copy[i] = Image[i];
+                    Delivered[i] = 1;
+                }
+            }
+        }
+    }
+
+    // True if every pixel of the rect was delivered and matches the image
+    bool IsKnown(const RegionRect& rect) const
+    {
+        for (int y = rect.Top; y < rect.Bottom; ++y) {
+            for (int x = rect.Left; x < rect.Right; ++x) {
+                const size_t i = static_cast<size_t>(y) * Width + x;
+                if (!Delivered[i] || Copy[i] != Image[i]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// Random rect that may reach off the image on any side
+static RegionRect RandomRect(TestRandom& rng, unsigned width, unsigned height, unsigned max_size)
+{
+    const int left = static_cast<int>(rng.NextRange(width + 32)) - 16;
+    const int top = static_cast<int>(rng.NextRange(height + 32)) - 16;
+    return RegionRect(left, top,
+        left + 1 + static_cast<int>(rng.NextRange(max_size)),
+        top + 1 + static_cast<int>(rng.NextRange(max_size)));
+}
+
+// Tile rect at a tile index, clipped to the image
+static RegionRect TileRect(unsigned tx, unsigned ty, unsigned width, unsigned height)
+{
+    return RegionRect(tx * kTileHashSize, ty * kTileHashSize,
+        std::min((tx + 1) * kTileHashSize, width),
+        std::min((ty + 1) * kTileHashSize, height));
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+
+/*
+    Every path gives the same hash for random sizes and pitches, including
+    rows shorter than a vector, and bytes between rows do not matter
+*/
+static bool TestPathsMatch()
+{
+    TestRandom rng(25);
+    std::vector<uint8_t> data, padded;
+
+    for (unsigned i = 0; i < 2000; ++i)
+    {
+        const unsigned row_bytes = 1 + rng.NextRange(i % 4 == 0 ? 4096 : 600);
+        const unsigned rows = 1 + rng.NextRange(70);
+        const unsigned pitch = row_bytes + rng.NextRange(64);
+
+        data.resize(static_cast<size_t>(pitch) * rows);
+        rng.Fill(data.data(), data.size());
+
+        const uint64_t expected = Hash(data.data(), pitch, row_bytes, rows);
+
+        uint64_t hash = 0;
+        TEST_CHECK(HashPlane2D(data.data(), pitch, row_bytes, rows, hash));
+        TEST_CHECK(hash == expected);
+
+        for (CopyKernelPath path : kCopyKernelPaths)
+        {
+            if (!IsCopyKernelPathSupported(path)) {
+                TEST_CHECK(!HashPlane2D(data.data(), pitch, row_bytes, rows, hash, path));
+                continue;
+            }
+            hash = 0;
+            TEST_CHECK(HashPlane2D(data.data(), pitch, row_bytes, rows, hash, path));
+            TEST_CHECK(hash == expected);
+        }
+
+        padded = data;
+        for (unsigned y = 0; y < rows; ++y) {
+            for (unsigned x = row_bytes; x < pitch; ++x) {
+                padded[y * pitch + x] ^= 0x5a;
+            }
+        }
+        TEST_CHECK(Hash(padded.data(), pitch, row_bytes, rows) == expected);
+    }
+    return true;
+}
+
+/*
+    A band of tiles hashed in one pass gives each tile the hash it has on
+    its own, on every path, for tile widths that do not fill a stripe and
+    bands wider than one pass
+*/
+static bool TestTilesMatchPlane()
+{
+    TestRandom rng(29);
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> hashes;
+
+    for (unsigned i = 0; i < 300; ++i)
+    {
+        const unsigned tile_bytes = i % 3 == 0 ? kTileHashSize * kTileHashBytesPerPixel : 1 + rng.NextRange(300);
+        const unsigned row_bytes = 1 + rng.NextRange(i % 10 == 0 ? 100 * tile_bytes : 8 * tile_bytes);
+        const unsigned rows = 1 + rng.NextRange(70);
+        const unsigned pitch = row_bytes + rng.NextRange(64);
+        const unsigned tiles = (row_bytes + tile_bytes - 1) / tile_bytes;
+
+        data.resize(static_cast<size_t>(pitch) * rows);
+        rng.Fill(data.data(), data.size());
+
+        for (CopyKernelPath path : kCopyKernelPaths)
+        {
+            if (!IsCopyKernelPathSupported(path)) {
+                TEST_CHECK(!HashTiles2D(data.data(), pitch, row_bytes, rows, tile_bytes, hashes.data(), path));
+                continue;
+            }
+
+            hashes.assign(tiles + 1, 0);
+            TEST_CHECK(HashTiles2D(data.data(), pitch, row_bytes, rows, tile_bytes, hashes.data(), path));
+            TEST_CHECK(hashes[tiles] == 0);
+
+            for (unsigned t = 0; t < tiles; ++t) {
+                const unsigned x = t * tile_bytes;
+                TEST_CHECK(hashes[t] == Hash(data.data() + x, pitch, std::min(tile_bytes, row_bytes - x), rows));
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Edits that a weak hash would miss on a mostly white tile: Every single
+    bit flip, swapped rows, swapped pixels, and a shift by one pixel
+*/
+static bool TestSensitivity()
+{
+    const unsigned row_bytes = kTileHashSize * kTileHashBytesPerPixel;
+    const unsigned rows = kTileHashSize;
+
+    TestRandom rng(26);
+    std::vector<uint8_t> tile(row_bytes * rows);
+    for (uint8_t& b : tile) {
+        b = rng.NextRange(4) == 0 ? static_cast<uint8_t>(rng.Next32()) : 0xff;
+    }
+    const uint64_t original = Hash(tile.data(), row_bytes, row_bytes, rows);
+
+    std::vector<uint8_t> edited;
+    std::vector<uint64_t> hashes;
+
+    for (unsigned bit = 0; bit < tile.size() * 8; ++bit)
+    {
+        edited = tile;
+        edited[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+        hashes.push_back(Hash(edited.data(), row_bytes, row_bytes, rows));
+    }
+
+    // Single bit flips all differ from the tile and from each other
+    hashes.push_back(original);
+    std::sort(hashes.begin(), hashes.end());
+    TEST_CHECK(std::adjacent_find(hashes.begin(), hashes.end()) == hashes.end());
+
+    for (unsigned y = 0; y + 1 < rows; ++y)
+    {
+        edited = tile;
+        std::swap_ranges(edited.begin() + y * row_bytes, edited.begin() + (y + 1) * row_bytes,
+            edited.begin() + (y + 1) * row_bytes);
+        if (edited != tile) {
+            TEST_CHECK(Hash(edited.data(), row_bytes, row_bytes, rows) != original);
+        }
+    }
+
+    for (unsigned i = 0; i < 10000; ++i)
+    {
+        edited = tile;
+        const unsigned a = rng.NextRange(kTileHashSize * kTileHashSize);
+        const unsigned b = rng.NextRange(kTileHashSize * kTileHashSize);
+        std::swap_ranges(edited.begin() + a * 4, edited.begin() + a * 4 + 4, edited.begin() + b * 4);
+        if (edited != tile) {
+            TEST_CHECK(Hash(edited.data(), row_bytes, row_bytes, rows) != original);
+        }
+    }
+
+    edited = tile;
+    std::rotate(edited.begin(), edited.begin() + 4, edited.end());
+    TEST_CHECK(Hash(edited.data(), row_bytes, row_bytes, rows) != original);
+    return true;
+}
+
+/*
+    Random updates of an image whose size is not a multiple of the tile
+    size, with changed rects that are partly no-ops, partly off the image,
+    and partly real edits.  Each update delivers the changed region minus
+    the unchanged tiles to a copy.
+
+    Known-tile invariant: A tile reported unchanged was delivered in full
+    before and its copy matches the image.  So the copy always matches the
+    image wherever it was delivered
+*/
+static bool TestDelivery()
+{
+    TestRandom rng(27);
+
+    for (unsigned round = 0; round < 4; ++round)
+    {
+        const unsigned width = 200 + rng.NextRange(600);
+        const unsigned height = 150 + rng.NextRange(400);
+        const CopyKernelPath path = kCopyKernelPaths[round];
+        if (!IsCopyKernelPathSupported(path)) {
+            continue;
+        }
+
+        DeliveryModel model;
+        model.Reset(width, height, rng);
+
+        TileHashTable table;
+        table.Reset(width, height);
+        TEST_CHECK(table.GetWidth() == width && table.GetHeight() == height);
+
+        Region changed, unchanged, delivered;
+        std::vector<RegionRect> rects;
+        uint64_t reported = 0;
+
+        for (unsigned update = 0; update < 500; ++update)
+        {
+            rects.clear();
+            const unsigned rect_count = 1 + rng.NextRange(4);
+            for (unsigned i = 0; i < rect_count; ++i)
+            {
+                // Whole tiles, as a repainted window often is, or any rect
+                if (rng.NextRange(3) == 0) {
+                    const unsigned tx = rng.NextRange((width + kTileHashSize - 1) / kTileHashSize);
+                    const unsigned ty = rng.NextRange((height + kTileHashSize - 1) / kTileHashSize);
+                    rects.push_back(TileRect(tx, ty, width, height));
+                }
+                else {
+                    rects.push_back(RandomRect(rng, width, height, 300));
+                }
+            }
+            changed.Set(rects.data(), static_cast<unsigned>(rects.size()));
+
+            // Edit a few pixels inside the changed region only
+            for (const RegionRect& rect : rects)
+            {
+                if (rng.NextRange(2) == 0) {
+                    continue;
+                }
+                const unsigned edits = 1 + rng.NextRange(5);
+                for (unsigned i = 0; i < edits; ++i) {
+                    const int x = rect.Left + static_cast<int>(rng.NextRange(rect.Width()));
+                    const int y = rect.Top + static_cast<int>(rng.NextRange(rect.Height()));
+                    if (x >= 0 && y >= 0 && x < (int)width && y < (int)height) {
+                        model.Image[static_cast<size_t>(y) * width + x] = rng.Next32();
+                    }
+                }
+            }
+
+            TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged, path));
+
+            // Unchanged tiles are whole tiles that the changed region touches
+            std::vector<RegionRect> unchanged_rects;
+            unchanged.GetRects(unchanged_rects);
+            for (const RegionRect& rect : unchanged_rects) {
+                TEST_CHECK(changed.Intersects(rect));
+                TEST_CHECK(model.IsKnown(rect));
+            }
+            for (unsigned ty = 0; ty * kTileHashSize < height; ++ty) {
+                for (unsigned tx = 0; tx * kTileHashSize < width; ++tx) {
+                    const RegionRect tile = TileRect(tx, ty, width, height);
+                    if (unchanged.Intersects(tile)) {
+                        ++reported;
+                        Region covered;
+                        covered.Set(tile);
+                        covered.Subtract(unchanged);
+                        TEST_CHECK(covered.Empty());
+                    }
+                }
+            }
+
+            delivered = changed;
+            delivered.Subtract(unchanged);
+            model.Deliver(delivered);
+
+            for (size_t i = 0; i < model.Image.size(); ++i) {
+                TEST_CHECK(!model.Delivered[i] || model.Copy[i] == model.Image[i]);
+            }
+        }
+
+        const TileHashStats& stats = table.GetStats();
+        TEST_CHECK(stats.Updates == 500);
+        TEST_CHECK(stats.TilesUnchanged == reported);
+        TEST_CHECK(stats.TilesUnchanged <= stats.TilesHashed);
+        TEST_CHECK(stats.SkippedBytes <= stats.ChangedBytes);
+
+        // Half the changed rects are no-ops, so some tiles must be skipped
+        TEST_CHECK(stats.TilesUnchanged > 0);
+    }
+    return true;
+}
+
+/*
+    A tile is only skipped after all of it was delivered, and Reset()
+    forgets every tile
+*/
+static bool TestKnownTiles()
+{
+    const unsigned width = 3 * kTileHashSize, height = 2 * kTileHashSize;
+
+    TestRandom rng(28);
+    DeliveryModel model;
+    model.Reset(width, height, rng);
+
+    TileHashTable table;
+    table.Reset(width, height);
+
+    const RegionRect tile = TileRect(1, 1, width, height);
+    const RegionRect top_half(tile.Left, tile.Top, tile.Right, tile.Top + kTileHashSize / 2);
+    const RegionRect bottom_half(tile.Left, top_half.Bottom, tile.Right, tile.Bottom);
+
+    Region changed, unchanged;
+
+    // Delivered in two halves: Each update covers only part of the tile,
+    // so it is never learned
+    changed.Set(top_half);
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+
+    changed.Set(bottom_half);
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+
+    // The whole tile is needed in one update to learn it
+    changed.Set(tile);
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.GetArea() == tile.Area());
+
+    // A partial repaint of a known tile with the same pixels is skipped
+    changed.Set(top_half);
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.GetArea() == tile.Area());
+
+    // An edit is not skipped, and the tile stays known afterwards
+    model.Image[(tile.Top + 1) * width + tile.Left + 1] ^= 1;
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.GetArea() == tile.Area());
+
+    // Off the image, empty, and after Reset()
+    changed.Set(RegionRect(-100, -100, -1, -1));
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+    changed.Clear();
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+
+    table.Reset(width, height);
+    changed.Set(tile);
+    TEST_CHECK(table.FindUnchanged(model.ImageData(), model.Pitch(), changed, unchanged));
+    TEST_CHECK(unchanged.Empty());
+    return true;
+}
+
+bool TestTileHash()
+{
+    return TestPathsMatch() &&
+        TestTilesMatchPlane() &&
+        TestSensitivity() &&
+        TestDelivery() &&
+        TestKnownTiles();
+}
+
+
+//------------------------------------------------------------------------------
+// Benchmarks
+
+/*
+    Hashing every tile of a 4K frame on each path, one band of tiles at a
+    time as FindUnchanged() does, against copying the frame, which is what
+    a skipped tile saves.  Hashing must cost less than the copy, or no
+    skipped tile can pay for it
+*/
+void BenchmarkTileHash()
+{
+    const unsigned width = 3840, height = 2160;
+    const unsigned pitch = width * kTileHashBytesPerPixel;
+    const uint64_t bytes = static_cast<uint64_t>(pitch) * height;
+
+    TestRandom rng(1);
+    std::vector<uint8_t> image(bytes), copy(bytes);
+    rng.Fill(image.data(), image.size());
+
+    const double copy_usec = MeasureUsecPerCall([&]() {
+        CopyPlane2D(copy.data(), pitch, image.data(), pitch, pitch, height);
+    });
+    Logger.Info("4K frame copy: ", copy_usec, " usec, ", GigabytesPerSecond(bytes, copy_usec), " GB/s");
+
+    std::vector<uint64_t> hashes((width + kTileHashSize - 1) / kTileHashSize);
+
+    for (CopyKernelPath path : kCopyKernelPaths)
+    {
+        if (!IsCopyKernelPathSupported(path)) {
+            continue;
+        }
+
+        uint64_t sum = 0;
+        const double usec = MeasureUsecPerCall([&]() {
+            for (unsigned y = 0; y < height; y += kTileHashSize) {
+                HashTiles2D(image.data() + static_cast<size_t>(y) * pitch,
+                    pitch, pitch, std::min(kTileHashSize, height - y),
+                    kTileHashSize * kTileHashBytesPerPixel, hashes.data(), path);
+                sum ^= hashes[0];
+            }
+        });
+        Logger.Info(CopyKernelPathToString(path), " 4K frame tile hash: ", usec, " usec, ",
+            GigabytesPerSecond(bytes, usec), " GB/s");
+
+        if (path == GetBestCopyKernelPath()) {
+            BENCH_CHECK(usec < copy_usec);
+        }
+    }
+}
+
+} // namespace core
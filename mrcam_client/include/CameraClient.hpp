@@ -3,7 +3,10 @@
 #pragma once
 
 #include "core.hpp"
-#include "core_win32.hpp"
+#include "core_ipc.hpp"
+#include "CameraFrameHeader.hpp"
+#include "CameraRecording.hpp"
+#include "CameraLatency.hpp"
 
 #include "implant_abi.hpp"
 #include "xrm_ui_abi.hpp"
@@ -14,7 +17,6 @@
 #include <memory>
 #include <mutex>
 #include <functional>
-#include <condition_variable>
 
 namespace core {
 
@@ -24,15 +26,40 @@ namespace core {
 
 struct CameraFrame
 {
+    // Host time (core::GetTimeUsec) when the sensor was exposed.
+    // Estimated as the receive time minus kCameraMinimumLatencyUsec
     uint64_t ExposureTimeUsec = 0;
     unsigned FrameNumber = 0;
 
-    uint8_t* Buffer = nullptr;
+    // Host time when the USB transfer completed
+    uint64_t ReceiveTimeUsec = 0;
+
+    // Points into shared memory until ReleaseFrame()
+    const uint8_t* Buffer = nullptr;
     unsigned BufferBytes = 0;
 
-    uint8_t* CameraImage = nullptr;
+    const uint8_t* CameraImage = nullptr;
     unsigned Width = 0;
     unsigned Height = 0;
+
+    // Stamped up to CameraLatencyStage::Acquire
+    CameraFrameStamps Stamps;
+};
+
+struct CameraClientStats
+{
+    // Frames returned by AcquireNextFrame()
+    uint64_t Acquired = 0;
+
+    // Frames published by the implant that were replaced by a newer one
+    // before this client acquired them
+    uint64_t Skipped = 0;
+
+    // Times the newest frame was replaced while it was being pinned
+    uint32_t AcquireRetries = 0;
+
+    // Frames the implant dropped because every slot was in use
+    uint32_t ImplantDropped = 0;
 };
 
 /// This class is thread-safe
@@ -43,16 +70,26 @@ public:
     void Stop();
 
     // Returns true if a new frame is ready.
-    // Returns false if prior frame is still active
+    // The frame is read in place from shared memory and the implant will not
+    // overwrite it until ReleaseFrame() is called.
+    // Returns false if no new frame has arrived
     bool AcquireNextFrame(CameraFrame& frame);
 
     // Release frame when done
     void ReleaseFrame();
 
+    // Counters since Start()
+    CameraClientStats GetStats();
+
     // Returns true if new UI state was received.
     // Returns false if no updates have occurred.
     bool ReadUiState(XrmUiData& data);
 
+    // Append every frame returned by AcquireNextFrame() to a recording file.
+    // Returns false if the file could not be created
+    bool StartRecording(const std::string& path);
+    void StopRecording();
+
     // Tell service to kick off USB hub power fix
     void ApplyUsbHubPowerFix()
     {
@@ -67,7 +104,7 @@ protected:
     SharedMemoryFile UiSharedFile;
     XrmUiSharedMemoryLayout* UiSharedMemoryLayout = nullptr;
 
-    AutoEvent FrameEvent;
+    IpcEvent FrameEvent;
 
     std::atomic<bool> Terminated = ATOMIC_VAR_INIT(false);
     std::shared_ptr<std::thread> Thread;
@@ -76,19 +113,21 @@ protected:
     //--------------------------------------------------------------------------
     // Camera
 
-    uint8_t CameraData[ImplantSharedMemoryLayout::kCameraBytes];
-
     std::mutex Lock;
-    std::condition_variable Condition;
 
-    bool FrameInUse = false;
-    CameraFrame LatestFrame;
-    unsigned LastAcquiredFrameNumber = 0;
+    // Slot pinned by AcquireNextFrame(), or nullptr
+    const ImplantCameraSlot* AcquiredSlot = nullptr;
+    uint32_t LastAcquiredFrameNumber = 0;
+
+    CameraClientStats Stats;
+
+
+    // Open while recording
+    CameraRecordingWriter Recorder;
 
 
     // Background thread
     void Loop();
-    void ReadFrame();
 
 
     //--------------------------------------------------------------------------
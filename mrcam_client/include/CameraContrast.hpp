@@ -0,0 +1,144 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Camera histograms and local contrast enhancement.
+
+    ComputeCameraHistogram() counts every pixel of a plane exactly.  The
+    histogram of each frame drives dark tracking frame rejection, where a
+    trimmed mean ignores the controller LEDs that stay bright in those frames.
+
+    CameraContrastEnhancer implements contrast limited adaptive histogram
+    equalization (CLAHE): The plane is split into a grid of tiles, each tile
+    gets a tone curve from its clipped and equalized histogram, and every
+    pixel blends the curves of its four nearest tile centers.  Clipping the
+    histogram limits how much noise is amplified, so dim rooms become
+    readable without flat areas turning into grain.
+
+    Tone curves are blended with integer weights, so every kernel path
+    produces identical output.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_parallel.hpp"
+#include "CameraKernels.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kCameraHistogramBins = 256;
+
+// Time allowed to enhance both eyes of one frame
+static const uint64_t kCameraContrastBudgetUsec = 1500;
+
+
+//------------------------------------------------------------------------------
+// CameraHistogram
+
+struct CameraHistogram
+{
+    uint32_t Bins[kCameraHistogramBins];
+    uint64_t PixelCount = 0;
+
+
+    CameraHistogram()
+    {
+        Clear();
+    }
+
+    void Clear();
+
+    /// Accumulate the counts of another histogram
+    void Add(const CameraHistogram& other);
+
+    /// Smallest pixel value that at least `percent` of the pixels are at or below
+    unsigned GetPercentile(unsigned percent) const;
+
+    /// Average pixel value in 1/16 steps, leaving out the brightest
+    /// trim_percent of the pixels
+    int GetTrimmedMean16(unsigned trim_percent) const;
+};
+
+/// Replace `histogram` with the counts of a width x height plane.
+/// Returns false if the path is not supported
+bool ComputeCameraHistogram(
+    const uint8_t* image,
+    unsigned pitch,
+    unsigned width,
+    unsigned height,
+    CameraHistogram& histogram,
+    CameraKernelPath path = CameraKernelPath::Auto);
+
+
+//------------------------------------------------------------------------------
+// CameraContrastParams
+
+struct CameraContrastParams
+{
+    // Tile grid, at most 64x64.  Tiles must be at least 8x8 pixels
+    unsigned TilesX = 8;
+    unsigned TilesY = 8;
+
+    // Histogram bins are clipped at this multiple of the average bin count.
+    // Lower values limit how much contrast and noise are added
+    float ClipLimit = 2.5f;
+
+    // Weight of the enhanced image in 1/16.  0 disables the effect
+    unsigned Strength = 16;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraContrastEnhancer
+
+class CameraContrastEnhancer : NoCopy
+{
+public:
+    void SetParams(const CameraContrastParams& params);
+
+    const CameraContrastParams& GetParams() const
+    {
+        return Params;
+    }
+
+    /// Enhance a width x height plane in place.
+    /// Tiles and row bands are spread across `pool` if it is given.
+    /// Returns false if the parameters or sizes are invalid
+    bool Process(
+        uint8_t* image,
+        unsigned pitch,
+        unsigned width,
+        unsigned height,
+        WorkerPool* pool = nullptr,
+        CameraKernelPath path = CameraKernelPath::Auto);
+
+protected:
+    CameraContrastParams Params;
+
+    // TilesX * TilesY tone curves of kCameraHistogramBins entries, row-major
+    std::vector<uint8_t> Curves;
+
+    // For each span between tile centers, the four surrounding curves
+    // interleaved: (TilesY + 1) * (TilesX + 1) * kCameraHistogramBins quads
+    std::vector<uint32_t> Quads;
+
+    // Per column: Quad offset of its span, and (128 - wx) | (wx << 16)
+    std::vector<uint16_t> ColumnOffsets;
+    std::vector<uint32_t> ColumnWeights;
+
+    // Size and tile count the columns were set up for
+    unsigned ColumnsWidth = 0;
+    unsigned ColumnsTilesX = 0;
+
+
+    void SetupColumns(unsigned width);
+};
+
+
+} // namespace core
@@ -0,0 +1,102 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Motion-adaptive temporal denoise for the headset camera planes.
+
+    Each eye keeps a history image.  For every pixel:
+
+        diff = input - history
+        weight = (|diff| > MotionThreshold) ? 16 : Strength
+        history += (diff * weight + 8) >> 4
+
+    and the new history is the output.  Static areas average over several
+    frames, while pixels that change by more than the threshold take the new
+    value immediately so motion does not smear.
+
+    All arithmetic is integer, so every kernel path produces identical output.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "CameraKernels.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kCameraDenoiseEyeCount = 2;
+
+// Time allowed to filter both eyes of one frame
+static const uint64_t kCameraDenoiseBudgetUsec = 1000;
+
+
+//------------------------------------------------------------------------------
+// CameraDenoiseParams
+
+struct CameraDenoiseParams
+{
+    // Weight of the new frame in static areas, in 1/16.
+    // 16 disables filtering, and lower values filter more
+    unsigned Strength = 6;
+
+    // Absolute pixel difference treated as motion
+    unsigned MotionThreshold = 12;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraTemporalDenoiser
+
+class CameraTemporalDenoiser : NoCopy
+{
+public:
+    ~CameraTemporalDenoiser();
+
+    void SetParams(const CameraDenoiseParams& params);
+
+    const CameraDenoiseParams& GetParams() const
+    {
+        return Params;
+    }
+
+    /// Filter one eye from input into output.  They may be the same
+    /// buffer, but must not otherwise overlap.
+    /// The first frame for an eye, or a change in size, resets its history.
+    /// Returns false on allocation failure
+    bool Process(
+        unsigned eye,
+        const uint8_t* input,
+        unsigned input_pitch,
+        uint8_t* output,
+        unsigned output_pitch,
+        unsigned width,
+        unsigned height,
+        CameraKernelPath path = CameraKernelPath::Auto);
+
+    /// Forget the history, for example after a gap in the camera stream
+    void Reset();
+
+protected:
+    CameraDenoiseParams Params;
+
+    struct EyeHistory
+    {
+        // 32-byte aligned rows of Pitch bytes
+        uint8_t* Image = nullptr;
+        unsigned Pitch = 0;
+        unsigned Width = 0;
+        unsigned Height = 0;
+        bool Valid = false;
+    };
+
+    EyeHistory Eyes[kCameraDenoiseEyeCount];
+
+
+    bool Allocate(EyeHistory& eye, unsigned width, unsigned height);
+};
+
+
+} // namespace core
@@ -0,0 +1,33 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Camera payload layout.
+
+    The headset sends each camera frame as a series of 0x6000 byte USB chunks.
+    Every chunk starts with a 32 byte tag block, and the first chunk also has
+    a header before the image, so the image starts at kCameraImageOffset:
+
+        [ tag | header ][ image ... ][ tag ][ image ... ][ tag ] ...
+        0     32        1312         0x6000              0xC000
+*/
+
+#pragma once
+
+#include "core.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kCameraChunkBytes = 0x6000;
+static const unsigned kCameraTagBytes = 32;
+static const unsigned kCameraImageOffset = 1312;
+
+// Time from the start of exposure to the USB transfer completing, measured
+// for the fastest frames
+static const uint64_t kCameraMinimumLatencyUsec = 15000;
+
+
+} // namespace core
@@ -0,0 +1,118 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Stand-ins for the camera service and implant.
+
+    CameraImplantHost creates the implant shared memory, UI shared memory and
+    frame event that CameraClient opens, and publishes frames into them as
+    the implant does.  CameraReplayServer uses it to play back recordings,
+    and CameraSyntheticServer to generate frames at any rate and size, so
+    the client side can be benchmarked and soak-tested without a headset.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_ipc.hpp"
+
+#include "implant_abi.hpp"
+#include "xrm_ui_abi.hpp"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CameraImplantHost
+
+class CameraImplantHost : NoCopy
+{
+public:
+    ~CameraImplantHost();
+
+    /// Create the shared memory and event.  Fails if the service is running
+    bool Create();
+    void Close();
+
+    /// Publish a frame and wake the client.
+    /// Returns false if every slot was in use and the frame was dropped
+    bool Publish(const uint8_t* payload, uint32_t bytes, uint64_t receive_usec);
+
+protected:
+    SharedMemoryFile ImplantSharedFile;
+    ImplantSharedMemoryLayout* ImplantSharedMemory = nullptr;
+
+    SharedMemoryFile UiSharedFile;
+
+    IpcEvent FrameEvent;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraSyntheticServer
+
+struct CameraSyntheticParams
+{
+    // Frames per second.  0 = as fast as possible
+    double RateHz = 30.;
+
+    // Bytes per transfer, at most kImplantCameraBytes.  CameraClient rejects
+    // transfers too short for a 640x480 stereo pair, which this can test
+    unsigned PayloadBytes = kImplantCameraBytes;
+
+    // Each frame is delayed by a random amount up to this, without
+    // affecting the schedule of later frames
+    unsigned JitterUsec = 0;
+};
+
+struct CameraSyntheticStats
+{
+    uint64_t Published = 0;
+
+    // Dropped by the implant ring because every slot was in use
+    uint64_t Dropped = 0;
+
+    // Time spent in the implant-side copy
+    uint64_t WriteUsecTotal = 0;
+    uint64_t WriteUsecMax = 0;
+};
+
+/**
+    Publishes generated frames laid out like headset transfers, so
+    CameraClient strips and splits them as it would live frames.  The image
+    is a moving gradient.
+*/
+class CameraSyntheticServer : NoCopy
+{
+public:
+    ~CameraSyntheticServer();
+
+    bool Start(const CameraSyntheticParams& params);
+    void Stop();
+
+    CameraSyntheticStats GetStats();
+
+protected:
+    CameraImplantHost Host;
+    CameraSyntheticParams Params;
+
+    // Pre-rendered payloads, cycled through so the image changes
+    std::vector<std::vector<uint8_t>> Payloads;
+
+    std::mutex StatsLock;
+    CameraSyntheticStats Stats;
+
+    std::atomic<bool> Terminated = ATOMIC_VAR_INIT(false);
+    std::shared_ptr<std::thread> Thread;
+
+
+    void Loop();
+};
+
+
+} // namespace core
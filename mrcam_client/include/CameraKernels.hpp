@@ -0,0 +1,71 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Image kernels for the headset camera frames.
+
+    Each kernel has a scalar reference and SIMD versions that produce
+    bit-identical output.  The fastest version the CPU supports is picked at
+    runtime, and a specific one can be requested for testing.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "CameraFrameHeader.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CameraKernelPath
+
+enum class CameraKernelPath
+{
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON
+};
+
+/// Returns the path that Auto resolves to on this CPU
+CameraKernelPath GetBestCameraKernelPath();
+
+/// Returns false if the path cannot run on this CPU
+bool IsCameraKernelPathSupported(CameraKernelPath path);
+
+const char* CameraKernelPathToString(CameraKernelPath path);
+
+
+//------------------------------------------------------------------------------
+// Tag Strip + Eye Split
+
+struct CameraEyePlanes
+{
+    uint8_t* Left = nullptr;
+    unsigned LeftPitch = 0;
+
+    uint8_t* Right = nullptr;
+    unsigned RightPitch = 0;
+};
+
+/**
+    Convert a raw camera transfer into two planar eye images in one pass.
+
+    The transfer holds rows of (eye_width * 2) pixels, left eye first,
+    starting at kCameraImageOffset and interrupted by a kCameraTagBytes tag
+    block at the start of every kCameraChunkBytes chunk.  The tags are
+    skipped, and each row half is written to its eye plane.  Every span is
+    a plain copy, so there is no per-path version.
+
+    Returns false if the transfer is too short for the requested image.
+*/
+bool StripTagsAndSplitEyes(
+    const uint8_t* transfer,
+    unsigned transfer_bytes,
+    unsigned eye_width,
+    unsigned height,
+    const CameraEyePlanes& planes);
+
+
+} // namespace core
@@ -0,0 +1,101 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Per-stage passthrough latency.
+
+    CameraFrameStamps travels with a camera frame from the implant ring to
+    the render that uses it, collecting a core::GetTimeUsec() stamp at each
+    CameraLatencyStage.  CameraLatencyTracker adds the finished stamps to
+    the per-interval histograms, logs them periodically, and publishes them
+    in the CAMERA_LATENCY_SHARED_MEMORY_NAME counter block.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_ipc.hpp"
+
+#include "camera_latency_abi.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Interval between latency log lines
+static const uint64_t kCameraLatencyLogIntervalMsec = 10000;
+
+
+//------------------------------------------------------------------------------
+// CameraFrameStamps
+
+struct CameraFrameStamps
+{
+    // core::GetTimeUsec() at each stage, or 0 if not reached yet
+    uint64_t Usec[kCameraLatencyStageCount];
+
+
+    CameraFrameStamps()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        memset(Usec, 0, sizeof(Usec));
+    }
+
+    void Set(CameraLatencyStage stage, uint64_t usec)
+    {
+        Usec[static_cast<unsigned>(stage)] = usec;
+    }
+
+    uint64_t Get(CameraLatencyStage stage) const
+    {
+        return Usec[static_cast<unsigned>(stage)];
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// CameraLatencyTracker
+
+/// Not thread-safe: Frames are added by the render thread
+class CameraLatencyTracker : NoCopy
+{
+public:
+    ~CameraLatencyTracker();
+
+    /// Create the shared counter block.  If this fails, the histograms are
+    /// still kept and logged
+    bool Start();
+    void Stop();
+
+    /// Add the stamps of a frame that reached CameraLatencyStage::Render
+    void AddFrame(const CameraFrameStamps& stamps);
+
+    /// Counters since Start()
+    const CameraLatencyCounters& GetCounters() const
+    {
+        return Counters;
+    }
+
+    /// Log the median and 99th percentile of each interval over the frames
+    /// added since the last log line, at most every kCameraLatencyLogIntervalMsec
+    void LogPeriodically();
+
+protected:
+    SharedMemoryFile SharedFile;
+    CameraLatencySharedMemoryLayout* SharedMemoryLayout = nullptr;
+
+    // Since Start()
+    CameraLatencyCounters Counters;
+
+    // Since the last log line
+    CameraLatencyCounters Window;
+    uint64_t LastLogMsec = 0;
+};
+
+
+} // namespace core
@@ -0,0 +1,217 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Camera frame recording and replay.
+
+    CameraRecordingWriter appends raw implant frames to a file, and
+    CameraReplayServer plays them back through the same shared memory and
+    frame event that the service and implant use.  This allows the client
+    side of the camera pipeline to run without a headset, for example to
+    reproduce passthrough stutter or to benchmark on a Linux box.
+
+    File format:
+
+        [ CameraRecordingFileHeader ]      kCameraRecordingHeaderBytes
+        [ chunk ][ chunk ] ...             kCameraRecordingChunkBytes each
+
+    Each chunk holds whole frame records, each 64-byte aligned:
+
+        [ CameraRecordingFrame ][ payload ... ][ padding ]
+
+    A record never crosses a chunk, so the writer and reader only ever need
+    one chunk mapped.  The unused tail of a chunk is zero, and a record with
+    a zero Magic means the reader should skip to the next chunk.  Readers
+    should prefer FrameCount in the header, but if the writer crashed before
+    updating it, the records are still found by scanning.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_mmap.hpp"
+#include "CameraImplantHost.hpp"
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const uint32_t kCameraRecordingMagic = 0x52434d58; // "XMCR"
+static const uint32_t kCameraRecordingFrameMagic = 0x4d415246; // "FRAM"
+static const uint32_t kCameraRecordingVersion = 1;
+
+static const uint32_t kCameraRecordingHeaderBytes = 64 * 1024;
+static const uint32_t kCameraRecordingChunkBytes = 64 * 1024 * 1024;
+static const uint32_t kCameraRecordingAlign = 64;
+
+
+//------------------------------------------------------------------------------
+// File Layout
+
+struct CameraRecordingFileHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t ChunkBytes;
+    uint32_t FrameCount;
+
+    // Bytes used in the file including this header
+    uint64_t FileBytes;
+};
+
+struct CameraRecordingFrame
+{
+    uint32_t Magic;
+    uint32_t PayloadBytes;
+
+    // Frame number published by the implant
+    uint32_t ImplantFrameNumber;
+
+    uint32_t Padding;
+
+    // Timestamps from the recording machine (core::GetTimeUsec)
+    uint64_t ExposureTimeUsec;
+    uint64_t ReceiveTimeUsec;
+
+    // When the client acquired the frame
+    uint64_t ArrivalTimeUsec;
+
+    uint8_t Reserved[24];
+};
+
+static_assert(sizeof(CameraRecordingFrame) == 64, "Update kCameraRecordingAlign");
+
+
+//------------------------------------------------------------------------------
+// CameraRecordingWriter
+
+class CameraRecordingWriter : NoCopy
+{
+public:
+    ~CameraRecordingWriter();
+
+    bool Open(const std::string& path);
+
+    /// Append one frame.  Returns false on error
+    bool Append(const CameraRecordingFrame& info, const uint8_t* payload);
+
+    /// Finish the header and trim the file
+    void Close();
+
+    bool IsOpen() const
+    {
+        return File.IsValid();
+    }
+
+    uint32_t GetFrameCount() const
+    {
+        return FrameCount;
+    }
+
+protected:
+    MappedFile File;
+    MappedView ChunkView;
+
+    // Chunk that ChunkView maps, and the next write offset in it
+    uint64_t ChunkOffset = 0;
+    uint32_t ChunkUsed = 0;
+
+    uint32_t FrameCount = 0;
+
+
+    bool WriteHeader(uint64_t file_bytes);
+    bool MapChunk(uint64_t offset);
+};
+
+
+//------------------------------------------------------------------------------
+// CameraRecordingReader
+
+class CameraRecordingReader : NoCopy
+{
+public:
+    bool Open(const std::string& path);
+    void Close();
+
+    /// Start reading from the first frame again
+    bool Rewind();
+
+    /// Read the next frame.  The payload pointer is valid until the next call.
+    /// Returns false at the end of the file
+    bool ReadNext(CameraRecordingFrame& info, const uint8_t*& payload);
+
+    uint32_t GetFrameCount() const
+    {
+        return FrameCount;
+    }
+
+protected:
+    MappedFile File;
+    MappedView ChunkView;
+
+    uint64_t FileBytes = 0;
+    uint32_t FrameCount = 0;
+
+    uint64_t ChunkOffset = 0;
+    uint32_t ChunkBytes = 0;
+    uint32_t ChunkUsed = 0;
+
+
+    bool MapChunk(uint64_t offset);
+};
+
+
+//------------------------------------------------------------------------------
+// CameraReplayServer
+
+/**
+    Stands in for the service and implant, publishing recorded frames
+    through a CameraImplantHost.
+
+    Frames are stamped with the replay machine's receive time, so the client
+    times them as it would live frames.
+*/
+class CameraReplayServer : NoCopy
+{
+public:
+    ~CameraReplayServer();
+
+    /// speed: 1 = original timing, 2 = twice as fast, 0 = as fast as possible.
+    /// loop: Start over at the end of the file instead of stopping
+    bool Start(const std::string& path, double speed, bool loop);
+    void Stop();
+
+    bool IsFinished() const
+    {
+        return Finished;
+    }
+
+    uint32_t GetFramesPublished() const
+    {
+        return FramesPublished;
+    }
+
+protected:
+    CameraRecordingReader Reader;
+    CameraImplantHost Host;
+
+    double Speed = 1.;
+    bool Loop = false;
+
+    std::atomic<bool> Terminated = ATOMIC_VAR_INIT(false);
+    std::atomic<bool> Finished = ATOMIC_VAR_INIT(false);
+    std::atomic<uint32_t> FramesPublished = ATOMIC_VAR_INIT(0);
+    std::shared_ptr<std::thread> Thread;
+
+
+    void ReplayLoop();
+};
+
+
+} // namespace core
@@ -0,0 +1,188 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Display-time-aligned camera frame scheduling.
+
+    The cameras run at 30 or 60 Hz and the headset at 90 Hz, so showing the
+    newest frame on every display frame makes the passthrough latency swing
+    by a camera period and the image judders as the two rates beat.
+
+    CameraFrameScheduler keeps a short queue of decoded frames.  For each
+    predicted display time it picks, among the queued frames and the one on
+    screen, the frame whose photon-to-display latency is closest to a target
+    latency.  The target follows the upper envelope of the newest frame's
+    latency: It rises quickly when frames arrive later, and falls slowly so
+    that a single early frame does not pull it down.
+
+    It also filters out the dark frames the headset interleaves for
+    controller tracking, which used to be done by CameraImager.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "CameraLatency.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Frames waiting to be shown, not counting the one on screen
+static const unsigned kCameraScheduleDepth = 3;
+
+// Default for CameraDarkFrameParams::MaxSkips
+static const unsigned kCameraScheduleMaxDarkSkips = 7;
+
+
+//------------------------------------------------------------------------------
+// CameraScheduledFrame
+
+struct CameraScheduledFrame
+{
+    // core::GetTimeUsec() when the sensor was exposed
+    uint64_t ExposureTimeUsec = 0;
+    uint32_t FrameNumber = 0;
+
+    // Stamped up to CameraLatencyStage::Process by the caller
+    CameraFrameStamps Stamps;
+
+    // Written by the caller between BeginPush() and CommitPush()
+    std::vector<uint8_t> Image;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraScheduleStats
+
+struct CameraScheduleStats
+{
+    // Frames committed to the queue
+    uint64_t Queued = 0;
+
+    // Frames returned by Select()
+    uint64_t Shown = 0;
+
+    // Queued frames that were skipped over or pushed out of a full queue
+    uint64_t Dropped = 0;
+
+    // Shown more than a display period after the target latency
+    uint64_t Late = 0;
+
+    // Rejected as controller tracking frames
+    uint64_t Dark = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraDarkFrameParams
+
+struct CameraDarkFrameParams
+{
+    // Frames darker than this percentage of the last accepted frame are
+    // tracking frames
+    unsigned DarkPercent = 25;
+
+    // ...unless this many in a row were rejected (the room went dark)
+    unsigned MaxSkips = kCameraScheduleMaxDarkSkips;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraFrameScheduler
+
+class CameraFrameScheduler : NoCopy
+{
+public:
+    CameraFrameScheduler();
+
+    void SetDarkFrameParams(const CameraDarkFrameParams& params)
+    {
+        DarkParams = params;
+    }
+
+    const CameraDarkFrameParams& GetDarkFrameParams() const
+    {
+        return DarkParams;
+    }
+
+    /// Returns false if the frame looks like a tracking frame and should not
+    /// be queued.  bright_avg is the average pixel value in any fixed units
+    bool AcceptBrightness(int bright_avg);
+
+    /// Buffer of `bytes` for the next frame.  The buffer is only queued by
+    /// CommitPush(), so a frame can be abandoned by not calling it, and the
+    /// queue is left as it was
+    uint8_t* BeginPush(unsigned bytes);
+
+    /// Queue the frame filled since BeginPush().  If the queue is full, the
+    /// oldest queued frame is dropped to make room
+    void CommitPush(
+        uint64_t exposure_usec,
+        uint32_t frame_number,
+        const CameraFrameStamps& stamps = CameraFrameStamps());
+
+    /**
+        Pick the frame to show at display_usec (core::GetTimeUsec units).
+        display_period_usec is the headset frame period.
+
+        Returns the frame to upload, or nullptr to keep showing the current
+        one.  The frame stays valid until the next call to BeginPush().
+
+        If display_usec is 0, the newest frame is returned, as before.
+    */
+    const CameraScheduledFrame* Select(uint64_t display_usec, uint64_t display_period_usec);
+
+    /// Forget all frames, for example after a gap in the camera stream
+    void Reset();
+
+    uint64_t GetTargetLatencyUsec() const
+    {
+        return TargetLatencyUsec;
+    }
+
+    const CameraScheduleStats& GetStats() const
+    {
+        return Stats;
+    }
+
+protected:
+    // One extra slot for the frame on screen, and one for BeginPush()
+    static const unsigned kSlotCount = kCameraScheduleDepth + 2;
+
+    CameraScheduledFrame Slots[kSlotCount];
+
+    // Queued slot indices, oldest first
+    unsigned Queue[kCameraScheduleDepth];
+    unsigned QueueCount = 0;
+
+    // Slot on screen, or -1
+    int ShownSlot = -1;
+
+    // Slot being filled between BeginPush() and CommitPush(), or -1
+    int PushSlot = -1;
+
+    // Adaptive photon-to-display latency we aim for, or 0 before the first frame
+    uint64_t TargetLatencyUsec = 0;
+
+    // Newest frame that TargetLatencyUsec has learned from
+    uint32_t TargetFrameNumber = 0;
+    bool HasTargetFrame = false;
+
+    CameraDarkFrameParams DarkParams;
+    int LastAcceptedBright = 0;
+    unsigned DarkSkipped = 0;
+
+    CameraScheduleStats Stats;
+
+
+    int FindFreeSlot() const;
+    void RemoveQueuedFront(unsigned count);
+    void DropQueuedFront(unsigned count);
+};
+
+
+} // namespace core
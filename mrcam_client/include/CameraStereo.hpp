@@ -0,0 +1,132 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Coarse stereo depth from the passthrough camera pair.
+
+    Both eye planes are box-downsampled by 2, split into square blocks, and
+    each left block is matched against the right plane along the same rows
+    by sum of absolute differences.  The best disparity is refined to
+    sub-pixel by fitting a parabola through its neighbors, and rejected if
+    the block has no texture or a different disparity matches almost as well.
+
+    The cameras are not rectified: They are canted and have lens distortion.
+    Undistort the planes with CameraRemapLut first for better results, and
+    set DisparityOffset to the disparity measured for a distant scene so the
+    cant does not bias the depth.
+
+    SAD is integer, so every kernel path finds the same disparities.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "core_parallel.hpp"
+#include "CameraKernels.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Time allowed to match one frame
+static const uint64_t kCameraStereoBudgetUsec = 2000;
+
+
+//------------------------------------------------------------------------------
+// CameraStereoParams
+
+struct CameraStereoParams
+{
+    // Block edge in downsampled pixels.  Must be 8
+    unsigned BlockSize = 8;
+
+    // Largest disparity searched, in downsampled pixels
+    unsigned MaxDisparity = 48;
+
+    // Sum of horizontal gradients a block needs to be matched
+    unsigned MinTexture = 200;
+
+    // The best SAD must be below this percentage of the best SAD at least
+    // two disparities away, or the block is ambiguous
+    unsigned UniquenessPercent = 90;
+
+    // Disparity of a distant scene, in downsampled pixels
+    float DisparityOffset = 0.f;
+
+    // Distance between the cameras and their focal length at full
+    // resolution.  Approximate until calibrated per headset
+    float BaselineMeters = 0.1f;
+    float FocalLengthPixels = 320.f;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraDepthGrid
+
+struct CameraDepthGrid
+{
+    unsigned Width = 0;
+    unsigned Height = 0;
+
+    // Width * Height blocks, row-major.  Disparity is in downsampled pixels,
+    // and both are 0 for blocks that could not be matched
+    std::vector<float> Disparity;
+    std::vector<float> DepthMeters;
+
+    unsigned ValidCount = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraStereoMatcher
+
+class CameraStereoMatcher : NoCopy
+{
+public:
+    void SetParams(const CameraStereoParams& params)
+    {
+        Params = params;
+    }
+
+    const CameraStereoParams& GetParams() const
+    {
+        return Params;
+    }
+
+    /// Estimate a depth grid from a full-resolution eye pair.
+    /// Block rows are spread across `pool` if it is given.
+    /// Returns false if the parameters or sizes are invalid
+    bool Process(
+        const uint8_t* left,
+        unsigned left_pitch,
+        const uint8_t* right,
+        unsigned right_pitch,
+        unsigned width,
+        unsigned height,
+        WorkerPool* pool = nullptr,
+        CameraKernelPath path = CameraKernelPath::Auto);
+
+    const CameraDepthGrid& GetDepthGrid() const
+    {
+        return Grid;
+    }
+
+    /// Median depth of the matched blocks, suitable for the passthrough
+    /// projection distance.  Returns 0 if too few blocks matched
+    float EstimateSceneDistance() const;
+
+protected:
+    CameraStereoParams Params;
+    CameraDepthGrid Grid;
+
+    // Downsampled planes, with padding for the SIMD reads
+    std::vector<uint8_t> Left, Right;
+    unsigned PlaneWidth = 0;
+    unsigned PlaneHeight = 0;
+};
+
+
+} // namespace core
@@ -0,0 +1,128 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    CPU lens undistortion for the headset camera planes.
+
+    This is the same radial model as the GPU mesh in CameraRenderer: a source
+    point p at radius r from the image center is drawn at
+
+        p / (1 + K1 * r^2 + K2 * r^4)
+
+    with coordinates normalized to the image height.  CameraRemapLut inverts
+    that mapping once per output pixel and stores where to sample the source,
+    so applying it is a table lookup plus a bilinear blend.
+
+    LUT entries are 32 bits:
+
+        bits  0..21: Byte offset of the top-left source pixel
+        bits 22..26: Horizontal blend weight of the right pixel, in 1/32
+        bits 27..31: Vertical blend weight of the bottom pixel, in 1/32
+
+    All arithmetic is integer, so every kernel path produces identical output.
+*/
+
+#pragma once
+
+#include "core.hpp"
+#include "CameraKernels.hpp"
+
+#include <vector>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kCameraRemapFracBits = 5;
+static const unsigned kCameraRemapFracOne = 1u << kCameraRemapFracBits;
+
+// LUT entry for output pixels that have no source pixel
+static const uint32_t kCameraRemapInvalid = 0xffffffff;
+
+// Source planes must be readable this many bytes past the last pixel.
+// The AVX2 path loads 4 bytes where it needs 2
+static const unsigned kCameraRemapSourcePadding = 4;
+
+
+//------------------------------------------------------------------------------
+// CameraUndistortParams
+
+struct CameraUndistortParams
+{
+    // Radial distortion from HeadsetCameraCalibration
+    float K1 = -0.65f;
+    float K2 = 0.f;
+
+    // Eye plane to sample
+    unsigned SourceWidth = 640;
+    unsigned SourceHeight = 480;
+    unsigned SourcePitch = 640;
+
+    // Rectified image to produce
+    unsigned OutputWidth = 640;
+    unsigned OutputHeight = 480;
+
+    // 1 = the left and right edge midpoints of the source land on the left
+    // and right edges of the output.  Larger values crop into the center
+    float OutputZoom = 1.f;
+
+    // Value written where the output has no source pixel
+    uint8_t BorderValue = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// CameraRemapLut
+
+class CameraRemapLut
+{
+public:
+    /// Returns false if the parameters are invalid or the source is too large
+    bool Build(const CameraUndistortParams& params);
+
+    bool IsValid() const
+    {
+        return !Entries.empty();
+    }
+
+    const CameraUndistortParams& GetParams() const
+    {
+        return Params;
+    }
+
+    /// Undistort the output rectangle [x, x + w) x [y, y + h).
+    /// Tiles do not overlap, so different tiles can run on different threads
+    void ApplyTile(
+        const uint8_t* source,
+        uint8_t* output,
+        unsigned output_pitch,
+        unsigned x,
+        unsigned y,
+        unsigned w,
+        unsigned h,
+        CameraKernelPath path = CameraKernelPath::Auto) const;
+
+    /// Undistort the whole output image
+    void Apply(
+        const uint8_t* source,
+        uint8_t* output,
+        unsigned output_pitch,
+        CameraKernelPath path = CameraKernelPath::Auto) const
+    {
+        ApplyTile(source, output, output_pitch, 0, 0, Params.OutputWidth, Params.OutputHeight, path);
+    }
+
+    /// Source position for an output pixel in source pixels, for tests.
+    /// Returns false if the output pixel has no source pixel
+    bool GetSourcePosition(unsigned x, unsigned y, float& source_x, float& source_y) const;
+
+protected:
+    CameraUndistortParams Params;
+
+    // OutputWidth * OutputHeight entries
+    std::vector<uint32_t> Entries;
+};
+
+
+} // namespace core
@@ -16,15 +16,14 @@ bool CameraClient::Start()
 {
     Terminated = true;
 
-    FrameEvent = ::OpenEventA(SYNCHRONIZE, FALSE, CAMERA_IMPLANT_FRAME_EVENT_NAME);
-    if (FrameEvent.Invalid()) {
-        Logger.Error("OpenEventA failed: ", WindowsErrorString(::GetLastError()));
+    if (!FrameEvent.Open(CAMERA_IMPLANT_FRAME_EVENT_NAME)) {
+        Logger.Error("FrameEvent.Open failed: ", LastIpcErrorString());
         Logger.Error("Camera Service is not running.");
         return false;
     }
 
     if (!UiSharedFile.Open(kXrmUiSharedMemoryBytes, XRM_UI_SHARED_MEMORY_NAME)) {
-        Logger.Error("UiSharedFile.Open failed: ", WindowsErrorString(::GetLastError()));
+        Logger.Error("UiSharedFile.Open failed: ", LastIpcErrorString());
         return false;
     }
     UiSharedMemoryLayout = reinterpret_cast<XrmUiSharedMemoryLayout*>(UiSharedFile.GetFront());
@@ -32,13 +31,19 @@ bool CameraClient::Start()
     LastUiEpoch = 0x7fffff;
 
     if (!SharedFile.Open(kImplantSharedMemoryBytes, CAMERA_IMPLANT_SHARED_MEMORY_NAME)) {
-        Logger.Error("SharedFile.Open failed: ", WindowsErrorString(::GetLastError()));
+        Logger.Error("SharedFile.Open failed: ", LastIpcErrorString());
         return false;
     }
     SharedMemoryLayout = reinterpret_cast<ImplantSharedMemoryLayout*>( SharedFile.GetFront() );
 
     SharedMemoryLayout->EnableServiceHook = 1;
 
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Stats = CameraClientStats();
+        LastAcquiredFrameNumber = 0;
+    }
+
     Terminated = false;
     Thread = std::make_shared<std::thread>(&CameraClient::Loop, this);
 
@@ -47,14 +52,13 @@ bool CameraClient::Start()
 
 void CameraClient::Stop()
 {
-    {
-        std::unique_lock<std::mutex> locker(Lock);
-        Condition.notify_all();
-    }
-
     Terminated = true;
     JoinThread(Thread);
 
+    StopRecording();
+
+    ReleaseFrame();
+
     if (SharedMemoryLayout) {
         SharedMemoryLayout->EnableServiceHook = 0;
     }
@@ -64,21 +68,115 @@ bool CameraClient::AcquireNextFrame(CameraFrame& frame)
 {
     std::lock_guard<std::mutex> locker(Lock);
 
-    if (LatestFrame.FrameNumber == LastAcquiredFrameNumber) {
+    if (!SharedMemoryLayout) {
         return false;
     }
-    LastAcquiredFrameNumber = LatestFrame.FrameNumber;
 
-    FrameInUse = true;
-    frame = LatestFrame;
+    // Do not leak a pin if the caller forgot to release the prior frame
+    if (AcquiredSlot) {
+        SharedMemoryLayout->ReleaseCamera(AcquiredSlot);
+        AcquiredSlot = nullptr;
+    }
+
+    uint32_t frame_number = 0;
+    const ImplantCameraSlot* slot = SharedMemoryLayout->AcquireCamera(
+        LastAcquiredFrameNumber,
+        frame_number,
+        &Stats.AcquireRetries);
+    if (!slot) {
+        return false;
+    }
+    if (LastAcquiredFrameNumber != 0 && frame_number > LastAcquiredFrameNumber + 1) {
+        Stats.Skipped += frame_number - LastAcquiredFrameNumber - 1;
+    }
+    LastAcquiredFrameNumber = frame_number;
+
+    const unsigned camera_width = 640;
+    const unsigned camera_height = 480;
+    const unsigned camera_bytes = camera_width * camera_height;
+    const unsigned pair_bytes = camera_bytes * 2;
+
+    const unsigned offset = kCameraImageOffset;
+
+    const unsigned read_bytes = slot->CameraBytes;
+    if (offset + pair_bytes > read_bytes) {
+        Logger.Error("Camera data is truncated");
+        SharedMemoryLayout->ReleaseCamera(slot);
+        return false;
+    }
+
+    AcquiredSlot = slot;
+    ++Stats.Acquired;
+
+    frame.FrameNumber = frame_number;
+    frame.Buffer = slot->CameraData;
+    frame.BufferBytes = read_bytes;
+    frame.CameraImage = slot->CameraData + offset;
+    frame.Width = camera_width * 2;
+    frame.Height = camera_height;
+    frame.ReceiveTimeUsec = slot->ReceiveTimeUsec;
+    frame.ExposureTimeUsec = slot->ReceiveTimeUsec - kCameraMinimumLatencyUsec;
+
+    frame.Stamps.Clear();
+    frame.Stamps.Set(CameraLatencyStage::Receive, slot->ReceiveTimeUsec);
+    frame.Stamps.Set(CameraLatencyStage::Publish, slot->PublishTimeUsec);
+    frame.Stamps.Set(CameraLatencyStage::Acquire, GetTimeUsec());
+
+    if (Recorder.IsOpen())
+    {
+        CameraRecordingFrame info{};
+        info.PayloadBytes = read_bytes;
+        info.ImplantFrameNumber = frame_number;
+        info.ExposureTimeUsec = frame.ExposureTimeUsec;
+        info.ReceiveTimeUsec = frame.ReceiveTimeUsec;
+        info.ArrivalTimeUsec = GetTimeUsec();
+
+        if (!Recorder.Append(info, slot->CameraData)) {
+            Logger.Error("Recording failed: Stopping");
+            Recorder.Close();
+        }
+    }
+
+    return true;
+}
+
+bool CameraClient::StartRecording(const std::string& path)
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    if (!Recorder.Open(path)) {
+        return false;
+    }
+    Logger.Info("Recording camera frames to ", path);
     return true;
 }
 
+void CameraClient::StopRecording()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    Recorder.Close();
+}
+
 void CameraClient::ReleaseFrame()
 {
-    std::unique_lock<std::mutex> locker(Lock);
-    FrameInUse = false;
-    Condition.notify_all();
+    std::lock_guard<std::mutex> locker(Lock);
+
+    if (AcquiredSlot) {
+        SharedMemoryLayout->ReleaseCamera(AcquiredSlot);
+        AcquiredSlot = nullptr;
+    }
+}
+
+CameraClientStats CameraClient::GetStats()
+{
+    std::lock_guard<std::mutex> locker(Lock);
+
+    CameraClientStats stats = Stats;
+    if (SharedMemoryLayout) {
+        stats.ImplantDropped = SharedMemoryLayout->CameraDropped;
+    }
+    return stats;
 }
 
 bool CameraClient::ReadUiState(XrmUiData& data)
@@ -111,13 +209,15 @@ void CameraClient::Loop()
 {
     SetCurrentThreadName("CameraClient");
 
+    // Frames are read in place by AcquireNextFrame(), so this thread only
+    // reports implant status when frames stop arriving.
     while (!Terminated)
     {
-        DWORD result = ::WaitForSingleObject(FrameEvent.Get(), 200);
-        if (result == WAIT_OBJECT_0) {
-            ReadFrame();
+        const IpcWaitResult result = FrameEvent.Wait(200);
+        if (result == IpcWaitResult::Signaled) {
+            continue;
         }
-        else if (result == WAIT_TIMEOUT) {
+        else if (result == IpcWaitResult::Timeout) {
             if (SharedMemoryLayout->ImplantInstalled) {
                 Logger.Info("Implant: Installed");
             }
@@ -126,58 +226,10 @@ void CameraClient::Loop()
             }
         }
         else {
-            Logger.Error("WaitForSingleObject failed: ", WindowsErrorString(::GetLastError()));
+            Logger.Error("FrameEvent.Wait failed: ", LastIpcErrorString());
         }
     }
 }
 
-void CameraClient::ReadFrame()
-{
-    // unique_lock used since QueueCondition.wait requires it
-    std::unique_lock<std::mutex> locker(Lock);
-
-    if (Terminated) {
-        return;
-    }
-
-    while (FrameInUse)
-    {
-        Condition.wait(locker);
-        if (Terminated) {
-            return;
-        }
-    }
-
-    // FIXME: Check here if we are locked and wait here to be woken up
-
-    uint32_t read_bytes, read_counter;
-    uint64_t exposure_usec;
-    bool success = SharedMemoryLayout->ReadCamera(CameraData, read_bytes, exposure_usec, read_counter);
-    if (success) {
-        const unsigned camera_width = 640;
-        const unsigned camera_height = 480;
-        const unsigned camera_bytes = camera_width * camera_height;
-        const unsigned pair_bytes = camera_bytes * 2;
-
-        const unsigned offset = 1312;
-
-        if (offset + pair_bytes > read_bytes) {
-            Logger.Error("Camera data is truncated");
-            return;
-        }
-
-        LatestFrame.FrameNumber = read_counter;
-        LatestFrame.Buffer = CameraData;
-        LatestFrame.BufferBytes = read_bytes;
-        LatestFrame.CameraImage = CameraData + offset;
-        LatestFrame.Width = camera_width * 2;
-        LatestFrame.Height = camera_height;
-        LatestFrame.ExposureTimeUsec = exposure_usec;
-    }
-    else {
-        Logger.Error("Failed to read frame");
-    }
-}
-
 
 } // namespace core
@@ -0,0 +1,701 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraContrast.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h> // memcpy
+#include <algorithm>
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kMaxTiles = 64;
+static const unsigned kMinTileSize = 8;
+
+// Rows enhanced per parallel task
+static const unsigned kBandRows = 16;
+
+static const unsigned kWeightBits = 7;
+static const unsigned kWeightOne = 1 << kWeightBits;
+
+
+//------------------------------------------------------------------------------
+// Histogram Kernels
+
+/*
+    Incrementing one table stalls when neighboring pixels hit the same bin,
+    because each increment waits for the previous store.  Pixels are spread
+    over four tables by their position in a 32-bit word instead, and the
+    tables are summed at the end.  The SIMD versions load a vector at a time
+    and count it word by word.
+*/
+
+typedef void (*HistogramRowFn)(
+    const uint8_t* row,
+    unsigned count,
+    uint32_t* tables);
+
+static CORE_INLINE void CountWord(uint32_t word, uint32_t* tables)
+{
+    ++tables[word & 0xff];
+    ++tables[kCameraHistogramBins + ((word >> 8) & 0xff)];
+    ++tables[kCameraHistogramBins * 2 + ((word >> 16) & 0xff)];
+    ++tables[kCameraHistogramBins * 3 + (word >> 24)];
+}
+
+static void HistogramRow_Scalar(
+    const uint8_t* row,
+    unsigned count,
+    uint32_t* tables)
+{
+    unsigned i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, row + i, 4);
+        CountWord(word, tables);
+    }
+    for (; i < count; ++i) {
+        ++tables[row[i]];
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static CORE_INLINE void Count16_SSE2(__m128i v, uint32_t* tables)
+{
+    CountWord(static_cast<uint32_t>(_mm_cvtsi128_si32(v)), tables);
+    CountWord(static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(v, 4))), tables);
+    CountWord(static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(v, 8))), tables);
+    CountWord(static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(v, 12))), tables);
+}
+
+static void HistogramRow_SSE2(
+    const uint8_t* row,
+    unsigned count,
+    uint32_t* tables)
+{
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16) {
+        Count16_SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), tables);
+    }
+
+    HistogramRow_Scalar(row + i, count - i, tables);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void HistogramRow_NEON(
+    const uint8_t* row,
+    unsigned count,
+    uint32_t* tables)
+{
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(row + i));
+        CountWord(vgetq_lane_u32(v, 0), tables);
+        CountWord(vgetq_lane_u32(v, 1), tables);
+        CountWord(vgetq_lane_u32(v, 2), tables);
+        CountWord(vgetq_lane_u32(v, 3), tables);
+    }
+
+    HistogramRow_Scalar(row + i, count - i, tables);
+}
+
+#endif // CORE_CPU_ARM64
+
+
+//------------------------------------------------------------------------------
+// Blend Kernels
+
+/*
+    Each output pixel blends the tone curves of its four nearest tiles:
+
+        top = (top0 * (128 - wx) + top1 * wx + 64) >> 7
+        bottom = (bottom0 * (128 - wx) + bottom1 * wx + 64) >> 7
+        output = (top * (128 - wy) + bottom * wy + 64) >> 7
+
+    The four curves around each span between tile centers are interleaved
+    into one table of 32-bit quads, so a pixel needs a single lookup.
+    Column weights are stored as (128 - wx) | (wx << 16) to feed pmaddwd.
+*/
+
+typedef void (*BlendRowFn)(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets,
+    const uint32_t* column_weights,
+    unsigned row_weight,
+    uint8_t* output,
+    unsigned count);
+
+static CORE_INLINE unsigned Lerp7(unsigned a, unsigned b, unsigned weight)
+{
+    return (a * (kWeightOne - weight) + b * weight + kWeightOne / 2) >> kWeightBits;
+}
+
+static void BlendRow_Scalar(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets,
+    const uint32_t* column_weights,
+    unsigned row_weight,
+    uint8_t* output,
+    unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const uint32_t q = quads[column_offsets[i] + input[i]];
+        const unsigned wx = column_weights[i] >> 16;
+
+        const unsigned top = Lerp7(q & 0xff, (q >> 8) & 0xff, wx);
+        const unsigned bottom = Lerp7((q >> 16) & 0xff, q >> 24, wx);
+        output[i] = static_cast<uint8_t>(Lerp7(top, bottom, row_weight));
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+/*
+    Blend 4 pixels from their quads.  Each pixel's bytes are widened to
+    (top0, top1, bottom0, bottom1), pmaddwd with (128 - wx, wx) gives the raw
+    top and bottom, and a second pmaddwd with (128 - wy, wy) the output.
+    Returns 32-bit results.
+*/
+static CORE_INLINE __m128i Blend4_SSE2(__m128i q, __m128i w, __m128i row_weights)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(kWeightOne / 2);
+
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(q, zero), _mm_unpacklo_epi32(w, w));
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(q, zero), _mm_unpackhi_epi32(w, w));
+
+    const __m128i top_bottom = _mm_packs_epi32(
+        _mm_srli_epi32(_mm_add_epi32(lo, round), kWeightBits),
+        _mm_srli_epi32(_mm_add_epi32(hi, round), kWeightBits));
+
+    return _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(top_bottom, row_weights), round), kWeightBits);
+}
+
+static CORE_INLINE __m128i GatherQuads4(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets)
+{
+    return _mm_set_epi32(
+        (int)quads[column_offsets[3] + input[3]],
+        (int)quads[column_offsets[2] + input[2]],
+        (int)quads[column_offsets[1] + input[1]],
+        (int)quads[column_offsets[0] + input[0]]);
+}
+
+static void BlendRow_SSE2(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets,
+    const uint32_t* column_weights,
+    unsigned row_weight,
+    uint8_t* output,
+    unsigned count)
+{
+    const __m128i row_weights = _mm_set1_epi32((int)((kWeightOne - row_weight) | (row_weight << 16)));
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i a = Blend4_SSE2(
+            GatherQuads4(input + i, quads, column_offsets + i),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(column_weights + i)),
+            row_weights);
+        const __m128i b = Blend4_SSE2(
+            GatherQuads4(input + i + 4, quads, column_offsets + i + 4),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(column_weights + i + 4)),
+            row_weights);
+
+        const __m128i y = _mm_packs_epi32(a, b);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(y, y));
+    }
+
+    BlendRow_Scalar(input + i, quads, column_offsets + i, column_weights + i,
+        row_weight, output + i, count - i);
+}
+
+CORE_TARGET_AVX2 static void BlendRow_AVX2(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets,
+    const uint32_t* column_weights,
+    unsigned row_weight,
+    uint8_t* output,
+    unsigned count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(kWeightOne / 2);
+    const __m256i row_weights = _mm256_set1_epi32((int)((kWeightOne - row_weight) | (row_weight << 16)));
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i index = _mm256_add_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i))),
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column_offsets + i))));
+        const __m256i q = _mm256_i32gather_epi32(reinterpret_cast<const int*>(quads), index, 4);
+        const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column_weights + i));
+
+        // Same as Blend4_SSE2, on pixels 0..3 in the low lane and 4..7 in the high
+        const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(q, zero), _mm256_unpacklo_epi32(w, w));
+        const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(q, zero), _mm256_unpackhi_epi32(w, w));
+
+        const __m256i top_bottom = _mm256_packs_epi32(
+            _mm256_srli_epi32(_mm256_add_epi32(lo, round), kWeightBits),
+            _mm256_srli_epi32(_mm256_add_epi32(hi, round), kWeightBits));
+
+        const __m256i y = _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(top_bottom, row_weights), round), kWeightBits);
+
+        const __m128i y16 = _mm_packs_epi32(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(y16, y16));
+    }
+
+    BlendRow_SSE2(input + i, quads, column_offsets + i, column_weights + i,
+        row_weight, output + i, count - i);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static CORE_INLINE uint16x8_t Lerp8_NEON(uint16x8_t a, uint16x8_t b, uint16x8_t inv_weight, uint16x8_t weight)
+{
+    // vrshrq rounds by adding 64 before the shift
+    return vrshrq_n_u16(vmlaq_u16(vmulq_u16(a, inv_weight), b, weight), kWeightBits);
+}
+
+static void BlendRow_NEON(
+    const uint8_t* input,
+    const uint32_t* quads,
+    const uint16_t* column_offsets,
+    const uint32_t* column_weights,
+    unsigned row_weight,
+    uint8_t* output,
+    unsigned count)
+{
+    const uint16x8_t wy = vdupq_n_u16((uint16_t)row_weight);
+    const uint16x8_t inv_wy = vdupq_n_u16((uint16_t)(kWeightOne - row_weight));
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint32_t q[8];
+        for (unsigned j = 0; j < 8; ++j) {
+            q[j] = quads[column_offsets[i + j] + input[i + j]];
+        }
+
+        // Deinterleave into top0, top1, bottom0, bottom1 and (128 - wx), wx
+        const uint8x8x4_t c = vld4_u8(reinterpret_cast<const uint8_t*>(q));
+        const uint16x8x2_t w = vld2q_u16(reinterpret_cast<const uint16_t*>(column_weights + i));
+
+        const uint16x8_t top = Lerp8_NEON(vmovl_u8(c.val[0]), vmovl_u8(c.val[1]), w.val[0], w.val[1]);
+        const uint16x8_t bottom = Lerp8_NEON(vmovl_u8(c.val[2]), vmovl_u8(c.val[3]), w.val[0], w.val[1]);
+
+        vst1_u8(output + i, vmovn_u16(Lerp8_NEON(top, bottom, inv_wy, wy)));
+    }
+
+    BlendRow_Scalar(input + i, quads, column_offsets + i, column_weights + i,
+        row_weight, output + i, count - i);
+}
+
+#endif // CORE_CPU_ARM64
+
+struct ContrastKernels
+{
+    HistogramRowFn HistogramRow = nullptr;
+    BlendRowFn BlendRow = nullptr;
+};
+
+static bool SelectContrastKernels(CameraKernelPath path, ContrastKernels& kernels)
+{
+    if (path == CameraKernelPath::Auto) {
+        path = GetBestCameraKernelPath();
+    }
+    if (!IsCameraKernelPathSupported(path)) {
+        return false;
+    }
+
+    kernels.HistogramRow = HistogramRow_Scalar;
+    kernels.BlendRow = BlendRow_Scalar;
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CameraKernelPath::SSE2:
+        kernels.HistogramRow = HistogramRow_SSE2;
+        kernels.BlendRow = BlendRow_SSE2;
+        break;
+    case CameraKernelPath::AVX2:
+        // Counting is bound by the table increments, so SSE2 is as fast
+        kernels.HistogramRow = HistogramRow_SSE2;
+        kernels.BlendRow = BlendRow_AVX2;
+        break;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CameraKernelPath::NEON:
+        kernels.HistogramRow = HistogramRow_NEON;
+        kernels.BlendRow = BlendRow_NEON;
+        break;
+#endif
+    default:
+        break;
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraHistogram
+
+void CameraHistogram::Clear()
+{
+    memset(Bins, 0, sizeof(Bins));
+    PixelCount = 0;
+}
+
+void CameraHistogram::Add(const CameraHistogram& other)
+{
+    for (unsigned i = 0; i < kCameraHistogramBins; ++i) {
+        Bins[i] += other.Bins[i];
+    }
+    PixelCount += other.PixelCount;
+}
+
+unsigned CameraHistogram::GetPercentile(unsigned percent) const
+{
+    const uint64_t target = (PixelCount * percent + 99) / 100;
+
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < kCameraHistogramBins; ++i)
+    {
+        sum += Bins[i];
+        if (sum >= target) {
+            return i;
+        }
+    }
+    return kCameraHistogramBins - 1;
+}
+
+int CameraHistogram::GetTrimmedMean16(unsigned trim_percent) const
+{
+    if (trim_percent > 100) {
+        trim_percent = 100;
+    }
+    const uint64_t keep = PixelCount - PixelCount * trim_percent / 100;
+    if (keep == 0) {
+        return 0;
+    }
+
+    // Take the darkest `keep` pixels
+    uint64_t remaining = keep;
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < kCameraHistogramBins && remaining > 0; ++i)
+    {
+        const uint64_t count = Bins[i] < remaining ? Bins[i] : remaining;
+        sum += count * i;
+        remaining -= count;
+    }
+
+    return static_cast<int>(sum * 16 / keep);
+}
+
+static void MergeTables(const uint32_t* tables, uint32_t* bins)
+{
+    for (unsigned i = 0; i < kCameraHistogramBins; ++i)
+    {
+        bins[i] =
+            tables[i] +
+            tables[kCameraHistogramBins + i] +
+            tables[kCameraHistogramBins * 2 + i] +
+            tables[kCameraHistogramBins * 3 + i];
+    }
+}
+
+bool ComputeCameraHistogram(
+    const uint8_t* image,
+    unsigned pitch,
+    unsigned width,
+    unsigned height,
+    CameraHistogram& histogram,
+    CameraKernelPath path)
+{
+    ContrastKernels kernels;
+    if (!SelectContrastKernels(path, kernels)) {
+        return false;
+    }
+
+    uint32_t tables[kCameraHistogramBins * 4] = {};
+    for (unsigned y = 0; y < height; ++y) {
+        kernels.HistogramRow(image + (size_t)y * pitch, width, tables);
+    }
+
+    MergeTables(tables, histogram.Bins);
+    histogram.PixelCount = (uint64_t)width * height;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tone Curves
+
+static void BuildToneCurve(
+    uint32_t* bins,
+    unsigned pixel_count,
+    float clip_limit,
+    unsigned strength,
+    uint8_t* curve)
+{
+    uint32_t clip = static_cast<uint32_t>(clip_limit * pixel_count / kCameraHistogramBins);
+    if (clip < 1) {
+        clip = 1;
+    }
+
+    uint32_t excess = 0;
+    for (unsigned i = 0; i < kCameraHistogramBins; ++i) {
+        if (bins[i] > clip) {
+            excess += bins[i] - clip;
+            bins[i] = clip;
+        }
+    }
+
+    // Spread the clipped counts evenly over all bins
+    const uint32_t spread = excess / kCameraHistogramBins;
+    const uint32_t leftover = excess % kCameraHistogramBins;
+
+    // 255 / pixel_count in 24-bit fixed point, to avoid a division per bin
+    const uint64_t scale = ((uint64_t)255 << 24) / pixel_count;
+
+    uint64_t cdf = 0;
+    for (unsigned i = 0; i < kCameraHistogramBins; ++i)
+    {
+        cdf += bins[i] + spread + (i < leftover ? 1 : 0);
+
+        const unsigned equalized = static_cast<unsigned>((cdf * scale + (1 << 23)) >> 24);
+        curve[i] = static_cast<uint8_t>((i * (16 - strength) + equalized * strength + 8) >> 4);
+    }
+}
+
+/*
+    Positions between two tile centers form a span, with the half tiles at
+    each edge as spans of their own:  Span 0 uses only the first tile, span
+    k blends tiles k - 1 and k, and span `tiles` uses only the last tile.
+*/
+
+static void GetSpanTiles(unsigned span, unsigned tiles, unsigned& tile0, unsigned& tile1)
+{
+    tile0 = span > 0 ? span - 1 : 0;
+    tile1 = span < tiles ? span : tiles - 1;
+}
+
+/// Find the span around position i, and the weight of its second tile
+static void GetTileSpan(
+    unsigned i,
+    float tile_size,
+    unsigned tiles,
+    unsigned& span,
+    unsigned& weight)
+{
+    const float f = (i + 0.5f) / tile_size - 0.5f;
+    if (f <= 0.f) {
+        span = 0;
+        weight = 0;
+        return;
+    }
+
+    const unsigned tile0 = static_cast<unsigned>(f);
+    if (tile0 >= tiles - 1) {
+        span = tiles;
+        weight = 0;
+        return;
+    }
+
+    span = tile0 + 1;
+    weight = static_cast<unsigned>((f - tile0) * kWeightOne + 0.5f);
+}
+
+
+//------------------------------------------------------------------------------
+// CameraContrastEnhancer
+
+void CameraContrastEnhancer::SetParams(const CameraContrastParams& params)
+{
+    Params = params;
+    if (Params.ClipLimit < 1.f) {
+        Params.ClipLimit = 1.f;
+    }
+    if (Params.Strength > 16) {
+        Params.Strength = 16;
+    }
+}
+
+void CameraContrastEnhancer::SetupColumns(unsigned width)
+{
+    if (ColumnsWidth == width && ColumnsTilesX == Params.TilesX) {
+        return;
+    }
+    ColumnsWidth = width;
+    ColumnsTilesX = Params.TilesX;
+
+    ColumnOffsets.resize(width);
+    ColumnWeights.resize(width);
+
+    const float tile_width = width / static_cast<float>(Params.TilesX);
+    for (unsigned x = 0; x < width; ++x)
+    {
+        unsigned span, weight;
+        GetTileSpan(x, tile_width, Params.TilesX, span, weight);
+
+        ColumnOffsets[x] = static_cast<uint16_t>(span * kCameraHistogramBins);
+        ColumnWeights[x] = (kWeightOne - weight) | (weight << 16);
+    }
+}
+
+bool CameraContrastEnhancer::Process(
+    uint8_t* image,
+    unsigned pitch,
+    unsigned width,
+    unsigned height,
+    WorkerPool* pool,
+    CameraKernelPath path)
+{
+    ContrastKernels kernels;
+    if (!SelectContrastKernels(path, kernels)) {
+        return false;
+    }
+
+    const unsigned tiles_x = Params.TilesX;
+    const unsigned tiles_y = Params.TilesY;
+    if (tiles_x < 1 || tiles_x > kMaxTiles ||
+        tiles_y < 1 || tiles_y > kMaxTiles ||
+        width < tiles_x * kMinTileSize ||
+        height < tiles_y * kMinTileSize)
+    {
+        return false;
+    }
+
+    if (Params.Strength == 0) {
+        return true;
+    }
+
+    SetupColumns(width);
+
+    const size_t tile_count = (size_t)tiles_x * tiles_y;
+    const size_t quad_row_count = (size_t)(tiles_x + 1) * kCameraHistogramBins;
+    Curves.resize(tile_count * kCameraHistogramBins);
+    Quads.resize((tiles_y + 1) * quad_row_count);
+
+    // Tone curve of each tile from its own pixels
+    auto build_tile = [&](unsigned tile)
+    {
+        const unsigned tx = tile % tiles_x;
+        const unsigned ty = tile / tiles_x;
+        const unsigned x0 = tx * width / tiles_x;
+        const unsigned x1 = (tx + 1) * width / tiles_x;
+        const unsigned y0 = ty * height / tiles_y;
+        const unsigned y1 = (ty + 1) * height / tiles_y;
+
+        uint32_t tables[kCameraHistogramBins * 4] = {};
+        for (unsigned y = y0; y < y1; ++y) {
+            kernels.HistogramRow(image + (size_t)y * pitch + x0, x1 - x0, tables);
+        }
+
+        uint32_t bins[kCameraHistogramBins];
+        MergeTables(tables, bins);
+
+        BuildToneCurve(
+            bins,
+            (x1 - x0) * (y1 - y0),
+            Params.ClipLimit,
+            Params.Strength,
+            Curves.data() + (size_t)tile * kCameraHistogramBins);
+    };
+
+    // Interleave the four curves around each span into quads
+    auto build_quads = [&](unsigned span_y)
+    {
+        unsigned ty0, ty1;
+        GetSpanTiles(span_y, tiles_y, ty0, ty1);
+
+        uint32_t* quads = Quads.data() + span_y * quad_row_count;
+        for (unsigned span_x = 0; span_x <= tiles_x; ++span_x)
+        {
+            unsigned tx0, tx1;
+            GetSpanTiles(span_x, tiles_x, tx0, tx1);
+
+            const uint8_t* top0 = Curves.data() + ((size_t)ty0 * tiles_x + tx0) * kCameraHistogramBins;
+            const uint8_t* top1 = Curves.data() + ((size_t)ty0 * tiles_x + tx1) * kCameraHistogramBins;
+            const uint8_t* bottom0 = Curves.data() + ((size_t)ty1 * tiles_x + tx0) * kCameraHistogramBins;
+            const uint8_t* bottom1 = Curves.data() + ((size_t)ty1 * tiles_x + tx1) * kCameraHistogramBins;
+
+            for (unsigned v = 0; v < kCameraHistogramBins; ++v) {
+                quads[v] = top0[v] | (top1[v] << 8) | (bottom0[v] << 16) | ((uint32_t)bottom1[v] << 24);
+            }
+            quads += kCameraHistogramBins;
+        }
+    };
+
+    const float tile_height = height / static_cast<float>(tiles_y);
+
+    // Each band only reads and writes its own rows
+    auto enhance_band = [&](unsigned band)
+    {
+        const unsigned y_end = std::min(height, (band + 1) * kBandRows);
+        for (unsigned y = band * kBandRows; y < y_end; ++y)
+        {
+            unsigned span_y, row_weight;
+            GetTileSpan(y, tile_height, tiles_y, span_y, row_weight);
+
+            uint8_t* row = image + (size_t)y * pitch;
+            kernels.BlendRow(
+                row,
+                Quads.data() + span_y * quad_row_count,
+                ColumnOffsets.data(),
+                ColumnWeights.data(),
+                row_weight,
+                row,
+                width);
+        }
+    };
+
+    const unsigned band_count = (height + kBandRows - 1) / kBandRows;
+    if (pool) {
+        pool->ParallelFor(static_cast<unsigned>(tile_count), build_tile);
+        pool->ParallelFor(tiles_y + 1, build_quads);
+        pool->ParallelFor(band_count, enhance_band);
+    }
+    else {
+        for (unsigned tile = 0; tile < tile_count; ++tile) {
+            build_tile(tile);
+        }
+        for (unsigned span_y = 0; span_y <= tiles_y; ++span_y) {
+            build_quads(span_y);
+        }
+        for (unsigned band = 0; band < band_count; ++band) {
+            enhance_band(band);
+        }
+    }
+
+    return true;
+}
+
+
+} // namespace core
@@ -0,0 +1,322 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraDenoise.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h> // memcpy
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Row Kernels
+
+static const int kWeightBits = 4;
+static const int kWeightOne = 1 << kWeightBits;
+
+typedef void (*DenoiseRowFn)(
+    const uint8_t* input,
+    uint8_t* history,
+    uint8_t* output,
+    unsigned count,
+    int strength,
+    int threshold);
+
+static void DenoiseRow_Scalar(
+    const uint8_t* input,
+    uint8_t* history,
+    uint8_t* output,
+    unsigned count,
+    int strength,
+    int threshold)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const int h = history[i];
+        const int diff = input[i] - h;
+        const int abs_diff = diff < 0 ? -diff : diff;
+        const int weight = abs_diff > threshold ? kWeightOne : strength;
+
+        // Arithmetic shift rounds toward -inf, as the SIMD versions do
+        const uint8_t y = static_cast<uint8_t>(h + ((diff * weight + kWeightOne / 2) >> kWeightBits));
+
+        history[i] = y;
+        output[i] = y;
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+// Filter 8 pixels held in 16-bit lanes
+static CORE_INLINE __m128i Denoise8_SSE2(__m128i x, __m128i h, __m128i strength, __m128i threshold)
+{
+    const __m128i diff = _mm_sub_epi16(x, h);
+    const __m128i abs_diff = _mm_max_epi16(diff, _mm_sub_epi16(_mm_setzero_si128(), diff));
+    const __m128i moving = _mm_cmpgt_epi16(abs_diff, threshold);
+    const __m128i weight = _mm_or_si128(
+        _mm_and_si128(moving, _mm_set1_epi16(kWeightOne)),
+        _mm_andnot_si128(moving, strength));
+    const __m128i step = _mm_srai_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(diff, weight), _mm_set1_epi16(kWeightOne / 2)),
+        kWeightBits);
+    return _mm_add_epi16(h, step);
+}
+
+static void DenoiseRow_SSE2(
+    const uint8_t* input,
+    uint8_t* history,
+    uint8_t* output,
+    unsigned count,
+    int strength,
+    int threshold)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i strength_v = _mm_set1_epi16((short)strength);
+    const __m128i threshold_v = _mm_set1_epi16((short)threshold);
+
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(history + i));
+
+        const __m128i lo = Denoise8_SSE2(
+            _mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(h, zero), strength_v, threshold_v);
+        const __m128i hi = Denoise8_SSE2(
+            _mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(h, zero), strength_v, threshold_v);
+        const __m128i y = _mm_packus_epi16(lo, hi);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(history + i), y);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), y);
+    }
+
+    DenoiseRow_Scalar(input + i, history + i, output + i, count - i, strength, threshold);
+}
+
+CORE_TARGET_AVX2 static CORE_INLINE __m256i Denoise16_AVX2(__m256i x, __m256i h, __m256i strength, __m256i threshold)
+{
+    const __m256i diff = _mm256_sub_epi16(x, h);
+    const __m256i moving = _mm256_cmpgt_epi16(_mm256_abs_epi16(diff), threshold);
+    const __m256i weight = _mm256_blendv_epi8(strength, _mm256_set1_epi16(kWeightOne), moving);
+    const __m256i step = _mm256_srai_epi16(
+        _mm256_add_epi16(_mm256_mullo_epi16(diff, weight), _mm256_set1_epi16(kWeightOne / 2)),
+        kWeightBits);
+    return _mm256_add_epi16(h, step);
+}
+
+CORE_TARGET_AVX2 static void DenoiseRow_AVX2(
+    const uint8_t* input,
+    uint8_t* history,
+    uint8_t* output,
+    unsigned count,
+    int strength,
+    int threshold)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i strength_v = _mm256_set1_epi16((short)strength);
+    const __m256i threshold_v = _mm256_set1_epi16((short)threshold);
+
+    unsigned i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        const __m256i h = _mm256_load_si256(reinterpret_cast<const __m256i*>(history + i));
+
+        // unpack and packus both work within 128-bit halves, so order is kept
+        const __m256i lo = Denoise16_AVX2(
+            _mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi8(h, zero), strength_v, threshold_v);
+        const __m256i hi = Denoise16_AVX2(
+            _mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi8(h, zero), strength_v, threshold_v);
+        const __m256i y = _mm256_packus_epi16(lo, hi);
+
+        _mm256_store_si256(reinterpret_cast<__m256i*>(history + i), y);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), y);
+    }
+
+    DenoiseRow_SSE2(input + i, history + i, output + i, count - i, strength, threshold);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static CORE_INLINE int16x8_t Denoise8_NEON(int16x8_t x, int16x8_t h, int16x8_t strength, int16x8_t threshold)
+{
+    const int16x8_t diff = vsubq_s16(x, h);
+    const uint16x8_t moving = vcgtq_s16(vabsq_s16(diff), threshold);
+    const int16x8_t weight = vbslq_s16(moving, vdupq_n_s16(kWeightOne), strength);
+    const int16x8_t step = vshrq_n_s16(
+        vaddq_s16(vmulq_s16(diff, weight), vdupq_n_s16(kWeightOne / 2)),
+        kWeightBits);
+    return vaddq_s16(h, step);
+}
+
+static void DenoiseRow_NEON(
+    const uint8_t* input,
+    uint8_t* history,
+    uint8_t* output,
+    unsigned count,
+    int strength,
+    int threshold)
+{
+    const int16x8_t strength_v = vdupq_n_s16((int16_t)strength);
+    const int16x8_t threshold_v = vdupq_n_s16((int16_t)threshold);
+
+    unsigned i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const uint8x16_t x = vld1q_u8(input + i);
+        const uint8x16_t h = vld1q_u8(history + i);
+
+        const int16x8_t lo = Denoise8_NEON(
+            vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(x))),
+            vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(h))),
+            strength_v, threshold_v);
+        const int16x8_t hi = Denoise8_NEON(
+            vreinterpretq_s16_u16(vmovl_high_u8(x)),
+            vreinterpretq_s16_u16(vmovl_high_u8(h)),
+            strength_v, threshold_v);
+        const uint8x16_t y = vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi));
+
+        vst1q_u8(history + i, y);
+        vst1q_u8(output + i, y);
+    }
+
+    DenoiseRow_Scalar(input + i, history + i, output + i, count - i, strength, threshold);
+}
+
+#endif // CORE_CPU_ARM64
+
+static DenoiseRowFn SelectDenoiseRow(CameraKernelPath path)
+{
+    if (path == CameraKernelPath::Auto) {
+        path = GetBestCameraKernelPath();
+    }
+    if (!IsCameraKernelPathSupported(path)) {
+        return nullptr;
+    }
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CameraKernelPath::SSE2: return DenoiseRow_SSE2;
+    case CameraKernelPath::AVX2: return DenoiseRow_AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CameraKernelPath::NEON: return DenoiseRow_NEON;
+#endif
+    default:
+        break;
+    }
+    return DenoiseRow_Scalar;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraTemporalDenoiser
+
+CameraTemporalDenoiser::~CameraTemporalDenoiser()
+{
+    for (EyeHistory& eye : Eyes) {
+        SIMDSafeFree(eye.Image);
+        eye.Image = nullptr;
+    }
+}
+
+void CameraTemporalDenoiser::SetParams(const CameraDenoiseParams& params)
+{
+    Params = params;
+    if (Params.Strength < 1) {
+        Params.Strength = 1;
+    }
+    if (Params.Strength > (unsigned)kWeightOne) {
+        Params.Strength = kWeightOne;
+    }
+    if (Params.MotionThreshold > 255) {
+        Params.MotionThreshold = 255;
+    }
+}
+
+void CameraTemporalDenoiser::Reset()
+{
+    for (EyeHistory& eye : Eyes) {
+        eye.Valid = false;
+    }
+}
+
+bool CameraTemporalDenoiser::Allocate(EyeHistory& eye, unsigned width, unsigned height)
+{
+    if (eye.Image && eye.Width == width && eye.Height == height) {
+        return true;
+    }
+
+    SIMDSafeFree(eye.Image);
+    eye.Valid = false;
+
+    // Round rows up so every row starts on a 32-byte boundary
+    eye.Pitch = (width + 31) & ~31u;
+    eye.Image = SIMDSafeAllocate((size_t)eye.Pitch * height);
+    if (!eye.Image) {
+        eye.Width = eye.Height = 0;
+        return false;
+    }
+    eye.Width = width;
+    eye.Height = height;
+    return true;
+}
+
+bool CameraTemporalDenoiser::Process(
+    unsigned eye_index,
+    const uint8_t* input,
+    unsigned input_pitch,
+    uint8_t* output,
+    unsigned output_pitch,
+    unsigned width,
+    unsigned height,
+    CameraKernelPath path)
+{
+    if (eye_index >= kCameraDenoiseEyeCount) {
+        return false;
+    }
+    EyeHistory& eye = Eyes[eye_index];
+
+    const DenoiseRowFn denoise_row = SelectDenoiseRow(path);
+    if (!denoise_row || !Allocate(eye, width, height)) {
+        return false;
+    }
+
+    // No history yet: Pass the frame through and start from it
+    if (!eye.Valid)
+    {
+        for (unsigned y = 0; y < height; ++y) {
+            memcpy(eye.Image + (size_t)y * eye.Pitch, input + (size_t)y * input_pitch, width);
+            if (output != input) {
+                memcpy(output + (size_t)y * output_pitch, input + (size_t)y * input_pitch, width);
+            }
+        }
+        eye.Valid = true;
+        return true;
+    }
+
+    for (unsigned y = 0; y < height; ++y)
+    {
+        denoise_row(
+            input + (size_t)y * input_pitch,
+            eye.Image + (size_t)y * eye.Pitch,
+            output + (size_t)y * output_pitch,
+            width,
+            (int)Params.Strength,
+            (int)Params.MotionThreshold);
+    }
+
+    return true;
+}
+
+
+} // namespace core
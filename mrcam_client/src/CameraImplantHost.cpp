@@ -0,0 +1,218 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraImplantHost.hpp"
+#include "CameraFrameHeader.hpp"
+#include "core_logger.hpp"
+
+#include <string.h> // memset
+#include <chrono>
+#include <random>
+
+namespace core {
+
+static logger::Channel Logger("CameraImplantHost");
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Distinct images cycled by CameraSyntheticServer
+static const unsigned kSyntheticImageCount = 8;
+
+// Image rows in a synthetic transfer
+static const unsigned kSyntheticRowBytes = 640 * 2;
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/// Sleep until GetTimeUsec() reaches due_usec, or `terminated` is set
+static void SleepUntil(uint64_t due_usec, const std::atomic<bool>& terminated)
+{
+    for (;;) {
+        const uint64_t now_usec = GetTimeUsec();
+        if (terminated || (int64_t)(due_usec - now_usec) <= 0) {
+            break;
+        }
+        uint64_t sleep_usec = due_usec - now_usec;
+        if (sleep_usec > 100 * 1000) {
+            sleep_usec = 100 * 1000;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(sleep_usec));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// CameraImplantHost
+
+CameraImplantHost::~CameraImplantHost()
+{
+    Close();
+}
+
+bool CameraImplantHost::Create()
+{
+    Close();
+
+    if (!FrameEvent.Create(CAMERA_IMPLANT_FRAME_EVENT_NAME)) {
+        Logger.Error("FrameEvent.Create failed: ", LastIpcErrorString());
+        return false;
+    }
+
+    if (!ImplantSharedFile.Create(kImplantSharedMemoryBytes, CAMERA_IMPLANT_SHARED_MEMORY_NAME)) {
+        Logger.Error("ImplantSharedFile.Create failed: ", LastIpcErrorString());
+        return false;
+    }
+    ImplantSharedMemory = reinterpret_cast<ImplantSharedMemoryLayout*>(ImplantSharedFile.GetFront());
+    memset(static_cast<void*>(ImplantSharedMemory), 0, kImplantSharedMemoryBytes);
+    ImplantSharedMemory->ImplantInstalled = 1;
+
+    // CameraClient also expects the UI state published by the service
+    if (!UiSharedFile.Create(kXrmUiSharedMemoryBytes, XRM_UI_SHARED_MEMORY_NAME)) {
+        Logger.Error("UiSharedFile.Create failed: ", LastIpcErrorString());
+        return false;
+    }
+    XrmUiSharedMemoryLayout* ui = reinterpret_cast<XrmUiSharedMemoryLayout*>(UiSharedFile.GetFront());
+    memset(static_cast<void*>(ui), 0, kXrmUiSharedMemoryBytes);
+    ui->Data.EnablePassthrough = true;
+
+    return true;
+}
+
+void CameraImplantHost::Close()
+{
+    ImplantSharedMemory = nullptr;
+    ImplantSharedFile.Close();
+    UiSharedFile.Close();
+    FrameEvent.Close();
+}
+
+bool CameraImplantHost::Publish(const uint8_t* payload, uint32_t bytes, uint64_t receive_usec)
+{
+    if (!ImplantSharedMemory) {
+        return false;
+    }
+    if (!ImplantSharedMemory->WriteCamera(payload, bytes, receive_usec)) {
+        return false;
+    }
+    FrameEvent.Signal();
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraSyntheticServer
+
+CameraSyntheticServer::~CameraSyntheticServer()
+{
+    Stop();
+}
+
+bool CameraSyntheticServer::Start(const CameraSyntheticParams& params)
+{
+    Stop();
+
+    Params = params;
+    if (Params.PayloadBytes < kCameraImageOffset) {
+        Params.PayloadBytes = kCameraImageOffset;
+    }
+    if (Params.PayloadBytes > kImplantCameraBytes) {
+        Params.PayloadBytes = kImplantCameraBytes;
+    }
+    if (Params.RateHz < 0.) {
+        Params.RateHz = 0.;
+    }
+
+    if (!Host.Create()) {
+        return false;
+    }
+
+    // Diagonal gradients that move between images.  The tag blocks hold
+    // gradient bytes too, since the client skips them unread
+    Payloads.resize(kSyntheticImageCount);
+    for (unsigned i = 0; i < kSyntheticImageCount; ++i)
+    {
+        std::vector<uint8_t>& payload = Payloads[i];
+        payload.assign(Params.PayloadBytes, 0);
+        for (unsigned offset = kCameraImageOffset; offset < Params.PayloadBytes; ++offset) {
+            const unsigned pixel = offset - kCameraImageOffset;
+            const unsigned x = pixel % kSyntheticRowBytes;
+            const unsigned y = pixel / kSyntheticRowBytes;
+            payload[offset] = static_cast<uint8_t>(x + y + i * 8);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(StatsLock);
+        Stats = CameraSyntheticStats();
+    }
+
+    Logger.Info("Publishing synthetic frames: ", Params.RateHz, " Hz, ",
+        Params.PayloadBytes, " bytes, jitter ", Params.JitterUsec, " usec");
+
+    Terminated = false;
+    Thread = std::make_shared<std::thread>(&CameraSyntheticServer::Loop, this);
+
+    return true;
+}
+
+void CameraSyntheticServer::Stop()
+{
+    Terminated = true;
+    JoinThread(Thread);
+
+    Host.Close();
+}
+
+CameraSyntheticStats CameraSyntheticServer::GetStats()
+{
+    std::lock_guard<std::mutex> locker(StatsLock);
+    return Stats;
+}
+
+void CameraSyntheticServer::Loop()
+{
+    SetCurrentThreadName("CameraSynthetic");
+
+    std::mt19937 prng(1);
+    std::uniform_int_distribution<unsigned> jitter(0, Params.JitterUsec);
+
+    const uint64_t period_usec = Params.RateHz > 0. ? (uint64_t)(1000000. / Params.RateHz) : 0;
+    uint64_t next_usec = GetTimeUsec();
+    uint32_t frame_counter = 0;
+
+    while (!Terminated)
+    {
+        if (period_usec > 0)
+        {
+            next_usec += period_usec;
+            SleepUntil(next_usec + (Params.JitterUsec > 0 ? jitter(prng) : 0), Terminated);
+            if (Terminated) {
+                break;
+            }
+        }
+
+        ++frame_counter;
+        const std::vector<uint8_t>& payload = Payloads[frame_counter % kSyntheticImageCount];
+
+        const uint64_t t0 = GetTimeUsec();
+        const bool published = Host.Publish(payload.data(), Params.PayloadBytes, t0);
+        const uint64_t write_usec = GetTimeUsec() - t0;
+
+        std::lock_guard<std::mutex> locker(StatsLock);
+        if (published) {
+            ++Stats.Published;
+        }
+        else {
+            ++Stats.Dropped;
+        }
+        Stats.WriteUsecTotal += write_usec;
+        if (Stats.WriteUsecMax < write_usec) {
+            Stats.WriteUsecMax = write_usec;
+        }
+    }
+}
+
+
+} // namespace core
@@ -0,0 +1,141 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraKernels.hpp"
+#include "core_cpu.hpp"
+
+#include <string.h>
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// CameraKernelPath
+
+CameraKernelPath GetBestCameraKernelPath()
+{
+    const CpuFeatures& cpu = GetCpuFeatures();
+    if (cpu.AVX2) {
+        return CameraKernelPath::AVX2;
+    }
+    if (cpu.SSE2) {
+        return CameraKernelPath::SSE2;
+    }
+    if (cpu.NEON) {
+        return CameraKernelPath::NEON;
+    }
+    return CameraKernelPath::Scalar;
+}
+
+bool IsCameraKernelPathSupported(CameraKernelPath path)
+{
+    const CpuFeatures& cpu = GetCpuFeatures();
+    switch (path)
+    {
+    case CameraKernelPath::Auto:
+    case CameraKernelPath::Scalar:
+        return true;
+#if defined(CORE_CPU_X86)
+    case CameraKernelPath::SSE2: return cpu.SSE2;
+    case CameraKernelPath::AVX2: return cpu.AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CameraKernelPath::NEON: return cpu.NEON;
+#endif
+    default:
+        break;
+    }
+    return false;
+}
+
+const char* CameraKernelPathToString(CameraKernelPath path)
+{
+    switch (path)
+    {
+    case CameraKernelPath::Auto: return "Auto";
+    case CameraKernelPath::Scalar: return "Scalar";
+    case CameraKernelPath::SSE2: return "SSE2";
+    case CameraKernelPath::AVX2: return "AVX2";
+    case CameraKernelPath::NEON: return "NEON";
+    default: break;
+    }
+    return "Unknown";
+}
+
+
+//------------------------------------------------------------------------------
+// Tag Strip + Eye Split
+
+namespace {
+
+// Reads image bytes from a transfer, stepping over the tag blocks
+struct TaggedStreamReader
+{
+    const uint8_t* Transfer;
+    unsigned TransferBytes;
+    unsigned Position;
+    unsigned NextTag;
+
+    bool Copy(uint8_t* dest, unsigned bytes)
+    {
+        while (bytes > 0)
+        {
+            unsigned count = NextTag - Position;
+            if (count > bytes) {
+                count = bytes;
+            }
+            if (Position + count > TransferBytes) {
+                return false;
+            }
+
+            memcpy(dest, Transfer + Position, count);
+            dest += count;
+            bytes -= count;
+            Position += count;
+
+            if (Position == NextTag) {
+                Position += kCameraTagBytes;
+                NextTag += kCameraChunkBytes;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+bool StripTagsAndSplitEyes(
+    const uint8_t* transfer,
+    unsigned transfer_bytes,
+    unsigned eye_width,
+    unsigned height,
+    const CameraEyePlanes& planes)
+{
+    if (!transfer) {
+        return false;
+    }
+
+    TaggedStreamReader reader;
+    reader.Transfer = transfer;
+    reader.TransferBytes = transfer_bytes;
+    reader.Position = kCameraImageOffset;
+    reader.NextTag = kCameraChunkBytes;
+
+    uint8_t* left = planes.Left;
+    uint8_t* right = planes.Right;
+
+    for (unsigned y = 0; y < height; ++y)
+    {
+        if (!reader.Copy(left, eye_width) ||
+            !reader.Copy(right, eye_width))
+        {
+            return false;
+        }
+        left += planes.LeftPitch;
+        right += planes.RightPitch;
+    }
+
+    return true;
+}
+
+
+} // namespace core
@@ -0,0 +1,87 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraLatency.hpp"
+#include "core_logger.hpp"
+
+#include <sstream>
+
+namespace core {
+
+static logger::Channel Logger("CameraLatency");
+
+
+//------------------------------------------------------------------------------
+// CameraLatencyTracker
+
+CameraLatencyTracker::~CameraLatencyTracker()
+{
+    Stop();
+}
+
+bool CameraLatencyTracker::Start()
+{
+    Stop();
+
+    Counters.Clear();
+    Window.Clear();
+    LastLogMsec = GetTimeMsec();
+
+    if (!SharedFile.Create(kCameraLatencySharedMemoryBytes, CAMERA_LATENCY_SHARED_MEMORY_NAME)) {
+        Logger.Warning("SharedFile.Create failed: ", LastIpcErrorString());
+        return false;
+    }
+    SharedMemoryLayout = reinterpret_cast<CameraLatencySharedMemoryLayout*>(SharedFile.GetFront());
+    memset(static_cast<void*>(SharedMemoryLayout), 0, kCameraLatencySharedMemoryBytes);
+    SharedMemoryLayout->Counters.Write(Counters);
+
+    return true;
+}
+
+void CameraLatencyTracker::Stop()
+{
+    SharedMemoryLayout = nullptr;
+    SharedFile.Close();
+}
+
+void CameraLatencyTracker::AddFrame(const CameraFrameStamps& stamps)
+{
+    if (!Counters.AddFrame(stamps.Usec)) {
+        return;
+    }
+    Window.AddFrame(stamps.Usec);
+
+    if (SharedMemoryLayout) {
+        // Written in place: Readers retry if they overlap the update
+        SharedMemoryLayout->Counters.BeginWrite();
+        memcpy(&SharedMemoryLayout->Counters.Data, &Counters, sizeof(Counters));
+        SharedMemoryLayout->Counters.EndWrite();
+    }
+}
+
+void CameraLatencyTracker::LogPeriodically()
+{
+    const uint64_t now_msec = GetTimeMsec();
+    if (now_msec - LastLogMsec < kCameraLatencyLogIntervalMsec) {
+        return;
+    }
+    LastLogMsec = now_msec;
+
+    if (Window.Frames == 0) {
+        return;
+    }
+
+    std::ostringstream oss;
+    oss << "Camera latency p50/p99 usec over " << Window.Frames << " frames:";
+    for (unsigned i = 0; i < kCameraLatencyIntervalCount; ++i) {
+        const CameraLatencyHistogram& histogram = Window.Intervals[i];
+        oss << " " << CameraLatencyIntervalName(i) << "="
+            << histogram.GetPercentileUsec(50) << "/"
+            << histogram.GetPercentileUsec(99);
+    }
+    Logger.Info(oss.str());
+
+    Window.Clear();
+}
+
+
+} // namespace core
@@ -0,0 +1,367 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraRecording.hpp"
+#include "core_logger.hpp"
+
+#include <string.h> // memcpy
+#include <chrono>
+
+namespace core {
+
+static logger::Channel Logger("CameraRecording");
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+// 64-bit so a corrupt payload size cannot wrap to a small record
+static uint64_t RecordBytes(uint32_t payload_bytes)
+{
+    const uint64_t bytes = sizeof(CameraRecordingFrame) + (uint64_t)payload_bytes;
+    return (bytes + kCameraRecordingAlign - 1) & ~(uint64_t)(kCameraRecordingAlign - 1);
+}
+
+
+//------------------------------------------------------------------------------
+// CameraRecordingWriter
+
+CameraRecordingWriter::~CameraRecordingWriter()
+{
+    Close();
+}
+
+bool CameraRecordingWriter::Open(const std::string& path)
+{
+    Close();
+
+    if (!File.OpenWrite(path.c_str(), kCameraRecordingHeaderBytes)) {
+        Logger.Error("Failed to create recording file: ", path);
+        File.Close();
+        return false;
+    }
+
+    FrameCount = 0;
+
+    // FileBytes = 0 until Close(), so readers scan a file cut short by a crash
+    if (!WriteHeader(0) ||
+        !MapChunk(kCameraRecordingHeaderBytes))
+    {
+        Logger.Error("Failed to map recording file: ", path);
+        File.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraRecordingWriter::WriteHeader(uint64_t file_bytes)
+{
+    MappedView header_view;
+    if (!header_view.Open(&File) ||
+        !header_view.MapView(0, sizeof(CameraRecordingFileHeader)))
+    {
+        return false;
+    }
+
+    CameraRecordingFileHeader header{};
+    header.Magic = kCameraRecordingMagic;
+    header.Version = kCameraRecordingVersion;
+    header.ChunkBytes = kCameraRecordingChunkBytes;
+    header.FrameCount = FrameCount;
+    header.FileBytes = file_bytes;
+    memcpy(header_view.Data, &header, sizeof(header));
+    return true;
+}
+
+bool CameraRecordingWriter::MapChunk(uint64_t offset)
+{
+    ChunkView.Close();
+
+    // The mapping must not extend past the end of the file
+    if (!File.Resize(offset + kCameraRecordingChunkBytes)) {
+        return false;
+    }
+    if (!ChunkView.Open(&File) ||
+        !ChunkView.MapView(offset, kCameraRecordingChunkBytes))
+    {
+        return false;
+    }
+
+    ChunkOffset = offset;
+    ChunkUsed = 0;
+    return true;
+}
+
+bool CameraRecordingWriter::Append(const CameraRecordingFrame& info, const uint8_t* payload)
+{
+    if (!IsOpen()) {
+        return false;
+    }
+
+    if (info.PayloadBytes > kImplantCameraBytes) {
+        return false;
+    }
+    const uint32_t record_bytes = (uint32_t)RecordBytes(info.PayloadBytes);
+
+    if (ChunkUsed + record_bytes > kCameraRecordingChunkBytes) {
+        if (!MapChunk(ChunkOffset + kCameraRecordingChunkBytes)) {
+            Logger.Error("Failed to extend recording file");
+            return false;
+        }
+    }
+
+    uint8_t* record = ChunkView.Data + ChunkUsed;
+
+    CameraRecordingFrame header = info;
+    header.Magic = kCameraRecordingFrameMagic;
+    memcpy(record + sizeof(CameraRecordingFrame), payload, info.PayloadBytes);
+    memcpy(record, &header, sizeof(header));
+
+    ChunkUsed += record_bytes;
+    ++FrameCount;
+    return true;
+}
+
+void CameraRecordingWriter::Close()
+{
+    if (!IsOpen()) {
+        return;
+    }
+
+    const uint64_t file_bytes = ChunkOffset + ChunkUsed;
+    ChunkView.Close();
+
+    if (!WriteHeader(file_bytes)) {
+        Logger.Error("Failed to write recording header");
+    }
+
+    // Trim the unused part of the last chunk
+    File.Resize(file_bytes);
+    File.Close();
+
+    Logger.Info("Recorded ", FrameCount, " frames (", file_bytes / 1000000, " MB)");
+}
+
+
+//------------------------------------------------------------------------------
+// CameraRecordingReader
+
+bool CameraRecordingReader::Open(const std::string& path)
+{
+    Close();
+
+    if (!File.OpenRead(path.c_str(), true) ||
+        File.Length < kCameraRecordingHeaderBytes)
+    {
+        Logger.Error("Failed to open recording file: ", path);
+        Close();
+        return false;
+    }
+
+    CameraRecordingFileHeader header{};
+    {
+        MappedView header_view;
+        if (!header_view.Open(&File) ||
+            !header_view.MapView(0, sizeof(CameraRecordingFileHeader)))
+        {
+            Logger.Error("Failed to map recording file: ", path);
+            Close();
+            return false;
+        }
+        memcpy(&header, header_view.Data, sizeof(header));
+    }
+
+    if (header.Magic != kCameraRecordingMagic ||
+        header.Version != kCameraRecordingVersion ||
+        header.ChunkBytes < kCameraRecordingAlign)
+    {
+        Logger.Error("Not a camera recording: ", path);
+        Close();
+        return false;
+    }
+
+    ChunkBytes = header.ChunkBytes;
+    FrameCount = header.FrameCount;
+
+    // If the writer did not finish, scan the whole file
+    FileBytes = File.Length;
+    if (header.FileBytes > 0 && header.FileBytes <= File.Length) {
+        FileBytes = header.FileBytes;
+    }
+
+    return Rewind();
+}
+
+void CameraRecordingReader::Close()
+{
+    ChunkView.Close();
+    File.Close();
+    FileBytes = 0;
+    FrameCount = 0;
+}
+
+bool CameraRecordingReader::Rewind()
+{
+    return MapChunk(kCameraRecordingHeaderBytes);
+}
+
+bool CameraRecordingReader::MapChunk(uint64_t offset)
+{
+    ChunkView.Close();
+    ChunkOffset = offset;
+    ChunkUsed = 0;
+
+    if (offset >= FileBytes) {
+        return false;
+    }
+
+    uint64_t length = FileBytes - offset;
+    if (length > ChunkBytes) {
+        length = ChunkBytes;
+    }
+
+    return ChunkView.Open(&File) &&
+        ChunkView.MapView(offset, (uint32_t)length) != nullptr;
+}
+
+bool CameraRecordingReader::ReadNext(CameraRecordingFrame& info, const uint8_t*& payload)
+{
+    for (;;)
+    {
+        if (!ChunkView.Data) {
+            return false;
+        }
+
+        if (ChunkUsed + sizeof(CameraRecordingFrame) <= ChunkView.Length)
+        {
+            const uint8_t* record = ChunkView.Data + ChunkUsed;
+            memcpy(&info, record, sizeof(info));
+
+            // Zero magic marks the unused tail of a chunk
+            if (info.Magic == kCameraRecordingFrameMagic)
+            {
+                // Replay publishes the payload as one implant transfer
+                if (info.PayloadBytes > kImplantCameraBytes) {
+                    Logger.Error("Recording is corrupted: Frame has ", info.PayloadBytes, " bytes");
+                    return false;
+                }
+
+                const uint64_t record_bytes = RecordBytes(info.PayloadBytes);
+                if (record_bytes > ChunkView.Length - ChunkUsed) {
+                    Logger.Error("Recording is truncated");
+                    return false;
+                }
+
+                payload = record + sizeof(CameraRecordingFrame);
+                ChunkUsed += (uint32_t)record_bytes;
+                return true;
+            }
+        }
+
+        if (!MapChunk(ChunkOffset + ChunkBytes)) {
+            return false;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// CameraReplayServer
+
+CameraReplayServer::~CameraReplayServer()
+{
+    Stop();
+}
+
+bool CameraReplayServer::Start(const std::string& path, double speed, bool loop)
+{
+    Stop();
+
+    if (!Reader.Open(path)) {
+        return false;
+    }
+    Logger.Info("Replaying ", Reader.GetFrameCount(), " frames from ", path);
+
+    if (!Host.Create()) {
+        return false;
+    }
+
+    Speed = speed;
+    Loop = loop;
+    FramesPublished = 0;
+    Finished = false;
+    Terminated = false;
+    Thread = std::make_shared<std::thread>(&CameraReplayServer::ReplayLoop, this);
+
+    return true;
+}
+
+void CameraReplayServer::Stop()
+{
+    Terminated = true;
+    JoinThread(Thread);
+
+    Host.Close();
+    Reader.Close();
+}
+
+void CameraReplayServer::ReplayLoop()
+{
+    SetCurrentThreadName("CameraReplay");
+
+    uint64_t start_usec = 0;
+    uint64_t first_receive_usec = 0;
+    bool first = true;
+
+    while (!Terminated)
+    {
+        CameraRecordingFrame info;
+        const uint8_t* payload = nullptr;
+
+        if (!Reader.ReadNext(info, payload))
+        {
+            if (!Loop || FramesPublished == 0 || !Reader.Rewind()) {
+                break;
+            }
+            first = true;
+            continue;
+        }
+
+        if (first) {
+            start_usec = GetTimeUsec();
+            first_receive_usec = info.ReceiveTimeUsec;
+            first = false;
+        }
+
+        // Wait until this frame is due
+        if (Speed > 0.)
+        {
+            int64_t offset_usec = (int64_t)(info.ReceiveTimeUsec - first_receive_usec);
+            if (offset_usec < 0) {
+                offset_usec = 0;
+            }
+            const uint64_t due_usec = start_usec + (uint64_t)((double)offset_usec / Speed);
+
+            for (;;) {
+                const uint64_t now_usec = GetTimeUsec();
+                if (Terminated || (int64_t)(due_usec - now_usec) <= 0) {
+                    break;
+                }
+                uint64_t sleep_usec = due_usec - now_usec;
+                if (sleep_usec > 100 * 1000) {
+                    sleep_usec = 100 * 1000;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(sleep_usec));
+            }
+        }
+
+        if (Host.Publish(payload, info.PayloadBytes, GetTimeUsec())) {
+            ++FramesPublished;
+        }
+    }
+
+    Finished = true;
+}
+
+
+} // namespace core
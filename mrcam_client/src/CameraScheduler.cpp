@@ -0,0 +1,202 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraScheduler.hpp"
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static uint64_t AbsDiff(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+static uint64_t LatencyUsec(uint64_t display_usec, uint64_t exposure_usec)
+{
+    return display_usec > exposure_usec ? display_usec - exposure_usec : 0;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraFrameScheduler
+
+CameraFrameScheduler::CameraFrameScheduler()
+{
+    Reset();
+}
+
+void CameraFrameScheduler::Reset()
+{
+    QueueCount = 0;
+    ShownSlot = -1;
+    PushSlot = -1;
+    TargetLatencyUsec = 0;
+    HasTargetFrame = false;
+}
+
+bool CameraFrameScheduler::AcceptBrightness(int bright_avg)
+{
+    const bool dark = (int64_t)bright_avg * 100 < (int64_t)LastAcceptedBright * DarkParams.DarkPercent;
+    if (dark && DarkSkipped < DarkParams.MaxSkips) {
+        ++DarkSkipped;
+        ++Stats.Dark;
+        return false;
+    }
+    LastAcceptedBright = bright_avg;
+    DarkSkipped = 0;
+    return true;
+}
+
+int CameraFrameScheduler::FindFreeSlot() const
+{
+    for (unsigned i = 0; i < kSlotCount; ++i)
+    {
+        if ((int)i == ShownSlot) {
+            continue;
+        }
+        bool queued = false;
+        for (unsigned j = 0; j < QueueCount; ++j) {
+            if (Queue[j] == i) {
+                queued = true;
+                break;
+            }
+        }
+        if (!queued) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void CameraFrameScheduler::RemoveQueuedFront(unsigned count)
+{
+    if (count > QueueCount) {
+        count = QueueCount;
+    }
+    for (unsigned i = count; i < QueueCount; ++i) {
+        Queue[i - count] = Queue[i];
+    }
+    QueueCount -= count;
+}
+
+void CameraFrameScheduler::DropQueuedFront(unsigned count)
+{
+    if (count > QueueCount) {
+        count = QueueCount;
+    }
+    RemoveQueuedFront(count);
+    Stats.Dropped += count;
+}
+
+uint8_t* CameraFrameScheduler::BeginPush(unsigned bytes)
+{
+    // There is always a free slot, even with a full queue: kSlotCount covers
+    // the queue, the frame on screen, and this one.  The queue is not touched
+    // until CommitPush(), so an abandoned frame changes nothing
+    PushSlot = FindFreeSlot();
+    CORE_DEBUG_ASSERT(PushSlot >= 0);
+
+    std::vector<uint8_t>& image = Slots[PushSlot].Image;
+    image.resize(bytes);
+    return image.data();
+}
+
+void CameraFrameScheduler::CommitPush(
+    uint64_t exposure_usec,
+    uint32_t frame_number,
+    const CameraFrameStamps& stamps)
+{
+    if (PushSlot < 0) {
+        return;
+    }
+
+    CameraScheduledFrame& frame = Slots[PushSlot];
+    frame.ExposureTimeUsec = exposure_usec;
+    frame.FrameNumber = frame_number;
+    frame.Stamps = stamps;
+
+    if (QueueCount >= kCameraScheduleDepth) {
+        DropQueuedFront(1);
+    }
+
+    Queue[QueueCount++] = (unsigned)PushSlot;
+    PushSlot = -1;
+    ++Stats.Queued;
+}
+
+const CameraScheduledFrame* CameraFrameScheduler::Select(
+    uint64_t display_usec,
+    uint64_t display_period_usec)
+{
+    if (QueueCount == 0) {
+        return nullptr;
+    }
+
+    const CameraScheduledFrame& newest = Slots[Queue[QueueCount - 1]];
+
+    unsigned chosen = QueueCount - 1;
+
+    if (display_usec != 0)
+    {
+        // Learn from each frame at its first chance to be shown only, since
+        // the latency of a held frame grows every display frame
+        if (!HasTargetFrame || newest.FrameNumber != TargetFrameNumber)
+        {
+            const uint64_t newest_latency = LatencyUsec(display_usec, newest.ExposureTimeUsec);
+
+            // Fast attack, slow release
+            if (newest_latency > TargetLatencyUsec) {
+                TargetLatencyUsec += (newest_latency - TargetLatencyUsec + 1) / 2;
+            }
+            else {
+                TargetLatencyUsec -= (TargetLatencyUsec - newest_latency) / 64;
+            }
+
+            TargetFrameNumber = newest.FrameNumber;
+            HasTargetFrame = true;
+        }
+
+        // Candidates are the frame on screen and everything queued.
+        // Ties go to the newer frame
+        uint64_t best_error = ~(uint64_t)0;
+        int best = -1;
+        if (ShownSlot >= 0) {
+            best_error = AbsDiff(LatencyUsec(display_usec, Slots[ShownSlot].ExposureTimeUsec), TargetLatencyUsec);
+        }
+        for (unsigned i = 0; i < QueueCount; ++i)
+        {
+            const uint64_t error = AbsDiff(
+                LatencyUsec(display_usec, Slots[Queue[i]].ExposureTimeUsec),
+                TargetLatencyUsec);
+            if (error <= best_error) {
+                best_error = error;
+                best = (int)i;
+            }
+        }
+
+        // Keep showing the current frame
+        if (best < 0) {
+            return nullptr;
+        }
+        chosen = (unsigned)best;
+
+        const uint64_t chosen_latency = LatencyUsec(display_usec, Slots[Queue[chosen]].ExposureTimeUsec);
+        if (chosen_latency > TargetLatencyUsec + display_period_usec) {
+            ++Stats.Late;
+        }
+    }
+
+    // Frames older than the chosen one will never be shown
+    DropQueuedFront(chosen);
+
+    ShownSlot = (int)Queue[0];
+    RemoveQueuedFront(1);
+    ++Stats.Shown;
+
+    return &Slots[ShownSlot];
+}
+
+
+} // namespace core
@@ -0,0 +1,516 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraStereo.hpp"
+#include "core_cpu.hpp"
+
+#include <algorithm>
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+static const unsigned kBlockSize = 8;
+
+// Readable bytes before and after each downsampled plane
+static const unsigned kPlanePadding = 32;
+
+// Blocks must match at least this many disparities to be judged
+static const unsigned kMinSearch = 4;
+
+// Fewer matched blocks than this percentage gives no scene distance
+static const unsigned kMinValidPercent = 5;
+
+
+//------------------------------------------------------------------------------
+// Downsample Kernels
+
+/*
+    Each output pixel is avg(avg(a, c), avg(b, d)) of its 2x2 input block,
+    with each average rounded up, because that is what the SIMD average
+    instructions compute.
+*/
+
+typedef void (*DownsampleRowFn)(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* output,
+    unsigned output_width);
+
+static CORE_INLINE uint8_t Avg(unsigned a, unsigned b)
+{
+    return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+static void DownsampleRow_Scalar(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* output,
+    unsigned output_width)
+{
+    for (unsigned x = 0; x < output_width; ++x) {
+        output[x] = Avg(Avg(row0[2 * x], row1[2 * x]), Avg(row0[2 * x + 1], row1[2 * x + 1]));
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static void DownsampleRow_SSE2(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* output,
+    unsigned output_width)
+{
+    const __m128i low_mask = _mm_set1_epi16(0x00ff);
+
+    unsigned x = 0;
+    for (; x + 16 <= output_width; x += 16)
+    {
+        const __m128i a = _mm_avg_epu8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x)));
+        const __m128i b = _mm_avg_epu8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x + 16)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x + 16)));
+
+        // Even and odd columns in 16-bit lanes
+        const __m128i avg_a = _mm_avg_epu16(_mm_and_si128(a, low_mask), _mm_srli_epi16(a, 8));
+        const __m128i avg_b = _mm_avg_epu16(_mm_and_si128(b, low_mask), _mm_srli_epi16(b, 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), _mm_packus_epi16(avg_a, avg_b));
+    }
+
+    DownsampleRow_Scalar(row0 + 2 * x, row1 + 2 * x, output + x, output_width - x);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void DownsampleRow_NEON(
+    const uint8_t* row0,
+    const uint8_t* row1,
+    uint8_t* output,
+    unsigned output_width)
+{
+    unsigned x = 0;
+    for (; x + 16 <= output_width; x += 16)
+    {
+        const uint8x16x2_t r0 = vld2q_u8(row0 + 2 * x);
+        const uint8x16x2_t r1 = vld2q_u8(row1 + 2 * x);
+
+        const uint8x16_t even = vrhaddq_u8(r0.val[0], r1.val[0]);
+        const uint8x16_t odd = vrhaddq_u8(r0.val[1], r1.val[1]);
+
+        vst1q_u8(output + x, vrhaddq_u8(even, odd));
+    }
+
+    DownsampleRow_Scalar(row0 + 2 * x, row1 + 2 * x, output + x, output_width - x);
+}
+
+#endif // CORE_CPU_ARM64
+
+
+//------------------------------------------------------------------------------
+// Block Cost Kernels
+
+/*
+    costs[d] = SAD of the 8x8 left block at `left` and the right block at
+    `right` - d, for d in [0, max_d].
+*/
+
+typedef void (*BlockCostsFn)(
+    const uint8_t* left,
+    const uint8_t* right,
+    unsigned pitch,
+    unsigned max_d,
+    uint32_t* costs);
+
+static void BlockCosts_Scalar(
+    const uint8_t* left,
+    const uint8_t* right,
+    unsigned pitch,
+    unsigned max_d,
+    uint32_t* costs)
+{
+    for (unsigned d = 0; d <= max_d; ++d)
+    {
+        const uint8_t* l = left;
+        const uint8_t* r = right - d;
+        uint32_t sad = 0;
+        for (unsigned y = 0; y < kBlockSize; ++y, l += pitch, r += pitch) {
+            for (unsigned x = 0; x < kBlockSize; ++x) {
+                const int diff = l[x] - r[x];
+                sad += diff < 0 ? -diff : diff;
+            }
+        }
+        costs[d] = sad;
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+static CORE_INLINE __m128i LoadRowPair_SSE2(const uint8_t* p, unsigned pitch)
+{
+    return _mm_unpacklo_epi64(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + pitch)));
+}
+
+static void BlockCosts_SSE2(
+    const uint8_t* left,
+    const uint8_t* right,
+    unsigned pitch,
+    unsigned max_d,
+    uint32_t* costs)
+{
+    const __m128i l0 = LoadRowPair_SSE2(left, pitch);
+    const __m128i l1 = LoadRowPair_SSE2(left + 2 * pitch, pitch);
+    const __m128i l2 = LoadRowPair_SSE2(left + 4 * pitch, pitch);
+    const __m128i l3 = LoadRowPair_SSE2(left + 6 * pitch, pitch);
+
+    for (unsigned d = 0; d <= max_d; ++d)
+    {
+        const uint8_t* r = right - d;
+
+        __m128i sum = _mm_sad_epu8(l0, LoadRowPair_SSE2(r, pitch));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(l1, LoadRowPair_SSE2(r + 2 * pitch, pitch)));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(l2, LoadRowPair_SSE2(r + 4 * pitch, pitch)));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(l3, LoadRowPair_SSE2(r + 6 * pitch, pitch)));
+
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+        costs[d] = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+    }
+}
+
+/*
+    mpsadbw compares one 4-byte group against 8 consecutive offsets, so each
+    row gives 8 disparities at once: The low lane matches left bytes 0..3
+    and the high lane left bytes 4..7, against windows 4 bytes apart.
+    Windows start up to 7 bytes before and end up to 12 bytes after the
+    block, which kPlanePadding covers.
+*/
+CORE_TARGET_AVX2 static void BlockCosts_AVX2(
+    const uint8_t* left,
+    const uint8_t* right,
+    unsigned pitch,
+    unsigned max_d,
+    uint32_t* costs)
+{
+    __m256i l[kBlockSize];
+    for (unsigned y = 0; y < kBlockSize; ++y) {
+        l[y] = _mm256_broadcastq_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(left + y * pitch)));
+    }
+
+    for (unsigned d0 = 0; d0 <= max_d; d0 += 8)
+    {
+        // Offset k in the window is disparity d0 + 7 - k
+        const uint8_t* window = right - d0 - 7;
+
+        // At most 8 rows * 4 bytes * 255 per lane, so 16 bits are enough
+        __m256i sum = _mm256_setzero_si256();
+        for (unsigned y = 0; y < kBlockSize; ++y, window += pitch)
+        {
+            const __m256i w = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(window))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + 4)),
+                1);
+
+            // Low lane: left group 0, high lane: left group 1
+            sum = _mm256_add_epi16(sum, _mm256_mpsadbw_epu8(w, l[y], 0x08));
+        }
+
+        const __m128i total = _mm_add_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+
+        uint16_t sads[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sads), total);
+        for (unsigned k = 0; k < 8; ++k) {
+            const unsigned d = d0 + 7 - k;
+            if (d <= max_d) {
+                costs[d] = sads[k];
+            }
+        }
+    }
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void BlockCosts_NEON(
+    const uint8_t* left,
+    const uint8_t* right,
+    unsigned pitch,
+    unsigned max_d,
+    uint32_t* costs)
+{
+    uint8x8_t l[kBlockSize];
+    for (unsigned y = 0; y < kBlockSize; ++y) {
+        l[y] = vld1_u8(left + y * pitch);
+    }
+
+    for (unsigned d = 0; d <= max_d; ++d)
+    {
+        const uint8_t* r = right - d;
+
+        // At most 8 * 255 per lane, so 16 bits are enough
+        uint16x8_t sum = vabdl_u8(l[0], vld1_u8(r));
+        for (unsigned y = 1; y < kBlockSize; ++y) {
+            sum = vabal_u8(sum, l[y], vld1_u8(r + y * pitch));
+        }
+        costs[d] = vaddlvq_u16(sum);
+    }
+}
+
+#endif // CORE_CPU_ARM64
+
+
+//------------------------------------------------------------------------------
+// Kernel Selection
+
+struct StereoKernels
+{
+    DownsampleRowFn DownsampleRow = nullptr;
+    BlockCostsFn BlockCosts = nullptr;
+};
+
+static bool SelectStereoKernels(CameraKernelPath path, StereoKernels& kernels)
+{
+    if (path == CameraKernelPath::Auto) {
+        path = GetBestCameraKernelPath();
+    }
+    if (!IsCameraKernelPathSupported(path)) {
+        return false;
+    }
+
+    kernels.DownsampleRow = DownsampleRow_Scalar;
+    kernels.BlockCosts = BlockCosts_Scalar;
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CameraKernelPath::SSE2:
+        kernels.DownsampleRow = DownsampleRow_SSE2;
+        kernels.BlockCosts = BlockCosts_SSE2;
+        break;
+    case CameraKernelPath::AVX2:
+        // Downsampling is bound by memory, so SSE2 is as fast
+        kernels.DownsampleRow = DownsampleRow_SSE2;
+        kernels.BlockCosts = BlockCosts_AVX2;
+        break;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CameraKernelPath::NEON:
+        kernels.DownsampleRow = DownsampleRow_NEON;
+        kernels.BlockCosts = BlockCosts_NEON;
+        break;
+#endif
+    default:
+        break;
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static unsigned BlockTexture(const uint8_t* block, unsigned pitch)
+{
+    unsigned texture = 0;
+    for (unsigned y = 0; y < kBlockSize; ++y, block += pitch) {
+        for (unsigned x = 0; x + 1 < kBlockSize; ++x) {
+            const int diff = block[x + 1] - block[x];
+            texture += diff < 0 ? -diff : diff;
+        }
+    }
+    return texture;
+}
+
+/// Returns the matched disparity, or a negative value if the block is rejected
+static float MatchBlock(
+    const uint32_t* costs,
+    unsigned max_d,
+    unsigned uniqueness_percent)
+{
+    unsigned best_d = 0;
+    for (unsigned d = 1; d <= max_d; ++d) {
+        if (costs[d] < costs[best_d]) {
+            best_d = d;
+        }
+    }
+
+    // Best cost at least two disparities away from the best
+    uint32_t second = ~(uint32_t)0;
+    for (unsigned d = 0; d <= max_d; ++d) {
+        if ((d + 1 < best_d || d > best_d + 1) && costs[d] < second) {
+            second = costs[d];
+        }
+    }
+    if ((uint64_t)costs[best_d] * 100 >= (uint64_t)second * uniqueness_percent) {
+        return -1.f;
+    }
+
+    // The true minimum may be past the end of the search
+    if (best_d == 0 || best_d == max_d) {
+        return -1.f;
+    }
+
+    // Parabola through the best cost and its neighbors
+    const float c_minus = static_cast<float>(costs[best_d - 1]);
+    const float c_best = static_cast<float>(costs[best_d]);
+    const float c_plus = static_cast<float>(costs[best_d + 1]);
+    const float curvature = c_minus - 2.f * c_best + c_plus;
+    float delta = 0.f;
+    if (curvature > 0.f) {
+        delta = 0.5f * (c_minus - c_plus) / curvature;
+    }
+
+    return static_cast<float>(best_d) + delta;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraStereoMatcher
+
+bool CameraStereoMatcher::Process(
+    const uint8_t* left,
+    unsigned left_pitch,
+    const uint8_t* right,
+    unsigned right_pitch,
+    unsigned width,
+    unsigned height,
+    WorkerPool* pool,
+    CameraKernelPath path)
+{
+    StereoKernels kernels;
+    if (Params.BlockSize != kBlockSize ||
+        !SelectStereoKernels(path, kernels))
+    {
+        return false;
+    }
+
+    PlaneWidth = width / 2;
+    PlaneHeight = height / 2;
+    Grid.Width = PlaneWidth / kBlockSize;
+    Grid.Height = PlaneHeight / kBlockSize;
+    if (Grid.Width == 0 || Grid.Height == 0) {
+        return false;
+    }
+
+    const size_t plane_bytes = (size_t)PlaneWidth * PlaneHeight;
+    Left.resize(kPlanePadding + plane_bytes + kPlanePadding);
+    Right.resize(kPlanePadding + plane_bytes + kPlanePadding);
+    uint8_t* left_plane = Left.data() + kPlanePadding;
+    uint8_t* right_plane = Right.data() + kPlanePadding;
+
+    const size_t block_count = (size_t)Grid.Width * Grid.Height;
+    Grid.Disparity.assign(block_count, 0.f);
+    Grid.DepthMeters.assign(block_count, 0.f);
+
+    const unsigned pitch = PlaneWidth;
+    const float focal = Params.FocalLengthPixels * 0.5f;
+
+    std::vector<unsigned> band_valid(Grid.Height, 0);
+
+    // Each task downsamples the rows of one block row and matches them.
+    // Blocks only read their own rows, so tasks are independent
+    auto process_block_row = [&](unsigned by)
+    {
+        for (unsigned y = by * kBlockSize; y < (by + 1) * kBlockSize; ++y)
+        {
+            const size_t row0 = (size_t)2 * y;
+            kernels.DownsampleRow(
+                left + row0 * left_pitch,
+                left + (row0 + 1) * left_pitch,
+                left_plane + (size_t)y * pitch,
+                PlaneWidth);
+            kernels.DownsampleRow(
+                right + row0 * right_pitch,
+                right + (row0 + 1) * right_pitch,
+                right_plane + (size_t)y * pitch,
+                PlaneWidth);
+        }
+
+        std::vector<uint32_t> costs(Params.MaxDisparity + 1);
+        unsigned valid = 0;
+
+        for (unsigned bx = 0; bx < Grid.Width; ++bx)
+        {
+            const unsigned x = bx * kBlockSize;
+            const size_t offset = (size_t)by * kBlockSize * pitch + x;
+            const uint8_t* left_block = left_plane + offset;
+
+            const unsigned max_d = std::min(Params.MaxDisparity, x);
+            if (max_d < kMinSearch || BlockTexture(left_block, pitch) < Params.MinTexture) {
+                continue;
+            }
+
+            kernels.BlockCosts(left_block, right_plane + offset, pitch, max_d, costs.data());
+
+            const float disparity = MatchBlock(costs.data(), max_d, Params.UniquenessPercent);
+            if (disparity < 0.f) {
+                continue;
+            }
+
+            // Disparities at or below a distant scene are out of range
+            const float effective = disparity - Params.DisparityOffset;
+            if (effective <= 0.25f) {
+                continue;
+            }
+
+            const size_t index = (size_t)by * Grid.Width + bx;
+            Grid.Disparity[index] = disparity;
+            Grid.DepthMeters[index] = Params.BaselineMeters * focal / effective;
+            ++valid;
+        }
+
+        band_valid[by] = valid;
+    };
+
+    if (pool) {
+        pool->ParallelFor(Grid.Height, process_block_row);
+    }
+    else {
+        for (unsigned by = 0; by < Grid.Height; ++by) {
+            process_block_row(by);
+        }
+    }
+
+    Grid.ValidCount = 0;
+    for (unsigned valid : band_valid) {
+        Grid.ValidCount += valid;
+    }
+
+    return true;
+}
+
+float CameraStereoMatcher::EstimateSceneDistance() const
+{
+    const size_t block_count = (size_t)Grid.Width * Grid.Height;
+    if (block_count == 0 || Grid.ValidCount * 100 < block_count * kMinValidPercent) {
+        return 0.f;
+    }
+
+    std::vector<float> depths;
+    depths.reserve(Grid.ValidCount);
+    for (float depth : Grid.DepthMeters) {
+        if (depth > 0.f) {
+            depths.push_back(depth);
+        }
+    }
+
+    auto median = depths.begin() + depths.size() / 2;
+    std::nth_element(depths.begin(), median, depths.end());
+    return *median;
+}
+
+
+} // namespace core
@@ -0,0 +1,536 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "CameraUndistort.hpp"
+#include "core_cpu.hpp"
+
+#include <math.h>
+#include <string.h> // memcpy, memset
+
+#if defined(CORE_CPU_X86)
+    #include <immintrin.h>
+#elif defined(CORE_CPU_ARM64)
+    #include <arm_neon.h>
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+static const unsigned kOffsetBits = 22;
+static const uint32_t kOffsetMask = (1u << kOffsetBits) - 1;
+static const unsigned kFracMask = kCameraRemapFracOne - 1;
+
+static uint32_t PackEntry(uint32_t offset, unsigned fx, unsigned fy)
+{
+    return offset | (fx << kOffsetBits) | (fy << (kOffsetBits + kCameraRemapFracBits));
+}
+
+/// Radius in the source image that the lens model draws at output radius r_out.
+/// Returns a negative value if there is none
+static double InvertRadius(double k1, double k2, double r_out)
+{
+    if (r_out <= 0.) {
+        return 0.;
+    }
+
+    // Newton's method on g(r) = r - r_out * (1 + k1 r^2 + k2 r^4)
+    double r = r_out;
+    for (int i = 0; i < 32; ++i)
+    {
+        const double r2 = r * r;
+        const double g = r - r_out * (1. + k1 * r2 + k2 * r2 * r2);
+        const double dg = 1. - r_out * (2. * k1 * r + 4. * k2 * r2 * r);
+        if (dg == 0.) {
+            return -1.;
+        }
+        const double step = g / dg;
+        r -= step;
+        if (r < 0.) {
+            return -1.;
+        }
+        if (fabs(step) < 1e-9) {
+            break;
+        }
+    }
+
+    // The forward mapping must be valid at the solution
+    const double r2 = r * r;
+    const double denominator = 1. + k1 * r2 + k2 * r2 * r2;
+    if (denominator <= 0. || fabs(r / denominator - r_out) > 1e-6) {
+        return -1.;
+    }
+    return r;
+}
+
+/// Bilinear blend of one pixel, shared by all paths for their edges
+static CORE_INLINE uint8_t SampleEntry(const uint8_t* source, unsigned pitch, uint32_t entry, uint8_t border)
+{
+    if (entry == kCameraRemapInvalid) {
+        return border;
+    }
+
+    const uint8_t* p = source + (entry & kOffsetMask);
+    const unsigned fx = (entry >> kOffsetBits) & kFracMask;
+    const unsigned fy = entry >> (kOffsetBits + kCameraRemapFracBits);
+
+    const unsigned top = p[0] * (kCameraRemapFracOne - fx) + p[1] * fx;
+    const unsigned bottom = p[pitch] * (kCameraRemapFracOne - fx) + p[pitch + 1] * fx;
+    const unsigned sum = top * (kCameraRemapFracOne - fy) + bottom * fy;
+
+    return static_cast<uint8_t>((sum + (1u << (2 * kCameraRemapFracBits - 1))) >> (2 * kCameraRemapFracBits));
+}
+
+
+//------------------------------------------------------------------------------
+// CameraRemapLut : Build
+
+bool CameraRemapLut::Build(const CameraUndistortParams& params)
+{
+    Entries.clear();
+    Params = params;
+
+    const unsigned sw = params.SourceWidth, sh = params.SourceHeight;
+    const unsigned ow = params.OutputWidth, oh = params.OutputHeight;
+
+    if (sw < 2 || sh < 2 || ow < 1 || oh < 1 ||
+        params.SourcePitch < sw ||
+        params.OutputZoom <= 0.f ||
+        (uint64_t)params.SourcePitch * sh > kOffsetMask)
+    {
+        return false;
+    }
+
+    const double k1 = params.K1, k2 = params.K2;
+
+    // Normalized to the source height, as in CameraRenderer::GenerateMesh()
+    const double aspect = (double)sw / sh;
+
+    // Where the source edge midpoints land in the output
+    const double edge_r = 0.5 * aspect;
+    const double edge_denominator = 1. + k1 * edge_r * edge_r + k2 * edge_r * edge_r * edge_r * edge_r;
+    if (edge_denominator <= 0.) {
+        return false;
+    }
+    const double extent_x = edge_r / edge_denominator / params.OutputZoom;
+
+    // Square output pixels
+    const double output_scale = 2. * extent_x / ow;
+
+    // Keep the sample point inside the source so both neighbors exist
+    const double max_x = (double)(sw - 1) - 1. / kCameraRemapFracOne;
+    const double max_y = (double)(sh - 1) - 1. / kCameraRemapFracOne;
+
+    Entries.resize((size_t)ow * oh);
+
+    for (unsigned y = 0; y < oh; ++y)
+    {
+        const double oy = ((double)y + 0.5 - 0.5 * oh) * output_scale;
+
+        for (unsigned x = 0; x < ow; ++x)
+        {
+            const double ox = ((double)x + 0.5 - 0.5 * ow) * output_scale;
+            const double r_out = sqrt(ox * ox + oy * oy);
+
+            uint32_t entry = kCameraRemapInvalid;
+
+            const double r_in = InvertRadius(k1, k2, r_out);
+            if (r_in >= 0.)
+            {
+                const double ratio = (r_out > 0.) ? (r_in / r_out) : 1.;
+
+                // Back to source pixels, with pixel centers at +0.5
+                double sx = (ox * ratio + 0.5 * aspect) * sh - 0.5;
+                double sy = (oy * ratio + 0.5) * sh - 0.5;
+
+                // Clamp up to half a pixel outside, like texture clamping
+                if (sx >= -0.5 && sy >= -0.5 && sx <= sw - 0.5 && sy <= sh - 0.5)
+                {
+                    sx = sx < 0. ? 0. : (sx > max_x ? max_x : sx);
+                    sy = sy < 0. ? 0. : (sy > max_y ? max_y : sy);
+
+                    const unsigned fixed_x = (unsigned)(sx * kCameraRemapFracOne + 0.5);
+                    const unsigned fixed_y = (unsigned)(sy * kCameraRemapFracOne + 0.5);
+                    const unsigned ix = fixed_x >> kCameraRemapFracBits;
+                    const unsigned iy = fixed_y >> kCameraRemapFracBits;
+
+                    entry = PackEntry(
+                        iy * params.SourcePitch + ix,
+                        fixed_x & kFracMask,
+                        fixed_y & kFracMask);
+                }
+            }
+
+            Entries[(size_t)y * ow + x] = entry;
+        }
+    }
+
+    return true;
+}
+
+bool CameraRemapLut::GetSourcePosition(unsigned x, unsigned y, float& source_x, float& source_y) const
+{
+    if (x >= Params.OutputWidth || y >= Params.OutputHeight || Entries.empty()) {
+        return false;
+    }
+    const uint32_t entry = Entries[(size_t)y * Params.OutputWidth + x];
+    if (entry == kCameraRemapInvalid) {
+        return false;
+    }
+
+    const uint32_t offset = entry & kOffsetMask;
+    const unsigned fx = (entry >> kOffsetBits) & kFracMask;
+    const unsigned fy = entry >> (kOffsetBits + kCameraRemapFracBits);
+
+    source_x = (float)(offset % Params.SourcePitch) + fx / (float)kCameraRemapFracOne;
+    source_y = (float)(offset / Params.SourcePitch) + fy / (float)kCameraRemapFracOne;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraRemapLut : Row Kernels
+
+typedef void (*RemapRowFn)(
+    const uint8_t* source,
+    unsigned pitch,
+    const uint32_t* entries,
+    uint8_t* output,
+    unsigned count,
+    uint8_t border);
+
+static void RemapRow_Scalar(
+    const uint8_t* source,
+    unsigned pitch,
+    const uint32_t* entries,
+    uint8_t* output,
+    unsigned count,
+    uint8_t border)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        output[i] = SampleEntry(source, pitch, entries[i], border);
+    }
+}
+
+#if defined(CORE_CPU_X86)
+
+/*
+    8 pixels at a time in 16-bit lanes:
+
+        top_pairs:    (p00, p01) per pixel
+        bottom_pairs: (p10, p11) per pixel
+        wx:           (32 - fx, fx) per pixel
+
+    madd(pairs, wx) gives the horizontal blends (at most 255 * 32), which
+    are packed back to 16 bits, interleaved top/bottom, and blended again
+    with (32 - fy, fy).
+*/
+static CORE_INLINE __m128i BlendPairs_SSE2(
+    __m128i top_pairs_lo, __m128i top_pairs_hi,
+    __m128i bottom_pairs_lo, __m128i bottom_pairs_hi,
+    __m128i wx_lo, __m128i wx_hi,
+    __m128i wy_lo, __m128i wy_hi)
+{
+    const __m128i top = _mm_packs_epi32(
+        _mm_madd_epi16(top_pairs_lo, wx_lo),
+        _mm_madd_epi16(top_pairs_hi, wx_hi));
+    const __m128i bottom = _mm_packs_epi32(
+        _mm_madd_epi16(bottom_pairs_lo, wx_lo),
+        _mm_madd_epi16(bottom_pairs_hi, wx_hi));
+
+    const __m128i round = _mm_set1_epi32(1 << (2 * kCameraRemapFracBits - 1));
+    const __m128i sum_lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), wy_lo), round);
+    const __m128i sum_hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(top, bottom), wy_hi), round);
+
+    return _mm_packs_epi32(
+        _mm_srli_epi32(sum_lo, 2 * kCameraRemapFracBits),
+        _mm_srli_epi32(sum_hi, 2 * kCameraRemapFracBits));
+}
+
+// Weight pairs (one - f, f) for 4 pixels from fractions in 32-bit lanes
+static CORE_INLINE __m128i WeightPairs_SSE2(__m128i f)
+{
+    const __m128i one = _mm_set1_epi32(kCameraRemapFracOne);
+    return _mm_or_si128(_mm_sub_epi32(one, f), _mm_slli_epi32(f, 16));
+}
+
+// Spread 8 byte pairs (16 bits each) into 32-bit lanes of 16-bit values
+static CORE_INLINE void SpreadPairs_SSE2(__m128i pairs, __m128i& lo, __m128i& hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes_lo = _mm_unpacklo_epi8(pairs, zero);
+    const __m128i bytes_hi = _mm_unpackhi_epi8(pairs, zero);
+    lo = bytes_lo;
+    hi = bytes_hi;
+}
+
+static void RemapRow_SSE2(
+    const uint8_t* source,
+    unsigned pitch,
+    const uint32_t* entries,
+    uint8_t* output,
+    unsigned count,
+    uint8_t border)
+{
+    const __m128i offset_mask = _mm_set1_epi32(kOffsetMask);
+    const __m128i frac_mask = _mm_set1_epi32(kFracMask);
+    const __m128i invalid = _mm_set1_epi32((int)kCameraRemapInvalid);
+    const __m128i border_v = _mm_set1_epi16(border);
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i e0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entries + i));
+        const __m128i e1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entries + i + 4));
+
+        // Invalid entries read pixel 0, then get replaced by the border
+        const __m128i bad0 = _mm_cmpeq_epi32(e0, invalid);
+        const __m128i bad1 = _mm_cmpeq_epi32(e1, invalid);
+        const __m128i v0 = _mm_andnot_si128(bad0, e0);
+        const __m128i v1 = _mm_andnot_si128(bad1, e1);
+
+        uint32_t offsets[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(offsets), _mm_and_si128(v0, offset_mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(offsets + 4), _mm_and_si128(v1, offset_mask));
+
+        // No gather on SSE2: Assemble the byte pairs with 16-bit inserts
+        __m128i top_pairs = _mm_setzero_si128();
+        __m128i bottom_pairs = _mm_setzero_si128();
+#define CORE_REMAP_INSERT(k) \
+        { \
+            uint16_t t, b; \
+            memcpy(&t, source + offsets[k], 2); \
+            memcpy(&b, source + offsets[k] + pitch, 2); \
+            top_pairs = _mm_insert_epi16(top_pairs, t, k); \
+            bottom_pairs = _mm_insert_epi16(bottom_pairs, b, k); \
+        }
+        CORE_REMAP_INSERT(0) CORE_REMAP_INSERT(1) CORE_REMAP_INSERT(2) CORE_REMAP_INSERT(3)
+        CORE_REMAP_INSERT(4) CORE_REMAP_INSERT(5) CORE_REMAP_INSERT(6) CORE_REMAP_INSERT(7)
+#undef CORE_REMAP_INSERT
+
+        __m128i top_lo, top_hi, bottom_lo, bottom_hi;
+        SpreadPairs_SSE2(top_pairs, top_lo, top_hi);
+        SpreadPairs_SSE2(bottom_pairs, bottom_lo, bottom_hi);
+
+        const __m128i wx_lo = WeightPairs_SSE2(_mm_and_si128(_mm_srli_epi32(v0, kOffsetBits), frac_mask));
+        const __m128i wx_hi = WeightPairs_SSE2(_mm_and_si128(_mm_srli_epi32(v1, kOffsetBits), frac_mask));
+        const __m128i wy_lo = WeightPairs_SSE2(_mm_srli_epi32(v0, kOffsetBits + kCameraRemapFracBits));
+        const __m128i wy_hi = WeightPairs_SSE2(_mm_srli_epi32(v1, kOffsetBits + kCameraRemapFracBits));
+
+        __m128i result = BlendPairs_SSE2(
+            top_lo, top_hi, bottom_lo, bottom_hi,
+            wx_lo, wx_hi, wy_lo, wy_hi);
+
+        const __m128i bad = _mm_packs_epi32(bad0, bad1);
+        result = _mm_or_si128(_mm_and_si128(bad, border_v), _mm_andnot_si128(bad, result));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(result, result));
+    }
+
+    RemapRow_Scalar(source, pitch, entries + i, output + i, count - i, border);
+}
+
+CORE_TARGET_AVX2 static void RemapRow_AVX2(
+    const uint8_t* source,
+    unsigned pitch,
+    const uint32_t* entries,
+    uint8_t* output,
+    unsigned count,
+    uint8_t border)
+{
+    const __m256i offset_mask = _mm256_set1_epi32(kOffsetMask);
+    const __m256i frac_mask = _mm256_set1_epi32(kFracMask);
+    const __m256i invalid = _mm256_set1_epi32((int)kCameraRemapInvalid);
+    const __m256i one = _mm256_set1_epi32(kCameraRemapFracOne);
+    const __m256i pair_mask = _mm256_set1_epi32(0xffff);
+    const __m256i round = _mm256_set1_epi32(1 << (2 * kCameraRemapFracBits - 1));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i border_v = _mm256_set1_epi32(border);
+    const __m256i row_offset = _mm256_set1_epi32((int)pitch);
+    const int* base = reinterpret_cast<const int*>(source);
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(entries + i));
+        const __m256i bad = _mm256_cmpeq_epi32(e, invalid);
+        const __m256i v = _mm256_andnot_si256(bad, e);
+
+        const __m256i offsets = _mm256_and_si256(v, offset_mask);
+
+        // Low 16 bits of each gathered word are the (left, right) byte pair
+        const __m256i top = _mm256_and_si256(
+            _mm256_i32gather_epi32(base, offsets, 1), pair_mask);
+        const __m256i bottom = _mm256_and_si256(
+            _mm256_i32gather_epi32(base, _mm256_add_epi32(offsets, row_offset), 1), pair_mask);
+
+        // Bytes to 16-bit lanes within each 32-bit lane: (p0, p1)
+        const __m256i top_pairs = _mm256_unpacklo_epi8(
+            _mm256_packus_epi32(top, zero), zero);
+        const __m256i bottom_pairs = _mm256_unpacklo_epi8(
+            _mm256_packus_epi32(bottom, zero), zero);
+
+        // packus_epi32 + unpacklo_epi8 keep each 128-bit half in order
+        const __m256i fx = _mm256_and_si256(_mm256_srli_epi32(v, kOffsetBits), frac_mask);
+        const __m256i fy = _mm256_srli_epi32(v, kOffsetBits + kCameraRemapFracBits);
+        const __m256i wx = _mm256_or_si256(_mm256_sub_epi32(one, fx), _mm256_slli_epi32(fx, 16));
+        const __m256i wy = _mm256_or_si256(_mm256_sub_epi32(one, fy), _mm256_slli_epi32(fy, 16));
+
+        // Horizontal then vertical blends, as in the SSE2 path
+        const __m256i h_top = _mm256_madd_epi16(top_pairs, wx);
+        const __m256i h_bottom = _mm256_madd_epi16(bottom_pairs, wx);
+        const __m256i h_pairs = _mm256_or_si256(h_top, _mm256_slli_epi32(h_bottom, 16));
+        __m256i sum = _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(h_pairs, wy), round),
+            2 * kCameraRemapFracBits);
+
+        sum = _mm256_blendv_epi8(sum, border_v, bad);
+
+        // 8 x 32-bit lanes down to 8 bytes
+        const __m256i packed16 = _mm256_packus_epi32(sum, zero);
+        const __m256i packed8 = _mm256_packus_epi16(packed16, zero);
+        const uint32_t lo = (uint32_t)_mm256_extract_epi32(packed8, 0);
+        const uint32_t hi = (uint32_t)_mm256_extract_epi32(packed8, 4);
+        memcpy(output + i, &lo, 4);
+        memcpy(output + i + 4, &hi, 4);
+    }
+
+    RemapRow_Scalar(source, pitch, entries + i, output + i, count - i, border);
+}
+
+#endif // CORE_CPU_X86
+
+#if defined(CORE_CPU_ARM64)
+
+static void RemapRow_NEON(
+    const uint8_t* source,
+    unsigned pitch,
+    const uint32_t* entries,
+    uint8_t* output,
+    unsigned count,
+    uint8_t border)
+{
+    const uint32x4_t offset_mask = vdupq_n_u32(kOffsetMask);
+    const uint32x4_t frac_mask = vdupq_n_u32(kFracMask);
+    const uint32x4_t invalid = vdupq_n_u32(kCameraRemapInvalid);
+    const uint16x8_t one = vdupq_n_u16(kCameraRemapFracOne);
+
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const uint32x4_t e0 = vld1q_u32(entries + i);
+        const uint32x4_t e1 = vld1q_u32(entries + i + 4);
+        const uint32x4_t bad0 = vceqq_u32(e0, invalid);
+        const uint32x4_t bad1 = vceqq_u32(e1, invalid);
+        const uint32x4_t v0 = vbicq_u32(e0, bad0);
+        const uint32x4_t v1 = vbicq_u32(e1, bad1);
+
+        uint32_t offsets[8];
+        vst1q_u32(offsets, vandq_u32(v0, offset_mask));
+        vst1q_u32(offsets + 4, vandq_u32(v1, offset_mask));
+
+        uint8_t p00[8], p01[8], p10[8], p11[8];
+        for (unsigned k = 0; k < 8; ++k) {
+            const uint8_t* p = source + offsets[k];
+            p00[k] = p[0];
+            p01[k] = p[1];
+            p10[k] = p[pitch];
+            p11[k] = p[pitch + 1];
+        }
+
+        const uint16x8_t fx = vcombine_u16(
+            vmovn_u32(vandq_u32(vshrq_n_u32(v0, kOffsetBits), frac_mask)),
+            vmovn_u32(vandq_u32(vshrq_n_u32(v1, kOffsetBits), frac_mask)));
+        const uint16x8_t fy = vcombine_u16(
+            vmovn_u32(vshrq_n_u32(v0, kOffsetBits + kCameraRemapFracBits)),
+            vmovn_u32(vshrq_n_u32(v1, kOffsetBits + kCameraRemapFracBits)));
+        const uint16x8_t ifx = vsubq_u16(one, fx);
+        const uint16x8_t ify = vsubq_u16(one, fy);
+
+        // At most 255 * 32, so the horizontal blends fit in 16 bits
+        const uint16x8_t top = vmlaq_u16(vmulq_u16(vmovl_u8(vld1_u8(p00)), ifx), vmovl_u8(vld1_u8(p01)), fx);
+        const uint16x8_t bottom = vmlaq_u16(vmulq_u16(vmovl_u8(vld1_u8(p10)), ifx), vmovl_u8(vld1_u8(p11)), fx);
+
+        const uint32x4_t sum_lo = vmlal_u16(vmull_u16(vget_low_u16(top), vget_low_u16(ify)), vget_low_u16(bottom), vget_low_u16(fy));
+        const uint32x4_t sum_hi = vmlal_u16(vmull_u16(vget_high_u16(top), vget_high_u16(ify)), vget_high_u16(bottom), vget_high_u16(fy));
+
+        const uint16x8_t result16 = vcombine_u16(
+            vrshrn_n_u32(sum_lo, 2 * kCameraRemapFracBits),
+            vrshrn_n_u32(sum_hi, 2 * kCameraRemapFracBits));
+        const uint16x8_t bad = vcombine_u16(vmovn_u32(bad0), vmovn_u32(bad1));
+        const uint16x8_t result = vbslq_u16(bad, vdupq_n_u16(border), result16);
+
+        vst1_u8(output + i, vmovn_u16(result));
+    }
+
+    RemapRow_Scalar(source, pitch, entries + i, output + i, count - i, border);
+}
+
+#endif // CORE_CPU_ARM64
+
+
+//------------------------------------------------------------------------------
+// CameraRemapLut : Apply
+
+static RemapRowFn SelectRemapRow(CameraKernelPath path)
+{
+    if (path == CameraKernelPath::Auto) {
+        path = GetBestCameraKernelPath();
+    }
+    if (!IsCameraKernelPathSupported(path)) {
+        return nullptr;
+    }
+
+    switch (path)
+    {
+#if defined(CORE_CPU_X86)
+    case CameraKernelPath::SSE2: return RemapRow_SSE2;
+    case CameraKernelPath::AVX2: return RemapRow_AVX2;
+#endif
+#if defined(CORE_CPU_ARM64)
+    case CameraKernelPath::NEON: return RemapRow_NEON;
+#endif
+    default:
+        break;
+    }
+    return RemapRow_Scalar;
+}
+
+void CameraRemapLut::ApplyTile(
+    const uint8_t* source,
+    uint8_t* output,
+    unsigned output_pitch,
+    unsigned x,
+    unsigned y,
+    unsigned w,
+    unsigned h,
+    CameraKernelPath path) const
+{
+    const RemapRowFn remap_row = SelectRemapRow(path);
+    if (!remap_row || Entries.empty() ||
+        x >= Params.OutputWidth || y >= Params.OutputHeight)
+    {
+        return;
+    }
+    if (w > Params.OutputWidth - x) {
+        w = Params.OutputWidth - x;
+    }
+    if (h > Params.OutputHeight - y) {
+        h = Params.OutputHeight - y;
+    }
+
+    for (unsigned row = y; row < y + h; ++row)
+    {
+        remap_row(
+            source,
+            Params.SourcePitch,
+            Entries.data() + (size_t)row * Params.OutputWidth + x,
+            output + (size_t)row * output_pitch + x,
+            w,
+            Params.BorderValue);
+    }
+}
+
+
+} // namespace core
@@ -0,0 +1,183 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Passthrough camera latency counters.
+
+    Each camera frame is stamped with core::GetTimeUsec() as it passes
+    through the pipeline, from the implant to the render that uses it.
+    Exposure is not a stage: Without a device clock it is only ever the
+    receive time minus a fixed latency.
+    The renderer adds the time between consecutive stages to one histogram
+    per interval, and publishes them in this shared memory so tools can
+    watch which stage regresses on a headset or driver without a debugger.
+
+    The renderer is the only writer.  Readers copy the counters out under
+    the sequence lock.
+*/
+
+#ifndef CAMERA_LATENCY_ABI_HPP
+#define CAMERA_LATENCY_ABI_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "seqlock.hpp"
+
+
+//------------------------------------------------------------------------------
+// Constants
+
+// Created by the renderer in the user session
+#define CAMERA_LATENCY_SHARED_MEMORY_NAME "Local\\mrcam_latency"
+
+// Incremented whenever CameraLatencyCounters changes
+#define CAMERA_LATENCY_ABI_VERSION 1
+
+
+//------------------------------------------------------------------------------
+// Stages
+
+// Points in the pipeline where a frame is stamped, in order
+enum class CameraLatencyStage : unsigned
+{
+    // USB transfer completed (My_WinUsb_GetOverlappedResult)
+    Receive,
+
+    // Implant finished copying the transfer into the frame ring
+    Publish,
+
+    // CameraClient::AcquireNextFrame() pinned the frame
+    Acquire,
+
+    // Split, denoised and enhanced into the scheduler queue
+    Process,
+
+    // Picked by the scheduler for a display frame
+    Select,
+
+    // Copied into the render texture (UpdateTexture)
+    Upload,
+
+    // First view rendered with the frame and its CameraPoseHistory pose
+    Render,
+
+    Count
+};
+
+static const unsigned kCameraLatencyStageCount = static_cast<unsigned>(CameraLatencyStage::Count);
+
+// One interval per pair of consecutive stages, then Receive to Render
+static const unsigned kCameraLatencyIntervalCount = kCameraLatencyStageCount;
+static const unsigned kCameraLatencyTotalInterval = kCameraLatencyIntervalCount - 1;
+
+/// Stage name, for example "upload"
+const char* CameraLatencyStageName(CameraLatencyStage stage);
+
+/// Name of the stage an interval ends at, or "total"
+const char* CameraLatencyIntervalName(unsigned interval);
+
+
+//------------------------------------------------------------------------------
+// CameraLatencyHistogram
+
+/*
+    Buckets are log-linear: Values below 8 usec get a bucket each, and every
+    power of two above that is split into four buckets, so a bucket is within
+    25% of the values in it.  The last bucket holds everything from about
+    115 msec up.  Bucket counts stop at UINT32_MAX instead of wrapping.
+*/
+static const unsigned kCameraLatencyBucketCount = 64;
+
+/// Bucket index for a latency
+unsigned CameraLatencyBucket(uint64_t usec);
+
+/// Smallest latency that falls in a bucket
+uint64_t CameraLatencyBucketUsec(unsigned bucket);
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable: 4324)  // Padded struct
+#endif
+#pragma pack(push)
+#pragma pack(4)
+
+struct CameraLatencyHistogram
+{
+    // Frames added
+    uint64_t Count;
+
+    // Sum and largest of all latencies added
+    uint64_t TotalUsec;
+    uint64_t MaxUsec;
+
+    uint32_t Buckets[kCameraLatencyBucketCount];
+
+
+    void Clear()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void Add(uint64_t usec);
+
+    /// Estimate of the given percentile, interpolated linearly within the
+    /// bucket that holds it.  100 returns MaxUsec, and an empty histogram 0
+    uint64_t GetPercentileUsec(unsigned percent) const;
+
+    uint64_t GetAverageUsec() const
+    {
+        return Count > 0 ? TotalUsec / Count : 0;
+    }
+};
+
+struct CameraLatencyCounters
+{
+    // CAMERA_LATENCY_ABI_VERSION
+    uint32_t Version;
+
+    // Frames missing a stage timestamp.  Their intervals are not counted
+    uint32_t Skipped;
+
+    // Frames added to the histograms
+    uint64_t Frames;
+
+    // Latest frame stamps, indexed by CameraLatencyStage
+    uint64_t LastStageUsec[kCameraLatencyStageCount];
+
+    // Indexed by the stage each interval ends at, then the total
+    CameraLatencyHistogram Intervals[kCameraLatencyIntervalCount];
+
+
+    void Clear()
+    {
+        memset(this, 0, sizeof(*this));
+        Version = CAMERA_LATENCY_ABI_VERSION;
+    }
+
+    /// Add the intervals between the stamps of one frame.
+    /// Returns false if a stamp was missing and the frame was skipped
+    bool AddFrame(const uint64_t stage_usec[kCameraLatencyStageCount]);
+};
+
+struct CameraLatencySharedMemoryLayout
+{
+    core::SeqLock<CameraLatencyCounters> Counters;
+
+    /// Returns false if the writer did not finish in time or the version
+    /// does not match
+    bool Read(
+        uint32_t& epoch,
+        CameraLatencyCounters& counters,
+        core::SeqLockStats* stats = nullptr) const;
+};
+
+#pragma pack(pop)
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+static const uint32_t kCameraLatencySharedMemoryBytes = static_cast<uint32_t>(sizeof(CameraLatencySharedMemoryLayout));
+
+#endif // CAMERA_LATENCY_ABI_HPP
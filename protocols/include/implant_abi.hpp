@@ -20,50 +20,115 @@
 //------------------------------------------------------------------------------
 // Implant Shared Memory Layout
 
+// Each shared atomic lives on its own cache lines.
+// GCC and Clang cap aligned() at the #pragma pack value, so the layout is
+// only packed on MSVC, where __declspec(align) takes precedence over packing.
+// Both ends of this layout are always built by the same compiler.
+#if defined(_MSC_VER)
+    #define IMPLANT_ALIGNED(x) __declspec(align(x))
+#else
+    #define IMPLANT_ALIGNED(x) __attribute__((aligned(x)))
+#endif
+
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable: 4324)  // Padded struct
-#endif
 #pragma pack(push)
 #pragma pack(4)
+#endif
+
+static const unsigned kImplantCameraBytes = 640 * 480 * 2 + 4096;
+
+// Number of frames the implant can hold.  Each reader pins at most one slot,
+// and the implant never overwrites the newest frame, so this allows up to
+// two simultaneous readers before frames are dropped.
+static const unsigned kImplantCameraSlotCount = 4;
+
+struct ImplantCameraSlot
+{
+    // Twice the frame number once written.  Odd while the implant is writing
+    std::atomic<uint32_t> Sequence = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingSequence[64 - 4];
+
+    // Number of readers using this slot.  The implant skips pinned slots
+    std::atomic<uint32_t> Pins = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingPins[64 - 4];
+
+    uint32_t CameraBytes;
+
+    // core::GetTimeUsec() when the USB transfer completed
+    uint64_t ReceiveTimeUsec;
+
+    // core::GetTimeUsec() when the implant finished copying the frame
+    uint64_t PublishTimeUsec;
+    IMPLANT_ALIGNED(256) uint8_t CameraData[kImplantCameraBytes];
+};
 
 struct ImplantSharedMemoryLayout
 {
     // Increment this to trigger another USB HUB power tweak
-    __declspec(align(256)) std::atomic<uint32_t> UsbHubPowerEpoch = ATOMIC_VAR_INIT(0);
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> UsbHubPowerEpoch = ATOMIC_VAR_INIT(0);
+
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> EnableServiceHook = ATOMIC_VAR_INIT(0);
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> RemoveServiceHook = ATOMIC_VAR_INIT(0);
+
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> ImplantStage = ATOMIC_VAR_INIT(0);
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> ImplantInstalled = ATOMIC_VAR_INIT(0);
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> ImplantRemoveGood = ATOMIC_VAR_INIT(0);
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> ImplantRemoveFail = ATOMIC_VAR_INIT(0);
+
+    static const unsigned kCameraBytes = kImplantCameraBytes;
+
+    /*
+        Camera frame ring:
 
-    __declspec(align(256)) std::atomic<uint32_t> EnableServiceHook = ATOMIC_VAR_INIT(0);
-    __declspec(align(256)) std::atomic<uint32_t> RemoveServiceHook = ATOMIC_VAR_INIT(0);
+        The implant writes each frame into a slot that is neither pinned by
+        a reader nor holding the newest frame, then publishes its frame
+        number.  Readers pin the newest slot and use the data in place until
+        they release it.  Frames are only copied once, from the USB buffer.
 
-    __declspec(align(256)) std::atomic<uint32_t> ImplantStage = ATOMIC_VAR_INIT(0);
-    __declspec(align(256)) std::atomic<uint32_t> ImplantInstalled = ATOMIC_VAR_INIT(0);
-    __declspec(align(256)) std::atomic<uint32_t> ImplantRemoveGood = ATOMIC_VAR_INIT(0);
-    __declspec(align(256)) std::atomic<uint32_t> ImplantRemoveFail = ATOMIC_VAR_INIT(0);
+        If a reader process dies while holding a pin, that slot is lost
+        until the service recreates the shared memory.
+    */
 
-    static const unsigned kCameraBytes = 640 * 480 * 2 + 4096;
+    // Newest complete frame number, or 0 if none
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> CameraPublished = ATOMIC_VAR_INIT(0);
 
-    // Writer will increment BeforeWriteCounter then write data and then
-    // increment AfterWriteCounter.  Reader will read them in the same order
-    // and read again if the counters do not match.
-    __declspec(align(256)) std::atomic<uint32_t> BeforeWriteCounter = ATOMIC_VAR_INIT(0);
-    __declspec(align(256)) volatile uint32_t CameraBytes;
-    __declspec(align(256)) volatile uint64_t ExposureTimeUsec;
-    __declspec(align(256)) volatile uint8_t CameraData[kCameraBytes];
-    __declspec(align(256)) std::atomic<uint32_t> AfterWriteCounter = ATOMIC_VAR_INIT(0);
+    // Number of frames dropped because every slot was in use
+    IMPLANT_ALIGNED(256) std::atomic<uint32_t> CameraDropped = ATOMIC_VAR_INIT(0);
 
-    void WriteCamera(
+    IMPLANT_ALIGNED(256) ImplantCameraSlot CameraSlots[kImplantCameraSlotCount];
+
+
+    // Implant-side:
+
+    // Forget all frames.  Reader pins are preserved
+    void ResetCamera();
+
+    // Returns false if the frame was dropped
+    bool WriteCamera(
         const uint8_t* data,
         uint32_t read_bytes,
-        uint64_t exposure_usec);
-    bool ReadCamera(
-        uint8_t* data,
-        uint32_t& read_bytes,
-        uint64_t& exposure_usec,
-        uint32_t& read_counter);
+        uint64_t receive_usec);
+
+    // Reader-side:
+
+    // Pin the newest frame if it is different from `last_frame_number`.
+    // Returns nullptr if there is no new frame.
+    // The slot must be passed to ReleaseCamera() when done.
+    // If `retries` is set, it is incremented each time the implant replaced
+    // the newest frame while it was being pinned
+    const ImplantCameraSlot* AcquireCamera(
+        uint32_t last_frame_number,
+        uint32_t& frame_number,
+        uint32_t* retries = nullptr);
+
+    // Unpin a slot returned by AcquireCamera()
+    void ReleaseCamera(const ImplantCameraSlot* slot);
 };
 
-#pragma pack(pop)
 #if defined(_MSC_VER)
+#pragma pack(pop)
 #pragma warning(pop)
 #endif
 
@@ -0,0 +1,282 @@
+// Copyright 2019 Augmented Perception Corporation
+
+/*
+    Sequence lock for single-writer, multiple-reader shared memory.
+
+    The writer makes the sequence number odd, writes the data, and then makes
+    the sequence number even again.  Readers copy the data out between two
+    loads of the sequence number and retry if the number was odd or changed
+    while copying.  Readers never block the writer.
+
+    Readers are bounded: they spin briefly, then yield the processor, and
+    give up after a fixed number of attempts.  They never sleep.
+
+    The layout uses explicit padding instead of alignas() so that it is stable
+    under the #pragma pack settings used by the shared memory ABI headers.
+*/
+
+#ifndef XRM_SEQLOCK_HPP
+#define XRM_SEQLOCK_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+    #include <intrin.h> // _mm_pause
+#endif
+
+namespace core {
+
+
+//------------------------------------------------------------------------------
+// Tools
+
+/// Hint to the processor that we are in a spin-wait loop
+inline void SpinPause()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// SeqLockStats
+
+/// Reader-side statistics.  This lives in the reader process, not in the
+/// shared memory region.
+struct SeqLockStats
+{
+    // Number of reads that returned data
+    uint64_t Reads = 0;
+
+    // Number of extra attempts needed by all reads
+    uint64_t Retries = 0;
+
+    // Number of copies that were invalidated by a concurrent write
+    uint64_t TornReads = 0;
+
+    // Number of reads that gave up after the backoff limit
+    uint64_t Failures = 0;
+
+    void Reset()
+    {
+        *this = SeqLockStats();
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// SeqLockBackoff
+
+/// Bounded spin-then-yield backoff for seqlock readers
+class SeqLockBackoff
+{
+public:
+    /// Attempts that use a pause instruction before yielding
+    static const unsigned kSpinAttempts = 64;
+
+    /// Total attempts before giving up
+    static const unsigned kMaxAttempts = 256;
+
+    /// Returns false when the reader should give up
+    bool Next()
+    {
+        if (++Attempts >= kMaxAttempts) {
+            return false;
+        }
+        if (Attempts < kSpinAttempts) {
+            for (unsigned i = 0; i < Attempts; ++i) {
+                SpinPause();
+            }
+        }
+        else {
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+protected:
+    unsigned Attempts = 0;
+};
+
+
+//------------------------------------------------------------------------------
+// SeqLock
+
+template<typename T>
+struct SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Data must be trivially copyable");
+
+    // Odd while a write is in progress
+    std::atomic<uint32_t> Sequence = ATOMIC_VAR_INIT(0);
+    uint8_t Padding[64 - 4];
+
+    // Written by the writer between sequence updates
+    T Data;
+
+
+    // Writer-side:
+
+    /// Reset the sequence number.  Only call while there are no readers
+    void Reset()
+    {
+        Sequence.store(0, std::memory_order_relaxed);
+    }
+
+    /// Mark the data as being modified.  Must be followed by EndWrite()
+    void BeginWrite()
+    {
+        const uint32_t seq = Sequence.load(std::memory_order_relaxed);
+        Sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /// Publish the data written since BeginWrite()
+    void EndWrite()
+    {
+        const uint32_t seq = Sequence.load(std::memory_order_relaxed);
+        Sequence.store(seq + 1, std::memory_order_release);
+    }
+
+    void Write(const T& data)
+    {
+        BeginWrite();
+        memcpy(&Data, &data, sizeof(T));
+        EndWrite();
+    }
+
+
+    // Reader-side:
+
+    /// Read using a custom copy function copy(const T& src).
+    /// The copy function may run more than once and must not act on the data
+    /// until this function returns true.
+    /// Epoch is set to the number of writes that have completed.
+    /// Returns false if the writer did not finish in time
+    template<typename CopyFn>
+    bool ReadWith(CopyFn&& copy, uint32_t& epoch, SeqLockStats* stats = nullptr) const
+    {
+        SeqLockBackoff backoff;
+
+        for (;;)
+        {
+            const uint32_t before = Sequence.load(std::memory_order_acquire);
+
+            if ((before & 1) == 0)
+            {
+                copy(Data);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const uint32_t after = Sequence.load(std::memory_order_relaxed);
+
+                if (before == after) {
+                    if (stats) {
+                        stats->Reads++;
+                    }
+                    epoch = before / 2;
+                    return true;
+                }
+
+                if (stats) {
+                    stats->TornReads++;
+                }
+            }
+
+            if (!backoff.Next()) {
+                break;
+            }
+            if (stats) {
+                stats->Retries++;
+            }
+        }
+
+        if (stats) {
+            stats->Failures++;
+        }
+        return false;
+    }
+
+    bool Read(T& data, uint32_t& epoch, SeqLockStats* stats = nullptr) const
+    {
+        return ReadWith([&data](const T& src) {
+            memcpy(&data, &src, sizeof(T));
+        }, epoch, stats);
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Two-Counter Reader
+
+/**
+    Reader for layouts whose writer cannot use SeqLock, such as the C# UI.
+
+    The writer stores `before`, then the data, then `after`, all with the same
+    incremented value.  The reader loads them in the opposite order: if the
+    copy was bracketed by equal values of `after` and then `before`, no write
+    overlapped it.
+
+    Returns false if the writer did not finish in time.
+*/
+template<typename T>
+bool SeqLockReadTwoCounter(
+    const std::atomic<uint32_t>& before_counter,
+    const std::atomic<uint32_t>& after_counter,
+    const T& src,
+    T& dest,
+    uint32_t& epoch,
+    SeqLockStats* stats = nullptr)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Data must be trivially copyable");
+
+    SeqLockBackoff backoff;
+
+    for (;;)
+    {
+        const uint32_t after = after_counter.load(std::memory_order_acquire);
+
+        memcpy(&dest, &src, sizeof(T));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint32_t before = before_counter.load(std::memory_order_relaxed);
+
+        if (before == after) {
+            if (stats) {
+                stats->Reads++;
+            }
+            epoch = after;
+            return true;
+        }
+
+        if (stats) {
+            stats->TornReads++;
+        }
+        if (!backoff.Next()) {
+            break;
+        }
+        if (stats) {
+            stats->Retries++;
+        }
+    }
+
+    if (stats) {
+        stats->Failures++;
+    }
+    return false;
+}
+
+
+} // namespace core
+
+
+#endif // XRM_SEQLOCK_HPP
@@ -9,7 +9,8 @@
 #include <string>
 #include <atomic>
 
-#include "core_win32.hpp"
+#include "core_ipc.hpp"
+#include "seqlock.hpp"
 
 
 //------------------------------------------------------------------------------
@@ -22,7 +23,22 @@
 // File names are e.g. "Global\\XRmonitorsPluginS2C_4" for plugin #4.
 #define XRM_PLUGINS_S2C_EVENT_PREFIX "Global\\XRmonitorsPluginS2C_"
 
-#define XRM_PLUGIN_COUNT 20
+// Incremented whenever XrmPluginsMemoryLayout changes
+#define XRM_PLUGINS_ABI_VERSION 4
+
+// Slot count the service creates the directory with
+#define XRM_PLUGIN_DEFAULT_SLOTS 32
+
+// Upper bound on the slot count, limited by the 64-bit doorbell
+#define XRM_PLUGIN_MAX_SLOTS 64
+
+// CPU surfaces are created by the plugin in its own session, so they use a
+// Local name.  File names are e.g. "Local\\XRmonitorsPluginSurface_4"
+#define XRM_PLUGIN_SURFACE_PREFIX "Local\\XRmonitorsPluginSurface_"
+
+// Surface types for XrmPluginToHostData::SurfaceType
+#define XRM_PLUGIN_SURFACE_D3D11 0 /* Shared texture with keyed mutex */
+#define XRM_PLUGIN_SURFACE_CPU   1 /* BGRA buffers in shared memory */
 
 
 //------------------------------------------------------------------------------
@@ -70,23 +86,29 @@ struct XrmHostToPluginData
 
 struct XrmHostToPluginUpdater
 {
-    std::atomic<uint32_t> BeforeWriteCounter = ATOMIC_VAR_INIT(0);
-    uint8_t PaddingBefore[32 - 4];
-
-    std::atomic<uint32_t> AfterWriteCounter = ATOMIC_VAR_INIT(0);
-    uint8_t PaddingAfter[32 - 4];
-
-    XrmHostToPluginData Data;
+    core::SeqLock<XrmHostToPluginData> Lock;
 
 
     void Write(const XrmHostToPluginData& data);
-    bool Read(uint32_t& epoch, XrmHostToPluginData& data) const;
+    bool Read(uint32_t& epoch, XrmHostToPluginData& data, core::SeqLockStats* stats = nullptr) const;
 };
 
 
 //------------------------------------------------------------------------------
 // Plugin -> Host
 
+// Maximum number of dirty rectangles per texture release
+#define XRM_PLUGIN_MAX_DIRTY_RECTS 16
+
+// Rectangle in texture pixels.  Right and Bottom are exclusive
+struct XrmPluginRect
+{
+    int32_t Left;
+    int32_t Top;
+    int32_t Right;
+    int32_t Bottom;
+};
+
 struct XrmPluginToHostData
 {
     // Must increment once every 5 seconds
@@ -110,31 +132,213 @@ struct XrmPluginToHostData
     // Dimensions of the plugin texture in pixels
     int32_t Width;
     int32_t Height;
+
+    // XRM_PLUGIN_SURFACE_D3D11 or XRM_PLUGIN_SURFACE_CPU.
+    // Applies to the surface opened for the current TextureHandleEpoch
+    uint32_t SurfaceType;
+
+    // Regions of the texture modified since the previous TextureReleaseEpoch.
+    // The host copies only these regions when the texture is released.
+    // 0: Unknown, so the whole texture is copied.
+    // Greater than XRM_PLUGIN_MAX_DIRTY_RECTS: Overflow, the whole texture
+    // is copied and DirtyRects is ignored
+    uint32_t DirtyRectCount;
+    XrmPluginRect DirtyRects[XRM_PLUGIN_MAX_DIRTY_RECTS];
 };
 
 struct XrmPluginToHostUpdater
 {
-    std::atomic<uint32_t> BeforeWriteCounter = ATOMIC_VAR_INIT(0);
-    uint8_t PaddingBefore[32 - 4];
+    core::SeqLock<XrmPluginToHostData> Lock;
 
-    std::atomic<uint32_t> AfterWriteCounter = ATOMIC_VAR_INIT(0);
-    uint8_t PaddingAfter[32 - 4];
 
-    XrmPluginToHostData Data;
+    void Write(const XrmPluginToHostData& data);
+    bool Read(uint32_t& epoch, XrmPluginToHostData& data, core::SeqLockStats* stats = nullptr) const;
+};
 
 
-    void Write(const XrmPluginToHostData& data);
-    bool Read(uint32_t& epoch, XrmPluginToHostData& data) const;
+//------------------------------------------------------------------------------
+// Host -> Plugin Event Ring
+
+/*
+    Single-producer, single-consumer ring of input events from the host to
+    one plugin.  Unlike XrmHostToPluginData, which only holds the latest
+    state, the ring delivers every gaze sample and focus transition in order.
+    XrmHostToPluginData remains the authoritative state if the ring fills up.
+
+    Doorbell: A plugin that has drained the ring sets ReaderWaiting before
+    sleeping on its HostToPluginEvent, and the host only signals the event
+    for a push when that flag is set.  While the plugin is busy, pushes cost
+    no syscall.  Focus changes and terminate always signal the event, so
+    plugins that do not read the ring still wake for them.
+*/
+
+// Must be a power of two
+#define XRM_PLUGIN_EVENT_RING_SIZE 64
+
+// Event types for XrmPluginEvent::Type
+#define XRM_PLUGIN_EVENT_GAZE      1 /* X, Y: Gaze in screen coordinates */
+#define XRM_PLUGIN_EVENT_FOCUS_IN  2 /* X, Y: Gaze that gained focus */
+#define XRM_PLUGIN_EVENT_FOCUS_OUT 3
+#define XRM_PLUGIN_EVENT_TERMINATE 4 /* Plugin should exit */
+
+struct XrmPluginEvent
+{
+    // core::GetTimeUsec() on the host when the event was generated
+    uint64_t TimestampUsec;
+
+    uint32_t Type;
+    int32_t X;
+    int32_t Y;
+    uint32_t Reserved;
+};
+
+class HostToPluginEvent;
+
+struct XrmPluginEventRing
+{
+    static_assert((XRM_PLUGIN_EVENT_RING_SIZE & (XRM_PLUGIN_EVENT_RING_SIZE - 1)) == 0,
+        "Ring size must be a power of two");
+
+    // Number of events pushed.  Written by the host
+    std::atomic<uint32_t> WriteCount = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingWriteCount[64 - 4];
+
+    // Number of events popped.  Written by the plugin
+    std::atomic<uint32_t> ReadCount = ATOMIC_VAR_INIT(0);
+
+    // Nonzero while the plugin is about to sleep or sleeping on its event
+    std::atomic<uint32_t> ReaderWaiting = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingReadCount[64 - 8];
+
+    // Number of events dropped because the ring was full
+    std::atomic<uint32_t> Dropped = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingDropped[64 - 4];
+
+    XrmPluginEvent Events[XRM_PLUGIN_EVENT_RING_SIZE];
+
+
+    // Host-side:
+
+    // Returns false if the ring is full and the event was dropped.
+    // Sets wake to true if the plugin must be signaled
+    bool Push(const XrmPluginEvent& event, bool& wake);
+
+    // Plugin-side:
+
+    // Skip events left for a previous owner.  Called by ClaimSlot()
+    void DiscardPending();
+
+    // Returns false if the ring is empty
+    bool Pop(XrmPluginEvent& event);
+
+    // Wait until the ring is not empty or the timeout expires.
+    // Returns false on timeout
+    bool Wait(HostToPluginEvent& doorbell, int timeout_msec);
 };
 
 
+//------------------------------------------------------------------------------
+// XrmPluginSlot
+
+struct XrmPluginSlot
+{
+    /*
+        Owner word: High 32 bits are a claim epoch that increments on every
+        claim, low 32 bits are the owning process id or 0 if free.
+
+        The epoch lets the host tell a new owner from an old one even if the
+        process id is reused, and makes every CAS on this word ABA-safe.
+    */
+    std::atomic<uint64_t> Owner = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingOwner[64 - 8];
+
+    XrmHostToPluginUpdater HostToPlugin;
+    XrmPluginToHostUpdater PluginToHost;
+
+    // Input events from the host
+    XrmPluginEventRing Events;
+};
+
+inline uint32_t XrmPluginOwnerProcessId(uint64_t owner)
+{
+    return static_cast<uint32_t>(owner);
+}
+
+inline uint32_t XrmPluginOwnerEpoch(uint64_t owner)
+{
+    return static_cast<uint32_t>(owner >> 32);
+}
+
+
 //------------------------------------------------------------------------------
 // XrmPluginsMemoryLayout
 
+/*
+    Slot directory header.  SlotCount slots follow the header in memory.
+
+    The service picks the slot count when it creates the shared memory, and
+    everyone else reads it from the header, so the capacity can change
+    without recompiling plugins.  Use OpenXrmPluginsSharedMemory() to map
+    the whole directory.
+
+    Plugins claim a free slot with ClaimSlot().  The host reclaims slots
+    whose KeepAliveEpoch stops changing.
+*/
+static_assert(XRM_PLUGIN_MAX_SLOTS <= 64, "Doorbell has one bit per slot");
+static_assert(XRM_PLUGIN_DEFAULT_SLOTS <= XRM_PLUGIN_MAX_SLOTS, "Too many slots");
+
 struct XrmPluginsMemoryLayout
 {
-    XrmHostToPluginUpdater HostToPlugin[XRM_PLUGIN_COUNT];
-    XrmPluginToHostUpdater PluginToHost[XRM_PLUGIN_COUNT];
+    // XRM_PLUGINS_ABI_VERSION of the service that created the directory
+    uint32_t Version;
+
+    // Number of slots following this header
+    uint32_t SlotCount;
+
+    uint8_t PaddingHeader[64 - 8];
+
+    // Doorbell: Bit i is set when slot i has been claimed or its PluginToHost
+    // has been written since the host last drained it.  The host only
+    // visits slots whose bit is set
+    std::atomic<uint64_t> DirtyPlugins = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingDirtyPlugins[64 - 8];
+
+
+    XrmPluginSlot* GetSlot(int plugin_index)
+    {
+        return reinterpret_cast<XrmPluginSlot*>(this + 1) + plugin_index;
+    }
+
+    // Server-side:
+
+    // Set up the header on zeroed memory of XrmPluginsLayoutBytes(slot_count)
+    void InitializeDirectory(uint32_t slot_count);
+
+    // Plugin-side:
+
+    // Claim a free slot for the given process.
+    // Returns the slot index and the new owner word, or -1 if all are taken
+    int ClaimSlot(uint32_t process_id, uint64_t& owner);
+
+    // Give up a slot claimed with ClaimSlot()
+    void ReleaseSlot(int plugin_index, uint64_t owner);
+
+    // Write PluginToHost for the slot and ring the doorbell.
+    // Plugins must use this rather than PluginToHost.Write() or the host
+    // will not notice the update
+    void WritePluginToHost(int plugin_index, const XrmPluginToHostData& data);
+
+    // Host-side:
+
+    // Free a slot whose owner stopped responding.
+    // Fails if the slot was released or claimed again since `owner` was read
+    bool ReclaimSlot(int plugin_index, uint64_t owner);
+
+    // Set the bit for a slot so it is visited again on the next drain
+    void MarkPluginDirty(int plugin_index);
+
+    // Returns the set of slots written since the last call and clears it
+    uint64_t DrainDirtyPlugins();
 };
 
 #pragma pack(pop)
@@ -142,7 +346,161 @@ struct XrmPluginsMemoryLayout
 #pragma warning(pop)
 #endif
 
-static const uint32_t kXrmPluginsMemoryLayoutBytes = static_cast<uint32_t>(sizeof(XrmPluginsMemoryLayout));
+// Bytes of shared memory for a directory with the given slot count
+inline uint32_t XrmPluginsLayoutBytes(uint32_t slot_count)
+{
+    return static_cast<uint32_t>(sizeof(XrmPluginsMemoryLayout) + sizeof(XrmPluginSlot) * slot_count);
+}
+
+// Open the plugin directory created by the service, mapping all of its slots.
+// Returns nullptr if it does not exist, was created by another ABI version,
+// or is smaller than its SlotCount requires
+XrmPluginsMemoryLayout* OpenXrmPluginsSharedMemory(
+    core::SharedMemoryFile& file,
+    const std::string& name = XRM_PLUGINS_SHARED_MEMORY_NAME);
+
+
+//------------------------------------------------------------------------------
+// CPU Surface
+
+/*
+    A CPU surface is an alternative to a D3D11 shared texture: the plugin
+    draws BGRA pixels into shared memory and the host uploads them, so the
+    plugin needs no GPU device or keyed mutex.
+
+    The surface is triple-buffered without locks.  The plugin owns the back
+    buffer and the host owns the front buffer.  The remaining buffer is held
+    by the Middle word.  The plugin publishes by swapping its back buffer
+    into Middle with the Fresh bit set, and the host takes the newest frame
+    by swapping its front buffer into Middle.  Neither side ever waits.
+
+    Each buffer records its frame number and the regions that changed since
+    the previous frame.  The host uses the rects only when it has uploaded
+    the previous frame, and uploads the whole surface otherwise.
+
+    The buffer handed back to the plugin by EndFrame() holds an older frame.
+    Its FrameNumber tells the plugin how far behind it is.
+*/
+
+#define XRM_PLUGIN_SURFACE_BUFFER_COUNT 3
+
+struct XrmPluginSurfaceBuffer
+{
+    // Frame written into this buffer, or 0 if never written
+    uint32_t FrameNumber;
+
+    // Regions changed since frame FrameNumber - 1, as in XrmPluginToHostData
+    uint32_t DirtyRectCount;
+    XrmPluginRect DirtyRects[XRM_PLUGIN_MAX_DIRTY_RECTS];
+};
+
+struct XrmPluginSurfaceLayout
+{
+    // Bits in Middle
+    static const uint32_t kIndexMask = 3;
+    static const uint32_t kFresh = 4;
+
+    // Pixel rows start on cache lines and buffers start on pages
+    static const uint32_t kPitchAlign = 64;
+    static const uint32_t kBufferAlign = 4096;
+
+    // XRM_PLUGINS_ABI_VERSION of the plugin that created the surface
+    uint32_t Version;
+
+    // Dimensions in pixels
+    uint32_t Width;
+    uint32_t Height;
+
+    // Bytes between rows and between buffers
+    uint32_t Pitch;
+    uint32_t BufferBytes;
+
+    // Total bytes of the shared memory file
+    uint32_t TotalBytes;
+
+    uint8_t PaddingHeader[64 - 24];
+
+    // Buffer index that is neither front nor back, plus the Fresh bit
+    std::atomic<uint32_t> Middle = ATOMIC_VAR_INIT(0);
+    uint8_t PaddingMiddle[64 - 4];
+
+    XrmPluginSurfaceBuffer Buffers[XRM_PLUGIN_SURFACE_BUFFER_COUNT];
+
+
+    static uint32_t PixelOffset()
+    {
+        return (static_cast<uint32_t>(sizeof(XrmPluginSurfaceLayout)) + kBufferAlign - 1) & ~(kBufferAlign - 1);
+    }
+
+    uint8_t* GetPixels(uint32_t buffer_index)
+    {
+        return reinterpret_cast<uint8_t*>(this) + PixelOffset() + BufferBytes * buffer_index;
+    }
+
+    // Host-side:
+
+    // If a new frame was published, swap it for `front_index` and return true.
+    // Start with front_index = 2
+    bool AcquireLatest(uint32_t& front_index);
+};
+
+// Plugin-side helper that creates and publishes a CPU surface
+class XrmPluginSurfaceWriter
+{
+public:
+    // Create the shared memory for the given slot.
+    // Set XrmPluginToHostData::SurfaceType to XRM_PLUGIN_SURFACE_CPU and
+    // increment TextureHandleEpoch after this succeeds
+    bool Create(int plugin_index, uint32_t width, uint32_t height);
+    void Close();
+
+    // Returns the back buffer to draw into
+    uint8_t* GetBackBuffer()
+    {
+        return Surface->GetPixels(BackIndex);
+    }
+
+    // Frame number that the back buffer currently holds, or 0 if none
+    uint32_t GetBackFrameNumber() const
+    {
+        return Surface->Buffers[BackIndex].FrameNumber;
+    }
+
+    uint32_t GetPitch() const
+    {
+        return Surface->Pitch;
+    }
+
+    // Publish the back buffer.  Pass rect_count = 0 if everything changed
+    void EndFrame(const XrmPluginRect* rects, uint32_t rect_count);
+
+protected:
+    core::SharedMemoryFile File;
+    XrmPluginSurfaceLayout* Surface = nullptr;
+    uint32_t BackIndex = 0;
+    uint32_t FrameNumber = 0;
+};
+
+// Name of the CPU surface shared memory for a slot
+std::string XrmPluginSurfaceName(int plugin_index);
+
+// Surface dimensions checked against the mapped size by OpenXrmPluginSurface()
+struct XrmPluginSurfaceGeometry
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t Pitch = 0;
+    uint32_t BufferBytes = 0;
+};
+
+// Open the CPU surface for a slot, mapping all of its buffers.
+// The plugin can still write the header afterwards, so only `geometry` may
+// be used to address the pixels.
+// Returns nullptr if it does not exist or is malformed
+XrmPluginSurfaceLayout* OpenXrmPluginSurface(
+    core::SharedMemoryFile& file,
+    int plugin_index,
+    XrmPluginSurfaceGeometry& geometry);
 
 
 //------------------------------------------------------------------------------
@@ -168,7 +526,7 @@ public:
     void Signal();
 
 protected:
-    core::AutoEvent Event;
+    core::IpcEvent Event;
 };
 
 
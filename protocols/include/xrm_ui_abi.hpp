@@ -9,6 +9,8 @@
 #include <string>
 #include <atomic>
 
+#include "seqlock.hpp"
+
 
 //------------------------------------------------------------------------------
 // Constants
@@ -55,6 +57,8 @@ struct XrmUiData
     uint8_t PanRightKeys[XRM_UI_MAX_KEYS];
 };
 
+// The UI writes this from C# at fixed offsets: It increments BeforeWriteCounter,
+// writes data, and then sets AfterWriteCounter to the same value.
 struct XrmUiSharedMemoryLayout
 {
     // Offset = 0
@@ -68,7 +72,7 @@ struct XrmUiSharedMemoryLayout
     // Offset = 64
     XrmUiData Data;
 
-    bool Read(uint32_t& epoch, XrmUiData& data) const;
+    bool Read(uint32_t& epoch, XrmUiData& data, core::SeqLockStats* stats = nullptr) const;
 };
 
 #pragma pack(pop)
@@ -0,0 +1,180 @@
+// Copyright 2019 Augmented Perception Corporation
+
+#include "camera_latency_abi.hpp"
+
+
+//------------------------------------------------------------------------------
+// Stages
+
+const char* CameraLatencyStageName(CameraLatencyStage stage)
+{
+    switch (stage)
+    {
+    case CameraLatencyStage::Receive: return "receive";
+    case CameraLatencyStage::Publish: return "publish";
+    case CameraLatencyStage::Acquire: return "acquire";
+    case CameraLatencyStage::Process: return "process";
+    case CameraLatencyStage::Select: return "select";
+    case CameraLatencyStage::Upload: return "upload";
+    case CameraLatencyStage::Render: return "render";
+    default: break;
+    }
+    return "unknown";
+}
+
+const char* CameraLatencyIntervalName(unsigned interval)
+{
+    if (interval == kCameraLatencyTotalInterval) {
+        return "total";
+    }
+    // Interval 0 ends at the second stage
+    return CameraLatencyStageName(static_cast<CameraLatencyStage>(interval + 1));
+}
+
+
+//------------------------------------------------------------------------------
+// CameraLatencyHistogram
+
+// Values below this get a bucket each
+static const unsigned kLinearBuckets = 8;
+
+// log2(kLinearBuckets)
+static const unsigned kLinearBits = 3;
+
+// Buckets per power of two above kLinearBuckets
+static const unsigned kSubBucketBits = 2;
+
+unsigned CameraLatencyBucket(uint64_t usec)
+{
+    if (usec < kLinearBuckets) {
+        return static_cast<unsigned>(usec);
+    }
+
+    unsigned octave = 0;
+    while ((usec >> octave) > 1) {
+        ++octave;
+    }
+
+    const unsigned sub = static_cast<unsigned>(usec >> (octave - kSubBucketBits)) & ((1u << kSubBucketBits) - 1);
+    const unsigned bucket = kLinearBuckets + ((octave - kLinearBits) << kSubBucketBits) + sub;
+
+    if (bucket >= kCameraLatencyBucketCount) {
+        return kCameraLatencyBucketCount - 1;
+    }
+    return bucket;
+}
+
+uint64_t CameraLatencyBucketUsec(unsigned bucket)
+{
+    if (bucket < kLinearBuckets) {
+        return bucket;
+    }
+
+    const unsigned octave = kLinearBits + ((bucket - kLinearBuckets) >> kSubBucketBits);
+    const unsigned sub = (bucket - kLinearBuckets) & ((1u << kSubBucketBits) - 1);
+
+    return static_cast<uint64_t>((1u << kSubBucketBits) + sub) << (octave - kSubBucketBits);
+}
+
+void CameraLatencyHistogram::Add(uint64_t usec)
+{
+    ++Count;
+    TotalUsec += usec;
+    if (MaxUsec < usec) {
+        MaxUsec = usec;
+    }
+    uint32_t& bucket = Buckets[CameraLatencyBucket(usec)];
+    if (bucket != UINT32_MAX) {
+        ++bucket;
+    }
+}
+
+uint64_t CameraLatencyHistogram::GetPercentileUsec(unsigned percent) const
+{
+    // Ranks come from the buckets rather than Count, which keeps going
+    // after a bucket saturates
+    uint64_t total = 0;
+    for (unsigned i = 0; i < kCameraLatencyBucketCount; ++i) {
+        total += Buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    if (percent >= 100) {
+        return MaxUsec;
+    }
+
+    // Rank of the percentile, rounded up and starting from 1
+    uint64_t rank = (total * percent + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t before = 0;
+    for (unsigned i = 0; i < kCameraLatencyBucketCount; ++i)
+    {
+        const uint64_t in_bucket = Buckets[i];
+        if (before + in_bucket < rank) {
+            before += in_bucket;
+            continue;
+        }
+
+        // Spread the bucket's values evenly up to the next bucket or the
+        // largest value, whichever is lower
+        const uint64_t lower = CameraLatencyBucketUsec(i);
+        uint64_t upper = MaxUsec + 1;
+        if (i + 1 < kCameraLatencyBucketCount && upper > CameraLatencyBucketUsec(i + 1)) {
+            upper = CameraLatencyBucketUsec(i + 1);
+        }
+        if (upper <= lower) {
+            return lower;
+        }
+        return lower + (upper - lower) * (rank - before - 1) / in_bucket;
+    }
+    return MaxUsec;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraLatencyCounters
+
+bool CameraLatencyCounters::AddFrame(const uint64_t stage_usec[kCameraLatencyStageCount])
+{
+    memcpy(LastStageUsec, stage_usec, sizeof(LastStageUsec));
+
+    for (unsigned i = 0; i < kCameraLatencyStageCount; ++i) {
+        if (stage_usec[i] == 0) {
+            ++Skipped;
+            return false;
+        }
+    }
+
+    // Stamps out of order count as zero rather than wrapping
+    for (unsigned i = 1; i < kCameraLatencyStageCount; ++i) {
+        const uint64_t start = stage_usec[i - 1];
+        const uint64_t end = stage_usec[i];
+        Intervals[i - 1].Add(end > start ? end - start : 0);
+    }
+
+    const uint64_t start = stage_usec[0];
+    const uint64_t end = stage_usec[kCameraLatencyStageCount - 1];
+    Intervals[kCameraLatencyTotalInterval].Add(end > start ? end - start : 0);
+
+    ++Frames;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// CameraLatencySharedMemoryLayout
+
+bool CameraLatencySharedMemoryLayout::Read(
+    uint32_t& epoch,
+    CameraLatencyCounters& counters,
+    core::SeqLockStats* stats) const
+{
+    if (!Counters.Read(counters, epoch, stats)) {
+        return false;
+    }
+    return counters.Version == CAMERA_LATENCY_ABI_VERSION;
+}
@@ -3,46 +3,122 @@
 #include "implant_abi.hpp"
 
 #include "core.hpp"
-#include "core_win32.hpp" // Sleep
 
 
 //------------------------------------------------------------------------------
 // Implant Shared Memory Layout
 
-void ImplantSharedMemoryLayout::WriteCamera(
+void ImplantSharedMemoryLayout::ResetCamera()
+{
+    CameraPublished = 0;
+    CameraDropped = 0;
+
+    // Pins are left alone: A reader may still hold a frame from a prior
+    // implant session, and it will release it normally.
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i) {
+        CameraSlots[i].Sequence = 0;
+    }
+}
+
+bool ImplantSharedMemoryLayout::WriteCamera(
     const uint8_t* data,
     uint32_t read_bytes,
-    uint64_t exposure_usec)
+    uint64_t receive_usec)
 {
-    uint32_t counter = ++BeforeWriteCounter;
-    ExposureTimeUsec = exposure_usec;
-    CameraBytes = read_bytes;
-    memcpy((void*)CameraData, data, read_bytes);
-    AfterWriteCounter = counter;
+    if (read_bytes > kCameraBytes) {
+        read_bytes = kCameraBytes;
+    }
+
+    // Only the implant writes CameraPublished
+    const uint32_t latest = CameraPublished.load(std::memory_order_relaxed);
+    uint32_t frame_number = latest + 1;
+    if (frame_number == 0) {
+        frame_number = 1;
+    }
+
+    for (unsigned i = 0; i < kImplantCameraSlotCount; ++i)
+    {
+        ImplantCameraSlot& slot = CameraSlots[(frame_number + i) % kImplantCameraSlotCount];
+
+        const uint32_t sequence = slot.Sequence.load(std::memory_order_relaxed);
+
+        // Never overwrite the newest frame so readers always find one
+        if (latest != 0 && sequence == latest * 2) {
+            continue;
+        }
+        if (slot.Pins.load() != 0) {
+            continue;
+        }
+
+        // Mark the slot as being written, then check again for a reader that
+        // pinned it in between.  Both sides use sequentially-consistent
+        // operations so that at least one of them sees the other.
+        slot.Sequence.store(sequence | 1);
+        if (slot.Pins.load() != 0) {
+            slot.Sequence.store(sequence, std::memory_order_release);
+            continue;
+        }
+
+        slot.ReceiveTimeUsec = receive_usec;
+        slot.CameraBytes = read_bytes;
+        memcpy(slot.CameraData, data, read_bytes);
+        slot.PublishTimeUsec = core::GetTimeUsec();
+
+        slot.Sequence.store(frame_number * 2, std::memory_order_release);
+        CameraPublished.store(frame_number, std::memory_order_release);
+        return true;
+    }
+
+    CameraDropped++;
+    return false;
 }
 
-bool ImplantSharedMemoryLayout::ReadCamera(
-    uint8_t* data,
-    uint32_t& read_bytes,
-    uint64_t& exposure_usec,
-    uint32_t& read_counter)
+const ImplantCameraSlot* ImplantSharedMemoryLayout::AcquireCamera(
+    uint32_t last_frame_number,
+    uint32_t& frame_number,
+    uint32_t* retries)
 {
-    for (int retries = 0; retries < 20; ++retries)
+    // Retry once if the newest frame was replaced while we were pinning it
+    for (int attempt = 0; attempt < 2; ++attempt)
     {
-        exposure_usec = ExposureTimeUsec;
-        read_counter = BeforeWriteCounter;
-        read_bytes = CameraBytes;
+        const uint32_t latest = CameraPublished.load(std::memory_order_acquire);
+        if (latest == 0 || latest == last_frame_number) {
+            return nullptr;
+        }
 
-        memcpy(data, (void*)&CameraData[0], read_bytes);
+        for (unsigned i = 0; i < kImplantCameraSlotCount; ++i)
+        {
+            ImplantCameraSlot& slot = CameraSlots[i];
 
-        const uint32_t after = AfterWriteCounter;
+            if (slot.Sequence.load(std::memory_order_relaxed) != latest * 2) {
+                continue;
+            }
 
-        if (read_counter == after) {
-            return true;
+            slot.Pins.fetch_add(1);
+            if (slot.Sequence.load() == latest * 2) {
+                frame_number = latest;
+                return &slot;
+            }
+            slot.Pins.fetch_sub(1, std::memory_order_release);
+            break;
         }
 
-        ::Sleep(1);
+        // The newest frame was replaced before it could be pinned
+        if (retries) {
+            ++*retries;
+        }
     }
 
-    return false;
+    return nullptr;
+}
+
+void ImplantSharedMemoryLayout::ReleaseCamera(const ImplantCameraSlot* slot)
+{
+    if (!slot) {
+        return;
+    }
+
+    // Slots live in this layout, so the pin count is ours to modify
+    ImplantCameraSlot* pinned = const_cast<ImplantCameraSlot*>(slot);
+    pinned->Pins.fetch_sub(1, std::memory_order_release);
 }
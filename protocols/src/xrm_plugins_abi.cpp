@@ -2,76 +2,347 @@
 
 #include "xrm_plugins_abi.hpp"
 
+#include <chrono>
+#include <thread>
+
 
 //------------------------------------------------------------------------------
 // Host -> Plugin
 
 void XrmHostToPluginUpdater::Write(const XrmHostToPluginData& data)
 {
-    const uint32_t epoch = BeforeWriteCounter + 1;
+    Lock.Write(data);
+}
+
+bool XrmHostToPluginUpdater::Read(uint32_t& epoch, XrmHostToPluginData& data, core::SeqLockStats* stats) const
+{
+    return Lock.Read(data, epoch, stats);
+}
+
+
+//------------------------------------------------------------------------------
+// Plugin -> Host
+
+void XrmPluginToHostUpdater::Write(const XrmPluginToHostData& data)
+{
+    Lock.Write(data);
+}
+
+bool XrmPluginToHostUpdater::Read(uint32_t& epoch, XrmPluginToHostData& data, core::SeqLockStats* stats) const
+{
+    return Lock.Read(data, epoch, stats);
+}
+
+
+//------------------------------------------------------------------------------
+// Host -> Plugin Event Ring
+
+bool XrmPluginEventRing::Push(const XrmPluginEvent& event, bool& wake)
+{
+    wake = false;
+
+    const uint32_t write_count = WriteCount.load(std::memory_order_relaxed);
+    const uint32_t read_count = ReadCount.load(std::memory_order_acquire);
+
+    // If full:
+    if (write_count - read_count >= XRM_PLUGIN_EVENT_RING_SIZE) {
+        Dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Events[write_count & (XRM_PLUGIN_EVENT_RING_SIZE - 1)] = event;
+
+    // Seq-cst: Pairs with the reader setting ReaderWaiting and re-checking
+    // WriteCount, so either it sees this event or we see it waiting
+    WriteCount.store(write_count + 1, std::memory_order_seq_cst);
+    wake = ReaderWaiting.load(std::memory_order_seq_cst) != 0;
+    return true;
+}
+
+void XrmPluginEventRing::DiscardPending()
+{
+    ReaderWaiting.store(0, std::memory_order_relaxed);
+    ReadCount.store(WriteCount.load(std::memory_order_acquire), std::memory_order_release);
+}
 
-    BeforeWriteCounter = epoch;
+bool XrmPluginEventRing::Pop(XrmPluginEvent& event)
+{
+    const uint32_t read_count = ReadCount.load(std::memory_order_relaxed);
+    const uint32_t write_count = WriteCount.load(std::memory_order_acquire);
 
-    Data = data;
+    // If empty:
+    if (write_count == read_count) {
+        return false;
+    }
+
+    event = Events[read_count & (XRM_PLUGIN_EVENT_RING_SIZE - 1)];
 
-    AfterWriteCounter = epoch;
+    // Release: The slot may be overwritten once this is visible
+    ReadCount.store(read_count + 1, std::memory_order_release);
+    return true;
 }
 
-bool XrmHostToPluginUpdater::Read(uint32_t& epoch, XrmHostToPluginData& data) const
+bool XrmPluginEventRing::Wait(HostToPluginEvent& doorbell, int timeout_msec)
 {
-    for (int retries = 0; retries < 20; ++retries)
+    ReaderWaiting.store(1, std::memory_order_seq_cst);
+
+    // Re-check after announcing so a concurrent push is not missed
+    bool ready = WriteCount.load(std::memory_order_seq_cst) != ReadCount.load(std::memory_order_relaxed);
+    if (!ready) {
+        ready = doorbell.Wait(timeout_msec);
+    }
+
+    ReaderWaiting.store(0, std::memory_order_relaxed);
+
+    // The doorbell is shared with state updates, so report the ring itself
+    return ready || WriteCount.load(std::memory_order_acquire) != ReadCount.load(std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// XrmPluginsMemoryLayout
+
+void XrmPluginsMemoryLayout::InitializeDirectory(uint32_t slot_count)
+{
+    Version = XRM_PLUGINS_ABI_VERSION;
+    SlotCount = slot_count;
+    DirtyPlugins = 0;
+}
+
+int XrmPluginsMemoryLayout::ClaimSlot(uint32_t process_id, uint64_t& owner)
+{
+    for (int i = 0; i < (int)SlotCount; ++i)
     {
-        uint32_t read_counter = BeforeWriteCounter;
+        XrmPluginSlot* slot = GetSlot(i);
+
+        uint64_t expected = slot->Owner.load(std::memory_order_relaxed);
+        if (XrmPluginOwnerProcessId(expected) != 0) {
+            continue;
+        }
 
-        data = Data;
+        const uint64_t epoch = XrmPluginOwnerEpoch(expected) + 1;
+        const uint64_t desired = (epoch << 32) | process_id;
 
-        const uint32_t after = AfterWriteCounter;
+        // Acquire: Pairs with the release in ReleaseSlot/ReclaimSlot
+        if (slot->Owner.compare_exchange_strong(expected, desired, std::memory_order_acq_rel))
+        {
+            owner = desired;
+            slot->Events.DiscardPending();
 
-        if (read_counter == after) {
-            epoch = after;
-            return true;
+            // Let the host see the new owner even before the first write
+            DirtyPlugins.fetch_or(UINT64_C(1) << i, std::memory_order_release);
+            return i;
         }
+    }
+
+    return -1;
+}
+
+void XrmPluginsMemoryLayout::ReleaseSlot(int plugin_index, uint64_t owner)
+{
+    // Keep the epoch so the next claim increments it
+    uint64_t expected = owner;
+    GetSlot(plugin_index)->Owner.compare_exchange_strong(
+        expected,
+        owner & ~UINT64_C(0xffffffff),
+        std::memory_order_release,
+        std::memory_order_relaxed);
+
+    DirtyPlugins.fetch_or(UINT64_C(1) << plugin_index, std::memory_order_release);
+}
+
+bool XrmPluginsMemoryLayout::ReclaimSlot(int plugin_index, uint64_t owner)
+{
+    uint64_t expected = owner;
+    return GetSlot(plugin_index)->Owner.compare_exchange_strong(
+        expected,
+        owner & ~UINT64_C(0xffffffff),
+        std::memory_order_release,
+        std::memory_order_relaxed);
+}
+
+void XrmPluginsMemoryLayout::WritePluginToHost(int plugin_index, const XrmPluginToHostData& data)
+{
+    GetSlot(plugin_index)->PluginToHost.Write(data);
+
+    // Release: The host sees the bit only after the seqlock write completes
+    DirtyPlugins.fetch_or(UINT64_C(1) << plugin_index, std::memory_order_release);
+}
+
+void XrmPluginsMemoryLayout::MarkPluginDirty(int plugin_index)
+{
+    DirtyPlugins.fetch_or(UINT64_C(1) << plugin_index, std::memory_order_relaxed);
+}
 
-        ::Sleep(1);
+uint64_t XrmPluginsMemoryLayout::DrainDirtyPlugins()
+{
+    // Relaxed load first so that idle frames do not take the cache line
+    if (DirtyPlugins.load(std::memory_order_relaxed) == 0) {
+        return 0;
     }
+    return DirtyPlugins.exchange(0, std::memory_order_acquire);
+}
 
-    return false;
+
+//------------------------------------------------------------------------------
+// Shared Memory
+
+XrmPluginsMemoryLayout* OpenXrmPluginsSharedMemory(
+    core::SharedMemoryFile& file,
+    const std::string& name)
+{
+    // Map just the header to learn the slot count
+    if (!file.Open(XrmPluginsLayoutBytes(0), name)) {
+        return nullptr;
+    }
+    const XrmPluginsMemoryLayout* header = reinterpret_cast<const XrmPluginsMemoryLayout*>(file.GetFront());
+    const uint32_t version = header->Version;
+    const uint32_t slot_count = header->SlotCount;
+
+    if (version != XRM_PLUGINS_ABI_VERSION ||
+        slot_count == 0 ||
+        slot_count > XRM_PLUGIN_MAX_SLOTS)
+    {
+        file.Close();
+        return nullptr;
+    }
+
+    // Remap the whole directory.  This fails if the object is smaller than
+    // the slot count claims, so slots past the end are never mapped
+    if (!file.Open(XrmPluginsLayoutBytes(slot_count), name)) {
+        return nullptr;
+    }
+    return reinterpret_cast<XrmPluginsMemoryLayout*>(file.GetFront());
 }
 
 
 //------------------------------------------------------------------------------
-// Plugin -> Host
+// CPU Surface
 
-void XrmPluginToHostUpdater::Write(const XrmPluginToHostData& data)
+std::string XrmPluginSurfaceName(int plugin_index)
+{
+    std::string name = XRM_PLUGIN_SURFACE_PREFIX;
+    name += std::to_string(plugin_index);
+    return name;
+}
+
+bool XrmPluginSurfaceLayout::AcquireLatest(uint32_t& front_index)
+{
+    if ((Middle.load(std::memory_order_relaxed) & kFresh) == 0) {
+        return false;
+    }
+
+    // Acquire: Pairs with the release in EndFrame() so the pixels are visible
+    const uint32_t middle = Middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = middle & kIndexMask;
+    return true;
+}
+
+bool XrmPluginSurfaceWriter::Create(int plugin_index, uint32_t width, uint32_t height)
 {
-    const uint32_t epoch = BeforeWriteCounter + 1;
+    Close();
 
-    BeforeWriteCounter = epoch;
+    if (width == 0 || height == 0 || width > 16384 || height > 16384) {
+        return false;
+    }
+
+    const uint32_t pitch = (width * 4 + XrmPluginSurfaceLayout::kPitchAlign - 1) & ~(XrmPluginSurfaceLayout::kPitchAlign - 1);
+    const uint32_t buffer_bytes = (pitch * height + XrmPluginSurfaceLayout::kBufferAlign - 1) & ~(XrmPluginSurfaceLayout::kBufferAlign - 1);
+    const uint64_t total_bytes = XrmPluginSurfaceLayout::PixelOffset() + (uint64_t)buffer_bytes * XRM_PLUGIN_SURFACE_BUFFER_COUNT;
+    if (total_bytes > INT32_MAX) {
+        return false;
+    }
 
-    Data = data;
+    if (!File.Create(static_cast<int>(total_bytes), XrmPluginSurfaceName(plugin_index))) {
+        return false;
+    }
+    Surface = reinterpret_cast<XrmPluginSurfaceLayout*>(File.GetFront());
+    memset(static_cast<void*>(Surface), 0, XrmPluginSurfaceLayout::PixelOffset());
 
-    AfterWriteCounter = epoch;
+    Surface->Width = width;
+    Surface->Height = height;
+    Surface->Pitch = pitch;
+    Surface->BufferBytes = buffer_bytes;
+    Surface->TotalBytes = static_cast<uint32_t>(total_bytes);
+
+    // Plugin starts with buffer 0, Middle holds buffer 1, host starts with 2
+    BackIndex = 0;
+    FrameNumber = 0;
+    Surface->Middle.store(1, std::memory_order_relaxed);
+
+    // Version last: The host does not use the surface until it is set
+    std::atomic_thread_fence(std::memory_order_release);
+    Surface->Version = XRM_PLUGINS_ABI_VERSION;
+    return true;
 }
 
-bool XrmPluginToHostUpdater::Read(uint32_t& epoch, XrmPluginToHostData& data) const
+void XrmPluginSurfaceWriter::Close()
 {
-    for (int retries = 0; retries < 20; ++retries)
-    {
-        uint32_t read_counter = BeforeWriteCounter;
+    Surface = nullptr;
+    File.Close();
+}
 
-        data = Data;
+void XrmPluginSurfaceWriter::EndFrame(const XrmPluginRect* rects, uint32_t rect_count)
+{
+    XrmPluginSurfaceBuffer& buffer = Surface->Buffers[BackIndex];
+    buffer.FrameNumber = ++FrameNumber;
+    if (rect_count > XRM_PLUGIN_MAX_DIRTY_RECTS) {
+        rect_count = XRM_PLUGIN_MAX_DIRTY_RECTS + 1; // Overflow: Full upload
+    }
+    else if (rect_count > 0) {
+        memcpy(buffer.DirtyRects, rects, rect_count * sizeof(XrmPluginRect));
+    }
+    buffer.DirtyRectCount = rect_count;
 
-        const uint32_t after = AfterWriteCounter;
+    // Release: The host sees the pixels and header before the new index
+    const uint32_t middle = Surface->Middle.exchange(
+        BackIndex | XrmPluginSurfaceLayout::kFresh,
+        std::memory_order_acq_rel);
+    BackIndex = middle & XrmPluginSurfaceLayout::kIndexMask;
+}
 
-        if (read_counter == after) {
-            epoch = after;
-            return true;
-        }
+XrmPluginSurfaceLayout* OpenXrmPluginSurface(
+    core::SharedMemoryFile& file,
+    int plugin_index,
+    XrmPluginSurfaceGeometry& geometry)
+{
+    const std::string name = XrmPluginSurfaceName(plugin_index);
 
-        ::Sleep(1);
+    // Map just the header to learn the size
+    if (!file.Open(static_cast<int>(sizeof(XrmPluginSurfaceLayout)), name)) {
+        return nullptr;
     }
+    const XrmPluginSurfaceLayout* header = reinterpret_cast<const XrmPluginSurfaceLayout*>(file.GetFront());
+    const uint32_t version = header->Version;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint32_t width = header->Width;
+    const uint32_t height = header->Height;
+    const uint32_t pitch = header->Pitch;
+    const uint32_t buffer_bytes = header->BufferBytes;
+    const uint32_t total_bytes = header->TotalBytes;
 
-    return false;
+    // Do not trust sizes from another process
+    if (version != XRM_PLUGINS_ABI_VERSION ||
+        width == 0 || height == 0 ||
+        pitch < (uint64_t)width * 4 ||
+        (uint64_t)buffer_bytes < (uint64_t)pitch * height ||
+        (uint64_t)total_bytes < XrmPluginSurfaceLayout::PixelOffset() + (uint64_t)buffer_bytes * XRM_PLUGIN_SURFACE_BUFFER_COUNT ||
+        total_bytes > INT32_MAX)
+    {
+        file.Close();
+        return nullptr;
+    }
+
+    // Remap the whole surface
+    if (!file.Open(static_cast<int>(total_bytes), name)) {
+        return nullptr;
+    }
+
+    geometry.Width = width;
+    geometry.Height = height;
+    geometry.Pitch = pitch;
+    geometry.BufferBytes = buffer_bytes;
+    return reinterpret_cast<XrmPluginSurfaceLayout*>(file.GetFront());
 }
 
 
@@ -88,24 +359,23 @@ static std::string EventNameForPluginIndex(int plugin_index)
 bool HostToPluginEvent::Open(int plugin_index)
 {
     const std::string event_name = EventNameForPluginIndex(plugin_index);
-    Event = ::OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, event_name.c_str());
-    return Event.Valid();
+    return Event.Open(event_name);
 }
 
 bool HostToPluginEvent::Wait(int timeout_msec)
 {
-    const DWORD result = ::WaitForSingleObject(Event.Get(), timeout_msec);
-    if (result == WAIT_OBJECT_0) {
+    const core::IpcWaitResult result = Event.Wait(timeout_msec);
+    if (result == core::IpcWaitResult::Signaled) {
         return true;
     }
-    if (result != WAIT_TIMEOUT) {
+    if (result != core::IpcWaitResult::Timeout) {
         // Sleep on errors that are not timeouts
-        ::Sleep(timeout_msec);
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_msec));
     }
     return false;
 }
 
 void HostToPluginEvent::Signal()
 {
-    ::SetEvent(Event.Get());
+    Event.Signal();
 }